@@ -0,0 +1,91 @@
+#!/bin/bash
+
+#  dali_benchmark.sh
+#  vdcd
+#
+#  Copyright (c) 2016 plan44.ch. All rights reserved.
+
+# Run vdcd against the dalibridgesim DALI bridge simulator and report
+# DALI bus throughput (frames/S), bus scan time and DALI device collection time.
+# Usage: dali_benchmark.sh [-v vdcd] [-s dalibridgesim] [-n ballasts] [-u unaddressed]
+#          [-d duplicates] [-w seconds] [-- further dalibridgesim options]
+
+VDCD=./vdcd
+SIM=./dalibridgesim
+BALLASTS=16
+UNADDRESSED=0
+DUPLICATES=0
+MAXWAIT=600 # seconds to wait for collection to complete
+VDSMPORT=18340 # avoid clashing with a vdcd running on the default port
+
+while getopts "v:s:n:u:d:w:" opt; do
+  case $opt in
+    v) VDCD=$OPTARG ;;
+    s) SIM=$OPTARG ;;
+    n) BALLASTS=$OPTARG ;;
+    u) UNADDRESSED=$OPTARG ;;
+    d) DUPLICATES=$OPTARG ;;
+    w) MAXWAIT=$OPTARG ;;
+    *) echo "usage: $0 [-v vdcd] [-s dalibridgesim] [-n ballasts] [-u unaddressed] [-d duplicates] [-w seconds] [-- simulator options]"; exit 1 ;;
+  esac
+done
+shift $((OPTIND-1))
+
+WORKDIR=$(mktemp -d)
+PTY=$WORKDIR/dalibridge
+SIMLOG=$WORKDIR/dalibridgesim.log
+VDCDLOG=$WORKDIR/vdcd.log
+
+cleanup()
+{
+  [ -n "$VDCDPID" ] && kill $VDCDPID 2>/dev/null
+  [ -n "$SIMPID" ] && kill $SIMPID 2>/dev/null
+  wait 2>/dev/null
+  rm -rf "$WORKDIR"
+}
+trap cleanup EXIT
+
+# start the simulated bridge, no periodic statistics (activity bursts are reported anyway)
+$SIM -n $BALLASTS -u $UNADDRESSED -d $DUPLICATES -i 0 -p "$PTY" "$@" >"$SIMLOG" 2>&1 &
+SIMPID=$!
+for i in $(seq 50); do
+  [ -e "$PTY" ] && break
+  sleep 0.1
+done
+if [ ! -e "$PTY" ]; then
+  echo "dalibridgesim did not start:"
+  cat "$SIMLOG"
+  exit 1
+fi
+
+# run vdcd with DALI only, on a fresh database (so the scan and the device info reads are not skipped)
+# - loglevel 6 (LOG_INFO) to see the quick scan time, too
+$VDCD --dali "$PTY" --sqlitedir "$WORKDIR" --vdsmport $VDSMPORT -l 6 >"$VDCDLOG" 2>&1 &
+VDCDPID=$!
+
+STARTED=$(date +%s)
+until grep -q "=== done collecting from" "$VDCDLOG"; do
+  if ! kill -0 $VDCDPID 2>/dev/null; then
+    echo "vdcd terminated before collection was complete:"
+    tail -20 "$VDCDLOG"
+    exit 1
+  fi
+  if [ $(( $(date +%s)-STARTED )) -gt $MAXWAIT ]; then
+    echo "collection not complete after $MAXWAIT seconds"
+    exit 1
+  fi
+  sleep 0.5
+done
+# wait for the bus to become idle, which ends the simulator's activity burst report
+sleep 3
+
+echo "DALI benchmark: $BALLASTS ballasts ($UNADDRESSED unaddressed, $DUPLICATES duplicates), simulator options: $*"
+echo
+echo "Bus throughput (dalibridgesim):"
+grep "Activity burst" "$SIMLOG" | sed -e 's/^.*Activity burst: /  /'
+echo
+echo "Bus scan (vdcd):"
+grep "scan took" "$VDCDLOG" | sed -e 's/^.*DaliComm: /  /'
+echo
+echo "Device collection (vdcd):"
+grep "=== done collecting from" "$VDCDLOG" | sed -e 's/^.*=== done collecting from /  /'
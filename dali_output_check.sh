@@ -0,0 +1,156 @@
+#!/bin/bash
+
+#  dali_output_check.sh
+#  vdcd
+#
+#  Copyright (c) 2016 plan44.ch. All rights reserved.
+
+# Run vdcd against the dalibridgesim DALI bridge simulator, call scenes on sets of
+# DALI devices via the config API and check the final ballast levels reported by the
+# simulator. All ballasts are preset members of native DALI group 1, so broadcast and
+# group output batching must only be used when it cannot hit ballasts not meant to change.
+# Usage: dali_output_check.sh [-v vdcd] [-s dalibridgesim] [-n ballasts] [-- further dalibridgesim options]
+
+VDCD=./vdcd
+SIM=./dalibridgesim
+BALLASTS=6
+MAXWAIT=600 # seconds to wait for collection to complete
+VDSMPORT=18340 # avoid clashing with a vdcd running on the default ports
+CFGAPIPORT=18390
+
+while getopts "v:s:n:" opt; do
+  case $opt in
+    v) VDCD=$OPTARG ;;
+    s) SIM=$OPTARG ;;
+    n) BALLASTS=$OPTARG ;;
+    *) echo "usage: $0 [-v vdcd] [-s dalibridgesim] [-n ballasts] [-- simulator options]"; exit 1 ;;
+  esac
+done
+shift $((OPTIND-1))
+if [ $BALLASTS -lt 4 ]; then
+  echo "need at least 4 ballasts"
+  exit 1
+fi
+
+WORKDIR=$(mktemp -d)
+PTY=$WORKDIR/dalibridge
+SIMLOG=$WORKDIR/dalibridgesim.log
+VDCDLOG=$WORKDIR/vdcd.log
+
+cleanup()
+{
+  [ -n "$VDCDPID" ] && kill $VDCDPID 2>/dev/null
+  [ -n "$SIMPID" ] && kill $SIMPID 2>/dev/null
+  wait 2>/dev/null
+  rm -rf "$WORKDIR"
+}
+trap cleanup EXIT
+
+# send one request to the config API, print the response line
+# @param $1 API selector (vdc or p44)
+# @param $2 JSON request
+cfgapi()
+{
+  exec 3<>/dev/tcp/127.0.0.1/$CFGAPIPORT || return 1
+  echo "{\"method\":\"POST\",\"uri\":\"$1\",\"data\":$2}" >&3
+  read -r -t 600 RESPONSE <&3
+  exec 3<&-
+  echo "$RESPONSE"
+}
+
+# print the dSUIDs of the devices of the DALI vdc as a JSON array
+devices()
+{
+  cfgapi vdc "{\"method\":\"getProperty\",\"dSUID\":\"$DALIVDC\",\"query\":{\"x-p44-devices\":{\"*\":{\"name\":null}}}}" | \
+    grep -o '"[0-9A-F]\{34\}":{"name"' | cut -d '"' -f 2 | sed -e 's/^/"/' -e 's/$/"/' | paste -sd, | sed -e 's/^/[/' -e 's/$/]/'
+}
+
+# call a scene on a set of devices in one go (so their outputs end up in the same output batch)
+# @param $1 scene number
+# @param $2 JSON array of dSUIDs
+callscene()
+{
+  cfgapi vdc "{\"notification\":\"callScene\",\"dSUID\":$2,\"scene\":$1,\"force\":true}" >/dev/null
+}
+
+# wait for the bus to get idle, then check the number of ballasts at a given level
+# @param $1 description
+# @param $2 level
+# @param $3 expected number of ballasts at that level
+expectlevels()
+{
+  sleep 4 # simulator reports the levels when the bus has been idle for 2 seconds
+  LEVELS=$(grep "Levels:" "$SIMLOG" | tail -1 | sed -e 's/^.*Levels: *//')
+  N=$(echo " $LEVELS" | grep -o ":$2\b" | wc -l)
+  if [ $N -eq $3 ]; then
+    echo "  OK: $1: $N ballasts at $2 ($LEVELS)"
+  else
+    echo "  FAILED: $1: $N instead of $3 ballasts at $2 ($LEVELS)"
+    FAILED=1
+  fi
+}
+
+# start the simulated bridge, all ballasts in native DALI group 1
+$SIM -n $BALLASTS -g 0x0002 -i 0 -p "$PTY" "$@" >"$SIMLOG" 2>&1 &
+SIMPID=$!
+for i in $(seq 50); do
+  [ -e "$PTY" ] && break
+  sleep 0.1
+done
+if [ ! -e "$PTY" ]; then
+  echo "dalibridgesim did not start:"
+  cat "$SIMLOG"
+  exit 1
+fi
+
+# run vdcd with DALI only, on a fresh database
+$VDCD --dali "$PTY" --sqlitedir "$WORKDIR" --vdsmport $VDSMPORT --cfgapiport $CFGAPIPORT -l 6 >"$VDCDLOG" 2>&1 &
+VDCDPID=$!
+STARTED=$(date +%s)
+until grep -q "=== done collecting from" "$VDCDLOG"; do
+  if ! kill -0 $VDCDPID 2>/dev/null; then
+    echo "vdcd terminated before collection was complete:"
+    tail -20 "$VDCDLOG"
+    exit 1
+  fi
+  if [ $(( $(date +%s)-STARTED )) -gt $MAXWAIT ]; then
+    echo "collection not complete after $MAXWAIT seconds"
+    exit 1
+  fi
+  sleep 0.5
+done
+
+DALIVDC=$(cfgapi vdc '{"method":"getProperty","dSUID":"","query":{"x-p44-vdcs":{"*":{"x-p44-deviceClass":null}}}}' | \
+  grep -o '"[0-9A-F]*":{"x-p44-deviceClass":"DALI_Bus_Container"' | cut -d '"' -f 2)
+if [ -z "$DALIVDC" ]; then
+  echo "DALI vdc not found"
+  exit 1
+fi
+ALL=$(devices)
+FIRST=$(echo "$ALL" | cut -d , -f 1 | tr -d '[]')
+SECOND=$(echo "$ALL" | cut -d , -f 2 | tr -d '[]')
+ALLBUTFIRST=$(echo "$ALL" | sed -e "s/$FIRST,\?//")
+ALLBUTTWO=$(echo "$ALLBUTFIRST" | sed -e "s/$SECOND,\?//")
+
+echo "DALI output check: $BALLASTS ballasts, all in native DALI group 1"
+echo
+echo "Single devices only (broadcast and native group allowed):"
+callscene 0 "$ALL"
+expectlevels "all off" 0 $BALLASTS
+callscene 5 "$ALL"
+expectlevels "all on" 254 $BALLASTS
+callscene 0 "$ALLBUTFIRST"
+expectlevels "all but one off" 254 1
+
+echo
+echo "Two devices combined into a dS group (not modeled as single devices any more):"
+cfgapi vdc "{\"method\":\"x-p44-groupDevices\",\"dSUID\":\"$DALIVDC\",\"members\":{\"D1\":$FIRST,\"D2\":$SECOND}}" >/dev/null
+callscene 0 "$(devices)"
+expectlevels "all off" 0 $BALLASTS
+callscene 5 "$ALLBUTTWO"
+expectlevels "all single devices on" 254 $((BALLASTS-2))
+
+echo
+echo "Output batching (vdcd):"
+grep "DALI output batch" "$VDCDLOG" | sed -e 's/^.*DALI output batch/  DALI output batch/' | sort | uniq -c
+exit ${FAILED:-0}
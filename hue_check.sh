@@ -0,0 +1,148 @@
+#!/bin/bash
+
+#  hue_check.sh
+#  vdcd
+#
+#  Copyright (c) 2016 plan44.ch. All rights reserved.
+
+# Run vdcd against the huebridgesim hue bridge simulator, with /lights responses delayed so
+# that light state reads get overtaken by scene calls. Checks that light states read back after
+# such a scene call reflect the new states, not the outdated ones from the overtaken read.
+# Usage: hue_check.sh [-v vdcd] [-s huebridgesim] [-n lights] [-d delay] [-- further huebridgesim options]
+
+VDCD=./vdcd
+SIM=./huebridgesim
+LIGHTS=4
+DELAY=1000 # mS, delay of /lights responses
+MAXWAIT=60 # seconds to wait for the lights to appear
+HUEPORT=18380 # avoid clashing with a vdcd running on the default ports
+VDSMPORT=18340
+CFGAPIPORT=18390
+
+while getopts "v:s:n:d:" opt; do
+  case $opt in
+    v) VDCD=$OPTARG ;;
+    s) SIM=$OPTARG ;;
+    n) LIGHTS=$OPTARG ;;
+    d) DELAY=$OPTARG ;;
+    *) echo "usage: $0 [-v vdcd] [-s huebridgesim] [-n lights] [-d delay] [-- simulator options]"; exit 1 ;;
+  esac
+done
+shift $((OPTIND-1))
+
+WORKDIR=$(mktemp -d)
+SIMLOG=$WORKDIR/huebridgesim.log
+VDCDLOG=$WORKDIR/vdcd.log
+
+cleanup()
+{
+  [ -n "$VDCDPID" ] && kill $VDCDPID 2>/dev/null
+  [ -n "$SIMPID" ] && kill $SIMPID 2>/dev/null
+  wait 2>/dev/null
+  rm -rf "$WORKDIR"
+}
+trap cleanup EXIT
+
+# send one request to the config API, print the response line
+# @param $1 API selector (vdc or p44)
+# @param $2 JSON request
+cfgapi()
+{
+  exec 3<>/dev/tcp/127.0.0.1/$CFGAPIPORT || return 1
+  echo "{\"method\":\"POST\",\"uri\":\"$1\",\"data\":$2}" >&3
+  read -r -t 600 RESPONSE <&3
+  exec 3<&-
+  echo "$RESPONSE"
+}
+
+# print the dSUIDs of the devices of the hue vdc, one per line
+devices()
+{
+  cfgapi vdc "{\"method\":\"getProperty\",\"dSUID\":\"$HUEVDC\",\"query\":{\"x-p44-devices\":{\"*\":{\"name\":null}}}}" | \
+    grep -o '"[0-9A-F]\{34\}":{"name"' | cut -d '"' -f 2
+}
+
+# send a scene notification to all lights in one go
+# @param $1 notification (callScene or saveScene)
+# @param $2 scene number
+allscene()
+{
+  cfgapi vdc "{\"notification\":\"$1\",\"dSUID\":$ALL,\"scene\":$2,\"force\":true}" >/dev/null
+}
+
+# start the simulated bridge
+$SIM -n $LIGHTS -p $HUEPORT -d $DELAY "$@" >"$SIMLOG" 2>&1 &
+SIMPID=$!
+sleep 0.5
+if ! kill -0 $SIMPID 2>/dev/null; then
+  echo "huebridgesim did not start:"
+  cat "$SIMLOG"
+  exit 1
+fi
+
+# run vdcd with hue only, on a fresh database
+$VDCD --huelights --hueapiurl "http://127.0.0.1:$HUEPORT/api" --sqlitedir "$WORKDIR" --vdsmport $VDSMPORT --cfgapiport $CFGAPIPORT -l 6 >"$VDCDLOG" 2>&1 &
+VDCDPID=$!
+for i in $(seq 100); do
+  cfgapi p44 '{"method":"logLevel"}' >/dev/null 2>&1 && break
+  if ! kill -0 $VDCDPID 2>/dev/null; then
+    echo "vdcd terminated:"
+    tail -20 "$VDCDLOG"
+    exit 1
+  fi
+  sleep 0.1
+done
+
+# register with the simulated bridge (link button is always pressed there)
+cfgapi p44 '{"method":"learn","seconds":10}' >/dev/null
+HUEVDC=$(cfgapi vdc '{"method":"getProperty","dSUID":"","query":{"x-p44-vdcs":{"*":{"x-p44-deviceClass":null}}}}' | \
+  grep -o '"[0-9A-F]*":{"x-p44-deviceClass":"hue_Lights_Container"' | cut -d '"' -f 2)
+if [ -z "$HUEVDC" ]; then
+  echo "hue vdc not found"
+  exit 1
+fi
+STARTED=$(date +%s)
+until [ $(devices | wc -l) -ge $LIGHTS ]; do
+  if [ $(( $(date +%s)-STARTED )) -gt $MAXWAIT ]; then
+    echo "lights not found after $MAXWAIT seconds:"
+    tail -20 "$VDCDLOG"
+    exit 1
+  fi
+  sleep 0.5
+done
+DEVS=$(devices)
+ALL="[$(echo "$DEVS" | sed -e 's/^/"/' -e 's/$/"/' | paste -sd,)]"
+
+echo "hue check: $LIGHTS lights, /lights responses delayed by $DELAY mS"
+allscene callScene 0
+sleep 3 # let cached light info expire
+QUERIES=$(grep -c "/lights query #" "$SIMLOG")
+# saving a scene reads back the light states, the scene call overtakes that read
+allscene saveScene 17
+allscene callScene 5
+sleep 0.3
+# this read must not be answered from the outdated result of the overtaken read
+allscene saveScene 18
+sleep $(( 4*DELAY/1000+3 ))
+
+FAILED=0
+N=$(grep "Light [0-9]*:" "$SIMLOG" | tail -$LIGHTS | grep -c "on=1 bri=254")
+if [ $N -eq $LIGHTS ]; then
+  echo "  OK: all lights on at full brightness in the bridge"
+else
+  echo "  FAILED: only $N of $LIGHTS lights on at full brightness in the bridge"
+  FAILED=1
+fi
+for DEV in $DEVS; do
+  VAL=$(cfgapi vdc "{\"method\":\"getProperty\",\"dSUID\":\"$DEV\",\"query\":{\"scenes\":{\"18\":{\"channels\":{\"1\":{\"value\":null}}}}}}" | \
+    grep -o '"value":[0-9.]*' | cut -d ':' -f 2 | cut -d '.' -f 1)
+  if [ -n "$VAL" ] && [ $VAL -ge 90 ]; then
+    echo "  OK: $DEV saved brightness $VAL"
+  else
+    echo "  FAILED: $DEV saved brightness '$VAL' instead of full brightness (outdated light state read)"
+    FAILED=1
+  fi
+done
+echo "  /lights queries for the two scene saves: $(( $(grep -c "/lights query #" "$SIMLOG")-QUERIES ))"
+grep "querying again" "$VDCDLOG" | sed -e 's/^.*hue/  vdcd: hue/' | sort | uniq -c
+exit $FAILED
@@ -33,6 +33,7 @@ BinaryInputBehaviour::BinaryInputBehaviour(Device &aDevice) :
   // state
   lastUpdate(Never),
   lastPush(Never),
+  trailingPushTicket(0),
   currentState(false)
 {
   // set dummy default hardware default configuration
@@ -40,6 +41,12 @@ BinaryInputBehaviour::BinaryInputBehaviour(Device &aDevice) :
 }
 
 
+BinaryInputBehaviour::~BinaryInputBehaviour()
+{
+  MainLoop::currentMainLoop().cancelExecutionTicket(trailingPushTicket);
+}
+
+
 void BinaryInputBehaviour::setHardwareInputConfig(DsBinaryInputType aInputType, DsUsageHint aUsage, bool aReportsChanges, MLMicroSeconds aUpdateInterval)
 {
   hardwareInputType = aInputType;
@@ -69,12 +76,28 @@ void BinaryInputBehaviour::updateInputState(bool aNewState)
   if (aNewState!=currentState || now>lastPush+changesOnlyInterval) {
     // changed state or no update sent for more than changesOnlyInterval
     currentState = aNewState;
+    propertiesChanged();
     if (lastPush==Never || now>lastPush+minPushInterval) {
-      // push the new value
-      if (pushBehaviourState()) {
+      // push the new state
+      MainLoop::currentMainLoop().cancelExecutionTicket(trailingPushTicket);
+      if (queueBehaviourStatePush()) {
         lastPush = now;
       }
     }
+    else if (!trailingPushTicket) {
+      // too early for pushing again, but make sure latest state gets pushed when minPushInterval expires
+      trailingPushTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&BinaryInputBehaviour::trailingPush, this), lastPush+minPushInterval-now);
+    }
+  }
+}
+
+
+void BinaryInputBehaviour::trailingPush()
+{
+  trailingPushTicket = 0;
+  // push the state as it is now (latest reported by hardware)
+  if (queueBehaviourStatePush()) {
+    lastPush = MainLoop::now();
   }
 }
 
@@ -61,6 +61,7 @@ namespace p44 {
     bool currentState; ///< current input value
     MLMicroSeconds lastUpdate; ///< time of last update from hardware
     MLMicroSeconds lastPush; ///< time of last push
+    long trailingPushTicket; ///< ticket for pushing the latest state when minPushInterval has expired
     /// @}
 
 
@@ -69,6 +70,9 @@ namespace p44 {
     /// constructor
     BinaryInputBehaviour(Device &aDevice);
 
+    /// destructor
+    virtual ~BinaryInputBehaviour();
+
     /// initialisation of hardware-specific constants for this binary input
     /// @note this must be called once before the device gets added to the device container. Implementation might
     ///   also derive default values for settings from this information.
@@ -116,6 +120,11 @@ namespace p44 {
     virtual void loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP);
     virtual void bindToStatement(sqlite3pp::statement &aStatement, int &aIndex, const char *aParentIdentifier, uint64_t aCommonFlags);
 
+
+  private:
+
+    void trailingPush();
+
   };
   typedef boost::intrusive_ptr<BinaryInputBehaviour> BinaryInputBehaviourPtr;
   
@@ -87,6 +87,7 @@ void ButtonBehaviour::buttonAction(bool aPressed)
 {
   BLOG(LOG_NOTICE, "Button[%zu] '%s' was %s", index, hardwareName.c_str(), aPressed ? "pressed" : "released");
   buttonPressed = aPressed; // remember state
+  propertiesChanged();
   checkStateMachine(true, MainLoop::now());
 }
 
@@ -385,6 +386,7 @@ void ButtonBehaviour::sendClick(DsClickType aClickType)
   // update button state
   lastClick = MainLoop::now();
   clickType = aClickType;
+  propertiesChanged();
   // button press is considered a (regular!) user action, have it checked globally first
   if (!device.getDeviceContainer().signalDeviceUserAction(device, true)) {
     // button press not consumed on global level, forward to upstream dS
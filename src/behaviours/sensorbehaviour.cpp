@@ -32,6 +32,7 @@ SensorBehaviour::SensorBehaviour(Device &aDevice) :
   // state
   lastUpdate(Never),
   lastPush(Never),
+  trailingPushTicket(0),
   currentValue(0)
 {
   // set dummy default hardware default configuration
@@ -39,6 +40,12 @@ SensorBehaviour::SensorBehaviour(Device &aDevice) :
 }
 
 
+SensorBehaviour::~SensorBehaviour()
+{
+  MainLoop::currentMainLoop().cancelExecutionTicket(trailingPushTicket);
+}
+
+
 void SensorBehaviour::setHardwareSensorConfig(DsSensorType aType, DsUsageHint aUsage, double aMin, double aMax, double aResolution, MLMicroSeconds aUpdateInterval, MLMicroSeconds aAliveSignInterval, MLMicroSeconds aDefaultChangesOnlyInterval)
 {
   sensorType = aType;
@@ -74,12 +81,28 @@ void SensorBehaviour::updateSensorValue(double aValue)
   if (aValue!=currentValue || now>lastPush+changesOnlyInterval) {
     // changed value or last push with same value long enough ago
     currentValue = aValue;
+    propertiesChanged();
     if (lastPush==Never || now>lastPush+minPushInterval) {
       // push the new value
-      if (pushBehaviourState()) {
+      MainLoop::currentMainLoop().cancelExecutionTicket(trailingPushTicket);
+      if (queueBehaviourStatePush()) {
         lastPush = now;
       }
     }
+    else if (!trailingPushTicket) {
+      // too early for pushing again, but make sure latest value gets pushed when minPushInterval expires
+      trailingPushTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&SensorBehaviour::trailingPush, this), lastPush+minPushInterval-now);
+    }
+  }
+}
+
+
+void SensorBehaviour::trailingPush()
+{
+  trailingPushTicket = 0;
+  // push the value as it is now (latest reported by hardware)
+  if (queueBehaviourStatePush()) {
+    lastPush = MainLoop::now();
   }
 }
 
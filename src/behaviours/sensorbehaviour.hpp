@@ -66,6 +66,7 @@ namespace p44 {
     double currentValue; ///< current sensor value
     MLMicroSeconds lastUpdate; ///< time of last update from hardware
     MLMicroSeconds lastPush; ///< time of last push
+    long trailingPushTicket; ///< ticket for pushing the latest value when minPushInterval has expired
     /// @}
 
 
@@ -74,6 +75,9 @@ namespace p44 {
     /// constructor
     SensorBehaviour(Device &aDevice);
 
+    /// destructor
+    virtual ~SensorBehaviour();
+
     /// initialisation of hardware-specific constants for this sensor
     /// @note this must be called once before the device gets added to the device container. Implementation might
     ///   also derive default values for settings from this information.
@@ -133,6 +137,11 @@ namespace p44 {
     virtual void loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP);
     virtual void bindToStatement(sqlite3pp::statement &aStatement, int &aIndex, const char *aParentIdentifier, uint64_t aCommonFlags);
 
+
+  private:
+
+    void trailingPush();
+
   };
   typedef boost::intrusive_ptr<SensorBehaviour> SensorBehaviourPtr;
 
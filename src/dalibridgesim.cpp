@@ -0,0 +1,757 @@
+//
+//  Copyright (c) 2013-2016 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of vdcd.
+//
+//  vdcd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  vdcd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with vdcd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Simulator for the plan44 DALI bridge (fim_dali) connected via a pseudo terminal.
+// Models a configurable population of DALI ballasts on the bus, DALI bus timing, collisions
+// of backward frames and the bridge's limited receive buffer, so that DaliComm's flow control,
+// bus scanning and memory reading can be exercised and timed without real hardware.
+// Point vdcd's --dali option at the pty path printed at startup (or the -p symlink).
+
+#include "application.hpp"
+
+#include "fdcomm.hpp"
+
+#include "dalidefs.h"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <termios.h>
+
+#define DEFAULT_BALLASTS 16
+#define DEFAULT_RXBUFFER_SIZE 80 // bytes, as in the real bridge
+#define DEFAULT_STATS_INTERVAL 10 // seconds
+#define DEFAULT_BURST_END_IDLE 2 // seconds of bus idle ending an activity burst
+#define MAINLOOP_CYCLE_TIME_uS 1000 // 1mS, to allow for DALI frame time resolution
+#define DEFAULT_LOGLEVEL LOG_NOTICE
+
+// DALI bus timing (1200 bit/s, bi-phase: Te = 416.67uS, one bit = 2*Te)
+#define DALI_TE (417) // uS
+#define DALI_FORWARD_FRAME_TIME (38*DALI_TE) // start bit + 16 data bits + 2 stop bits
+#define DALI_BACKWARD_FRAME_TIME (22*DALI_TE) // start bit + 8 data bits + 2 stop bits
+#define DALI_SETTLING_TIME (13*DALI_TE) // between forward and backward frame (7..22 Te)
+#define DALI_BACKWARD_TIMEOUT (22*DALI_TE+DALI_BACKWARD_FRAME_TIME) // how long the bridge waits for a backward frame that does not come
+#define DALI_INTERFRAME_TIME (22*DALI_TE) // minimal idle time between frames
+#define DALI_DOUBLESEND_GAP (10*MilliSecond) // gap between the two frames of a CMD_CODE_2SEND16
+
+// serial link to the bridge (9600 bd, 8N1)
+#define SERIAL_BYTE_TIME (1042) // uS
+
+// Bridge commands and responses (see dalicomm.cpp)
+#define CMD_CODE_RESET 0
+#define CMD_CODE_VERSION 1
+#define CMD_CODE_SEND16 0x10
+#define CMD_CODE_2SEND16 0x11
+#define CMD_CODE_SEND16_REC8 0x12
+#define CMD_CODE_ECHO_DATA1 0x41
+#define CMD_CODE_ECHO_DATA2 0x42
+#define CMD_CODE_OVLRESET 0x43
+#define CMD_CODE_EDGEADJ 0x44
+
+#define RESP_CODE_ACK 0x2A
+#define RESP_CODE_DATA 0x3D
+#define ACK_OK 0x30
+#define ACK_TIMEOUT 0x31
+#define ACK_FRAME_ERR 0x32
+#define ACK_INVALIDCMD 0x39
+
+#define SIM_BRIDGE_VERSION 3
+
+#define NO_ADDRESS 0xFF
+
+
+using namespace p44;
+
+
+/// simulated DALI ballast
+class SimBallast
+{
+public:
+  uint8_t shortAddress; ///< short address 0..63, NO_ADDRESS if none
+  uint32_t randomAddress; ///< 24 bit random address
+  uint16_t groups; ///< group membership bits
+  uint8_t scenes[DALI_MAXSCENES]; ///< scene levels, 0xFF = not part of scene
+  uint8_t actualLevel;
+  uint8_t minLevel;
+  uint8_t maxLevel;
+  uint8_t powerOnLevel;
+  uint8_t failureLevel;
+  uint8_t fadeTime;
+  uint8_t fadeRate;
+  bool initialised; ///< in initialise state (random address search)
+  bool withdrawn; ///< withdrawn from compare
+  uint8_t bank0[DALIMEM_BANK0_MINBYTES]; ///< memory bank 0 contents
+
+  SimBallast(uint8_t aShortAddress, uint32_t aSerial) :
+    shortAddress(aShortAddress),
+    groups(0),
+    actualLevel(0),
+    minLevel(1),
+    maxLevel(254),
+    powerOnLevel(254),
+    failureLevel(254),
+    fadeTime(0),
+    fadeRate(7),
+    initialised(false),
+    withdrawn(false)
+  {
+    randomAddress = random() & 0xFFFFFF;
+    for (int i=0; i<DALI_MAXSCENES; i++) scenes[i] = 0xFF;
+    // bank 0: last address, checksum, last bank, GTIN, firmware version, serial number
+    uint64_t gtin = gtinWithCheckDigit(761234500000ll + (aSerial % 10));
+    bank0[0] = DALIMEM_BANK0_MINBYTES-1;
+    bank0[2] = 0;
+    for (int i=0; i<6; i++) bank0[0x03+i] = (gtin>>(8*(5-i))) & 0xFF;
+    bank0[0x09] = 1;
+    bank0[0x0A] = 2;
+    for (int i=0; i<4; i++) bank0[0x0B+i] = (aSerial>>(8*(3-i))) & 0xFF;
+    uint8_t sum = 0;
+    for (int i=0x02; i<DALIMEM_BANK0_MINBYTES; i++) sum += bank0[i];
+    bank0[1] = 0-sum;
+  };
+
+  static uint64_t gtinWithCheckDigit(uint64_t aBase)
+  {
+    int sum = 0;
+    int weight = 3;
+    for (uint64_t n = aBase; n>0; n /= 10) {
+      sum += (n%10)*weight;
+      weight = 4-weight;
+    }
+    return aBase*10 + (10-sum%10)%10;
+  };
+
+  bool matchesAddress(uint8_t aDali1) const
+  {
+    if ((aDali1 & 0xFE)==0xFE) return true; // broadcast
+    if ((aDali1 & 0x80)==0) return shortAddress==((aDali1>>1) & 0x3F); // short address
+    if ((aDali1 & 0xE0)==0x80) return (groups & (1<<((aDali1>>1) & 0x0F)))!=0; // group
+    return false;
+  };
+
+};
+
+typedef std::vector<SimBallast> SimBallastVector;
+
+
+class DaliBridgeSim : public Application
+{
+  // pty
+  int ptyMaster;
+  int ptySlave; ///< kept open so the pty survives vdcd closing and reopening the port
+  FdCommPtr bridgeLink;
+
+  // bus population and parameters
+  SimBallastVector ballasts;
+  double timeScale; ///< factor applied to all simulated delays (0 = as fast as possible)
+  MLMicroSeconds extraResponseDelay; ///< additional bridge processing delay per command
+  int frameErrorPermille; ///< probability of a backward frame getting corrupted
+  size_t rxBufferSize; ///< bridge command receive buffer size
+  MLMicroSeconds stallInterval; ///< interval between injected bridge stalls (0 = none)
+  MLMicroSeconds stallDuration; ///< how long the bridge stops processing commands during a stall
+  MLMicroSeconds statsInterval;
+  MLMicroSeconds burstEndIdle;
+
+  // bridge state
+  string rxBuffer; ///< command bytes received, not yet processed
+  bool busy; ///< bridge is executing a command
+  uint8_t dtr, dtr1, dtr2;
+  uint32_t searchAddress;
+  MLMicroSeconds stalledUntil; ///< bridge does not process commands before this time
+
+  // statistics
+  long commands, forwardFrames, backwardFrames, timeouts, collisions, frameErrors, rxOverflows, stalls;
+  long burstCommands, burstFrames;
+  MLMicroSeconds burstStart;
+  MLMicroSeconds lastActivity;
+  long intervalFrames;
+  long burstTicket;
+
+public:
+
+  DaliBridgeSim() :
+    ptyMaster(-1),
+    ptySlave(-1),
+    timeScale(1),
+    extraResponseDelay(0),
+    frameErrorPermille(0),
+    rxBufferSize(DEFAULT_RXBUFFER_SIZE),
+    stallInterval(0),
+    stallDuration(0),
+    statsInterval(DEFAULT_STATS_INTERVAL*Second),
+    burstEndIdle(DEFAULT_BURST_END_IDLE*Second),
+    busy(false),
+    dtr(0), dtr1(0), dtr2(0),
+    searchAddress(0xFFFFFF),
+    stalledUntil(Never),
+    commands(0), forwardFrames(0), backwardFrames(0), timeouts(0), collisions(0), frameErrors(0), rxOverflows(0), stalls(0),
+    burstCommands(0), burstFrames(0),
+    burstStart(Never),
+    lastActivity(Never),
+    intervalFrames(0),
+    burstTicket(0)
+  {
+  }
+
+
+  void usage(char *name)
+  {
+    fprintf(stderr, "usage:\n");
+    fprintf(stderr, "  %s [options]\n", name);
+    fprintf(stderr, "    -n ballasts     : number of simulated ballasts (default=%d)\n", DEFAULT_BALLASTS);
+    fprintf(stderr, "    -u unaddressed  : number of those ballasts without short address (default=0)\n");
+    fprintf(stderr, "    -d duplicates   : number of those ballasts sharing the short address of another one (default=0)\n");
+    fprintf(stderr, "    -g groupmask    : native DALI group membership preset in all ballasts, as 16 bit mask (default=0=none)\n");
+    fprintf(stderr, "    -t timescale    : factor for all simulated bus and bridge delays, 0=no delays (default=1)\n");
+    fprintf(stderr, "    -r delay        : additional bridge response delay per command in mS (default=0)\n");
+    fprintf(stderr, "    -e permille     : probability of corrupted backward frames (default=0)\n");
+    fprintf(stderr, "    -b bytes        : bridge receive buffer size, excess bytes are lost (default=%d)\n", DEFAULT_RXBUFFER_SIZE);
+    fprintf(stderr, "    -S seconds      : inject a bridge stall every given number of seconds (default=0=none)\n");
+    fprintf(stderr, "    -D delay        : duration of injected stalls in mS, bridge processes no commands meanwhile (default=1000)\n");
+    fprintf(stderr, "    -i seconds      : statistics output interval, 0=none (default=%d)\n", DEFAULT_STATS_INTERVAL);
+    fprintf(stderr, "    -p path         : create symlink to the pty slave device at path\n");
+    fprintf(stderr, "    -s seed         : random seed for random addresses and errors (default=1)\n");
+    fprintf(stderr, "    -l loglevel     : set loglevel (default = %d)\n", DEFAULT_LOGLEVEL);
+  };
+
+  virtual int main(int argc, char **argv)
+  {
+    int loglevel = DEFAULT_LOGLEVEL; // use defaults
+
+    int numBallasts = DEFAULT_BALLASTS;
+    int numUnaddressed = 0;
+    int numDuplicates = 0;
+    uint16_t presetGroups = 0;
+    unsigned int seed = 1;
+    const char *linkPath = NULL;
+
+    int c;
+    stallDuration = 1*Second;
+    while ((c = getopt(argc, argv, "n:u:d:g:t:r:e:b:S:D:i:p:s:l:h")) != -1)
+    {
+      switch (c) {
+        case 'n':
+          numBallasts = atoi(optarg);
+          break;
+        case 'u':
+          numUnaddressed = atoi(optarg);
+          break;
+        case 'd':
+          numDuplicates = atoi(optarg);
+          break;
+        case 'g':
+          presetGroups = strtol(optarg, NULL, 0);
+          break;
+        case 't':
+          timeScale = atof(optarg);
+          break;
+        case 'r':
+          extraResponseDelay = atof(optarg)*MilliSecond;
+          break;
+        case 'e':
+          frameErrorPermille = atoi(optarg);
+          break;
+        case 'b':
+          rxBufferSize = atoi(optarg);
+          break;
+        case 'S':
+          stallInterval = atof(optarg)*Second;
+          break;
+        case 'D':
+          stallDuration = atof(optarg)*MilliSecond;
+          break;
+        case 'i':
+          statsInterval = atoi(optarg)*Second;
+          break;
+        case 'p':
+          linkPath = optarg;
+          break;
+        case 's':
+          seed = atoi(optarg);
+          break;
+        case 'l':
+          loglevel = atoi(optarg);
+          break;
+        default:
+          usage(argv[0]);
+          exit(-1);
+      }
+    }
+    if (numBallasts<0 || numUnaddressed+numDuplicates>numBallasts || timeScale<0 || rxBufferSize<3) {
+      usage(argv[0]);
+      exit(-1);
+    }
+
+    SETLOGLEVEL(loglevel);
+    srandom(seed);
+
+    // create the ballast population
+    int nextShortAddress = 0;
+    for (int i=0; i<numBallasts; i++) {
+      uint8_t sa;
+      if (i<numUnaddressed) {
+        sa = NO_ADDRESS;
+      }
+      else if (i<numUnaddressed+numDuplicates && nextShortAddress>0) {
+        sa = random() % nextShortAddress; // share an address already in use
+      }
+      else {
+        sa = nextShortAddress<DALI_MAXDEVICES ? nextShortAddress++ : NO_ADDRESS;
+      }
+      ballasts.push_back(SimBallast(sa, 0x10000+i));
+      ballasts.back().groups = presetGroups;
+    }
+
+    // create the pseudo terminal
+    ErrorPtr err = openPty(linkPath);
+    if (!Error::isOK(err)) {
+      LOG(LOG_ERR, "Cannot create pseudo terminal: %s", err->description().c_str());
+      exit(1);
+    }
+    LOG(LOG_NOTICE,
+      "Simulated DALI bridge with %d ballasts (%d unaddressed, %d duplicate addresses) ready at %s",
+      numBallasts, numUnaddressed, numDuplicates, ptsname(ptyMaster)
+    );
+    if (statsInterval>0) {
+      MainLoop::currentMainLoop().executeOnce(boost::bind(&DaliBridgeSim::showStatistics, this), statsInterval);
+    }
+    if (stallInterval>0 && stallDuration>0) {
+      MainLoop::currentMainLoop().executeOnce(boost::bind(&DaliBridgeSim::startStall, this), stallInterval);
+    }
+    // app now ready to run
+    return run();
+  }
+
+
+  ErrorPtr openPty(const char *aLinkPath)
+  {
+    ptyMaster = posix_openpt(O_RDWR|O_NOCTTY);
+    if (ptyMaster<0 || grantpt(ptyMaster)<0 || unlockpt(ptyMaster)<0) {
+      return SysError::errNo("posix_openpt: ");
+    }
+    const char *slaveName = ptsname(ptyMaster);
+    ptySlave = open(slaveName, O_RDWR|O_NOCTTY);
+    if (ptySlave<0) {
+      return SysError::errNo("open pty slave: ");
+    }
+    // raw mode, so bytes pass unmodified even before vdcd configures the port
+    struct termios tio;
+    tcgetattr(ptySlave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(ptySlave, TCSANOW, &tio);
+    if (aLinkPath) {
+      unlink(aLinkPath);
+      if (symlink(slaveName, aLinkPath)<0) {
+        return SysError::errNo("symlink: ");
+      }
+    }
+    bridgeLink = FdCommPtr(new FdComm(MainLoop::currentMainLoop()));
+    bridgeLink->setReceiveHandler(boost::bind(&DaliBridgeSim::bridgeDataReceived, this, _1));
+    bridgeLink->setFd(ptyMaster);
+    bridgeLink->makeNonBlocking();
+    return ErrorPtr();
+  }
+
+
+  // bridge command processing
+
+  MLMicroSeconds scaled(MLMicroSeconds aTime)
+  {
+    return (MLMicroSeconds)(aTime*timeScale);
+  }
+
+
+  void bridgeDataReceived(ErrorPtr aError)
+  {
+    if (!Error::isOK(aError)) {
+      LOG(LOG_ERR, "Error reading from pty: %s", aError->description().c_str());
+      return;
+    }
+    size_t n = bridgeLink->numBytesReady();
+    if (n==0) return;
+    uint8_t buf[256];
+    if (n>sizeof(buf)) n = sizeof(buf);
+    n = bridgeLink->receiveBytes(n, buf, aError);
+    if (!Error::isOK(aError)) return;
+    // bridge has a limited receive buffer, bytes exceeding it are lost
+    size_t room = rxBufferSize>rxBuffer.size() ? rxBufferSize-rxBuffer.size() : 0;
+    if (n>room) {
+      rxOverflows++;
+      LOG(LOG_WARNING, "Bridge receive buffer overflow: %zu bytes lost (%zu bytes buffered)", n-room, rxBuffer.size());
+      n = room;
+    }
+    rxBuffer.append((const char *)buf, n);
+    processNextCommand();
+  }
+
+
+  void startStall()
+  {
+    stalls++;
+    stalledUntil = MainLoop::now()+stallDuration;
+    LOG(LOG_NOTICE, "Injected bridge stall: no commands processed for %lld mS (%zu bytes buffered)", stallDuration/MilliSecond, rxBuffer.size());
+    MainLoop::currentMainLoop().executeOnce(boost::bind(&DaliBridgeSim::processNextCommand, this), stallDuration);
+    MainLoop::currentMainLoop().executeOnce(boost::bind(&DaliBridgeSim::startStall, this), stallInterval);
+  }
+
+
+  void processNextCommand()
+  {
+    if (busy || rxBuffer.empty() || MainLoop::now()<stalledUntil) return;
+    uint8_t cmd = rxBuffer[0];
+    size_t cmdLen = cmd<8 ? 1 : 3;
+    if (rxBuffer.size()<cmdLen) return; // wait for rest of command
+    uint8_t dali1 = cmdLen>1 ? rxBuffer[1] : 0;
+    uint8_t dali2 = cmdLen>1 ? rxBuffer[2] : 0;
+    rxBuffer.erase(0, cmdLen);
+    busy = true;
+    commands++;
+    burstCommands++;
+    MLMicroSeconds now = MainLoop::now();
+    if (burstStart==Never) burstStart = now;
+    lastActivity = now;
+    // execute
+    uint8_t resp1 = RESP_CODE_ACK;
+    uint8_t resp2 = ACK_OK;
+    MLMicroSeconds duration = cmdLen*SERIAL_BYTE_TIME;
+    switch (cmd) {
+      case CMD_CODE_RESET:
+        rxBuffer.clear();
+        break;
+      case CMD_CODE_VERSION:
+        resp1 = RESP_CODE_DATA;
+        resp2 = SIM_BRIDGE_VERSION;
+        break;
+      case CMD_CODE_SEND16:
+        daliForward(dali1, dali2, false);
+        duration += DALI_FORWARD_FRAME_TIME+DALI_INTERFRAME_TIME;
+        break;
+      case CMD_CODE_2SEND16:
+        daliForward(dali1, dali2, true);
+        duration += 2*DALI_FORWARD_FRAME_TIME+DALI_DOUBLESEND_GAP+DALI_INTERFRAME_TIME;
+        break;
+      case CMD_CODE_SEND16_REC8: {
+        int answers = 0;
+        bool differing = false;
+        uint8_t answer = daliForward(dali1, dali2, false, &answers, &differing);
+        duration += DALI_FORWARD_FRAME_TIME+DALI_SETTLING_TIME;
+        if (answers==0) {
+          timeouts++;
+          resp2 = ACK_TIMEOUT;
+          duration += DALI_BACKWARD_TIMEOUT;
+        }
+        else {
+          backwardFrames++;
+          burstFrames++;
+          intervalFrames++;
+          duration += DALI_BACKWARD_FRAME_TIME+DALI_INTERFRAME_TIME;
+          if (differing) {
+            // overlapping, differing backward frames cannot be decoded
+            collisions++;
+            resp2 = ACK_FRAME_ERR;
+          }
+          else if (frameErrorPermille>0 && random()%1000<frameErrorPermille) {
+            frameErrors++;
+            resp2 = ACK_FRAME_ERR;
+          }
+          else {
+            resp1 = RESP_CODE_DATA;
+            resp2 = answer;
+          }
+        }
+        break;
+      }
+      case CMD_CODE_ECHO_DATA1:
+        resp1 = RESP_CODE_DATA;
+        resp2 = dali1;
+        break;
+      case CMD_CODE_ECHO_DATA2:
+        resp1 = RESP_CODE_DATA;
+        resp2 = dali2;
+        break;
+      case CMD_CODE_OVLRESET:
+      case CMD_CODE_EDGEADJ:
+        break;
+      default:
+        resp2 = ACK_INVALIDCMD;
+        break;
+    }
+    LOG(LOG_DEBUG, "bridge cmd %02X %02X %02X -> %02X %02X after %lld uS", cmd, dali1, dali2, resp1, resp2, duration);
+    duration += 2*SERIAL_BYTE_TIME + extraResponseDelay; // sending the response
+    MainLoop::currentMainLoop().executeOnce(boost::bind(&DaliBridgeSim::commandDone, this, resp1, resp2), scaled(duration));
+  }
+
+
+  void commandDone(uint8_t aResp1, uint8_t aResp2)
+  {
+    busy = false;
+    uint8_t resp[2] = { aResp1, aResp2 };
+    ErrorPtr err;
+    bridgeLink->transmitBytes(2, resp, err);
+    if (!Error::isOK(err)) {
+      LOG(LOG_WARNING, "Cannot send bridge response: %s", err->description().c_str());
+    }
+    lastActivity = MainLoop::now();
+    MainLoop::currentMainLoop().cancelExecutionTicket(burstTicket);
+    burstTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DaliBridgeSim::burstEnded, this), burstEndIdle);
+    processNextCommand();
+  }
+
+
+  // DALI bus simulation
+
+  /// deliver a forward frame to all ballasts
+  /// @param aTwice set if frame was sent twice (required for configuration commands to take effect)
+  /// @param aAnswersP if not NULL, number of ballasts answering is returned here
+  /// @param aDifferingP if not NULL, set when answering ballasts sent different values
+  /// @return the (first) answer
+  uint8_t daliForward(uint8_t aDali1, uint8_t aDali2, bool aTwice, int *aAnswersP = NULL, bool *aDifferingP = NULL)
+  {
+    int frames = aTwice ? 2 : 1;
+    forwardFrames += frames;
+    burstFrames += frames;
+    intervalFrames += frames;
+    int answers = 0;
+    uint8_t answer = 0;
+    bool differing = false;
+    if (aDali1>=0xA0 && aDali1<=0xCF && (aDali1 & 0x01)) {
+      // special command
+      daliSpecialCommand(aDali1, aDali2, aTwice, answers, answer, differing);
+    }
+    else {
+      for (SimBallastVector::iterator pos = ballasts.begin(); pos!=ballasts.end(); ++pos) {
+        if (!pos->matchesAddress(aDali1)) continue;
+        if ((aDali1 & 0x01)==0) {
+          // direct arc power
+          if (aDali2!=0xFF) pos->actualLevel = aDali2;
+          continue;
+        }
+        int a = ballastCommand(*pos, aDali2, aTwice);
+        if (a>=0) {
+          if (answers>0 && answer!=a) differing = true;
+          answer = a;
+          answers++;
+        }
+      }
+    }
+    if (aAnswersP) *aAnswersP = answers;
+    if (aDifferingP) *aDifferingP = differing;
+    return answer;
+  }
+
+
+  /// execute a special command (DTR access, random address search)
+  void daliSpecialCommand(uint8_t aDali1, uint8_t aDali2, bool aTwice, int &aAnswers, uint8_t &aAnswer, bool &aDiffering)
+  {
+    switch (aDali1) {
+      case DALICMD_TERMINATE:
+        for (SimBallastVector::iterator pos = ballasts.begin(); pos!=ballasts.end(); ++pos) {
+          pos->initialised = false;
+          pos->withdrawn = false;
+        }
+        return;
+      case DALICMD_SET_DTR: dtr = aDali2; return;
+      case DALICMD_SET_DTR1: dtr1 = aDali2; return;
+      case DALICMD_SET_DTR2: dtr2 = aDali2; return;
+      case DALICMD_INITIALISE:
+        if (aTwice) {
+          for (SimBallastVector::iterator pos = ballasts.begin(); pos!=ballasts.end(); ++pos) {
+            if (
+              aDali2==0x00 ||
+              (aDali2==0xFF && pos->shortAddress==NO_ADDRESS) ||
+              ((aDali2 & 0x81)==0x01 && pos->shortAddress==((aDali2>>1) & 0x3F))
+            ) {
+              pos->initialised = true;
+              pos->withdrawn = false;
+            }
+          }
+        }
+        return;
+      case DALICMD_RANDOMISE:
+        if (aTwice) {
+          for (SimBallastVector::iterator pos = ballasts.begin(); pos!=ballasts.end(); ++pos) {
+            if (pos->initialised) pos->randomAddress = random() & 0xFFFFFF;
+          }
+        }
+        return;
+      case DALICMD_SEARCHADDRH: searchAddress = (searchAddress & 0x00FFFF) | (aDali2<<16); return;
+      case DALICMD_SEARCHADDRM: searchAddress = (searchAddress & 0xFF00FF) | (aDali2<<8); return;
+      case DALICMD_SEARCHADDRL: searchAddress = (searchAddress & 0xFFFF00) | aDali2; return;
+      default:
+        break;
+    }
+    // commands addressing initialised ballasts
+    for (SimBallastVector::iterator pos = ballasts.begin(); pos!=ballasts.end(); ++pos) {
+      if (!pos->initialised) continue;
+      int a = -1;
+      switch (aDali1) {
+        case DALICMD_COMPARE:
+          if (!pos->withdrawn && pos->randomAddress<=searchAddress) a = DALIANSWER_YES;
+          break;
+        case DALICMD_WITHDRAW:
+          if (pos->randomAddress==searchAddress) pos->withdrawn = true;
+          break;
+        case DALICMD_PROGRAM_SHORT_ADDRESS:
+          if (pos->randomAddress==searchAddress) pos->shortAddress = aDali2==0xFF ? NO_ADDRESS : (aDali2>>1) & 0x3F;
+          break;
+        case DALICMD_VERIFY_SHORT_ADDRESS:
+          if (pos->shortAddress==((aDali2>>1) & 0x3F)) a = DALIANSWER_YES;
+          break;
+        case DALICMD_QUERY_SHORT_ADDRESS:
+          if (!pos->withdrawn && pos->randomAddress==searchAddress) a = pos->shortAddress==NO_ADDRESS ? 0xFF : (pos->shortAddress<<1)|0x01;
+          break;
+        default:
+          break;
+      }
+      if (a>=0) {
+        if (aAnswers>0 && aAnswer!=a) aDiffering = true;
+        aAnswer = a;
+        aAnswers++;
+      }
+    }
+  }
+
+
+  /// execute a standard command on a ballast
+  /// @return answer byte, -1 if no answer
+  int ballastCommand(SimBallast &aBallast, uint8_t aCommand, bool aTwice)
+  {
+    // normal commands
+    if (aCommand==DALICMD_OFF) { aBallast.actualLevel = 0; return -1; }
+    if (aCommand==DALICMD_RECALL_MAX_LEVEL) { aBallast.actualLevel = aBallast.maxLevel; return -1; }
+    if (aCommand==DALICMD_RECALL_MIN_LEVEL) { aBallast.actualLevel = aBallast.minLevel; return -1; }
+    if ((aCommand & 0xF0)==DALICMD_GO_TO_SCENE) {
+      uint8_t l = aBallast.scenes[aCommand & 0x0F];
+      if (l!=0xFF) aBallast.actualLevel = l;
+      return -1;
+    }
+    // configuration commands, only effective when received twice
+    if (aCommand>=DALICMD_RESET && aCommand<=DALICMD_ENABLE_WRITE_MEMORY) {
+      if (!aTwice) return -1;
+      switch (aCommand & 0xF0) {
+        case DALICMD_STORE_DTR_AS_SCENE: aBallast.scenes[aCommand & 0x0F] = dtr; return -1;
+        case DALICMD_REMOVE_FROM_SCENE: aBallast.scenes[aCommand & 0x0F] = 0xFF; return -1;
+        case DALICMD_ADD_TO_GROUP: aBallast.groups |= (1<<(aCommand & 0x0F)); return -1;
+        case DALICMD_REMOVE_FROM_GROUP: aBallast.groups &= ~(1<<(aCommand & 0x0F)); return -1;
+      }
+      switch (aCommand) {
+        case DALICMD_RESET: aBallast.actualLevel = 254; aBallast.groups = 0; break;
+        case DALICMD_STORE_ACTUAL_LEVEL_IN_DTR: dtr = aBallast.actualLevel; break;
+        case DALICMD_STORE_DTR_AS_MAX_LEVEL: aBallast.maxLevel = dtr; break;
+        case DALICMD_STORE_DTR_AS_MIN_LEVEL: aBallast.minLevel = dtr; break;
+        case DALICMD_STORE_DTR_AS_FAILURE_LEVEL: aBallast.failureLevel = dtr; break;
+        case DALICMD_STORE_DTR_AS_POWER_ON_LEVEL: aBallast.powerOnLevel = dtr; break;
+        case DALICMD_STORE_DTR_AS_FADE_TIME: aBallast.fadeTime = dtr & 0x0F; break;
+        case DALICMD_STORE_DTR_AS_FADE_RATE: aBallast.fadeRate = dtr & 0x0F; break;
+        case DALICMD_STORE_DTR_AS_SHORT_ADDRESS: aBallast.shortAddress = dtr==0xFF ? NO_ADDRESS : (dtr>>1) & 0x3F; break;
+      }
+      return -1;
+    }
+    // queries
+    if ((aCommand & 0xF0)==DALICMD_QUERY_SCENE_LEVEL) return aBallast.scenes[aCommand & 0x0F];
+    switch (aCommand) {
+      case DALICMD_QUERY_STATUS: return aBallast.actualLevel>0 ? 0x04 : 0x00;
+      case DALICMD_QUERY_CONTROL_GEAR: return DALIANSWER_YES;
+      case DALICMD_QUERY_LAMP_POWER_ON: return aBallast.actualLevel>0 ? DALIANSWER_YES : -1;
+      case DALICMD_QUERY_MISSING_SHORT_ADDRESS: return aBallast.shortAddress==NO_ADDRESS ? DALIANSWER_YES : -1;
+      case DALICMD_QUERY_VERSION_NUMBER: return 1;
+      case DALICMD_QUERY_CONTENT_DTR: return dtr;
+      case DALICMD_QUERY_CONTENT_DTR1: return dtr1;
+      case DALICMD_QUERY_CONTENT_DTR2: return dtr2;
+      case DALICMD_QUERY_DEVICE_TYPE: return 6; // LED module
+      case DALICMD_QUERY_PHYSICAL_MINIMUM_LEVEL: return 1;
+      case DALICMD_QUERY_ACTUAL_LEVEL: return aBallast.actualLevel;
+      case DALICMD_QUERY_MAX_LEVEL: return aBallast.maxLevel;
+      case DALICMD_QUERY_MIN_LEVEL: return aBallast.minLevel;
+      case DALICMD_QUERY_POWER_ON_LEVEL: return aBallast.powerOnLevel;
+      case DALICMD_QUERY_FAILURE_LEVEL: return aBallast.failureLevel;
+      case DALICMD_QUERY_FADE_PARAMS: return (aBallast.fadeTime<<4) | aBallast.fadeRate;
+      case DALICMD_QUERY_GROUPS_0_TO_7: return aBallast.groups & 0xFF;
+      case DALICMD_QUERY_GROUPS_8_TO_15: return (aBallast.groups>>8) & 0xFF;
+      case DALICMD_QUERY_RANDOM_ADDRESS_H: return (aBallast.randomAddress>>16) & 0xFF;
+      case DALICMD_QUERY_RANDOM_ADDRESS_M: return (aBallast.randomAddress>>8) & 0xFF;
+      case DALICMD_QUERY_RANDOM_ADDRESS_L: return aBallast.randomAddress & 0xFF;
+      case DALICMD_READ_MEMORY_LOCATION: {
+        // only bank 0 is implemented, DTR auto-increments
+        if (dtr1!=0 || dtr>=DALIMEM_BANK0_MINBYTES) return -1;
+        return aBallast.bank0[dtr++];
+      }
+      default:
+        return -1;
+    }
+  }
+
+
+  // statistics
+
+  void burstEnded()
+  {
+    burstTicket = 0;
+    if (burstStart==Never) return;
+    MLMicroSeconds t = lastActivity-burstStart;
+    LOG(LOG_NOTICE,
+      "Activity burst: %.3f S, %ld bridge commands, %ld DALI frames -> %.1f frames/S, %.1f commands/S",
+      (double)t/Second, burstCommands, burstFrames,
+      t>0 ? (double)burstFrames*Second/t : 0.0,
+      t>0 ? (double)burstCommands*Second/t : 0.0
+    );
+    burstStart = Never;
+    burstCommands = 0;
+    burstFrames = 0;
+    // bus is idle, report where all ballasts have ended up (short address:level, - for unaddressed)
+    string levels;
+    for (SimBallastVector::iterator pos = ballasts.begin(); pos!=ballasts.end(); ++pos) {
+      if (pos->shortAddress==NO_ADDRESS)
+        string_format_append(levels, " -:%d", pos->actualLevel);
+      else
+        string_format_append(levels, " %d:%d", pos->shortAddress, pos->actualLevel);
+    }
+    LOG(LOG_NOTICE, "Levels:%s", levels.c_str());
+  }
+
+
+  void showStatistics()
+  {
+    LOG(LOG_NOTICE,
+      "Statistics: %.1f frames/S in last %lld S, total: %ld commands, %ld forward/%ld backward frames, %ld timeouts, %ld collisions, %ld frame errors, %ld rx overflows, %ld stalls",
+      (double)intervalFrames*Second/statsInterval, statsInterval/Second,
+      commands, forwardFrames, backwardFrames, timeouts, collisions, frameErrors, rxOverflows, stalls
+    );
+    intervalFrames = 0;
+    MainLoop::currentMainLoop().executeOnce(boost::bind(&DaliBridgeSim::showStatistics, this), statsInterval);
+  }
+
+
+  virtual void initialize()
+  {
+  }
+
+};
+
+
+int main(int argc, char **argv)
+{
+  // create the mainloop
+  MainLoop::currentMainLoop().setLoopCycleTime(MAINLOOP_CYCLE_TIME_uS);
+  // create app with current mainloop
+  static DaliBridgeSim application;
+  // pass control
+  return application.main(argc, argv);
+}
@@ -48,9 +48,14 @@ DaliComm::DaliComm(MainLoop &aMainLoop) :
   connectionTimeoutTicket(0),
   expectedBridgeResponses(0),
   responsesInSequence(false),
+  bridgeWindow(0),
+  windowLimited(false),
+  goodResponsesInRow(0),
+  lastBridgeResponse(Never),
   sendEdgeAdj(DEFAULT_SENDING_EDGE_ADJUSTMENT),
   samplePointAdj(DEFAULT_SAMPLING_POINT_ADJUSTMENT)
 {
+  resetBridgeStats();
 }
 
 
@@ -111,10 +116,18 @@ bool DaliComm::isBusy()
 #define ACK_OVERLOAD 0x33 // bus overload (max current for longer period = possibly shortened)
 #define ACK_INVALIDCMD 0x39 // invalid command
 
-//#define BUFFERED_BRIDGE_RESPONSES_HIGH 35 // Rx buf in bridge is 80 bytes = 40 answers, only use 35 to make sure
-//#define BUFFERED_BRIDGE_RESPONSES_LOW 5 // low watermark to restart sending
-#define BUFFERED_BRIDGE_RESPONSES_HIGH 5 // Conservative to prevent lockup
-#define BUFFERED_BRIDGE_RESPONSES_LOW 2 // low watermark to restart sending
+// Flow control: the number of bridge responses allowed to be pending (the window) adapts at runtime.
+// It grows by one after a series of good responses while sending was actually limited by the window,
+// and is halved on every communication error or stalled response.
+#define BRIDGE_RX_BUFFER_SIZE 80 // command receive buffer in the bridge, bytes beyond it are lost
+#define BRIDGE_CMD_SIZE 3 // size of the largest bridge command (command code + 2 data bytes)
+#define BRIDGE_WINDOW_MIN 1
+#define BRIDGE_WINDOW_INITIAL 5 // conservative start, known to work with all bridges
+#define BRIDGE_WINDOW_MAX (BRIDGE_RX_BUFFER_SIZE/BRIDGE_CMD_SIZE) // unanswered commands may all still be in the bridge's Rx buffer: 80/3 = 26
+#define BRIDGE_WINDOW_GROW_RESPONSES 2 // number of good responses per window size needed to grow the window
+#define BRIDGE_STALL_TIME (300*MilliSecond) // a single command never takes that long on the bus, bridge must be stalled
+// low watermark to restart sending without waiting for answers
+#define BRIDGE_WINDOW_LOW(w) ((w)*2/5>0 ? (w)*2/5 : 1)
 
 
 static const char *bridgeCmdName(uint8_t aBridgeCmd)
@@ -155,13 +168,72 @@ void DaliComm::setConnectionSpecification(const char *aConnectionSpec, uint16_t
 }
 
 
-void DaliComm::bridgeResponseHandler(DaliBridgeResultCB aBridgeResultHandler, SerialOperationPtr aOperation, OperationQueuePtr aQueueP, ErrorPtr aError)
+void DaliComm::resetBridgeStats()
+{
+  bridgeStats.responses = 0;
+  bridgeStats.errors = 0;
+  bridgeStats.stalls = 0;
+  bridgeStats.windowIncreases = 0;
+  bridgeStats.windowDecreases = 0;
+  bridgeStats.serviceTime.reset();
+  if (bridgeWindow==0) bridgeWindow = BRIDGE_WINDOW_INITIAL;
+  bridgeStats.minWindow = bridgeWindow;
+  bridgeStats.maxWindow = bridgeWindow;
+}
+
+
+void DaliComm::setBridgeWindow(int aWindow)
+{
+  if (aWindow<BRIDGE_WINDOW_MIN) aWindow = BRIDGE_WINDOW_MIN;
+  if (aWindow>BRIDGE_WINDOW_MAX) aWindow = BRIDGE_WINDOW_MAX;
+  if (aWindow==bridgeWindow) return;
+  if (aWindow>bridgeWindow) bridgeStats.windowIncreases++; else bridgeStats.windowDecreases++;
+  FOCUSLOG("DALI bridge flow control window changed from %d to %d", bridgeWindow, aWindow);
+  bridgeWindow = aWindow;
+  if (bridgeWindow<bridgeStats.minWindow) bridgeStats.minWindow = bridgeWindow;
+  if (bridgeWindow>bridgeStats.maxWindow) bridgeStats.maxWindow = bridgeWindow;
+  goodResponsesInRow = 0;
+  windowLimited = false;
+}
+
+
+void DaliComm::adaptBridgeWindow(MLMicroSeconds aQueuedAt, bool aDelayed, bool aFailed)
+{
+  MLMicroSeconds now = MainLoop::now();
+  bridgeStats.responses++;
+  // The bridge processes commands one by one, so the time it needed for this command is from when
+  // the command was queued or when the previous response arrived, whichever is later
+  MLMicroSeconds serviceTime = now - (aQueuedAt>lastBridgeResponse ? aQueuedAt : lastBridgeResponse);
+  lastBridgeResponse = now;
+  if (aFailed) {
+    bridgeStats.errors++;
+    LOG(LOG_WARNING, "DALI bridge communication error with %d responses pending -> reducing window", expectedBridgeResponses);
+    setBridgeWindow(bridgeWindow/2);
+    return;
+  }
+  if (aDelayed) return; // service time includes intentional delay, not meaningful
+  bridgeStats.serviceTime.record(serviceTime);
+  if (serviceTime>BRIDGE_STALL_TIME) {
+    bridgeStats.stalls++;
+    LOG(LOG_INFO, "DALI bridge stalled for %lld mS with %d responses pending -> reducing window", serviceTime/MilliSecond, expectedBridgeResponses);
+    setBridgeWindow(bridgeWindow/2);
+    return;
+  }
+  // only grow when the window actually limited throughput
+  if (windowLimited && ++goodResponsesInRow>=BRIDGE_WINDOW_GROW_RESPONSES*bridgeWindow) {
+    setBridgeWindow(bridgeWindow+1);
+  }
+}
+
+
+void DaliComm::bridgeResponseHandler(DaliBridgeResultCB aBridgeResultHandler, MLMicroSeconds aQueuedAt, bool aDelayed, SerialOperationPtr aOperation, OperationQueuePtr aQueueP, ErrorPtr aError)
 {
   if (expectedBridgeResponses>0) expectedBridgeResponses--;
-  if (expectedBridgeResponses<BUFFERED_BRIDGE_RESPONSES_LOW) {
+  SerialOperationReceivePtr ropP = boost::dynamic_pointer_cast<SerialOperationReceive>(aOperation);
+  adaptBridgeWindow(aQueuedAt, aDelayed, !ropP || !Error::isOK(aError) || ropP->getDataSize()<2);
+  if (expectedBridgeResponses<BRIDGE_WINDOW_LOW(bridgeWindow)) {
     responsesInSequence = false; // allow buffered sends without waiting for answers again
   }
-  SerialOperationReceivePtr ropP = boost::dynamic_pointer_cast<SerialOperationReceive>(aOperation);
   if (ropP) {
     // get received data
     if (Error::isOK(aError) && ropP->getDataSize()>=2) {
@@ -198,7 +270,7 @@ void DaliComm::sendBridgeCommand(uint8_t aCmd, uint8_t aDali1, uint8_t aDali2, D
   SerialOperationSendAndReceive *opP = NULL;
   if (aCmd<8) {
     // single byte command
-    opP = new SerialOperationSendAndReceive(1, &aCmd, 2, boost::bind(&DaliComm::bridgeResponseHandler, this, aResultCB, _1, _2, _3));
+    opP = new SerialOperationSendAndReceive(1, &aCmd, 2, boost::bind(&DaliComm::bridgeResponseHandler, this, aResultCB, MainLoop::now(), aWithDelay>0, _1, _2, _3));
   }
   else {
     // 3 byte command
@@ -206,7 +278,7 @@ void DaliComm::sendBridgeCommand(uint8_t aCmd, uint8_t aDali1, uint8_t aDali2, D
     cmd3[0] = aCmd;
     cmd3[1] = aDali1;
     cmd3[2] = aDali2;
-    opP = new SerialOperationSendAndReceive(3, cmd3, 2, boost::bind(&DaliComm::bridgeResponseHandler, this, aResultCB, _1, _2, _3));
+    opP = new SerialOperationSendAndReceive(3, cmd3, 2, boost::bind(&DaliComm::bridgeResponseHandler, this, aResultCB, MainLoop::now(), aWithDelay>0, _1, _2, _3));
   }
   if (opP) {
     expectedBridgeResponses++;
@@ -217,8 +289,9 @@ void DaliComm::sendBridgeCommand(uint8_t aCmd, uint8_t aDali1, uint8_t aDali2, D
     }
     else {
       // non-delayed sends may be sent before answer of previous commands have arrived as long as Rx buf in bridge does not overflow
-      if (expectedBridgeResponses>BUFFERED_BRIDGE_RESPONSES_HIGH) {
+      if (expectedBridgeResponses>bridgeWindow) {
         responsesInSequence = true; // prevent further sends without answers
+        windowLimited = true; // window limits throughput, so growing it might help
       }
       opP->answersInSequence = responsesInSequence;
       FOCUSLOG("DALI bridge command:  %s (%02X)      %02X %02X - %d pending responses - %s", bridgeCmdName(aCmd), aCmd, aDali1, aDali2, expectedBridgeResponses, responsesInSequence ? "sent when no more responses pending" : "sent as soon as possible");
@@ -544,6 +617,7 @@ class DaliBusScanner : public P44Obj
   DaliComm::ShortAddressListPtr unreliableDevicesPtr;
   bool probablyCollision;
   bool unconfiguredDevices;
+  MLMicroSeconds scanStarted;
 public:
   static void scanBus(DaliComm &aDaliComm, DaliComm::DaliBusScanCB aResultCB)
   {
@@ -560,6 +634,7 @@ private:
     unreliableDevicesPtr(new DaliComm::ShortAddressList)
   {
     daliComm.startProcedure();
+    scanStarted = MainLoop::now();
     LOG(LOG_INFO, "DaliComm: starting quick bus scan (short address poll)");
     // reset the bus first
     daliComm.reset(boost::bind(&DaliBusScanner::resetComplete, this, _1));
@@ -687,6 +762,7 @@ private:
       }
       aError = ErrorPtr(new DaliCommError(DaliCommErrorNeedFullScan,"Need full bus scan"));
     }
+    LOG(LOG_INFO, "DaliComm: quick bus scan took %.3f S, found %d devices", (double)(MainLoop::now()-scanStarted)/Second, (int)activeDevicesPtr->size());
     daliComm.endProcedure();
     callback(activeDevicesPtr, unreliableDevicesPtr, aError);
     // done, delete myself
@@ -731,6 +807,7 @@ class DaliFullBusScanner : public P44Obj
   DaliComm::ShortAddressListPtr usedShortAddrsPtr;
   DaliComm::ShortAddressListPtr conflictedShortAddrsPtr;
   DaliAddress newAddress;
+  MLMicroSeconds scanStarted;
 public:
   static void fullBusScan(DaliComm &aDaliComm, DaliComm::DaliBusScanCB aResultCB, bool aFullScanOnlyIfNeeded)
   {
@@ -745,6 +822,7 @@ private:
     foundDevicesPtr(new DaliComm::ShortAddressList)
   {
     daliComm.startProcedure();
+    scanStarted = MainLoop::now();
     // start a scan
     startScan();
   }
@@ -1013,6 +1091,7 @@ private:
   {
     // terminate
     daliComm.daliSend(DALICMD_TERMINATE, 0x00);
+    LOG(LOG_NOTICE, "DaliComm: bus scan took %.3f S, found %d devices", (double)(MainLoop::now()-scanStarted)/Second, foundDevicesPtr ? (int)foundDevicesPtr->size() : 0);
     // callback
     daliComm.endProcedure();
     callback(foundDevicesPtr, DaliComm::ShortAddressListPtr(), aError);
@@ -27,6 +27,8 @@
 
 #include "serialqueue.hpp"
 
+#include "vdcmetrics.hpp"
+
 #include "dalidefs.h"
 
 using namespace std;
@@ -112,6 +114,19 @@ namespace p44 {
 
 
 
+  /// statistics of the adaptive bridge flow control
+  typedef struct {
+    long responses; ///< bridge responses received
+    long errors; ///< bridge communication errors (missing or unreadable responses)
+    long stalls; ///< responses that took longer than the stall limit
+    long windowIncreases; ///< number of times the window was grown
+    long windowDecreases; ///< number of times the window was shrunk
+    int minWindow; ///< smallest window used
+    int maxWindow; ///< largest window used
+    LatencyHistogram serviceTime; ///< time the bridge needed per command
+  } DaliBridgeStats;
+
+
   typedef boost::intrusive_ptr<DaliComm> DaliCommPtr;
 
   /// A class providing low level access to the DALI bus
@@ -130,6 +145,13 @@ namespace p44 {
     int expectedBridgeResponses; ///< not yet received bridge responses
     bool responsesInSequence; ///< set when repsonses need to be in sequence with requests
 
+    // adaptive flow control
+    int bridgeWindow; ///< max number of pending bridge responses before sending waits for responses
+    bool windowLimited; ///< set when sending had to wait for responses since the last window change
+    int goodResponsesInRow; ///< responses without error or stall since last window change
+    MLMicroSeconds lastBridgeResponse; ///< time when last response was received
+    DaliBridgeStats bridgeStats;
+
     uint8_t sendEdgeAdj; ///< adjustment for sending rising edge - first param to CMD_CODE_EDGEADJ
     uint8_t samplePointAdj; ///< adjustment for sampling point - second param to CMD_CODE_EDGEADJ
 
@@ -138,6 +160,15 @@ namespace p44 {
     DaliComm(MainLoop &aMainLoop);
     virtual ~DaliComm();
 
+    /// @return statistics of bridge communication and adaptive flow control
+    const DaliBridgeStats &getBridgeStats() { return bridgeStats; };
+
+    /// @return current flow control window (max number of bridge responses pending)
+    int getBridgeWindow() { return bridgeWindow; };
+
+    /// reset the bridge statistics
+    void resetBridgeStats();
+
     void startProcedure();
     void endProcedure();
 
@@ -312,7 +343,9 @@ namespace p44 {
 
   private:
 
-    void bridgeResponseHandler(DaliBridgeResultCB aBridgeResultHandler, SerialOperationPtr aOperation, OperationQueuePtr aQueueP, ErrorPtr aError);
+    void bridgeResponseHandler(DaliBridgeResultCB aBridgeResultHandler, MLMicroSeconds aQueuedAt, bool aDelayed, SerialOperationPtr aOperation, OperationQueuePtr aQueueP, ErrorPtr aError);
+    void adaptBridgeWindow(MLMicroSeconds aQueuedAt, bool aDelayed, bool aFailed);
+    void setBridgeWindow(int aWindow);
     void daliCommandStatusHandler(DaliCommandStatusCB aResultCB, uint8_t aResp1, uint8_t aResp2, ErrorPtr aError);
     void daliQueryResponseHandler(DaliQueryResultCB aResultCB, uint8_t aResp1, uint8_t aResp2, ErrorPtr aError);
     void connectionTimeout();
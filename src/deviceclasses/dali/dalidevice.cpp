@@ -50,7 +50,10 @@ DaliBusDevice::DaliBusDevice(DaliDeviceContainer &aDaliDeviceContainer) :
   lampFailure(false),
   currentTransitionTime(Infinite), // invalid
   currentDimPerMS(0), // none
-  currentFadeRate(0xFF), currentFadeTime(0xFF) // unlikely values
+  currentFadeRate(0xFF), currentFadeTime(0xFF), // unlikely values
+  daliGroups(0),
+  groupsKnown(false),
+  pendingArcPower(-1) // none
 {
 }
 
@@ -170,12 +173,7 @@ void DaliBusDevice::queryGroup8to15Response(DaliGroupsCB aDaliGroupsCB, DaliAddr
 void DaliBusDevice::initialize(StatusCB aCompletedCB, uint16_t aUsedGroupsMask)
 {
   // make sure device is in none of the used groups
-  if (aUsedGroupsMask==0) {
-    // no groups in use at all, just return
-    if (aCompletedCB) aCompletedCB(ErrorPtr());
-    return;
-  }
-  // need to query current groups
+  // Note: always query, even if no groups are in use, as the native group membership is needed for output batching
   getGroupMemberShip(boost::bind(&DaliBusDevice::groupMembershipResponse, this, aCompletedCB, aUsedGroupsMask, deviceInfo.shortAddress, _1, _2), deviceInfo.shortAddress);
 }
 
@@ -184,6 +182,9 @@ void DaliBusDevice::groupMembershipResponse(StatusCB aCompletedCB, uint16_t aUse
 {
   // remove groups that are in use on the bus
   if (Error::isOK(aError)) {
+    // remember remaining native groups, output batching can use these to address multiple devices at once
+    daliGroups = aGroups & ~aUsedGroupsMask;
+    groupsKnown = true;
     for (int g=0; g<16; ++g) {
       if (aUsedGroupsMask & aGroups & (1<<g)) {
         // single device is member of a group in use -> remove it
@@ -273,21 +274,29 @@ void DaliBusDevice::queryStatusResponse(StatusCB aCompletedCB, bool aNoOrTimeout
 
 
 
+uint8_t DaliBusDevice::transitionTimeToFadeTime(MLMicroSeconds aTransitionTime)
+{
+  uint8_t tr = 0; // default to 0
+  if (aTransitionTime>0) {
+    // Fade time: T = 0.5 * SQRT(2^X) [seconds] -> x = ln2((T/0.5)^2) : T=0.25 [sec] -> x = -2, T=10 -> 8.64
+    double h = (((double)aTransitionTime/Second)/0.5);
+    h = h*h;
+    h = log(h)/log(2);
+    tr = h>1 ? (uint8_t)h : 1;
+    LOG(LOG_DEBUG, "DaliDevice: new transition time = %.1f mS, calculated FADE_TIME setting = %f (rounded %d)", (double)aTransitionTime/MilliSecond, h, (int)tr);
+  }
+  return tr;
+}
+
+
 void DaliBusDevice::setTransitionTime(MLMicroSeconds aTransitionTime)
 {
   if (isDummy) return;
   if (currentTransitionTime==Infinite || currentTransitionTime!=aTransitionTime) {
-    uint8_t tr = 0; // default to 0
-    if (aTransitionTime>0) {
-      // Fade time: T = 0.5 * SQRT(2^X) [seconds] -> x = ln2((T/0.5)^2) : T=0.25 [sec] -> x = -2, T=10 -> 8.64
-      double h = (((double)aTransitionTime/Second)/0.5);
-      h = h*h;
-      h = log(h)/log(2);
-      tr = h>1 ? (uint8_t)h : 1;
-      LOG(LOG_DEBUG, "DaliDevice: new transition time = %.1f mS, calculated FADE_TIME setting = %f (rounded %d)", (double)aTransitionTime/MilliSecond, h, (int)tr);
-    }
+    uint8_t tr = transitionTimeToFadeTime(aTransitionTime);
     if (tr!=currentFadeTime || currentTransitionTime==Infinite) {
       LOG(LOG_DEBUG, "DaliDevice: setting DALI FADE_TIME to %d", (int)tr);
+      daliDeviceContainer.sendQueuedArcPower(this); // arc power queued before must still use the previous fade time
       daliDeviceContainer.daliComm->daliSendDtrAndConfigCommand(deviceInfo.shortAddress, DALICMD_STORE_DTR_AS_FADE_TIME, tr);
       currentFadeTime = tr;
     }
@@ -303,7 +312,14 @@ void DaliBusDevice::setBrightness(Brightness aBrightness)
     currentBrightness = aBrightness;
     uint8_t power = brightnessToArcpower(aBrightness);
     LOG(LOG_INFO, "Dali dimmer at shortaddr=%d: setting new brightness = %0.2f, arc power = %d", (int)deviceInfo.shortAddress, aBrightness, (int)power);
-    daliDeviceContainer.daliComm->daliSendDirectPower(deviceInfo.shortAddress, power);
+    if (isGrouped()) {
+      // already addressed as a group, send directly
+      daliDeviceContainer.daliComm->daliSendDirectPower(deviceInfo.shortAddress, power);
+    }
+    else {
+      // single device: let container combine with other outputs changing in the same mainloop cycle
+      daliDeviceContainer.queueArcPower(this, power);
+    }
   }
 }
 
@@ -330,6 +346,7 @@ void DaliBusDevice::dim(DsDimMode aDimMode, double aDimPerMS)
 {
   if (isDummy) return;
   MainLoop::currentMainLoop().cancelExecutionTicket(dimRepeaterTicket); // stop any previous dimming activity
+  daliDeviceContainer.sendQueuedArcPower(this); // dimming must start from (or stop after) the output value set before
   // Use DALI UP/DOWN dimming commands
   if (aDimMode==dimmode_stop) {
     // stop dimming - send MASK
@@ -859,7 +876,6 @@ void DaliRGBWDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
             (int)r, (int)g, (int)b, (int)w
           );
         }
-        dimmers[dimmer_white]->setTransitionTime(tt);
       }
       else {
         // RGB
@@ -872,10 +888,10 @@ void DaliRGBWDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
         }
       }
       // set transition time for all dimmers to brightness transition time
-      dimmers[dimmer_red]->setTransitionTime(tt);
-      dimmers[dimmer_green]->setTransitionTime(tt);
-      dimmers[dimmer_blue]->setTransitionTime(tt);
+      setTransitionTimes(tt);
       // apply new values
+      // Note: the arc powers are not sent immediately, but all go into the same DALI output batch, so
+      //   all channels are sent back-to-back (or as one group command when possible) and start fading together
       dimmers[dimmer_red]->setBrightness(r);
       dimmers[dimmer_green]->setBrightness(g);
       dimmers[dimmer_blue]->setBrightness(b);
@@ -890,6 +906,34 @@ void DaliRGBWDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
 
 
 
+void DaliRGBWDevice::setTransitionTimes(MLMicroSeconds aTransitionTime)
+{
+  // collect dimmers that actually need a new fade time
+  uint8_t tr = DaliBusDevice::transitionTimeToFadeTime(aTransitionTime);
+  DaliBusDevicePtr needsUpdate[numDimmers];
+  int numNeedsUpdate = 0;
+  for (DimmerIndex idx=dimmer_red; idx<numDimmers; idx++) {
+    DaliBusDevicePtr dimmer = dimmers[idx];
+    if (!dimmer || dimmer->isDummy) continue;
+    if (dimmer->currentTransitionTime==Infinite || dimmer->currentFadeTime!=tr) {
+      needsUpdate[numNeedsUpdate++] = dimmer;
+    }
+    dimmer->currentTransitionTime = aTransitionTime;
+  }
+  if (numNeedsUpdate==0) return; // all dimmers already have correct fade time
+  // DTR is common to all devices on the bus, so set it only once and then store it in all dimmers needing it
+  // (saves a DTR frame per dimmer compared to setTransitionTime() on each dimmer)
+  LOG(LOG_DEBUG, "DaliDevice: setting DALI FADE_TIME to %d in %d dimmers of composite device", (int)tr, numNeedsUpdate);
+  DaliCommPtr daliComm = needsUpdate[0]->daliDeviceContainer.daliComm;
+  daliComm->daliSend(DALICMD_SET_DTR, tr);
+  for (int i=0; i<numNeedsUpdate; i++) {
+    daliComm->daliSendConfigCommand(needsUpdate[i]->deviceInfo.shortAddress, DALICMD_STORE_DTR_AS_FADE_TIME);
+    needsUpdate[i]->currentFadeTime = tr;
+  }
+}
+
+
+
 void DaliRGBWDevice::deriveDsUid()
 {
   // Multi-channel DALI devices construct their ID from UUIDs of the DALI devices involved,
@@ -74,6 +74,11 @@ namespace p44 {
     double currentDimPerMS; ///< current dim steps per second
     uint8_t currentFadeRate; ///< currently set DALI fade rate
 
+    /// output batching
+    uint16_t daliGroups; ///< native DALI groups this (single) bus device is member of, not including groups in use for dS grouped dimmers
+    bool groupsKnown; ///< set when daliGroups has been read from the bus
+    int pendingArcPower; ///< arc power waiting to be sent in the current output batch, -1 if none
+
   public:
 
     DaliBusDevice(DaliDeviceContainer &aDaliDeviceContainer);
@@ -115,12 +120,19 @@ namespace p44 {
     /// @return brightness 0..100%
     Brightness arcpowerToBrightness(int aArcpower);
 
+    /// convert transition time to DALI fade time
+    /// @param aTransitionTime time for transition
+    /// @return DALI FADE_TIME setting 0..15
+    static uint8_t transitionTimeToFadeTime(MLMicroSeconds aTransitionTime);
+
     /// set transition time for subsequent brightness changes
     /// @param aTransitionTime time for transition
     void setTransitionTime(MLMicroSeconds aTransitionTime);
 
     /// set transition time for subsequent brightness changes
     /// @param aBrightness new brightness to set
+    /// @note for single bus devices, the arc power is not sent immediately, but queued in the container's output
+    ///   batch, which is sent at the end of the current mainloop cycle using group or broadcast addressing where possible
     void setBrightness(Brightness aBrightness);
 
     /// start or stop optimized DALI dimming
@@ -470,6 +482,7 @@ namespace p44 {
 
     void updateNextDimmer(StatusCB aCompletedCB, bool aFactoryReset, DimmerIndex aDimmerIndex, ErrorPtr aError);
     DaliBusDevicePtr firstBusDevice();
+    void setTransitionTimes(MLMicroSeconds aTransitionTime);
 
     void checkPresenceResponse(PresenceCB aPresenceResultHandler, DaliBusDevicePtr aDimmer);
     void disconnectableHandler(bool aForgetParams, DisconnectCB aDisconnectResultHandler, bool aPresent);
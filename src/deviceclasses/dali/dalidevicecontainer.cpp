@@ -27,7 +27,16 @@ using namespace p44;
 
 
 DaliDeviceContainer::DaliDeviceContainer(int aInstanceNumber, DeviceContainer *aDeviceContainerP, int aTag) :
-  DeviceClassContainer(aInstanceNumber, aDeviceContainerP, aTag)
+  DeviceClassContainer(aInstanceNumber, aDeviceContainerP, aTag),
+  groupsInUse(0),
+  outputBatchTicket(0),
+  busModeled(false),
+  busUnreliable(false),
+  useDevInfCache(false),
+  devInfCacheHits(0),
+  devInfReads(0),
+  collectStartTime(Never),
+  collectPhaseStartTime(Never)
 {
   daliComm = DaliCommPtr(new 	DaliComm(MainLoop::currentMainLoop()));
 }
@@ -55,8 +64,22 @@ bool DaliDeviceContainer::getDeviceIcon(string &aIcon, bool aWithData, const cha
 // Version history
 //  1 : first version
 //  2 : added groupNo (0..15) for DALI groups
+//  3 : added deviceInfoCache
 #define DALI_SCHEMA_MIN_VERSION 1 // minimally supported version, anything older will be deleted
-#define DALI_SCHEMA_VERSION 2 // current version
+#define DALI_SCHEMA_VERSION 3 // current version
+
+#define DALI_DEVINFCACHE_SCHEMA \
+  "CREATE TABLE deviceInfoCache (" \
+  " shortAddress INTEGER," \
+  " gtin INTEGER," \
+  " fwVersionMajor INTEGER," \
+  " fwVersionMinor INTEGER," \
+  " serialNo INTEGER," \
+  " oemGtin INTEGER," \
+  " oemSerialNo INTEGER," \
+  " devInfStatus INTEGER," \
+  " PRIMARY KEY (shortAddress)" \
+  ");"
 
 string DaliPersistence::dbSchemaUpgradeSQL(int aFromVersion, int &aToVersion)
 {
@@ -75,6 +98,7 @@ string DaliPersistence::dbSchemaUpgradeSQL(int aFromVersion, int &aToVersion)
       " PRIMARY KEY (dimmerUID)"
       ");"
     );
+    sql.append(DALI_DEVINFCACHE_SCHEMA);
     // reached final version in one step
     aToVersion = DALI_SCHEMA_VERSION;
   }
@@ -85,6 +109,12 @@ string DaliPersistence::dbSchemaUpgradeSQL(int aFromVersion, int &aToVersion)
     // reached version 2
     aToVersion = 2;
   }
+  else if (aFromVersion==2) {
+    // V2->V3: device info cache added
+    sql = DALI_DEVINFCACHE_SCHEMA;
+    // reached version 3
+    aToVersion = 3;
+  }
   return sql;
 }
 
@@ -114,7 +144,21 @@ void DaliDeviceContainer::collectDevices(StatusCB aCompletedCB, bool aIncrementa
 {
   if (!aIncremental) {
     removeDevices(aClearSettings);
+    // forget output batching info, will be rebuilt from collected devices
+    MainLoop::currentMainLoop().cancelExecutionTicket(outputBatchTicket);
+    pendingOutputs.clear();
+    outputDevices.clear();
+    groupsInUse = 0;
   }
+  // no broadcast or native group output until the bus is confirmed to have no unmodeled devices again
+  busModeled = false;
+  // cached device info is only used when not exhaustively collecting
+  useDevInfCache = !aExhaustive;
+  devInfCacheHits = 0;
+  devInfReads = 0;
+  collectStartTime = MainLoop::now();
+  collectPhaseStartTime = collectStartTime;
+  collectTimingReport.clear();
   // start collecting, allow quick scan when not exhaustively collecting (will still use full scan when bus collisions are detected)
   daliComm->daliFullBusScan(boost::bind(&DaliDeviceContainer::deviceListReceived, this, aCompletedCB, _1, _2, _3), !aExhaustive);
 }
@@ -122,9 +166,18 @@ void DaliDeviceContainer::collectDevices(StatusCB aCompletedCB, bool aIncrementa
 
 void DaliDeviceContainer::deviceListReceived(StatusCB aCompletedCB, DaliComm::ShortAddressListPtr aDeviceListPtr, DaliComm::ShortAddressListPtr aUnreliableDeviceListPtr, ErrorPtr aError)
 {
+  collectPhaseDone("bus scan");
+  // remember what is on the bus, to check later if all of it is modeled
+  busAddresses.clear();
+  busUnreliable = false;
+  if (!aError) {
+    busAddresses = *aDeviceListPtr;
+    busUnreliable = aUnreliableDeviceListPtr && aUnreliableDeviceListPtr->size()>0;
+  }
   // check if any devices
-  if (aError || aDeviceListPtr->size()==0)
+  if (aError || aDeviceListPtr->size()==0) {
     return aCompletedCB(aError); // no devices to query, completed
+  }
   // create a Dali bus device for every detected device
   DaliBusDeviceListPtr busDevices(new DaliBusDeviceList);
   for (DaliComm::ShortAddressList::iterator pos = aDeviceListPtr->begin(); pos!=aDeviceListPtr->end(); ++pos) {
@@ -147,10 +200,18 @@ void DaliDeviceContainer::queryNextDev(DaliBusDeviceListPtr aBusDevices, DaliBus
   if (Error::isOK(aError)) {
     if (aNextDev != aBusDevices->end()) {
       DaliAddress addr = (*aNextDev)->deviceInfo.shortAddress;
+      DaliComm::DaliDeviceInfoPtr cachedInfo;
+      if (useDevInfCache) cachedInfo = cachedDeviceInfo(addr);
+      if (cachedInfo) {
+        // we have a cached device info for this short address, just verify GTIN, firmware version and serial number (bank 0, 0x03..0x0E)
+        daliComm->daliReadMemory(boost::bind(&DaliDeviceContainer::cachedDeviceInfoVerified, this, aBusDevices, aNextDev, aCompletedCB, cachedInfo, _1, _2), addr, 0, 0x03, 12);
+        return;
+      }
       daliComm->daliReadDeviceInfo(boost::bind(&DaliDeviceContainer::deviceInfoReceived, this, aBusDevices, aNextDev, aCompletedCB, _1, _2), addr);
       return;
     }
     // all done successfully, complete bus info now available in aBusDevices
+    collectPhaseDone(string_format("device info (%d cached, %d read)", devInfCacheHits, devInfReads).c_str());
     // - look for dimmers that are to be addressed as a group
     DaliBusDeviceListPtr dimmerDevices = DaliBusDeviceListPtr(new DaliBusDeviceList());
     uint16_t groupsInUse = 0; // groups in use
@@ -225,6 +286,8 @@ void DaliDeviceContainer::queryNextDev(DaliBusDeviceListPtr aBusDevices, DaliBus
         }
       }
     }
+    // remember groups in use, these must not be used for output batching
+    this->groupsInUse |= groupsInUse;
     // initialize dimmer devices
     initializeNextDimmer(dimmerDevices, groupsInUse, dimmerDevices->begin(), aCompletedCB, ErrorPtr());
   }
@@ -246,6 +309,7 @@ void DaliDeviceContainer::initializeNextDimmer(DaliBusDeviceListPtr aDimmerDevic
   }
   else {
     // done, now create dS devices from dimmers
+    collectPhaseDone("dimmer initialisation");
     createDsDevices(aDimmerDevices, aCompletedCB);
   }
 }
@@ -304,7 +368,12 @@ void DaliDeviceContainer::createDsDevices(DaliBusDeviceListPtr aDimmerDevices, S
             daliDevice->addDimmer(dimmer, dimmerType);
           } // for all needed dimmers
           // - add it to our collection (if not already there)
-          addDevice(daliDevice);
+          if (addDevice(daliDevice)) {
+            // new device, its dimmers are available for output batching
+            for (int d=0; d<DaliRGBWDevice::numDimmers; d++) {
+              if (daliDevice->dimmers[d]) addOutputDevice(daliDevice->dimmers[d]);
+            }
+          }
         }
       } // part of composite multichannel device
       else {
@@ -322,9 +391,33 @@ void DaliDeviceContainer::createDsDevices(DaliBusDeviceListPtr aDimmerDevices, S
     // - set whiteDimmer (gives device info to calculate dSUID)
     daliDimmerDevice->brightnessDimmer = daliBusDevice;
     // - add it to our collection (if not already there)
-    addDevice(daliDimmerDevice);
+    if (addDevice(daliDimmerDevice)) {
+      // new device, available for output batching
+      addOutputDevice(daliBusDevice);
+    }
+    else {
+      // already known (incremental collect, or restored from snapshot): update native group membership of known device
+      for (DeviceVector::iterator dpos = devices.begin(); dpos!=devices.end(); ++dpos) {
+        if ((*dpos)->getDsUid()==daliDimmerDevice->getDsUid()) {
+          DaliDimmerDevicePtr knownDevice = boost::dynamic_pointer_cast<DaliDimmerDevice>(*dpos);
+          if (knownDevice && knownDevice->brightnessDimmer && !knownDevice->brightnessDimmer->isGrouped()) {
+            knownDevice->brightnessDimmer->daliGroups = daliBusDevice->daliGroups;
+            knownDevice->brightnessDimmer->groupsKnown = daliBusDevice->groupsKnown;
+          }
+          break;
+        }
+      }
+    }
   }
+  // broadcast and native groups can be used only if nothing on the bus would be hit unintentionally
+  busModeled = checkBusModeled();
   // collecting complete
+  collectPhaseDone("creating devices");
+  LOG(LOG_NOTICE,
+    "DALI bus collection took %.3f seconds: %s",
+    (double)(MainLoop::now()-collectStartTime)/Second,
+    collectTimingReport.c_str()
+  );
   aCompletedCB(ErrorPtr());
 }
 
@@ -341,6 +434,14 @@ void DaliDeviceContainer::deviceInfoReceived(DaliBusDeviceListPtr aBusDevices, D
     if (badData) { LOG(LOG_INFO, "Device at shortAddress %d does not have valid device info",aDaliDeviceInfoPtr->shortAddress); }
     // update device info entry in dali bus device
     (*aNextDev)->setDeviceInfo(*aDaliDeviceInfoPtr);
+    devInfReads++;
+    // update the cache (only complete, valid reads are cached, devices with missing/bad data will be re-read next time)
+    if (Error::isOK(aError)) {
+      cacheDeviceInfo(aDaliDeviceInfoPtr);
+    }
+    else {
+      db.executef("DELETE FROM deviceInfoCache WHERE shortAddress=%d", aDaliDeviceInfoPtr->shortAddress);
+    }
   }
   else {
     LOG(LOG_ERR, "Error reading device info: %s",aError->description().c_str());
@@ -352,6 +453,325 @@ void DaliDeviceContainer::deviceInfoReceived(DaliBusDeviceListPtr aBusDevices, D
 }
 
 
+DaliComm::DaliDeviceInfoPtr DaliDeviceContainer::cachedDeviceInfo(DaliAddress aShortAddress)
+{
+  DaliComm::DaliDeviceInfoPtr info;
+  sqlite3pp::query qry(db);
+  string sql = string_format("SELECT gtin, fwVersionMajor, fwVersionMinor, serialNo, oemGtin, oemSerialNo, devInfStatus FROM deviceInfoCache WHERE shortAddress=%d", aShortAddress);
+  if (qry.prepare(sql.c_str())==SQLITE_OK) {
+    sqlite3pp::query::iterator i = qry.begin();
+    if (i!=qry.end()) {
+      info = DaliComm::DaliDeviceInfoPtr(new DaliDeviceInfo);
+      info->shortAddress = aShortAddress;
+      info->gtin = i->get<long long>(0);
+      info->fw_version_major = i->get<int>(1);
+      info->fw_version_minor = i->get<int>(2);
+      info->serialNo = i->get<long long>(3);
+      info->oem_gtin = i->get<long long>(4);
+      info->oem_serialNo = i->get<long long>(5);
+      info->devInfStatus = (DaliDeviceInfo::DaliDevInfStatus)i->get<int>(6);
+    }
+  }
+  return info;
+}
+
+
+void DaliDeviceContainer::cachedDeviceInfoVerified(DaliBusDeviceListPtr aBusDevices, DaliBusDeviceList::iterator aNextDev, StatusCB aCompletedCB, DaliComm::DaliDeviceInfoPtr aCachedInfo, DaliComm::MemoryVectorPtr aIdData, ErrorPtr aError)
+{
+  if (Error::isOK(aError) && aIdData && aIdData->size()==12) {
+    // aIdData[0] is bank 0 offset 0x03
+    // - GTIN: bytes 0x03..0x08, MSB first
+    long long gtin = 0;
+    for (int i=0; i<6; i++) {
+      gtin = (gtin << 8) + (*aIdData)[i];
+    }
+    // - Serial: bytes 0x0B..0x0E
+    long long serialNo = 0;
+    for (int i=8; i<12; i++) {
+      serialNo = (serialNo << 8) + (*aIdData)[i];
+    }
+    if (
+      gtin==aCachedInfo->gtin &&
+      (*aIdData)[6]==aCachedInfo->fw_version_major &&
+      (*aIdData)[7]==aCachedInfo->fw_version_minor &&
+      serialNo==aCachedInfo->serialNo
+    ) {
+      // same device as last time, use cached info
+      LOG(LOG_INFO, "Device at shortAddress %d has same GTIN, firmware version and serial number as cached, using cached device info", aCachedInfo->shortAddress);
+      (*aNextDev)->setDeviceInfo(*aCachedInfo);
+      devInfCacheHits++;
+      ++aNextDev;
+      queryNextDev(aBusDevices, aNextDev, aCompletedCB, ErrorPtr());
+      return;
+    }
+  }
+  // cannot verify, or different device now -> read full device info
+  LOG(LOG_INFO, "Device at shortAddress %d does not match cached device info, re-reading", aCachedInfo->shortAddress);
+  daliComm->daliReadDeviceInfo(boost::bind(&DaliDeviceContainer::deviceInfoReceived, this, aBusDevices, aNextDev, aCompletedCB, _1, _2), aCachedInfo->shortAddress);
+}
+
+
+void DaliDeviceContainer::cacheDeviceInfo(DaliComm::DaliDeviceInfoPtr aDaliDeviceInfoPtr)
+{
+  db.executef(
+    "INSERT OR REPLACE INTO deviceInfoCache (shortAddress, gtin, fwVersionMajor, fwVersionMinor, serialNo, oemGtin, oemSerialNo, devInfStatus) VALUES (%d,%lld,%d,%d,%lld,%lld,%lld,%d)",
+    aDaliDeviceInfoPtr->shortAddress,
+    aDaliDeviceInfoPtr->gtin,
+    aDaliDeviceInfoPtr->fw_version_major,
+    aDaliDeviceInfoPtr->fw_version_minor,
+    aDaliDeviceInfoPtr->serialNo,
+    aDaliDeviceInfoPtr->oem_gtin,
+    aDaliDeviceInfoPtr->oem_serialNo,
+    (int)aDaliDeviceInfoPtr->devInfStatus
+  );
+}
+
+
+void DaliDeviceContainer::collectPhaseDone(const char *aPhaseName)
+{
+  MLMicroSeconds now = MainLoop::now();
+  if (!collectTimingReport.empty()) collectTimingReport.append(", ");
+  string_format_append(collectTimingReport, "%s %.3fs", aPhaseName, (double)(now-collectPhaseStartTime)/Second);
+  collectPhaseStartTime = now;
+}
+
+
+
+#pragma mark - device tree snapshot
+
+// snapshot info of a single dimmer device: short address, devInfStatus, fw version major/minor,
+// gtin, serialNo, oem_gtin, oem_serialNo (each 8 bytes, MSB first)
+#define DALI_SNAPSHOT_INFO_SIZE (4+4*8)
+
+static void appendUInt64(string &aInfo, uint64_t aValue)
+{
+  for (int i=7; i>=0; i--) aInfo += (char)((aValue>>(i*8)) & 0xFF);
+}
+
+static uint64_t getUInt64(const string &aInfo, size_t &aIndex)
+{
+  uint64_t v = 0;
+  for (int i=0; i<8; i++) v = (v<<8) + (uint8_t)aInfo[aIndex++];
+  return v;
+}
+
+
+string DaliDeviceContainer::deviceSnapshotInfo(DevicePtr aDevice)
+{
+  string info;
+  // only single dimmers can be restored, grouped and composite devices depend on the DB and bus state
+  DaliDimmerDevicePtr dev = boost::dynamic_pointer_cast<DaliDimmerDevice>(aDevice);
+  if (dev && dev->brightnessDimmer && !dev->brightnessDimmer->isGrouped() && !dev->brightnessDimmer->isDummy) {
+    DaliDeviceInfo &di = dev->brightnessDimmer->deviceInfo;
+    info += (char)di.shortAddress;
+    info += (char)di.devInfStatus;
+    info += (char)di.fw_version_major;
+    info += (char)di.fw_version_minor;
+    appendUInt64(info, di.gtin);
+    appendUInt64(info, di.serialNo);
+    appendUInt64(info, di.oem_gtin);
+    appendUInt64(info, di.oem_serialNo);
+  }
+  return info;
+}
+
+
+DevicePtr DaliDeviceContainer::deviceFromSnapshotInfo(const string &aSnapshotInfo)
+{
+  if (aSnapshotInfo.size()!=DALI_SNAPSHOT_INFO_SIZE) return DevicePtr(); // invalid
+  DaliDeviceInfo di;
+  size_t i = 0;
+  di.shortAddress = (uint8_t)aSnapshotInfo[i++];
+  di.devInfStatus = (DaliDeviceInfo::DaliDevInfStatus)aSnapshotInfo[i++];
+  di.fw_version_major = (uint8_t)aSnapshotInfo[i++];
+  di.fw_version_minor = (uint8_t)aSnapshotInfo[i++];
+  di.gtin = getUInt64(aSnapshotInfo, i);
+  di.serialNo = getUInt64(aSnapshotInfo, i);
+  di.oem_gtin = getUInt64(aSnapshotInfo, i);
+  di.oem_serialNo = getUInt64(aSnapshotInfo, i);
+  // create bus device, derives same dSUID as when collected from the bus
+  DaliBusDevicePtr busDevice(new DaliBusDevice(*this));
+  busDevice->setDeviceInfo(di);
+  DaliDimmerDevicePtr daliDimmerDevice(new DaliDimmerDevice(this));
+  daliDimmerDevice->brightnessDimmer = busDevice;
+  // available for output batching, but native groups are unknown and no broadcast until confirmed by collection
+  addOutputDevice(busDevice);
+  busModeled = false;
+  return daliDimmerDevice;
+}
+
+
+
+#pragma mark - output batching
+
+
+void DaliDeviceContainer::addOutputDevice(DaliBusDevicePtr aBusDevice)
+{
+  // only real single devices can be part of broadcast or native group output
+  if (aBusDevice->isDummy || aBusDevice->isGrouped()) return;
+  outputDevices.push_back(aBusDevice);
+}
+
+
+bool DaliDeviceContainer::checkBusModeled()
+{
+  // A broadcast or native group command reaches every ballast on the bus (in that group), including
+  // ballasts that are part of dS grouped dimmers or composite devices with other outputs, ballasts
+  // not answering reliably, and ballasts whose group membership could not be read. Only when every
+  // short address found on the bus is a single output device with group membership read from the
+  // bus, the membership known here is the complete membership on the bus.
+  if (busUnreliable) {
+    LOG(LOG_INFO, "DALI output batching: bus has short addresses with unreliable answers -> no broadcast/group output");
+    return false;
+  }
+  for (DaliComm::ShortAddressList::iterator apos = busAddresses.begin(); apos!=busAddresses.end(); ++apos) {
+    bool modeled = false;
+    for (DaliBusDeviceList::iterator pos = outputDevices.begin(); pos!=outputDevices.end(); ++pos) {
+      if ((*pos)->deviceInfo.shortAddress==*apos && (*pos)->groupsKnown) {
+        modeled = true;
+        break;
+      }
+    }
+    if (!modeled) {
+      LOG(LOG_INFO, "DALI output batching: bus device #%d is not a single output device with known groups -> no broadcast/group output", (int)*apos);
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void DaliDeviceContainer::removeOutputDevice(DaliBusDevicePtr aBusDevice)
+{
+  if (!aBusDevice) return;
+  outputDevices.remove(aBusDevice);
+  pendingOutputs.remove(aBusDevice);
+  aBusDevice->pendingArcPower = -1;
+  // the ballast may still be on the bus, unmodeled now, until the next collection shows otherwise
+  if (!aBusDevice->isDummy) busModeled = false;
+}
+
+
+void DaliDeviceContainer::removeDevice(DevicePtr aDevice, bool aForget)
+{
+  // bus devices of a removed device must no longer be part of output batching
+  // (and as their ballasts may still be on the bus, no broadcast/group output until next collection)
+  DaliDimmerDevicePtr dimmerDev = boost::dynamic_pointer_cast<DaliDimmerDevice>(aDevice);
+  if (dimmerDev) {
+    removeOutputDevice(dimmerDev->brightnessDimmer);
+  }
+  else {
+    DaliRGBWDevicePtr rgbwDev = boost::dynamic_pointer_cast<DaliRGBWDevice>(aDevice);
+    if (rgbwDev) {
+      for (int d=0; d<DaliRGBWDevice::numDimmers; d++) {
+        removeOutputDevice(rgbwDev->dimmers[d]);
+      }
+    }
+  }
+  inherited::removeDevice(aDevice, aForget);
+}
+
+
+void DaliDeviceContainer::queueArcPower(DaliBusDevicePtr aBusDevice, uint8_t aArcPower)
+{
+  if (aBusDevice->pendingArcPower<0) {
+    pendingOutputs.push_back(aBusDevice);
+  }
+  aBusDevice->pendingArcPower = aArcPower; // latest value wins
+  if (!outputBatchTicket) {
+    // send batch at end of this mainloop cycle, when all outputs affected by the same scene call have been applied
+    outputBatchTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DaliDeviceContainer::sendOutputBatch, this), 0);
+  }
+}
+
+
+void DaliDeviceContainer::sendQueuedArcPower(DaliBusDevicePtr aBusDevice)
+{
+  if (aBusDevice->pendingArcPower>=0) {
+    // send it individually now, so bus commands for this device stay in the order they were issued
+    daliComm->daliSendDirectPower(aBusDevice->deviceInfo.shortAddress, aBusDevice->pendingArcPower);
+    aBusDevice->pendingArcPower = -1;
+    pendingOutputs.remove(aBusDevice);
+  }
+}
+
+
+bool DaliDeviceContainer::sameArcPower(DaliBusDeviceList &aBusDevices, uint8_t &aArcPower)
+{
+  // all devices must have a pending arc power, and all must be equal in arc power and fade time
+  int power = -1;
+  uint8_t fadeTime = 0;
+  for (DaliBusDeviceList::iterator pos = aBusDevices.begin(); pos!=aBusDevices.end(); ++pos) {
+    DaliBusDevicePtr dev = *pos;
+    if (dev->pendingArcPower<0) return false; // this one is not changing
+    if (power<0) {
+      power = dev->pendingArcPower;
+      fadeTime = dev->currentFadeTime;
+    }
+    else if (dev->pendingArcPower!=power || dev->currentFadeTime!=fadeTime) {
+      return false; // differing output
+    }
+  }
+  if (power<0) return false; // empty list
+  aArcPower = power;
+  return true;
+}
+
+
+void DaliDeviceContainer::sendOutputBatch()
+{
+  outputBatchTicket = 0;
+  uint8_t power;
+  // - broadcast when all devices on the bus get the same output (and the bus has no other devices that would be hit as well)
+  if (busModeled && pendingOutputs.size()>1 && pendingOutputs.size()==outputDevices.size() && sameArcPower(pendingOutputs, power)) {
+    LOG(LOG_INFO, "DALI output batch: broadcasting arc power = %d to all %d devices", (int)power, (int)pendingOutputs.size());
+    daliComm->daliSendDirectPower(DaliBroadcast, power);
+    for (DaliBusDeviceList::iterator pos = pendingOutputs.begin(); pos!=pendingOutputs.end(); ++pos) {
+      (*pos)->pendingArcPower = -1;
+    }
+    pendingOutputs.clear();
+    return;
+  }
+  // - use native DALI groups where all members get the same output, largest groups first
+  //   (only when membership of all devices on the bus is known, see checkBusModeled())
+  if (busModeled && pendingOutputs.size()>1) {
+    DaliBusDeviceList members[16];
+    for (DaliBusDeviceList::iterator pos = outputDevices.begin(); pos!=outputDevices.end(); ++pos) {
+      for (int g=0; g<16; g++) {
+        if (((*pos)->daliGroups & ~groupsInUse) & (1<<g)) members[g].push_back(*pos);
+      }
+    }
+    while (true) {
+      int bestGroup = -1;
+      size_t bestSize = 1; // a group must save at least one command
+      for (int g=0; g<16; g++) {
+        if (members[g].size()>bestSize && sameArcPower(members[g], power)) {
+          bestGroup = g;
+          bestSize = members[g].size();
+        }
+      }
+      if (bestGroup<0) break; // no more groups to use
+      sameArcPower(members[bestGroup], power);
+      LOG(LOG_INFO, "DALI output batch: sending arc power = %d to %d devices in DALI group %d", (int)power, (int)bestSize, bestGroup);
+      daliComm->daliSendDirectPower(bestGroup|DaliGroup, power);
+      for (DaliBusDeviceList::iterator pos = members[bestGroup].begin(); pos!=members[bestGroup].end(); ++pos) {
+        (*pos)->pendingArcPower = -1; // done, which also disqualifies overlapping groups
+      }
+    }
+  }
+  // - send remaining outputs individually
+  for (DaliBusDeviceList::iterator pos = pendingOutputs.begin(); pos!=pendingOutputs.end(); ++pos) {
+    DaliBusDevicePtr dev = *pos;
+    if (dev->pendingArcPower>=0) {
+      daliComm->daliSendDirectPower(dev->deviceInfo.shortAddress, dev->pendingArcPower);
+      dev->pendingArcPower = -1;
+    }
+  }
+  pendingOutputs.clear();
+}
+
+
+
 #pragma mark - DALI specific methods
 
 ErrorPtr DaliDeviceContainer::handleMethod(VdcApiRequestPtr aRequest, const string &aMethod, ApiValuePtr aParams)
@@ -369,6 +789,10 @@ ErrorPtr DaliDeviceContainer::handleMethod(VdcApiRequestPtr aRequest, const stri
     // diagnostics: direct DALI commands
     respErr = daliCmd(aRequest, aParams);
   }
+  else if (aMethod=="x-p44-bridgeStats") {
+    // diagnostics: bridge communication and flow control statistics
+    respErr = bridgeStats(aRequest, aParams);
+  }
   else {
     respErr = inherited::handleMethod(aRequest, aMethod, aParams);
   }
@@ -379,6 +803,39 @@ ErrorPtr DaliDeviceContainer::handleMethod(VdcApiRequestPtr aRequest, const stri
 #pragma mark - DALI bus diagnostics
 
 
+// bridge flow control statistics
+
+static ApiValuePtr msValue(ApiValuePtr aFactory, MLMicroSeconds aTime)
+{
+  return aFactory->newDouble((double)aTime/MilliSecond);
+}
+
+
+ErrorPtr DaliDeviceContainer::bridgeStats(VdcApiRequestPtr aRequest, ApiValuePtr aParams)
+{
+  const DaliBridgeStats &stats = daliComm->getBridgeStats();
+  ApiValuePtr answer = aRequest->newApiValue();
+  answer->setType(apivalue_object);
+  answer->add("window", answer->newInt64(daliComm->getBridgeWindow()));
+  answer->add("minWindow", answer->newInt64(stats.minWindow));
+  answer->add("maxWindow", answer->newInt64(stats.maxWindow));
+  answer->add("windowIncreases", answer->newInt64(stats.windowIncreases));
+  answer->add("windowDecreases", answer->newInt64(stats.windowDecreases));
+  answer->add("responses", answer->newInt64(stats.responses));
+  answer->add("errors", answer->newInt64(stats.errors));
+  answer->add("stalls", answer->newInt64(stats.stalls));
+  answer->add("serviceTime_p50_mS", msValue(answer, stats.serviceTime.percentile(50)));
+  answer->add("serviceTime_p99_mS", msValue(answer, stats.serviceTime.percentile(99)));
+  answer->add("serviceTime_max_mS", msValue(answer, stats.serviceTime.percentile(100)));
+  // optionally start new collection period
+  ApiValuePtr o = aParams->get("reset");
+  if (o && o->boolValue()) {
+    daliComm->resetBridgeStats();
+  }
+  return aRequest->sendResult(answer);
+}
+
+
 // scan bus, return status string
 
 ErrorPtr DaliDeviceContainer::daliScan(VdcApiRequestPtr aRequest, ApiValuePtr aParams)
@@ -56,6 +56,23 @@ namespace p44 {
 
 		DaliPersistence db;
 
+    // output batching
+    DaliBusDeviceList outputDevices; ///< all single DALI bus devices in use (not grouped, not dummy), for planning group/broadcast output
+    uint16_t groupsInUse; ///< DALI groups in use for dS grouped dimmers, cannot be used for output batching
+    DaliBusDeviceList pendingOutputs; ///< bus devices with arc power pending in the current output batch
+    long outputBatchTicket; ///< ticket for sending the current output batch
+    bool busModeled; ///< set when the last bus scan found only output devices with group membership read from the bus (required for broadcast and native group output)
+    DaliComm::ShortAddressList busAddresses; ///< short addresses found by the last bus scan
+    bool busUnreliable; ///< set when the last bus scan found short addresses with unreliable answers (possibly several ballasts)
+
+    // collection
+    bool useDevInfCache; ///< set if cached device info may be used in current collection
+    int devInfCacheHits; ///< number of device infos taken from cache in current collection
+    int devInfReads; ///< number of device infos read from the bus in current collection
+    MLMicroSeconds collectStartTime; ///< when current collection started
+    MLMicroSeconds collectPhaseStartTime; ///< when current phase of the collection started
+    string collectTimingReport; ///< durations of the collection phases completed so far
+
   public:
     DaliDeviceContainer(int aInstanceNumber, DeviceContainer *aDeviceContainerP, int aTag);
 
@@ -77,6 +94,21 @@ namespace p44 {
     /// collect and add devices to the container
     virtual void collectDevices(StatusCB aCompletedCB, bool aIncremental, bool aExhaustive, bool aClearSettings);
 
+    /// remove device, including its bus devices from output batching
+    /// @param aDevice device to remove
+    /// @param aForget if set, all parameters stored for the device will be deleted
+    virtual void removeDevice(DevicePtr aDevice, bool aForget = false);
+
+    /// get information to re-create a device at next startup without accessing the bus
+    /// @param aDevice a device of this class container
+    /// @return device info of single dimmer devices, empty for grouped and composite devices
+    virtual string deviceSnapshotInfo(DevicePtr aDevice);
+
+    /// re-create a single dimmer device from snapshot info
+    /// @param aSnapshotInfo info as returned by deviceSnapshotInfo() in a previous run
+    /// @return new device object, not yet added, or NULL if info is invalid
+    virtual DevicePtr deviceFromSnapshotInfo(const string &aSnapshotInfo);
+
     /// vdc level methods (p44 specific, JSON only, for configuring multichannel RGB(W) devices)
     virtual ErrorPtr handleMethod(VdcApiRequestPtr aRequest, const string &aMethod, ApiValuePtr aParams);
 
@@ -90,6 +122,17 @@ namespace p44 {
     /// @return error if not successful
     ErrorPtr ungroupDevice(DaliDevicePtr aDevice, VdcApiRequestPtr aRequest);
 
+    /// queue arc power for a single bus device in the current output batch
+    /// @param aBusDevice the (single, non-grouped) bus device
+    /// @param aArcPower the arc power to apply
+    /// @note the batch is sent at the end of the current mainloop cycle. Devices getting the same arc power with the same
+    ///   fade time are addressed together using a DALI broadcast or native DALI group command where possible.
+    void queueArcPower(DaliBusDevicePtr aBusDevice, uint8_t aArcPower);
+
+    /// send arc power still queued for a bus device right now
+    /// @param aBusDevice the bus device about to get another command that must not overtake the queued arc power
+    void sendQueuedArcPower(DaliBusDevicePtr aBusDevice);
+
     /// Get icon data or name
     /// @param aIcon string to put result into (when method returns true)
     /// - if aWithData is set, binary PNG icon data for given resolution prefix is returned
@@ -104,12 +147,22 @@ namespace p44 {
     void queryNextDev(DaliBusDeviceListPtr aBusDevices, DaliBusDeviceList::iterator aNextDev, StatusCB aCompletedCB, ErrorPtr aError);
     void initializeNextDimmer(DaliBusDeviceListPtr aDimmerDevices, uint16_t aGroupsInUse, DaliBusDeviceList::iterator aNextDimmer, StatusCB aCompletedCB, ErrorPtr aError);
     void createDsDevices(DaliBusDeviceListPtr aDimmerDevices, StatusCB aCompletedCB);
+    void addOutputDevice(DaliBusDevicePtr aBusDevice);
+    void removeOutputDevice(DaliBusDevicePtr aBusDevice);
+    void sendOutputBatch();
+    bool checkBusModeled();
+    bool sameArcPower(DaliBusDeviceList &aBusDevices, uint8_t &aArcPower);
     void deviceInfoReceived(DaliBusDeviceListPtr aBusDevices, DaliBusDeviceList::iterator aNextDev, StatusCB aCompletedCB, DaliComm::DaliDeviceInfoPtr aDaliDeviceInfoPtr, ErrorPtr aError);
+    DaliComm::DaliDeviceInfoPtr cachedDeviceInfo(DaliAddress aShortAddress);
+    void cachedDeviceInfoVerified(DaliBusDeviceListPtr aBusDevices, DaliBusDeviceList::iterator aNextDev, StatusCB aCompletedCB, DaliComm::DaliDeviceInfoPtr aCachedInfo, DaliComm::MemoryVectorPtr aIdData, ErrorPtr aError);
+    void cacheDeviceInfo(DaliComm::DaliDeviceInfoPtr aDaliDeviceInfoPtr);
+    void collectPhaseDone(const char *aPhaseName);
     void groupCollected(VdcApiRequestPtr aRequest);
 
     ErrorPtr groupDevices(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
     ErrorPtr daliScan(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
     ErrorPtr daliCmd(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
+    ErrorPtr bridgeStats(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
 
     typedef boost::shared_ptr<std::string> StringPtr;
     void daliScanNext(VdcApiRequestPtr aRequest, DaliAddress aShortAddress, StringPtr aResult);
@@ -71,7 +71,7 @@ void Enocean4BSDevice::sendTeachInResponse()
     responsePacket->setRadioDestination(getAddress());
     // now send
     LOG(LOG_INFO, "Sending 4BS teach-in response for EEP %06X", EEP_PURE(getEEProfile()));
-    getEnoceanDeviceContainer().enoceanComm.sendCommand(responsePacket, NULL);
+    getEnoceanDeviceContainer().enoceanComm.sendCommand(responsePacket, NULL, cmdprio_learn);
   }
 }
 
@@ -134,8 +134,9 @@ namespace p44 {
 
   /// decoder function
   /// @param aDescriptor descriptor for data to extract
+  /// @param aBehaviour the behaviour, must be of the type specified by aDescriptor.behaviourType
   /// @param a4BSdata the 4BS data as 32-bit value, MSB=enocean DB_3, LSB=enocean DB_0
-  typedef void (*BitFieldHandlerFunc)(const struct Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviourPtr aBehaviour, bool aForSend, uint32_t &a4BSdata);
+  typedef void (*BitFieldHandlerFunc)(const struct Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviour &aBehaviour, bool aForSend, uint32_t &a4BSdata);
 
 
   /// enocean sensor value descriptor
@@ -166,7 +167,7 @@ namespace p44 {
 #pragma mark - bit field handlers for Enocean4bsSensorHandler
 
 /// standard bitfield extractor function for sensor behaviours (read only)
-static void stdSensorHandler(const struct Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviourPtr aBehaviour, bool aForSend, uint32_t &a4BSdata)
+static void stdSensorHandler(const struct Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviour &aBehaviour, bool aForSend, uint32_t &a4BSdata)
 {
   if (!aForSend) {
     uint32_t value = a4BSdata>>aSensorDescriptor.lsBit;
@@ -174,15 +175,14 @@ static void stdSensorHandler(const struct Enocean4BSSensorDescriptor &aSensorDes
     long mask = (1l<<numBits)-1;
     value &= mask;
     // now pass to behaviour
-    SensorBehaviourPtr sb = boost::dynamic_pointer_cast<SensorBehaviour>(aBehaviour);
-    if (sb) {
-      sb->updateEngineeringValue(value);
+    if (aBehaviour.getType()==behaviour_sensor) {
+      static_cast<SensorBehaviour &>(aBehaviour).updateEngineeringValue(value);
     }
   }
 }
 
 /// inverted bitfield extractor function
-static void invSensorHandler(const struct Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviourPtr aBehaviour, bool aForSend, uint32_t &a4BSdata)
+static void invSensorHandler(const struct Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviour &aBehaviour, bool aForSend, uint32_t &a4BSdata)
 {
   if (!aForSend) {
     uint32_t data = ~a4BSdata;
@@ -192,7 +192,7 @@ static void invSensorHandler(const struct Enocean4BSSensorDescriptor &aSensorDes
 
 
 /// two-range illumination handler, as used in A5-06-01 and A5-06-02
-static void illumHandler(const struct Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviourPtr aBehaviour, bool aForSend, uint32_t &a4BSdata)
+static void illumHandler(const struct Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviour &aBehaviour, bool aForSend, uint32_t &a4BSdata)
 {
   uint32_t data = 0;
   if (!aForSend) {
@@ -213,7 +213,7 @@ static void illumHandler(const struct Enocean4BSSensorDescriptor &aSensorDescrip
 }
 
 
-static void powerMeterHandler(const struct Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviourPtr aBehaviour, bool aForSend, uint32_t &a4BSdata)
+static void powerMeterHandler(const struct Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviour &aBehaviour, bool aForSend, uint32_t &a4BSdata)
 {
   if (!aForSend) {
     // raw value is in DB3.7..DB1.0 (upper 24 bits)
@@ -225,8 +225,8 @@ static void powerMeterHandler(const struct Enocean4BSSensorDescriptor &aSensorDe
       case 2: divisor = 100; break; // value scale is 0.01kWh or 0.01W per LSB
       case 3: divisor = 1000; break; // value scale is 0.001kWh (1Wh) or 0.001W (1mW) per LSB
     }
-    SensorBehaviourPtr sb = boost::dynamic_pointer_cast<SensorBehaviour>(aBehaviour);
-    if (sb) {
+    if (aBehaviour.getType()==behaviour_sensor) {
+      SensorBehaviour *sb = static_cast<SensorBehaviour *>(&aBehaviour);
       // DB0.2 signals which value it is: 0=cumulative (energy), 1=current value (power)
       if (a4BSdata & 0x04) {
         // power
@@ -249,7 +249,7 @@ static void powerMeterHandler(const struct Enocean4BSSensorDescriptor &aSensorDe
 
 
 /// standard binary input handler
-static void stdInputHandler(const struct Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviourPtr aBehaviour, bool aForSend, uint32_t &a4BSdata)
+static void stdInputHandler(const struct Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviour &aBehaviour, bool aForSend, uint32_t &a4BSdata)
 {
   // read only
   if (!aForSend) {
@@ -260,9 +260,8 @@ static void stdInputHandler(const struct Enocean4BSSensorDescriptor &aSensorDesc
     else
       newState = (bool)aSensorDescriptor.min; // false: report value for min
     // now pass to behaviour
-    BinaryInputBehaviourPtr bb = boost::dynamic_pointer_cast<BinaryInputBehaviour>(aBehaviour);
-    if (bb) {
-      bb->updateInputState(newState);
+    if (aBehaviour.getType()==behaviour_binaryinput) {
+      static_cast<BinaryInputBehaviour &>(aBehaviour).updateInputState(newState);
     }
   }
 }
@@ -410,15 +409,44 @@ static const p44::Enocean4BSSensorDescriptor enocean4BSdescriptors[] = {
 
 
 // helper to make sure handler and its parameter always match
-static void handle4BSBitField(const Enocean4BSSensorDescriptor &aSensorDescriptor, DsBehaviourPtr aBehaviour, bool aForSend, uint32_t &a4BSdata)
+static void handle4BSBitField(const Enocean4BSSensorDescriptor &aSensorDescriptor, const DsBehaviourPtr &aBehaviour, bool aForSend, uint32_t &a4BSdata)
 {
-  if (aSensorDescriptor.bitFieldHandler) {
-    aSensorDescriptor.bitFieldHandler(aSensorDescriptor, aBehaviour, aForSend, a4BSdata);
+  if (aSensorDescriptor.bitFieldHandler && aBehaviour) {
+    aSensorDescriptor.bitFieldHandler(aSensorDescriptor, *aBehaviour, aForSend, a4BSdata);
   }
 }
 
 
 
+#pragma mark - EEP index for enocean4BSdescriptors
+
+// Note: all descriptors for the same variant/func/type and subdevice are contiguous in enocean4BSdescriptors[],
+//   so the index only needs to record the first of them and their number
+#define EEP_INDEX_KEY(variant, func, type, subDevice) \
+  (((uint32_t)(variant)<<24) | ((uint32_t)(func)<<16) | ((uint32_t)(type)<<8) | (uint32_t)(subDevice))
+
+typedef struct {
+  const Enocean4BSSensorDescriptor *firstDescP; ///< first descriptor for the key
+  int numDescriptors; ///< number of consecutive descriptors for the key
+} EepIndexEntry;
+typedef map<uint32_t, EepIndexEntry> EepIndexMap;
+
+/// @return index of the descriptor table by variant/func/type/subdevice, built once on first use
+static const EepIndexMap &eepIndex()
+{
+  static EepIndexMap index;
+  if (index.empty()) {
+    for (const Enocean4BSSensorDescriptor *descP = enocean4BSdescriptors; descP->bitFieldHandler!=NULL; descP++) {
+      EepIndexEntry &e = index[EEP_INDEX_KEY(descP->variant, descP->func, descP->type, descP->subDevice)];
+      if (e.numDescriptors==0) e.firstDescP = descP;
+      e.numDescriptors++;
+    }
+  }
+  return index;
+}
+
+
+
 Enocean4bsSensorHandler::Enocean4bsSensorHandler(EnoceanDevice &aDevice) :
   inherited(aDevice),
   sensorChannelDescriptorP(NULL)
@@ -457,18 +485,13 @@ EnoceanDevicePtr Enocean4bsSensorHandler::newDevice(
 
   // create device from matching with sensor table
   int numDescriptors = 0; // number of descriptors
-  // Search descriptors for this EEP and for the start of channels for this aSubDeviceIndex (in case sensors in one physical devices are split into multiple vdSDs)
+  // Look up descriptors for this EEP and this aSubDeviceIndex (in case sensors in one physical devices are split into multiple vdSDs)
   const Enocean4BSSensorDescriptor *subdeviceDescP = NULL;
-  const Enocean4BSSensorDescriptor *descP = enocean4BSdescriptors;
-  while (descP->bitFieldHandler!=NULL) {
-    if (descP->variant==variant && descP->func==func && descP->type==type) {
-      // remember if this is the subdevice we are looking for
-      if (descP->subDevice==aSubDeviceIndex) {
-        if (!subdeviceDescP) subdeviceDescP = descP; // remember the first descriptor of this subdevice as starting point for creating handlers below
-        numDescriptors++; // count descriptors for this subdevice as a limit for creating handlers below
-      }
-    }
-    descP++;
+  const EepIndexMap &index = eepIndex();
+  EepIndexMap::const_iterator pos = index.find(EEP_INDEX_KEY(variant, func, type, aSubDeviceIndex));
+  if (pos!=index.end()) {
+    subdeviceDescP = pos->second.firstDescP; // first descriptor of this subdevice as starting point for creating handlers below
+    numDescriptors = pos->second.numDescriptors; // number of descriptors for this subdevice as a limit for creating handlers below
   }
   // Create device and channels
   bool needsTeachInResponse = false;
@@ -616,6 +639,90 @@ string Enocean4bsSensorHandler::sensorDesc(const Enocean4BSSensorDescriptor &aSe
 
 
 
+#define DECODE_BENCHMARK_ADDRESS 0xFFFFFFFE // scratch devices for the benchmark are never added, so address does not matter
+
+void Enocean4bsSensorHandler::decodeBenchmark(EnoceanDeviceContainer *aClassContainerP, ApiValuePtr aTelegrams, int aRepeat, ApiValuePtr aResult)
+{
+  // collect the corpus
+  typedef vector<pair<EnoceanProfile, uint32_t> > TelegramVector;
+  TelegramVector corpus;
+  if (aTelegrams && aTelegrams->arrayLength()>0) {
+    for (int i=0; i<aTelegrams->arrayLength(); i++) {
+      ApiValuePtr t = aTelegrams->arrayGet(i);
+      ApiValuePtr eep = t->get("eep");
+      ApiValuePtr data = t->get("data");
+      if (eep && data) corpus.push_back(make_pair((EnoceanProfile)eep->uint32Value(), (uint32_t)data->uint32Value()));
+    }
+  }
+  else {
+    // one synthetic telegram for every profile in the sensor table
+    for (const Enocean4BSSensorDescriptor *descP = enocean4BSdescriptors; descP->bitFieldHandler!=NULL; descP++) {
+      EnoceanProfile eep = ((EnoceanProfile)descP->variant<<24) | ((EnoceanProfile)rorg_4BS<<16) | ((EnoceanProfile)descP->func<<8) | descP->type;
+      if (corpus.empty() || corpus.back().first!=eep) corpus.push_back(make_pair(eep, (uint32_t)0x5A3C9601));
+    }
+  }
+  // create scratch devices for every profile in the corpus. These are not added to the container,
+  // so they are never announced or persisted, and their behaviours cannot push anything
+  // Note: creation itself is not marking anything changed, so marking scratch right after creation is sufficient
+  typedef vector<EnoceanDevicePtr> DeviceVector;
+  typedef map<EnoceanProfile, DeviceVector> ProfileDevicesMap;
+  ProfileDevicesMap devices;
+  MLMicroSeconds t = MainLoop::now();
+  for (TelegramVector::iterator pos = corpus.begin(); pos!=corpus.end(); ++pos) {
+    if (devices.find(pos->first)!=devices.end()) continue; // already created
+    DeviceVector &devs = devices[pos->first];
+    EnoceanSubDevice subDeviceIndex = 0;
+    while (true) {
+      EnoceanDevicePtr dev = newDevice(aClassContainerP, DECODE_BENCHMARK_ADDRESS, subDeviceIndex, pos->first, manufacturer_unknown, false);
+      if (!dev) break;
+      // no logging (would dominate the measurement) and no change propagation into the vdc
+      dev->setScratch();
+      devs.push_back(dev);
+    }
+  }
+  MLMicroSeconds creationTime = MainLoop::now()-t;
+  // prepare the packets
+  vector<Esp3PacketPtr> packets;
+  vector<DeviceVector *> targets;
+  int unsupported = 0;
+  for (TelegramVector::iterator pos = corpus.begin(); pos!=corpus.end(); ++pos) {
+    DeviceVector &devs = devices[pos->first];
+    if (devs.empty()) {
+      // not a table driven sensor profile
+      unsupported++;
+      continue;
+    }
+    Esp3PacketPtr packet = Esp3PacketPtr(new Esp3Packet());
+    packet->initForRorg(rorg_4BS);
+    packet->set4BSdata(pos->second | LRN_BIT_MASK); // LRN bit set means regular data telegram
+    packets.push_back(packet);
+    targets.push_back(&devs);
+  }
+  // decode
+  long decoded = 0;
+  t = MainLoop::now();
+  for (int r=0; r<aRepeat; r++) {
+    for (size_t i=0; i<packets.size(); i++) {
+      DeviceVector &devs = *targets[i];
+      for (DeviceVector::iterator pos = devs.begin(); pos!=devs.end(); ++pos) {
+        (*pos)->handleRadioPacket(packets[i]);
+      }
+      decoded++;
+    }
+  }
+  MLMicroSeconds decodeTime = MainLoop::now()-t;
+  // report
+  aResult->add("telegrams", aResult->newUint64(corpus.size()));
+  aResult->add("unsupported", aResult->newUint64(unsupported));
+  aResult->add("profiles", aResult->newUint64(devices.size()));
+  aResult->add("creationTime_mS", aResult->newDouble((double)creationTime/MilliSecond));
+  aResult->add("decoded", aResult->newUint64(decoded));
+  aResult->add("decodeTime_mS", aResult->newDouble((double)decodeTime/MilliSecond));
+  aResult->add("telegramsPerSecond", aResult->newDouble(decodeTime>0 ? (double)decoded*Second/decodeTime : 0));
+}
+
+
+
 #pragma mark - EnoceanA52001Handler
 
 
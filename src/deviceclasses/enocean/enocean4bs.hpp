@@ -150,6 +150,15 @@ namespace p44 {
     /// utility: get description string from sensor descriptor info
     static string sensorDesc(const Enocean4BSSensorDescriptor &aSensorDescriptor);
 
+    /// benchmark: decode a corpus of 4BS telegrams with scratch devices for table driven sensor profiles
+    /// @note runs on the main loop, only to be called via the config API ("decode" vdcBenchmark) with bounded parameters
+    /// @param aClassContainerP the class container (scratch devices are created, but never added to it)
+    /// @param aTelegrams array of {"eep":<profile, variant in MSB>, "data":<32bit 4BS data>} objects,
+    ///   NULL or empty to use one synthetic telegram for every profile in the sensor table
+    /// @param aRepeat number of times the entire corpus is decoded
+    /// @param aResult object to add the benchmark results to
+    static void decodeBenchmark(EnoceanDeviceContainer *aClassContainerP, ApiValuePtr aTelegrams, int aRepeat, ApiValuePtr aResult);
+
     /// handle radio packet related to this channel
     /// @param aEsp3PacketPtr the radio packet to analyze and extract channel related information
     virtual void handleRadioPacket(Esp3PacketPtr aEsp3PacketPtr);
@@ -39,7 +39,8 @@ using namespace p44;
 // 55 00 07 07 01 7A F6 30 00 86 B8 1A 30 03 FF FF FF FF FF 00 C0
 
 Esp3Packet::Esp3Packet() :
-  payloadP(NULL)
+  payloadP(NULL),
+  payloadCapacity(0)
 {
   clear();
 }
@@ -47,13 +48,14 @@ Esp3Packet::Esp3Packet() :
 
 Esp3Packet::~Esp3Packet()
 {
-  clear();
+  clearData();
 }
 
 
 void Esp3Packet::clear()
 {
-  clearData();
+  // Note: payload buffer is kept allocated for re-use (recycled packets)
+  payloadSize = 0;
   memset(header, 0, sizeof(header));
   state = ps_syncwait;
 }
@@ -61,10 +63,9 @@ void Esp3Packet::clear()
 
 void Esp3Packet::clearData()
 {
-  if (payloadP) {
-    if (payloadP) delete [] payloadP;
-    payloadP = NULL;
-  }
+  if (payloadP) delete [] payloadP;
+  payloadP = NULL;
+  payloadCapacity = 0;
   payloadSize = 0;
 }
 
@@ -80,6 +81,9 @@ void Esp3Packet::clearData()
 
 #define ESP3_HEADERBYTES 6
 
+// minimal payload buffer size, enough for common radio telegrams, so recycled packets rarely need reallocation
+#define ESP3_MIN_PAYLOAD_CAPACITY 32
+
 
 
 size_t Esp3Packet::dataLength()
@@ -125,7 +129,7 @@ uint8_t Esp3Packet::headerCRC()
 
 uint8_t Esp3Packet::payloadCRC()
 {
-  if (!payloadP) return 0;
+  if (!payloadP || payloadSize==0) return 0;
   return crc8(payloadP, payloadSize-1); // last byte of payload is CRC itself
 }
 
@@ -152,6 +156,32 @@ size_t Esp3Packet::acceptBytes(size_t aNumBytes, uint8_t *aBytes)
       byte = *replayP++;
       replayBytes--;
     }
+    else if (state==ps_syncwait) {
+      // burst: skip everything up to next potential sync byte at once
+      uint8_t *syncP = (uint8_t *)memchr(aBytes, 0x55, aNumBytes-acceptedBytes);
+      if (!syncP) {
+        // no sync byte in the entire remaining buffer
+        return aNumBytes;
+      }
+      acceptedBytes += syncP-aBytes+1;
+      aBytes = syncP+1;
+      byte = 0x55;
+    }
+    else if (state==ps_dataread) {
+      // burst: copy as much of the payload as available at once
+      size_t n = payloadSize-dataIndex;
+      if (n>aNumBytes-acceptedBytes) n = aNumBytes-acceptedBytes;
+      if (n>1) {
+        // all but the last byte are just stored, last one is handled below
+        memcpy(payloadP+dataIndex, aBytes, n-1);
+        dataIndex += n-1;
+        aBytes += n-1;
+        acceptedBytes += n-1;
+      }
+      byte = *aBytes;
+      aBytes++;
+      acceptedBytes++;
+    }
     else {
       // process a new byte
       byte = *aBytes;
@@ -188,7 +218,11 @@ size_t Esp3Packet::acceptBytes(size_t aNumBytes, uint8_t *aBytes)
           else {
             // CRC matches, now read data
             // - make sure we have a buffer according to dataLength() and optDataLength()
-            data();
+            if (!data()) {
+              // oversize packet, discard and start scanning for packet at next byte
+              clear();
+              break;
+            }
             dataIndex = 0; // start of data read
             // - enter payload read state
             state = ps_dataread;
@@ -229,14 +263,18 @@ uint8_t *Esp3Packet::data()
 {
   size_t s = dataLength()+optDataLength()+1; // one byte extra for CRC
   if (s!=payloadSize || !payloadP) {
-    if (payloadSize>300) {
+    if (s>300) {
       // safety - prevent huge telegrams
       clearData();
       return NULL;
     }
     payloadSize = s;
-    if (payloadP) delete [] payloadP;
-    payloadP = new uint8_t[payloadSize];
+    if (payloadSize>payloadCapacity || !payloadP) {
+      // existing buffer (if any) too small, allocate new one
+      if (payloadP) delete [] payloadP;
+      payloadCapacity = payloadSize<ESP3_MIN_PAYLOAD_CAPACITY ? ESP3_MIN_PAYLOAD_CAPACITY : payloadSize;
+      payloadP = new uint8_t[payloadCapacity];
+    }
     memset(payloadP, 0, payloadSize); // zero out
   }
   return payloadP;
@@ -264,7 +302,7 @@ void Esp3Packet::finalize()
     // assign header CRC
     header[ESP3_HEADERBYTES-1] = headerCRC();
     // assign payload CRC
-    if (payloadP) {
+    if (payloadP && payloadSize>0) {
       payloadP[payloadSize-1] = payloadCRC();
     }
     // packet is complete now
@@ -938,6 +976,22 @@ const char *EnoceanComm::manufacturerName(EnoceanManufacturer aManufacturerCode)
 
 #define ENOCEAN_ESP3_COMMAND_TIMEOUT (3*Second)
 
+// default max number of radio telegrams sent to the modem without having received the response yet
+// Note: ESP3 has no flow control; the TCM310 answers a radio telegram once it has taken it into its
+//   transmit buffer. The buffer depth is not specified, so this is a conservative value, not a datasheet
+//   figure: 2 lets the serial transfer of a telegram overlap with the radio transmission of the previous
+//   one, while more urgent commands queued later do not have to wait behind a long pipeline.
+//   Can be changed with setMaxPipelined() (--enoceanpipeline), 1 disables pipelining.
+#define ENOCEAN_ESP3_MAX_PIPELINED 2
+
+// after a command timeout, responses arriving within this time are considered late responses to
+// timed out commands and discarded, and no new commands are sent meanwhile
+#define ENOCEAN_ESP3_RESYNC_TIME (500*MilliSecond)
+
+// commands of a less urgent priority class waiting longer than this are sent before more urgent ones
+// queued after them, so a steady flow of outputs cannot starve housekeeping (such as alive checks)
+#define ENOCEAN_ESP3_MAX_QUEUE_WAIT (2*Second)
+
 #define ENOCEAN_INIT_RETRIES 5
 #define ENOCEAN_INIT_RETRY_INTERVAL (5*Second)
 
@@ -947,10 +1001,21 @@ EnoceanComm::EnoceanComm(MainLoop &aMainLoop) :
 	inherited(aMainLoop),
   aliveCheckTicket(0),
   cmdTimeoutTicket(0),
+  maxPipelined(ENOCEAN_ESP3_MAX_PIPELINED),
+  resyncUntil(Never),
+  resyncTicket(0),
+  metricsP(NULL),
   apiVersion(0),
   appVersion(0),
   myAddress(0),
-  myIdBase(0)
+  myIdBase(0),
+  packetsReceived(0),
+  packetAllocations(0),
+  replayRemaining(0),
+  replayPackets(0),
+  replayAllocations(0),
+  replayDuration(0),
+  replayTicket(0)
 {
 }
 
@@ -959,6 +1024,8 @@ EnoceanComm::~EnoceanComm()
 {
   MainLoop::currentMainLoop().cancelExecutionTicket(aliveCheckTicket);
   MainLoop::currentMainLoop().cancelExecutionTicket(cmdTimeoutTicket);
+  MainLoop::currentMainLoop().cancelExecutionTicket(resyncTicket);
+  MainLoop::currentMainLoop().cancelExecutionTicket(replayTicket);
 }
 
 
@@ -1086,6 +1153,7 @@ void EnoceanComm::aliveCheckResponse(Esp3PacketPtr aEsp3PacketPtr, ErrorPtr aErr
     if (aEsp3PacketPtr->dataLength()!=33) {
       FOCUSLOG("Alive check received packet after sending CO_RD_VERSION, but hat wrong data length (%zu instead of 33)", aEsp3PacketPtr->dataLength());
     }
+    LOG(LOG_INFO, "EnoceanComm: alive check ok, %s", rxStatistics().c_str());
     // also schedule the next alive check
     aliveCheckTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&EnoceanComm::aliveCheck, this), ENOCEAN_ESP3_ALIVECHECK_INTERVAL);
   }
@@ -1125,18 +1193,33 @@ size_t EnoceanComm::acceptBytes(size_t aNumBytes, uint8_t *aBytes)
     }
     FOCUSLOG("%s",d.c_str());
   }
+  return parseBytes(aNumBytes, aBytes, currentIncomingPacket, true);
+}
+
+
+size_t EnoceanComm::parseBytes(size_t aNumBytes, uint8_t *aBytes, Esp3PacketPtr &aIncomingPacket, bool aDispatch)
+{
+  // real and replayed packets are counted separately
+  long &packets = aDispatch ? packetsReceived : replayPackets;
+  long &allocations = aDispatch ? packetAllocations : replayAllocations;
 	size_t remainingBytes = aNumBytes;
 	while (remainingBytes>0) {
-		if (!currentIncomingPacket) {
-			currentIncomingPacket = Esp3PacketPtr(new Esp3Packet);
+		if (!aIncomingPacket) {
+			aIncomingPacket = newIncomingPacket(allocations);
 		}
 		// pass bytes to current telegram
-		size_t consumedBytes = currentIncomingPacket->acceptBytes(remainingBytes, aBytes);
-		if (currentIncomingPacket->isComplete()) {
-      FOCUSLOG("Received Enocean Packet:\n%s", currentIncomingPacket->description().c_str());
-      dispatchPacket(currentIncomingPacket);
-      // forget the packet, further incoming bytes will create new packet
-			currentIncomingPacket = Esp3PacketPtr(); // forget
+		size_t consumedBytes = aIncomingPacket->acceptBytes(remainingBytes, aBytes);
+		if (aIncomingPacket->isComplete()) {
+      packets++;
+      Esp3PacketPtr packet = aIncomingPacket;
+      // further incoming bytes will go to a new (or recycled) packet
+      aIncomingPacket.reset();
+      if (aDispatch) {
+        FOCUSLOG("Received Enocean Packet:\n%s", packet->description().c_str());
+        dispatchPacket(packet);
+      }
+      // packet is processed now, recycle it
+      recyclePacket(packet);
 		}
 		// continue with rest (if any)
 		aBytes+=consumedBytes;
@@ -1146,6 +1229,83 @@ size_t EnoceanComm::acceptBytes(size_t aNumBytes, uint8_t *aBytes)
 }
 
 
+// max number of packets kept for re-use
+#define ESP3_PACKET_POOL_SIZE 4
+
+Esp3PacketPtr EnoceanComm::newIncomingPacket(long &aAllocations)
+{
+  if (!packetPool.empty()) {
+    Esp3PacketPtr packet = packetPool.back();
+    packetPool.pop_back();
+    return packet;
+  }
+  aAllocations++;
+  return Esp3PacketPtr(new Esp3Packet);
+}
+
+
+void EnoceanComm::recyclePacket(Esp3PacketPtr &aPacket)
+{
+  // Note: packet handlers must not keep references to received packets (see ESPPacketCB), so a
+  //   processed packet can be re-used for receiving
+  if (packetPool.size()<ESP3_PACKET_POOL_SIZE) {
+    aPacket->clear();
+    packetPool.push_back(aPacket);
+  }
+  aPacket.reset();
+}
+
+
+// number of replayed bytes parsed in one main loop cycle before yielding
+#define REPLAY_SLICE_BYTES 16384
+
+void EnoceanComm::replayBenchmark(const string &aEsp3Data, int aRepeat, ReplayBenchmarkCB aDoneCB)
+{
+  replayData = aEsp3Data;
+  replayRemaining = aRepeat;
+  replayPackets = 0;
+  replayAllocations = 0;
+  replayDuration = 0;
+  replayDoneCB = aDoneCB;
+  replayNext();
+}
+
+
+void EnoceanComm::replayNext()
+{
+  replayTicket = 0;
+  // replay a slice, then let the main loop run (real reception uses its own incoming packet, so it does not mix with the replay)
+  size_t sliceBytes = 0;
+  MLMicroSeconds startTime = MainLoop::now();
+  while (replayRemaining>0 && sliceBytes<REPLAY_SLICE_BYTES) {
+    parseBytes(replayData.size(), (uint8_t *)replayData.c_str(), replayPacket, false);
+    sliceBytes += replayData.size();
+    replayRemaining--;
+  }
+  replayDuration += MainLoop::now()-startTime;
+  if (replayRemaining>0) {
+    replayTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&EnoceanComm::replayNext, this), 0);
+    return;
+  }
+  // discard incomplete replay data
+  if (replayPacket) recyclePacket(replayPacket);
+  replayData.clear();
+  ReplayBenchmarkCB cb = replayDoneCB;
+  replayDoneCB = NULL;
+  cb(replayDuration, replayPackets, replayAllocations);
+}
+
+
+string EnoceanComm::rxStatistics()
+{
+  return string_format(
+    "%ld packets received, %ld packet allocations (%.3f per packet)",
+    packetsReceived, packetAllocations,
+    packetsReceived>0 ? (double)packetAllocations/packetsReceived : 0.0
+  );
+}
+
+
 void EnoceanComm::dispatchPacket(Esp3PacketPtr aPacket)
 {
   // dispatch the packet
@@ -1159,23 +1319,26 @@ void EnoceanComm::dispatchPacket(Esp3PacketPtr aPacket)
   }
   else if (pt==pt_response) {
     // This is a command response
-    // - stop timeout
-    MainLoop::currentMainLoop().cancelExecutionTicket(cmdTimeoutTicket);
-    // - this is a command response
-    if (cmdQueue.empty() || cmdQueue.front().commandPacket) {
+    if (resyncUntil!=Never) {
+      // late response to a command that has timed out, must not be matched to a newer command
+      LOG(LOG_INFO, "Discarded late ESP3 response packet after command timeout");
+      if (metricsP) metricsP->count("enocean.lateresponse");
+    }
+    else if (pendingCmds.empty()) {
       // received unexpected answer
       LOG(LOG_WARNING, "Received unexpected ESP3 response packet of length %zu", aPacket->dataLength());
     }
     else {
-      // must be response to first entry in queue
-      // - deliver to waiting callback, if any
-      ESPPacketCB callback = cmdQueue.front().responseCB;
-      // - remove waiting marker from queue
-      cmdQueue.pop_front();
+      // responses arrive in order of sending, so this must be the response to the oldest pending command
+      EnoceanCmd cmd = pendingCmds.front();
+      pendingCmds.pop_front();
+      // - timeout now applies to next pending command, if any
+      startCmdTimeout();
+      if (metricsP) metricsP->recordLatency("enocean.response", MainLoop::now()-cmd.sentAt);
       // - now call handler
-      if (callback) {
+      if (cmd.responseCB) {
         // pass packet and response status
-        callback(aPacket, aPacket->responseStatus());
+        cmd.responseCB(aPacket, aPacket->responseStatus());
       }
       // check if more commands in queue to be sent
       checkCmdQueue();
@@ -1222,53 +1385,116 @@ void EnoceanComm::sendPacket(Esp3PacketPtr aPacket)
 
 
 
-void EnoceanComm::sendCommand(Esp3PacketPtr aCommandPacket, ESPPacketCB aResponsePacketCB)
+static const char *cmdPriorityNames[numCmdPriorities] = { "output", "learn", "housekeeping" };
+
+
+void EnoceanComm::sendCommand(Esp3PacketPtr aCommandPacket, ESPPacketCB aResponsePacketCB, EnoceanCmdPriority aPriority)
 {
   // queue command
   EnoceanCmd cmd;
   cmd.commandPacket = aCommandPacket;
   cmd.responseCB = aResponsePacketCB;
-  cmdQueue.push_back(cmd);
+  cmd.priority = aPriority;
+  cmd.queuedAt = MainLoop::now();
+  cmd.sentAt = Never;
+  cmdQueues[aPriority].push_back(cmd);
   checkCmdQueue();
 }
 
 
+void EnoceanComm::setMaxPipelined(int aMaxPipelined)
+{
+  maxPipelined = aMaxPipelined<1 ? 1 : aMaxPipelined;
+}
+
+
 void EnoceanComm::checkCmdQueue()
 {
-  if (cmdQueue.empty()) return; // queue empty
-  EnoceanCmd cmd = cmdQueue.front();
-  if (cmd.commandPacket) {
-    // front is command to be sent -> send it
+  if (resyncUntil!=Never) return; // no commands until late responses are out of the way
+  while (true) {
+    // find most urgent command waiting to be sent, unless a less urgent one has waited too long
+    MLMicroSeconds now = MainLoop::now();
+    int prio = numCmdPriorities;
+    for (int p=0; p<numCmdPriorities; p++) {
+      if (cmdQueues[p].empty()) continue;
+      if (prio>=numCmdPriorities) {
+        prio = p; // most urgent class with commands waiting
+      }
+      else if (
+        now-cmdQueues[p].front().queuedAt>ENOCEAN_ESP3_MAX_QUEUE_WAIT &&
+        cmdQueues[p].front().queuedAt<cmdQueues[prio].front().queuedAt
+      ) {
+        prio = p; // aged: overdue and queued before the more urgent one
+      }
+    }
+    if (prio>=numCmdPriorities) return; // all queues empty
+    EnoceanCmdList &queue = cmdQueues[prio];
+    if (!pendingCmds.empty()) {
+      // modem has not yet answered everything sent so far.
+      // Only radio telegrams may be pipelined, and only behind other radio telegrams
+      if (
+        (int)pendingCmds.size()>=maxPipelined ||
+        queue.front().commandPacket->packetType()!=pt_radio ||
+        pendingCmds.front().commandPacket->packetType()!=pt_radio
+      ) {
+        return; // must wait for response(s) first
+      }
+    }
+    // send it
+    EnoceanCmd &cmd = queue.front();
+    cmd.sentAt = MainLoop::now();
+    if (metricsP) metricsP->recordLatency(string("enocean.queue.")+cmdPriorityNames[prio], cmd.sentAt-cmd.queuedAt);
     sendPacket(cmd.commandPacket);
-    // remove original entry, put waiting-for-response marker there instead
-    cmd.commandPacket.reset(); // clear out, marks this entry for "waiting for response"
-    cmdQueue.pop_front();
-    cmdQueue.push_front(cmd);
-    // schedule timeout
-    cmdTimeoutTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&EnoceanComm::cmdTimeout, this), ENOCEAN_ESP3_COMMAND_TIMEOUT);
+    // move to list of commands waiting for response
+    bool wasIdle = pendingCmds.empty();
+    pendingCmds.splice(pendingCmds.end(), queue, queue.begin());
+    // schedule timeout if this is the only pending command
+    if (wasIdle) startCmdTimeout();
   }
 }
 
 
+void EnoceanComm::startCmdTimeout()
+{
+  MainLoop::currentMainLoop().cancelExecutionTicket(cmdTimeoutTicket);
+  if (pendingCmds.empty()) return; // nothing to time out
+  // timeout is counted from when the oldest pending command was sent
+  MLMicroSeconds remaining = pendingCmds.front().sentAt+ENOCEAN_ESP3_COMMAND_TIMEOUT-MainLoop::now();
+  cmdTimeoutTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&EnoceanComm::cmdTimeout, this), remaining>0 ? remaining : 0);
+}
+
+
 void EnoceanComm::cmdTimeout()
 {
-  // currently waiting command has timed out
-  if (cmdQueue.empty()) return; // queue empty -> NOP (should not happen, no timeout should be running when queue is empty!)
-  EnoceanCmd cmd = cmdQueue.front();
-  // Note: commandPacket should always be NULL here (because we are waiting for a response)
-  if (!cmd.commandPacket) {
-    // done with this command
-    // - remove from queue
-    cmdQueue.pop_front();
-    // - now call handler with error
-    if (cmd.responseCB) {
-      cmd.responseCB(Esp3PacketPtr(), ErrorPtr(new EnoceanCommError(EnoceanCommErrorCmdTimeout)));
+  cmdTimeoutTicket = 0;
+  // oldest pending command has timed out
+  if (pendingCmds.empty()) return; // nothing pending -> NOP (should not happen, no timeout should be running then)
+  if (metricsP) metricsP->count("enocean.timeout");
+  // responses are only matched by order, so after a missing response the responses to commands
+  // pipelined behind it (and a possible late one) can no longer be assigned reliably:
+  // - fail all pending commands
+  EnoceanCmdList timedOut;
+  timedOut.swap(pendingCmds);
+  // - discard responses for a while before sending again
+  resyncUntil = MainLoop::now()+ENOCEAN_ESP3_RESYNC_TIME;
+  resyncTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&EnoceanComm::resyncDone, this), ENOCEAN_ESP3_RESYNC_TIME);
+  LOG(LOG_WARNING, "EnoceanComm: command timeout, failing %zu pending command(s), resynchronizing", timedOut.size());
+  // - now call handlers with error
+  for (EnoceanCmdList::iterator pos = timedOut.begin(); pos!=timedOut.end(); ++pos) {
+    if (pos->responseCB) {
+      pos->responseCB(Esp3PacketPtr(), ErrorPtr(new EnoceanCommError(EnoceanCommErrorCmdTimeout)));
     }
   }
-  // check if more commands in queue to be sent
-  checkCmdQueue();
 }
 
 
+void EnoceanComm::resyncDone()
+{
+  resyncTicket = 0;
+  resyncUntil = Never;
+  // resume sending queued commands
+  checkCmdQueue();
+}
+
 
 
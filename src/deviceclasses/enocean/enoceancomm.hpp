@@ -27,6 +27,8 @@
 #include "serialqueue.hpp"
 #include "digitalio.hpp"
 
+#include "vdcmetrics.hpp"
+
 using namespace std;
 
 namespace p44 {
@@ -181,6 +183,7 @@ namespace p44 {
     uint8_t header[6]; ///< the ESP3 header
     uint8_t *payloadP; ///< the payload or NULL if none defined
     size_t payloadSize; ///< the payload size
+    size_t payloadCapacity; ///< the allocated size of the payload buffer (kept across clear() for re-use)
     // scanner
     PacketState state; ///< scanning state
     size_t dataIndex; ///< data scanner index
@@ -205,14 +208,16 @@ namespace p44 {
 
     /// clear the packet so that we can re-start accepting bytes and looking for packet start or
     /// start filling in information for creating an outgoing packet
+    /// @note the payload buffer remains allocated for re-use
     void clear();
-    /// clear only the payload data/optdata (implicitly happens at setDataLength() and setOptDataLength()
+    /// clear the payload data/optdata and free the payload buffer (used to discard oversize packets)
     void clearData();
 
     /// check if packet is complete
     bool isComplete();
 
     /// swallow bytes until packet is complete
+    /// @note bytes before a sync byte and payload bytes are consumed in bursts, not one by one
     /// @param aNumBytes number of bytes ready for accepting
     /// @param aBytes pointer to bytes buffer
     /// @return number of bytes operation could accept, 0 if none (means that packet is already complete)
@@ -380,13 +385,30 @@ namespace p44 {
 
   };
 
+  /// callback for received ESP3 packets
+  /// @note received packets are recycled for receiving further packets after the callback returns,
+  ///   so handlers must not keep a reference to aEsp3PacketPtr beyond the callback
+  typedef boost::function<void (Esp3PacketPtr aEsp3PacketPtr, ErrorPtr aError)> ESPPacketCB;
 
+  /// callback for replay benchmark results
+  typedef boost::function<void (MLMicroSeconds aDuration, long aPackets, long aAllocations)> ReplayBenchmarkCB;
 
-  typedef boost::function<void (Esp3PacketPtr aEsp3PacketPtr, ErrorPtr aError)> ESPPacketCB;
+  typedef std::vector<Esp3PacketPtr> Esp3PacketVector;
+
+  /// priority classes for commands sent to the modem, lower values are sent first
+  typedef enum {
+    cmdprio_output, ///< user visible actuator output (scene calls, dimming, remote control buttons)
+    cmdprio_learn, ///< teach-in/learn responses
+    cmdprio_housekeeping, ///< modem management such as version and ID base reads or alive checks
+    numCmdPriorities
+  } EnoceanCmdPriority;
 
   typedef struct {
-    Esp3PacketPtr commandPacket; ///< packet to send. If empty, this means we are waiting for the response
+    Esp3PacketPtr commandPacket; ///< packet to send
     ESPPacketCB responseCB; ///< callback to call when response arrives
+    EnoceanCmdPriority priority; ///< priority class
+    MLMicroSeconds queuedAt; ///< when the command was queued
+    MLMicroSeconds sentAt; ///< when the command was sent to the modem
   } EnoceanCmd;
 
   typedef std::list<EnoceanCmd> EnoceanCmdList;
@@ -398,8 +420,23 @@ namespace p44 {
 		typedef SerialOperationQueue inherited;
 		
 		Esp3PacketPtr currentIncomingPacket;
+    Esp3PacketVector packetPool; ///< recycled packets for receiving
     ESPPacketCB radioPacketHandler;
 
+    // receive statistics
+    long packetsReceived; ///< number of complete packets received
+    long packetAllocations; ///< number of packet objects allocated for receiving
+
+    // replay benchmark
+    Esp3PacketPtr replayPacket; ///< packet being parsed from replayed data (separate from currentIncomingPacket)
+    string replayData; ///< ESP3 byte stream being replayed
+    int replayRemaining; ///< number of replays still to do
+    long replayPackets; ///< number of complete packets parsed from replayed data
+    long replayAllocations; ///< number of packet objects allocated for replayed data
+    MLMicroSeconds replayDuration; ///< time spent parsing replayed data, not including main loop cycles in between
+    ReplayBenchmarkCB replayDoneCB; ///< set while a replay is in progress
+    long replayTicket; ///< for continuing the replay in the next main loop cycle
+
     DigitalIoPtr enoceanResetPin;
     long aliveCheckTicket;
 
@@ -409,9 +446,14 @@ namespace p44 {
     EnoceanAddress myAddress; ///< real EnOcean module address
     EnoceanAddress myIdBase; ///< base address for creating other sender addresses than my own module address (e.g. to simulate switches to control actors)
 
-    // Command queue
-    EnoceanCmdList cmdQueue; ///< commands awaiting send or receive
-    long cmdTimeoutTicket; ///< timeout for waiting for command response
+    // Command queues
+    EnoceanCmdList cmdQueues[numCmdPriorities]; ///< commands awaiting send, one queue per priority class
+    EnoceanCmdList pendingCmds; ///< commands sent to the modem and awaiting response, in order of sending
+    long cmdTimeoutTicket; ///< timeout for waiting for the response to the oldest pending command
+    int maxPipelined; ///< max number of radio telegrams sent without having received their responses
+    MLMicroSeconds resyncUntil; ///< set after a command timeout: responses are discarded and no commands sent until then, Never otherwise
+    long resyncTicket; ///< for ending resync
+    VdcMetrics *metricsP; ///< if set, per priority queue wait times are recorded here
 
 	public:
 		
@@ -449,6 +491,20 @@ namespace p44 {
     /// @return number of bytes parser could accept (normally, all)
     virtual size_t acceptBytes(size_t aNumBytes, uint8_t *aBytes);
 
+    /// @return receive statistics as a string (packets received, allocations per packet)
+    string rxStatistics();
+
+    /// replay a recorded ESP3 byte stream through the receive parser and packet pool, without dispatching the packets
+    /// @param aEsp3Data raw ESP3 byte stream (one or multiple packets)
+    /// @param aRepeat number of times to feed aEsp3Data
+    /// @param aDoneCB called with the parsing time (not including main loop cycles run in between),
+    ///   the number of complete packets parsed and the number of packet objects allocated
+    /// @note the replay is done in slices, giving the main loop a chance to run in between
+    void replayBenchmark(const string &aEsp3Data, int aRepeat, ReplayBenchmarkCB aDoneCB);
+
+    /// @return true if a replay benchmark is in progress
+    bool replayInProgress() { return !replayDoneCB.empty(); }
+
     /// set callback to handle received radio packets
     /// @param aRadioPacketCB callback to deliver radio packets to
     void setRadioPacketHandler(ESPPacketCB aRadioPacketCB);
@@ -462,7 +518,19 @@ namespace p44 {
 
     /// send a command and await response
     /// @param aResponsePacketCB callback to deliver command response to
-    void sendCommand(Esp3PacketPtr aCommandPacket, ESPPacketCB aResponsePacketCB);
+    /// @param aPriority priority class. Commands of a more urgent class are sent before all queued commands of less urgent classes
+    /// @note radio telegrams are pipelined, i.e. sent without waiting for the response to previous radio telegrams,
+    ///   up to maxPipelined unanswered packets (see setMaxPipelined()). Other commands are only sent when nothing is pending.
+    ///   Commands of a less urgent class are sent first when they have been waiting for too long, to prevent starving.
+    void sendCommand(Esp3PacketPtr aCommandPacket, ESPPacketCB aResponsePacketCB, EnoceanCmdPriority aPriority = cmdprio_housekeeping);
+
+    /// set the max number of radio telegrams sent to the modem before their responses have arrived
+    /// @param aMaxPipelined max number of unanswered telegrams, 1 to disable pipelining
+    void setMaxPipelined(int aMaxPipelined);
+
+    /// set metrics collection
+    /// @param aMetricsP metrics collection, NULL for none
+    void setMetrics(VdcMetrics *aMetricsP) { metricsP = aMetricsP; };
 
     /// manufacturer name lookup
     /// @param aManufacturerCode EEP manufacturer code
@@ -489,7 +557,14 @@ namespace p44 {
     void reopenConnection();
 
     void checkCmdQueue();
+    void startCmdTimeout();
     void cmdTimeout();
+    void resyncDone();
+
+    size_t parseBytes(size_t aNumBytes, uint8_t *aBytes, Esp3PacketPtr &aIncomingPacket, bool aDispatch);
+    Esp3PacketPtr newIncomingPacket(long &aAllocations);
+    void recyclePacket(Esp3PacketPtr &aPacket);
+    void replayNext();
 
 	};
 
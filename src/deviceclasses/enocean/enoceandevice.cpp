@@ -239,7 +239,7 @@ void EnoceanDevice::sendOutgoingUpdate()
       outgoingEsp3Packet->finalize();
       ALOG(LOG_INFO, "sending outgoing EnOcean packet:\n%s", outgoingEsp3Packet->description().c_str());
       // send it
-      getEnoceanDeviceContainer().enoceanComm.sendCommand(outgoingEsp3Packet, NULL);
+      getEnoceanDeviceContainer().enoceanComm.sendCommand(outgoingEsp3Packet, NULL, cmdprio_output);
     }
   }
 }
@@ -21,6 +21,8 @@
 
 #include "enoceandevicecontainer.hpp"
 
+#include "enocean4bs.hpp"
+
 using namespace p44;
 
 
@@ -31,6 +33,7 @@ EnoceanDeviceContainer::EnoceanDeviceContainer(int aInstanceNumber, DeviceContai
   disableProximityCheck(false),
 	enoceanComm(MainLoop::currentMainLoop())
 {
+  enoceanComm.setMetrics(&aDeviceContainerP->getMetrics());
 }
 
 
@@ -246,6 +249,67 @@ ErrorPtr EnoceanDeviceContainer::handleMethod(VdcApiRequestPtr aRequest, const s
 
 
 
+// max number of stream replays and max stream size in one benchmark call (replay yields to the main loop between slices)
+#define REPLAY_BENCHMARK_MAX_REPEAT 100000
+#define REPLAY_BENCHMARK_MAX_DATA 4096
+// max number of corpus decodes and max corpus size in one decode benchmark call (runs on the main loop)
+#define DECODE_BENCHMARK_MAX_REPEAT 10000
+#define DECODE_BENCHMARK_MAX_TELEGRAMS 1000
+
+ErrorPtr EnoceanDeviceContainer::runBenchmark(const string &aBenchmark, ApiValuePtr aParams, ApiValuePtr aResult, StatusCB aCompletedCB)
+{
+  if (aBenchmark=="replay") {
+    // ESP3 byte stream, defaults to a single 1BS telegram
+    string esp3Data = hexToBinaryString("55000707017AF6300086B81A3003FFFFFFFFFF00C0");
+    int repeat = 1000;
+    ApiValuePtr o = aParams->get("data");
+    if (o) esp3Data = o->binaryValue();
+    o = aParams->get("repeat");
+    if (o) repeat = o->int32Value();
+    if (repeat<1 || repeat>REPLAY_BENCHMARK_MAX_REPEAT) {
+      return ErrorPtr(new WebError(400, string_format("repeat must be 1..%d", REPLAY_BENCHMARK_MAX_REPEAT)));
+    }
+    if (esp3Data.size()<1 || esp3Data.size()>REPLAY_BENCHMARK_MAX_DATA) {
+      return ErrorPtr(new WebError(400, string_format("data must be 1..%d bytes", REPLAY_BENCHMARK_MAX_DATA)));
+    }
+    if (enoceanComm.replayInProgress()) {
+      return ErrorPtr(new WebError(409, "replay benchmark already running"));
+    }
+    enoceanComm.replayBenchmark(esp3Data, repeat, boost::bind(&EnoceanDeviceContainer::replayBenchmarkDone, this, (uint64_t)esp3Data.size()*repeat, aResult, aCompletedCB, _1, _2, _3));
+    return ErrorPtr(); // aCompletedCB will be called
+  }
+  else if (aBenchmark=="decode") {
+    // 4BS telegram corpus, defaults to one synthetic telegram per table driven sensor profile
+    int repeat = 1000;
+    ApiValuePtr o = aParams->get("repeat");
+    if (o) repeat = o->int32Value();
+    if (repeat<1 || repeat>DECODE_BENCHMARK_MAX_REPEAT) {
+      return ErrorPtr(new WebError(400, string_format("repeat must be 1..%d", DECODE_BENCHMARK_MAX_REPEAT)));
+    }
+    ApiValuePtr telegrams = aParams->get("telegrams");
+    if (telegrams && telegrams->arrayLength()>DECODE_BENCHMARK_MAX_TELEGRAMS) {
+      return ErrorPtr(new WebError(400, string_format("max %d telegrams", DECODE_BENCHMARK_MAX_TELEGRAMS)));
+    }
+    Enocean4bsSensorHandler::decodeBenchmark(this, telegrams, repeat, aResult);
+    return Error::ok();
+  }
+  return inherited::runBenchmark(aBenchmark, aParams, aResult, aCompletedCB);
+}
+
+
+void EnoceanDeviceContainer::replayBenchmarkDone(uint64_t aBytes, ApiValuePtr aResult, StatusCB aCompletedCB, MLMicroSeconds aDuration, long aPackets, long aAllocations)
+{
+  aResult->add("bytes", aResult->newUint64(aBytes));
+  aResult->add("packets", aResult->newUint64(aPackets));
+  aResult->add("allocations", aResult->newUint64(aAllocations));
+  if (aPackets>0) {
+    aResult->add("usPerPacket", aResult->newDouble((double)aDuration/aPackets));
+  }
+  if (aCompletedCB) aCompletedCB(ErrorPtr());
+}
+
+
+
 ErrorPtr EnoceanDeviceContainer::addProfile(VdcApiRequestPtr aRequest, ApiValuePtr aParams)
 {
   // add an EnOcean profile
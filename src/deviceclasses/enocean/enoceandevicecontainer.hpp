@@ -113,6 +113,10 @@ namespace p44 {
     /// vdc level methods (p44 specific, JSON only, for configuring multichannel RGB(W) devices)
     virtual ErrorPtr handleMethod(VdcApiRequestPtr aRequest, const string &aMethod, ApiValuePtr aParams);
 
+    /// "replay" benchmark: feeds a recorded ESP3 byte stream through the receive parser
+    /// "decode" benchmark: decodes 4BS telegrams with scratch devices for table driven sensor profiles
+    virtual ErrorPtr runBenchmark(const string &aBenchmark, ApiValuePtr aParams, ApiValuePtr aResult, StatusCB aCompletedCB);
+
     /// @param aForget if set, all parameters stored for the device (if any) will be deleted. Note however that
     ///   the devices are not disconnected (=unlearned) by this.
     virtual void removeDevices(bool aForget);
@@ -169,6 +173,7 @@ namespace p44 {
     void handleTestRadioPacket(StatusCB aCompletedCB, Esp3PacketPtr aEsp3PacketPtr, ErrorPtr aError);
 
     ErrorPtr addProfile(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
+    void replayBenchmarkDone(uint64_t aBytes, ApiValuePtr aResult, StatusCB aCompletedCB, MLMicroSeconds aDuration, long aPackets, long aAllocations);
 
   };
 
@@ -84,7 +84,7 @@ void EnoceanRemoteControlDevice::buttonAction(bool aRight, bool aUp, bool aPress
     packet->setRadioStatus(status_T21); // released
   }
   packet->setRadioSender(getAddress()); // my own ID base derived address that is learned into this actor
-  getEnoceanDeviceContainer().enoceanComm.sendCommand(packet, NULL);
+  getEnoceanDeviceContainer().enoceanComm.sendCommand(packet, NULL, cmdprio_output);
 }
 
 
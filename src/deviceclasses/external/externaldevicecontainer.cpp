@@ -41,6 +41,7 @@ ExternalDevice::ExternalDevice(DeviceClassContainer *aClassContainerP, ExternalD
   tag(aTag),
   useMovement(false), // no movement by default
   querySync(false), // no sync query by default
+  useChannelsMessage(false), // separate message per channel by default
   configured(false),
   iconBaseName("ext"), // default icon name
   modelNameString("plan44 vdcd external device")
@@ -398,6 +399,8 @@ void ExternalDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
       cl->deriveColorMode();
     }
     // generic channel apply
+    string channelsText; // for simple text "channels" message
+    JsonObjectPtr channelsArr; // for JSON "channels" message
     for (size_t i=0; i<numChannels(); i++) {
       ChannelBehaviourPtr cb = getChannelByIndex(i);
       if (cb->needsApplying()) {
@@ -405,7 +408,22 @@ void ExternalDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
         double chval = cb->getChannelValue();
         chval = output->outputValueAccordingToMode(chval, i);
         // send channel value message
-        if (deviceConnector->simpletext) {
+        if (useChannelsMessage) {
+          // just collect, all changed channels will be sent together
+          if (deviceConnector->simpletext) {
+            if (!channelsText.empty()) channelsText += ",";
+            string_format_append(channelsText, "%zu:%lf", i, chval);
+          }
+          else {
+            if (!channelsArr) channelsArr = JsonObject::newArray();
+            JsonObjectPtr ch = JsonObject::newObj();
+            ch->add("index", JsonObject::newInt32((int)i));
+            ch->add("type", JsonObject::newInt32(cb->getChannelType())); // informational
+            ch->add("value", JsonObject::newDouble(cb->getChannelValue()));
+            channelsArr->arrayAppend(ch);
+          }
+        }
+        else if (deviceConnector->simpletext) {
           string m = string_format("C%zu=%lf", i, chval);
           sendDeviceApiSimpleMessage(m);
         }
@@ -420,6 +438,16 @@ void ExternalDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
         cb->channelValueApplied();
       }
     }
+    // send collected channels as one message
+    if (!channelsText.empty()) {
+      sendDeviceApiSimpleMessage("CS="+channelsText);
+    }
+    else if (channelsArr) {
+      JsonObjectPtr message = JsonObject::newObj();
+      message->add("message", JsonObject::newString("channels"));
+      message->add("channels", channelsArr);
+      sendDeviceApiJsonMessage(message);
+    }
   }
   inherited::applyChannelValues(aDoneCB, aForDimming);
 }
@@ -494,6 +522,7 @@ ErrorPtr ExternalDevice::configureDevice(JsonObjectPtr aInitParams)
   // options
   if (aInitParams->get("sync", o)) querySync = o->boolValue();
   if (aInitParams->get("move", o)) useMovement = o->boolValue();
+  if (aInitParams->get("channels", o)) useChannelsMessage = o->boolValue();
   // get unique ID
   if (!aInitParams->get("uniqueid", o)) {
     return TextError::err("missing 'uniqueid'");
@@ -57,6 +57,7 @@ namespace p44 {
     bool configured; ///< set when device is configured (init message received and device added to vdc)
     bool useMovement; ///< if set, device communication uses MV/move command for dimming and shadow device operation
     bool querySync; ///< if set, device is asked for synchronizing actual values of channels when needed (e.g. before saveScene)
+    bool useChannelsMessage; ///< if set, all channel changes of an apply are sent in a single "channels"/CS message
 
     SimpleCB syncedCB; ///< will be called when device confirms "SYNC" message with "SYNCED" response
 
@@ -129,8 +129,7 @@ void HueDevice::setName(const string &aName)
 void HueDevice::initializeDevice(StatusCB aCompletedCB, bool aFactoryReset)
 {
   // query light attributes and state
-  string url = string_format("/lights/%s", lightID.c_str());
-  hueComm().apiQuery(url.c_str(), boost::bind(&HueDevice::deviceStateReceived, this, aCompletedCB, aFactoryReset, _1, _2));
+  hueDeviceContainer().queryLightInfo(lightID, boost::bind(&HueDevice::deviceStateReceived, this, aCompletedCB, aFactoryReset, _1, _2));
 }
 
 
@@ -187,8 +186,7 @@ string HueDevice::hardwareGUID()
 void HueDevice::checkPresence(PresenceCB aPresenceResultHandler)
 {
   // query the device
-  string url = string_format("/lights/%s", lightID.c_str());
-  hueComm().apiQuery(url.c_str(), boost::bind(&HueDevice::presenceStateReceived, this, aPresenceResultHandler, _1, _2));
+  hueDeviceContainer().queryLightInfo(lightID, boost::bind(&HueDevice::presenceStateReceived, this, aPresenceResultHandler, _1, _2));
 }
 
 
@@ -244,7 +242,6 @@ void HueDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
     ColorLightBehaviourPtr cl = boost::dynamic_pointer_cast<ColorLightBehaviour>(l);
     MLMicroSeconds transitionTime = 0; // undefined so far
     // build hue API light state
-    string url = string_format("/lights/%s/state", lightID.c_str());
     JsonObjectPtr newState = JsonObject::newObj();
     // brightness is always re-applied unless it's dimming
     bool lightIsOn = true; // assume on
@@ -336,7 +333,7 @@ void HueDevice::applyChannelValues(SimpleCB aDoneCB, bool aForDimming)
     }
     // use transition time from (1/10 = 100mS second resolution)
     newState->add("transitiontime", JsonObject::newInt64(transitionTime/(100*MilliSecond)));
-    hueComm().apiAction(httpMethodPUT, url.c_str(), newState, boost::bind(&HueDevice::channelValuesSent, this, l, aDoneCB, _1, _2));
+    hueDeviceContainer().sendLightState(lightID, newState, boost::bind(&HueDevice::channelValuesSent, this, l, aDoneCB, _1, _2));
   }
 }
 
@@ -453,8 +450,7 @@ void HueDevice::parseLightState(JsonObjectPtr aDeviceInfo)
 void HueDevice::syncChannelValues(SimpleCB aDoneCB)
 {
   // query light attributes and state
-  string url = string_format("/lights/%s", lightID.c_str());
-  hueComm().apiQuery(url.c_str(), boost::bind(&HueDevice::channelValuesReceived, this, aDoneCB, _1, _2));
+  hueDeviceContainer().queryLightInfo(lightID, boost::bind(&HueDevice::channelValuesReceived, this, aDoneCB, _1, _2));
 }
 
 
@@ -25,10 +25,20 @@
 
 using namespace p44;
 
+// how long a /lights query result may be re-used to answer light info queries
+#define HUE_LIGHTSINFO_MAX_AGE (2*Second)
+// how many times a /lights query overtaken by light state changes is repeated before its result is used uncached
+#define HUE_MAX_STALE_LIGHTS_QUERIES 3
+
 
 HueDeviceContainer::HueDeviceContainer(int aInstanceNumber, DeviceContainer *aDeviceContainerP, int aTag) :
   inherited(aInstanceNumber, aDeviceContainerP, aTag),
-  hueComm()
+  hueComm(),
+  lightsQueryPending(false),
+  lightsInfoTime(Never),
+  staleLightsQueries(0),
+  lightStateBatchTicket(0),
+  lightStateGeneration(0)
 {
 }
 
@@ -108,7 +118,9 @@ void HueDeviceContainer::collectDevices(StatusCB aCompletedCB, bool aIncremental
   if (!aIncremental) {
     // full collect, remove all devices
     removeDevices(aClearSettings);
+    bridgeGroups.clear();
   }
+  lightsInfo.reset();
   // load hue bridge uuid and token
   sqlite3pp::query qry(db);
   if (qry.prepare("SELECT hueBridgeUUID, hueBridgeUser FROM globs")==SQLITE_OK) {
@@ -249,7 +261,9 @@ void HueDeviceContainer::collectedLightsHandler(JsonObjectPtr aResult, ErrorPtr
     aResult->resetKeyIteration();
     string lightID;
     JsonObjectPtr lightInfo;
+    std::list<string> allLights;
     while (aResult->nextKeyValue(lightID, lightInfo)) {
+      allLights.push_back(lightID);
       // create hue device
       if (lightInfo) {
         // pre 1.3 bridges, which do not know yet hue Lux, don't have the "state" -> no state == all lights have color (hue or living color)
@@ -274,6 +288,12 @@ void HueDeviceContainer::collectedLightsHandler(JsonObjectPtr aResult, ErrorPtr
         }
       }
     }
+    // group 0 is the built-in group containing all lights
+    bridgeGroups[lightsKey(allLights)] = "0";
+    // also get the groups configured in the bridge, these can be used to send identical light states with one request
+    LOG(LOG_INFO, "Querying hue bridge for groups...");
+    hueComm.apiQuery("/groups", boost::bind(&HueDeviceContainer::collectedGroupsHandler, this, _1, _2));
+    return;
   }
   // collect phase done
   if (collectedHandler)
@@ -282,6 +302,202 @@ void HueDeviceContainer::collectedLightsHandler(JsonObjectPtr aResult, ErrorPtr
 }
 
 
+void HueDeviceContainer::collectedGroupsHandler(JsonObjectPtr aResult, ErrorPtr aError)
+{
+  if (Error::isOK(aError) && aResult) {
+    // { "1": { "name": "Group 1", "lights": [ "1", "2" ], ... }, "2": ... }
+    // Note: bridges not delivering "lights" in the group list are not supported, groups will just not be used then
+    aResult->resetKeyIteration();
+    string groupID;
+    JsonObjectPtr groupInfo;
+    while (aResult->nextKeyValue(groupID, groupInfo)) {
+      JsonObjectPtr l = groupInfo ? groupInfo->get("lights") : JsonObjectPtr();
+      if (!l || l->arrayLength()<2) continue; // groups with less than 2 lights are useless for batching
+      std::list<string> lights;
+      for (int i=0; i<l->arrayLength(); i++) {
+        lights.push_back(l->arrayGet(i)->stringValue());
+      }
+      string key = lightsKey(lights);
+      if (bridgeGroups.find(key)==bridgeGroups.end()) {
+        LOG(LOG_INFO, "- hue bridge group %s contains lights %s, can be used for batching", groupID.c_str(), key.c_str());
+        bridgeGroups[key] = groupID;
+      }
+    }
+  }
+  // collect phase done
+  if (collectedHandler)
+    collectedHandler(ErrorPtr());
+  collectedHandler = NULL; // done
+}
+
+
+
+#pragma mark - light state reading and writing
+
+
+string HueDeviceContainer::lightsKey(std::list<string> aLightIDs)
+{
+  aLightIDs.sort();
+  string key;
+  for (std::list<string>::iterator pos = aLightIDs.begin(); pos!=aLightIDs.end(); ++pos) {
+    if (!key.empty()) key += ",";
+    key += *pos;
+  }
+  return key;
+}
+
+
+void HueDeviceContainer::queryLightInfo(const string &aLightID, HueApiResultCB aResultCB)
+{
+  // use recent /lights result if possible
+  if (lightsInfo && MainLoop::now()<lightsInfoTime+HUE_LIGHTSINFO_MAX_AGE) {
+    JsonObjectPtr info = lightsInfo->get(aLightID.c_str());
+    if (info && info->get("state")) {
+      aResultCB(info, ErrorPtr());
+      return;
+    }
+  }
+  // join next /lights query
+  lightInfoWaiters.push_back(make_pair(aLightID, aResultCB));
+  if (!lightsQueryPending) {
+    lightsQueryPending = true;
+    // let other requests made in this mainloop cycle join
+    MainLoop::currentMainLoop().executeOnce(boost::bind(&HueDeviceContainer::queryLights, this), 0);
+  }
+}
+
+
+void HueDeviceContainer::queryLights()
+{
+  hueComm.apiQuery("/lights", boost::bind(&HueDeviceContainer::lightsQueryHandler, this, lightStateGeneration, _1, _2));
+}
+
+
+void HueDeviceContainer::lightsQueryHandler(uint32_t aGeneration, JsonObjectPtr aResult, ErrorPtr aError)
+{
+  bool stale = aGeneration!=lightStateGeneration;
+  if (stale && Error::isOK(aError) && staleLightsQueries<HUE_MAX_STALE_LIGHTS_QUERIES) {
+    // light states were sent or confirmed while the query was in progress, result may predate them
+    staleLightsQueries++;
+    LOG(LOG_INFO, "hue /lights result may be older than light states sent meanwhile -> querying again");
+    queryLights();
+    return;
+  }
+  staleLightsQueries = 0;
+  lightsQueryPending = false;
+  if (Error::isOK(aError) && aResult && !stale) {
+    // only cache results not overtaken by light state changes
+    lightsInfo = aResult;
+    lightsInfoTime = MainLoop::now();
+  }
+  // serve all waiting requests
+  LightInfoWaiterList waiters;
+  waiters.swap(lightInfoWaiters);
+  for (LightInfoWaiterList::iterator pos = waiters.begin(); pos!=waiters.end(); ++pos) {
+    JsonObjectPtr info;
+    if (Error::isOK(aError) && aResult) info = aResult->get(pos->first.c_str());
+    if (info && info->get("state")) {
+      pos->second(info, ErrorPtr());
+    }
+    else if (!Error::isOK(aError)) {
+      pos->second(JsonObjectPtr(), aError);
+    }
+    else {
+      // pre-1.3 bridges do not deliver state in /lights, query light individually
+      string url = string_format("/lights/%s", pos->first.c_str());
+      hueComm.apiQuery(url.c_str(), pos->second);
+    }
+  }
+}
+
+
+static void chainedLightStateResult(HueApiResultCB aFirstCB, HueApiResultCB aSecondCB, JsonObjectPtr aResult, ErrorPtr aError)
+{
+  if (aFirstCB) aFirstCB(aResult, aError);
+  if (aSecondCB) aSecondCB(aResult, aError);
+}
+
+
+void HueDeviceContainer::sendLightState(const string &aLightID, JsonObjectPtr aState, HueApiResultCB aResultCB)
+{
+  // a newer state for a light already in the batch supersedes the older one
+  for (PendingLightStateList::iterator pos = pendingLightStates.begin(); pos!=pendingLightStates.end(); ++pos) {
+    if (pos->lightID==aLightID) {
+      pos->state = aState;
+      pos->resultCB = boost::bind(&chainedLightStateResult, pos->resultCB, aResultCB, _1, _2);
+      return;
+    }
+  }
+  PendingLightState pls;
+  pls.lightID = aLightID;
+  pls.state = aState;
+  pls.resultCB = aResultCB;
+  pendingLightStates.push_back(pls);
+  if (!lightStateBatchTicket) {
+    // send at end of this mainloop cycle, when all lights affected by the same scene call have been applied
+    lightStateBatchTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&HueDeviceContainer::sendLightStateBatch, this), 0);
+  }
+}
+
+
+void HueDeviceContainer::sendLightStateBatch()
+{
+  lightStateBatchTicket = 0;
+  lightsInfo.reset(); // states are changing, cached light info is no longer valid
+  lightStateGeneration++; // /lights queries in progress may return the old states
+  while (!pendingLightStates.empty()) {
+    // collect all lights getting the same state as the first one
+    string state = pendingLightStates.front().state->c_strValue();
+    PendingLightStateList sameState;
+    std::list<string> lights;
+    PendingLightStateList::iterator pos = pendingLightStates.begin();
+    while (pos!=pendingLightStates.end()) {
+      if (state==pos->state->c_strValue()) {
+        sameState.push_back(*pos);
+        lights.push_back(pos->lightID);
+        pos = pendingLightStates.erase(pos);
+      }
+      else {
+        ++pos;
+      }
+    }
+    // check for a bridge group containing exactly these lights
+    GroupsMap::iterator grp = bridgeGroups.end();
+    if (sameState.size()>1) grp = bridgeGroups.find(lightsKey(lights));
+    if (grp!=bridgeGroups.end()) {
+      LOG(LOG_INFO, "sending same light state to %d lights via hue group %s", (int)sameState.size(), grp->second.c_str());
+      string url = string_format("/groups/%s/action", grp->second.c_str());
+      hueComm.apiAction(httpMethodPUT, url.c_str(), sameState.front().state, boost::bind(&HueDeviceContainer::lightStateBatchSent, this, sameState, _1, _2));
+    }
+    else {
+      // send individually
+      for (pos = sameState.begin(); pos!=sameState.end(); ++pos) {
+        string url = string_format("/lights/%s/state", pos->lightID.c_str());
+        hueComm.apiAction(httpMethodPUT, url.c_str(), pos->state, boost::bind(&HueDeviceContainer::lightStateSent, this, pos->resultCB, _1, _2));
+      }
+    }
+  }
+}
+
+
+void HueDeviceContainer::lightStateSent(HueApiResultCB aResultCB, JsonObjectPtr aResult, ErrorPtr aError)
+{
+  // bridge has applied the state now, /lights queries issued before may not reflect it
+  lightStateGeneration++;
+  if (aResultCB) aResultCB(aResult, aError);
+}
+
+
+void HueDeviceContainer::lightStateBatchSent(PendingLightStateList aSentStates, JsonObjectPtr aResult, ErrorPtr aError)
+{
+  lightStateGeneration++; // see lightStateSent()
+  // group action result contains the same success items as single light state changes (only with group path)
+  for (PendingLightStateList::iterator pos = aSentStates.begin(); pos!=aSentStates.end(); ++pos) {
+    if (pos->resultCB) pos->resultCB(aResult, aError);
+  }
+}
+
+
 
 
 
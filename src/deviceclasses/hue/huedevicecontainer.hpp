@@ -66,6 +66,35 @@ namespace p44 {
 
     /// @}
 
+    /// @name light state read coalescing
+    /// @{
+
+    typedef std::list< std::pair<string, HueApiResultCB> > LightInfoWaiterList;
+    LightInfoWaiterList lightInfoWaiters; ///< requests waiting for the /lights query in progress
+    bool lightsQueryPending; ///< set while a /lights query is in progress
+    JsonObjectPtr lightsInfo; ///< last /lights query result
+    MLMicroSeconds lightsInfoTime; ///< when lightsInfo was received, Never if invalid
+    int staleLightsQueries; ///< number of times the current /lights query was repeated because light states changed meanwhile
+
+    /// @}
+
+    /// @name light state write batching
+    /// @{
+
+    typedef struct {
+      string lightID; ///< the light
+      JsonObjectPtr state; ///< the new state to send
+      HueApiResultCB resultCB; ///< callback for the result of sending the state
+    } PendingLightState;
+    typedef std::list<PendingLightState> PendingLightStateList;
+    PendingLightStateList pendingLightStates; ///< light states to be sent at the end of this mainloop cycle
+    long lightStateBatchTicket; ///< ticket for sending the light state batch
+    uint32_t lightStateGeneration; ///< incremented whenever light states are sent or confirmed, to detect outdated /lights results
+    typedef std::map<string, string> GroupsMap;
+    GroupsMap bridgeGroups; ///< maps sorted, comma separated light ID lists to the bridge group ID addressing exactly these lights
+
+    /// @}
+
   public:
 
     HueDeviceContainer(int aInstanceNumber, DeviceContainer *aDeviceContainerP, int aTag);
@@ -109,12 +138,34 @@ namespace p44 {
     /// @return string, single line extra info describing aspects of the device not visible elsewhere
     virtual string getExtraInfo();
 
+    /// query the info (including state) of a light
+    /// @param aLightID the light ID as used in the bridge
+    /// @param aResultCB will be called with the info object for the light (as in a /lights/<id> query)
+    /// @note requests for all lights made in the same mainloop cycle or while a query is in progress are served
+    ///   by a single /lights query. A recent /lights result is re-used unless light states were sent since.
+    void queryLightInfo(const string &aLightID, HueApiResultCB aResultCB);
+
+    /// send new state to a light
+    /// @param aLightID the light ID as used in the bridge
+    /// @param aState the new state (body of a /lights/<id>/state PUT)
+    /// @param aResultCB will be called with the result of sending the state
+    /// @note states sent in the same mainloop cycle are batched. Lights receiving identical states are addressed
+    ///   via /groups/<id>/action when the bridge has a group containing exactly these lights.
+    void sendLightState(const string &aLightID, JsonObjectPtr aState, HueApiResultCB aResultCB);
+
   private:
 
     void refindResultHandler(ErrorPtr aError);
     void searchResultHandler(ErrorPtr aError);
     void collectLights();
     void collectedLightsHandler(JsonObjectPtr aResult, ErrorPtr aError);
+    void collectedGroupsHandler(JsonObjectPtr aResult, ErrorPtr aError);
+    static string lightsKey(std::list<string> aLightIDs);
+    void queryLights();
+    void lightsQueryHandler(uint32_t aGeneration, JsonObjectPtr aResult, ErrorPtr aError);
+    void sendLightStateBatch();
+    void lightStateSent(HueApiResultCB aResultCB, JsonObjectPtr aResult, ErrorPtr aError);
+    void lightStateBatchSent(PendingLightStateList aSentStates, JsonObjectPtr aResult, ErrorPtr aError);
 
   };
 
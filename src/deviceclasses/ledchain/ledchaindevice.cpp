@@ -167,7 +167,7 @@ void LedChainDevice::applyChannelValueSteps(bool aForDimming, double aStepSize)
 }
 
 
-double LedChainDevice::getLEDColor(uint16_t aLedNumber, uint8_t &aRed, uint8_t &aGreen, uint8_t &aBlue)
+uint8_t LedChainDevice::getLEDColor(uint16_t aLedNumber, uint8_t &aRed, uint8_t &aGreen, uint8_t &aBlue)
 {
   // index relative to beginning of my segment
   uint16_t i = aLedNumber-firstLED;
@@ -178,16 +178,16 @@ double LedChainDevice::getLEDColor(uint16_t aLedNumber, uint8_t &aRed, uint8_t &
   // for soft edges
   if (i>=startSoftEdge && i<=numLEDs-endSoftEdge) {
     // not withing soft edge range, full opacity
-    return 1;
+    return 255;
   }
   else {
     if (i<startSoftEdge) {
       // zero point is LED *before* first LED!
-      return 1.0/(startSoftEdge+1)*(i+1);
+      return 255*(i+1)/(startSoftEdge+1);
     }
     else {
       // zero point is LED *after* last LED!
-      return 1.0/(endSoftEdge+1)*(numLEDs-i);
+      return 255*(numLEDs-i)/(endSoftEdge+1);
     }
   }
 }
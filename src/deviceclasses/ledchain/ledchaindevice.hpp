@@ -85,8 +85,8 @@ namespace p44 {
     /// @param aRed will receive red intensity
     /// @param aGreen will receive green intensity
     /// @param aBlue will receive blue intensity
-    /// @return opacity of light (0=no light, 1=only this light source, between: weight in mix with other sources)
-    double getLEDColor(uint16_t aLedNumber, uint8_t &aRed, uint8_t &aGreen, uint8_t &aBlue);
+    /// @return opacity of light (0=no light, 255=only this light source, between: weight in mix with other sources)
+    uint8_t getLEDColor(uint16_t aLedNumber, uint8_t &aRed, uint8_t &aGreen, uint8_t &aBlue);
 
     /// @}
 
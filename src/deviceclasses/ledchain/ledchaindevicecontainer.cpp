@@ -19,6 +19,14 @@
 //  along with vdcd. If not, see <http://www.gnu.org/licenses/>.
 //
 
+// File scope debugging options
+// - Set ALWAYS_DEBUG to 1 to enable DBGLOG output even in non-DEBUG builds of this file
+#define ALWAYS_DEBUG 0
+// - set FOCUSLOGLEVEL to non-zero log level (usually, 5,6, or 7==LOG_DEBUG) to get focus (extensive logging) for this file
+//   Note: must be before including "logger.hpp" (or anything that includes "logger.hpp")
+#define FOCUSLOGLEVEL 0
+
+
 #include "ledchaindevicecontainer.hpp"
 
 #if !DISABLE_LEDCHAIN
@@ -68,6 +76,7 @@ LedChainDeviceContainer::LedChainDeviceContainer(int aInstanceNumber, int aNumLe
   renderTicket(0),
   maxOutValue(128)
 {
+  renderAccu.resize(3*numLedsInChain);
 }
 
 
@@ -108,36 +117,44 @@ void LedChainDeviceContainer::triggerRenderingRange(uint16_t aFirst, uint16_t aN
 }
 
 
-static inline void increase(uint8_t &aByte, uint8_t aAmount, uint8_t aMax = 255)
-{
-  uint16_t r = aByte+aAmount;
-  if (r>aMax)
-    aByte = aMax;
-  else
-    aByte = (uint8_t)r;
-}
-
-
 void LedChainDeviceContainer::render()
 {
   renderTicket = 0; // done
-  for (uint16_t i=renderStart; i<renderEnd; i++) {
-    // TODO: optimize asking only devices active in this range
-    // for now, just ask all
+  if (renderEnd>numLedsInChain) renderEnd = numLedsInChain;
+  if (renderStart>=renderEnd) return; // nothing to render
+  MLMicroSeconds startTime = MainLoop::now();
+  // clear accumulator for the range
+  for (int i=3*renderStart; i<3*renderEnd; i++) renderAccu[i] = 0;
+  // add contributions of all segments overlapping the range
+  // Note: segments are sorted by firstLED, so we can stop at the first segment beginning after the range
+  for (LedChainDeviceList::iterator pos = sortedSegments.begin(); pos!=sortedSegments.end(); ++pos) {
+    LedChainDevicePtr seg = *pos;
+    if (seg->firstLED>=renderEnd) break; // this and all following segments are beyond the range
+    uint16_t segEnd = seg->firstLED+seg->numLEDs;
+    if (segEnd<=renderStart) continue; // segment ends before range
+    uint16_t from = seg->firstLED>renderStart ? seg->firstLED : renderStart;
+    uint16_t to = segEnd<renderEnd ? segEnd : renderEnd;
     uint8_t r,g,b;
-    uint8_t rv=0,gv=0,bv=0; // composed
-    for (LedChainDeviceList::iterator pos = sortedSegments.begin(); pos!=sortedSegments.end(); ++pos) {
-      double opacity = (*pos)->getLEDColor(i, r, g, b);
+    for (uint16_t i=from; i<to; i++) {
+      uint16_t opacity = seg->getLEDColor(i, r, g, b);
       if (opacity>0) {
-        increase(rv, opacity*r);
-        increase(gv, opacity*g);
-        increase(bv, opacity*b);
+        // fixed point blending: (opacity+1)/256 is exactly 1 for full opacity
+        opacity++;
+        uint16_t *accu = &renderAccu[3*i];
+        accu[0] += (r*opacity)>>8;
+        accu[1] += (g*opacity)>>8;
+        accu[2] += (b*opacity)>>8;
       }
     }
-    ws281xcomm->setColorDimmed(i, rv, gv, bv, maxOutValue); // only half brightness for full area color
+  }
+  // transfer composed colors to chain, saturating at max intensity
+  for (uint16_t i=renderStart; i<renderEnd; i++) {
+    uint16_t *accu = &renderAccu[3*i];
+    ws281xcomm->setColorDimmed(i, accu[0]>255 ? 255 : accu[0], accu[1]>255 ? 255 : accu[1], accu[2]>255 ? 255 : accu[2], maxOutValue); // only half brightness for full area color
   }
   // transfer to hardware
   ws281xcomm->show();
+  FOCUSLOG("rendered LEDs %d..%d in %lld uS", renderStart, renderEnd-1, MainLoop::now()-startTime);
 }
 
 
@@ -273,6 +290,37 @@ ErrorPtr LedChainDeviceContainer::handleMethod(VdcApiRequestPtr aRequest, const
   return respErr;
 }
 
+
+#define RENDER_BENCHMARK_MAX_REPEAT 1000 // runs on the main loop, keep it below a few seconds even for long chains
+
+ErrorPtr LedChainDeviceContainer::runBenchmark(const string &aBenchmark, ApiValuePtr aParams, ApiValuePtr aResult, StatusCB aCompletedCB)
+{
+  if (aBenchmark!="render") return inherited::runBenchmark(aBenchmark, aParams, aResult, aCompletedCB);
+  int repeat = 100;
+  ApiValuePtr o = aParams->get("repeat");
+  if (o) repeat = o->int32Value();
+  if (repeat<1 || repeat>RENDER_BENCHMARK_MAX_REPEAT) {
+    return ErrorPtr(new WebError(400, string_format("repeat must be 1..%d", RENDER_BENCHMARK_MAX_REPEAT)));
+  }
+  // the benchmark renders the full chain anyway, no need for a pending partial update any more
+  MainLoop::currentMainLoop().cancelExecutionTicket(renderTicket);
+  MLMicroSeconds startTime = MainLoop::now();
+  for (int i=0; i<repeat; i++) {
+    renderStart = 0;
+    renderEnd = numLedsInChain;
+    render();
+  }
+  MLMicroSeconds duration = MainLoop::now()-startTime;
+  aResult->add("frames", aResult->newUint64(repeat));
+  aResult->add("leds", aResult->newUint64(numLedsInChain));
+  aResult->add("segments", aResult->newUint64(sortedSegments.size()));
+  aResult->add("usPerFrame", aResult->newDouble((double)duration/repeat));
+  if (duration>0) {
+    aResult->add("ledsPerSecond", aResult->newDouble((double)numLedsInChain*repeat*Second/duration));
+  }
+  return Error::ok();
+}
+
 #endif // !DISABLE_LEDCHAIN
 
 
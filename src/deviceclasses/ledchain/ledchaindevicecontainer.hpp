@@ -70,6 +70,7 @@ namespace p44 {
     uint16_t renderStart; ///< first LED needing rendering (valid if renderTicket!=0)
     uint16_t renderEnd; ///< end of rendering range = first LED not needing rendering (valid if renderTicket!=0)
     long renderTicket;
+    std::vector<uint16_t> renderAccu; ///< R,G,B accumulator per LED for compositing overlapping segments
 
   public:
   
@@ -96,6 +97,9 @@ namespace p44 {
     /// vdc level methods (p44 specific, JSON only, for configuring static devices)
     virtual ErrorPtr handleMethod(VdcApiRequestPtr aRequest, const string &aMethod, ApiValuePtr aParams);
 
+    /// "render" benchmark: composes and shows the entire chain "repeat" times
+    virtual ErrorPtr runBenchmark(const string &aBenchmark, ApiValuePtr aParams, ApiValuePtr aResult, StatusCB aCompletedCB);
+
     /// Get icon data or name
     /// @param aIcon string to put result into (when method returns true)
     /// - if aWithData is set, binary PNG icon data for given resolution prefix is returned
@@ -69,6 +69,10 @@ WS281xComm::WS281xComm(uint16_t aNumLeds, uint16_t aLedsPerRow, bool aXReversed,
   ledstring.channel[1].invert = 0;
   ledstring.channel[1].brightness = MAX_BRIGHTNESS;
   ledstring.channel[1].leds = NULL; // will be allocated by the library
+  #else
+  // off-target: LEDs are simulated by a framebuffer in memory
+  framebuffer.resize(numLeds, 0);
+  framesShown = 0;
   #endif
   // make sure operation ends when mainloop terminates
   MainLoop::currentMainLoop().registerCleanupHandler(boost::bind(&WS281xComm::end, this));
@@ -131,6 +135,8 @@ void WS281xComm::show()
   if (!initialized) return;
   #if defined(RASPBERRYPI)
   ws2811_render(&ledstring);
+  #else
+  framesShown++;
   #endif
 }
 
@@ -193,12 +199,14 @@ void WS281xComm::setColorXY(uint16_t aX, uint16_t aY, uint8_t aRed, uint8_t aGre
 {
   uint16_t ledindex = ledIndexFromXY(aX,aY);
   if (ledindex>=numLeds) return;
-  #if defined(RASPBERRYPI)
-  ws2811_led_t pixel =
+  uint32_t pixel =
   (pwmtable[aRed] << 16) |
   (pwmtable[aGreen] << 8) |
   (pwmtable[aBlue]);
+  #if defined(RASPBERRYPI)
   ledstring.channel[0].leds[ledindex] = pixel;
+  #else
+  framebuffer[ledindex] = pixel;
   #endif
 }
 
@@ -239,10 +247,12 @@ void WS281xComm::getColorXY(uint16_t aX, uint16_t aY, uint8_t &aRed, uint8_t &aG
   if (ledindex>=numLeds) return;
   #if defined(RASPBERRYPI)
   ws2811_led_t pixel = ledstring.channel[0].leds[ledindex];
+  #else
+  uint32_t pixel = framebuffer[ledindex];
+  #endif
   aRed = brightnesstable[(pixel>>16) & 0xFF];
   aGreen = brightnesstable[(pixel>>8) & 0xFF];
   aBlue = brightnesstable[pixel & 0xFF];
-  #endif
 }
 
 #endif // !DISABLE_LEDCHAIN
@@ -34,6 +34,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <vector>
+
 #if defined(RASPBERRYPI)
 
 // we use the rpi_ws281x library to communicate with the WS2812 chain on RaspberryPi
@@ -72,6 +74,9 @@ namespace p44 {
 
     #if defined(RASPBERRYPI)
     ws2811_t ledstring; // the descriptor for the rpi_ws2811 library
+    #else
+    std::vector<uint32_t> framebuffer; // off-target: pixels in same format as rpi_ws2811 would get them
+    long framesShown; // off-target: number of frames show()n
     #endif
 
   public:
@@ -125,6 +130,12 @@ namespace p44 {
     /// @return number of LEDs
     uint16_t getNumLeds();
 
+    #if !defined(RASPBERRYPI)
+    /// @return number of frames transferred with show() so far
+    /// @note only available off-target, where the LEDs are simulated by a framebuffer in memory
+    long getFramesShown() { return framesShown; };
+    #endif
+
     /// @return size of array in X direction (x range is 0..getSizeX()-1)
     uint16_t getSizeX();
 
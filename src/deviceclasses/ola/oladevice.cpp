@@ -38,6 +38,7 @@ static bool nextChannelSpec(string &aConfig, size_t &aStartPos, char &aChannelTy
 {
   // check for channel spec
   // syntax is: C=n[=v][,C=n[=v],...] where C=channel type character, n=channel number, v=default value (if missing, default value is 0)
+  // Note: channel numbers above 512 address the following universes (513=channel 1 of the second universe, etc.)
   size_t i = aConfig.find("=", aStartPos);
   if (i==string::npos || i==0) return false;
   // first char before = is channel type
@@ -27,6 +27,8 @@
 
 #include <ola/DmxBuffer.h>
 
+#include <sys/time.h>
+
 using namespace p44;
 
 
@@ -62,15 +64,25 @@ string OlaDevicePersistence::dbSchemaUpgradeSQL(int aFromVersion, int &aToVersio
 
 
 OlaDeviceContainer::OlaDeviceContainer(int aInstanceNumber, DeviceContainer *aDeviceContainerP, int aTag) :
-  DeviceClassContainer(aInstanceNumber, aDeviceContainerP, aTag)
+  DeviceClassContainer(aInstanceNumber, aDeviceContainerP, aTag),
+  baseUniverse(OLA_DEFAULT_BASE_UNIVERSE),
+  changedUniverses(0),
+  handoverTicket(0),
+  pendingUniverses(0),
+  usedUniverses(0x01), // first universe is always sent (blackout until devices set values)
+  olaClientP(NULL)
 {
+  memset(dmxValues, 0, sizeof(dmxValues));
+  memset(olaValues, 0, sizeof(olaValues));
+  pthread_mutex_init(&olaBufferAccess, NULL);
+  pthread_cond_init(&olaOutputChanged, NULL);
 }
 
 
-#define DMX512_INTERFRAME_PAUSE (50*MilliSecond)
+#define DMX512_MIN_FRAME_INTERVAL (25*MilliSecond) // min time between two frames to the same universe (one full DMX512 frame takes ~23mS on the wire)
+#define DMX512_REFRESH_INTERVAL (2*Second) // unchanged universes are re-sent this often to keep OLA in sync, e.g. after olad restart
 #define DMX512_RETRY_INTERVAL (15*Second)
 #define OLA_SETUP_RETRY_INTERVAL (30*Second)
-#define DMX512_UNIVERSE 42
 
 void OlaDeviceContainer::initialize(StatusCB aCompletedCB, bool aFactoryReset)
 {
@@ -80,7 +92,6 @@ void OlaDeviceContainer::initialize(StatusCB aCompletedCB, bool aFactoryReset)
   string_format_append(databaseName, "%s_%d.sqlite3", deviceClassIdentifier(), getInstanceNumber());
   err = db.connectAndInitialize(databaseName.c_str(), OLADEVICES_SCHEMA_VERSION, OLADEVICES_SCHEMA_MIN_VERSION, aFactoryReset);
   // launch OLA thread
-  pthread_mutex_init(&olaBufferAccess, NULL);
   olaThread = MainLoop::currentMainLoop().executeInThread(boost::bind(&OlaDeviceContainer::olaThreadRoutine, this, _1), NULL);
   // done
   aCompletedCB(ErrorPtr());
@@ -91,44 +102,106 @@ void OlaDeviceContainer::olaThreadRoutine(ChildThreadWrapper &aThread)
 {
   // turn on OLA logging when loglevel is debugging, otherwise off
   ola::InitLogging(LOGENABLED(LOG_DEBUG) ? ola::OLA_LOG_WARN : ola::OLA_LOG_NONE, ola::OLA_LOG_STDERR);
-  dmxBufferP = new ola::DmxBuffer;
+  ola::DmxBuffer dmxBuffer;
   ola::client::StreamingClient::Options options;
   options.auto_start = false; // do not start olad from client
   olaClientP = new ola::client::StreamingClient(options);
-  if (olaClientP && dmxBufferP) {
-    dmxBufferP->Blackout();
-    while (!aThread.shouldTerminate()) {
-      if (!olaClientP->Setup()) {
-        // cannot start yet, wait a little
-        usleep(OLA_SETUP_RETRY_INTERVAL);
+  if (!olaClientP) return;
+  // wait for olad
+  while (!olaClientP->Setup()) {
+    if (aThread.shouldTerminate()) return;
+    // cannot start yet, wait a little
+    usleep(OLA_SETUP_RETRY_INTERVAL);
+  }
+  // send frames when values change (rate limited per universe), and refresh unchanged universes slowly
+  MLMicroSeconds lastSent[OLA_MAX_UNIVERSES];
+  memset(lastSent, 0, sizeof(lastSent)); // long ago
+  DmxValue frames[OLA_MAX_UNIVERSES][DMX512_CHANNELS];
+  pthread_mutex_lock(&olaBufferAccess);
+  while (!aThread.shouldTerminate()) {
+    // find universes due for sending
+    MLMicroSeconds now = MainLoop::now();
+    MLMicroSeconds nextDue = now+DMX512_REFRESH_INTERVAL;
+    uint32_t sendNow = 0;
+    for (int u=0; u<OLA_MAX_UNIVERSES; u++) {
+      uint32_t m = 1<<u;
+      if ((usedUniverses & m)==0) continue;
+      MLMicroSeconds due = lastSent[u] + ((pendingUniverses & m) ? DMX512_MIN_FRAME_INTERVAL : DMX512_REFRESH_INTERVAL);
+      if (due<=now) {
+        sendNow |= m;
+        memcpy(frames[u], olaValues[u], DMX512_CHANNELS);
       }
-      else {
-        while (!aThread.shouldTerminate()) {
-          pthread_mutex_lock(&olaBufferAccess);
-          bool ok = olaClientP->SendDMX(DMX512_UNIVERSE, *dmxBufferP, ola::client::StreamingClient::SendArgs());
-          pthread_mutex_unlock(&olaBufferAccess);
-          if (ok) {
-            // successful send
-            usleep(DMX512_INTERFRAME_PAUSE); // sleep a little between frames.
-          }
-          else {
-            // unsuccessful send, do not try too often
-            usleep(DMX512_RETRY_INTERVAL); // sleep longer between failed attempts
-          }
-        }
+      else if (due<nextDue) {
+        nextDue = due;
       }
     }
+    if (sendNow==0) {
+      // nothing due now, sleep until next due time or until main loop hands over changes
+      struct timeval tv;
+      gettimeofday(&tv, NULL);
+      MLMicroSeconds wakeAt = (MLMicroSeconds)tv.tv_sec*Second + tv.tv_usec + (nextDue-now);
+      struct timespec ts;
+      ts.tv_sec = wakeAt/Second;
+      ts.tv_nsec = (wakeAt%Second)*1000;
+      pthread_cond_timedwait(&olaOutputChanged, &olaBufferAccess, &ts);
+      continue;
+    }
+    pendingUniverses &= ~sendNow;
+    pthread_mutex_unlock(&olaBufferAccess);
+    // send outside the lock
+    uint32_t failed = 0;
+    for (int u=0; u<OLA_MAX_UNIVERSES; u++) {
+      uint32_t m = 1<<u;
+      if ((sendNow & m)==0) continue;
+      dmxBuffer.Set(frames[u], DMX512_CHANNELS);
+      if (!olaClientP->SendDMX(baseUniverse+u, dmxBuffer, ola::client::StreamingClient::SendArgs())) {
+        failed |= m;
+      }
+      lastSent[u] = MainLoop::now();
+    }
+    if (failed) {
+      // unsuccessful send, do not try too often
+      usleep(DMX512_RETRY_INTERVAL);
+    }
+    pthread_mutex_lock(&olaBufferAccess);
+    pendingUniverses |= failed; // retry these
   }
+  pthread_mutex_unlock(&olaBufferAccess);
 }
 
 
 void OlaDeviceContainer::setDMXChannel(DmxChannel aChannel, DmxValue aChannelValue)
 {
-  if (dmxBufferP && aChannel>=1 && aChannel<=512) {
-    pthread_mutex_lock(&olaBufferAccess);
-    dmxBufferP->SetChannel(aChannel-1, aChannelValue);
-    pthread_mutex_unlock(&olaBufferAccess);
+  if (aChannel>=1 && aChannel<=OLA_MAX_UNIVERSES*DMX512_CHANNELS) {
+    int u = (aChannel-1)/DMX512_CHANNELS;
+    DmxValue &v = dmxValues[u][(aChannel-1)%DMX512_CHANNELS];
+    if (v!=aChannelValue) {
+      v = aChannelValue;
+      changedUniverses |= 1<<u;
+      // collect all changes of this main loop cycle into one handover
+      if (!handoverTicket) {
+        handoverTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&OlaDeviceContainer::handoverChanges, this), 0);
+      }
+    }
+  }
+}
+
+
+void OlaDeviceContainer::handoverChanges()
+{
+  handoverTicket = 0;
+  if (changedUniverses==0) return;
+  pthread_mutex_lock(&olaBufferAccess);
+  for (int u=0; u<OLA_MAX_UNIVERSES; u++) {
+    if (changedUniverses & (1<<u)) {
+      memcpy(olaValues[u], dmxValues[u], DMX512_CHANNELS);
+    }
   }
+  pendingUniverses |= changedUniverses;
+  usedUniverses |= changedUniverses;
+  pthread_cond_signal(&olaOutputChanged);
+  pthread_mutex_unlock(&olaBufferAccess);
+  changedUniverses = 0;
 }
 
 
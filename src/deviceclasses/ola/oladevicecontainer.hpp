@@ -41,6 +41,14 @@ namespace p44 {
   typedef uint8_t DmxValue;
   const DmxChannel dmxNone = 0; // no channel
 
+  /// number of channels in one DMX512 universe
+  #define DMX512_CHANNELS 512
+  /// max number of universes. Channel numbers beyond 512 address the following universes
+  /// (513..1024 = second universe, etc.)
+  #define OLA_MAX_UNIVERSES 16
+  /// default OLA universe number of the first universe
+  #define OLA_DEFAULT_BASE_UNIVERSE 42
+
   class OlaDeviceContainer;
   class OlaDevice;
   typedef boost::intrusive_ptr<OlaDevice> OlaDevicePtr;
@@ -65,10 +73,20 @@ namespace p44 {
 
     OlaDevicePersistence db;
 
+    int baseUniverse; ///< OLA universe number of the first universe
+
+    // DMX values as set from the main loop
+    DmxValue dmxValues[OLA_MAX_UNIVERSES][DMX512_CHANNELS];
+    uint32_t changedUniverses; ///< bit mask of universes changed since last handover to OLA thread
+    long handoverTicket; ///< handover of changes to the OLA thread at end of main loop cycle
+
     // OLA Thread
     ChildThreadWrapperPtr olaThread;
-    pthread_mutex_t olaBufferAccess;
-    ola::DmxBuffer *dmxBufferP;
+    pthread_mutex_t olaBufferAccess; ///< protects the members below
+    pthread_cond_t olaOutputChanged; ///< signalled when new values are handed over
+    DmxValue olaValues[OLA_MAX_UNIVERSES][DMX512_CHANNELS]; ///< values handed over to the OLA thread
+    uint32_t pendingUniverses; ///< bit mask of universes with values not yet sent by the OLA thread
+    uint32_t usedUniverses; ///< bit mask of universes that are in use at all
     ola::client::StreamingClient *olaClientP;
 
 
@@ -101,12 +119,18 @@ namespace p44 {
     ///   Will be appended to product name to create modelName() for vdcs
     virtual string vdcModelSuffix() { return "OLA/DMX512"; }
 
+    /// set the OLA universe number of the first universe
+    /// @param aBaseUniverse OLA universe number for channels 1..512, following universes use consecutive numbers
+    /// @note must be called before initialize(). To test without DMX hardware, patch the OLA dummy plugin's port(s) to these universes
+    void setBaseUniverse(int aBaseUniverse) { baseUniverse = aBaseUniverse; };
+
   private:
 
     OlaDevicePtr addOlaDevice(string aDeviceType, string aDeviceConfig);
 
     void olaThreadRoutine(ChildThreadWrapper &aThread);
     void setDMXChannel(DmxChannel aChannel, DmxValue aChannelValue);
+    void handoverChanges();
 
   };
 
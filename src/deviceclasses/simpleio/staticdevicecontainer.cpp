@@ -228,4 +228,44 @@ ErrorPtr StaticDeviceContainer::handleMethod(VdcApiRequestPtr aRequest, const st
 }
 
 
+#define BENCHMARK_DEVICES_MAX 5000
+
+ErrorPtr StaticDeviceContainer::runBenchmark(const string &aBenchmark, ApiValuePtr aParams, ApiValuePtr aResult, StatusCB aCompletedCB)
+{
+  if (aBenchmark=="populate") {
+    // add synthetic devices up to the requested total. These are console dimmers (no console key),
+    // which are not stored in devConfigs, so they are gone after restart
+    int count = 1000;
+    ApiValuePtr o = aParams->get("count");
+    if (o) count = o->int32Value();
+    if (count<1 || count>BENCHMARK_DEVICES_MAX) {
+      return ErrorPtr(new WebError(400, string_format("count must be 1..%d", BENCHMARK_DEVICES_MAX)));
+    }
+    long residentBefore = VdcMetrics::residentMemoryKB();
+    MLMicroSeconds start = MainLoop::now();
+    for (int i=(int)benchmarkDevices.size(); i<count; i++) {
+      StaticDevicePtr dev = addStaticDevice("console", string_format("bench%d:dimmer", i));
+      if (dev) benchmarkDevices.push_back(dev);
+    }
+    aResult->add("devices", aResult->newUint64(benchmarkDevices.size()));
+    aResult->add("msToAdd", aResult->newDouble((double)(MainLoop::now()-start)/MilliSecond));
+    aResult->add("residentKBBefore", aResult->newInt64(residentBefore));
+    aResult->add("residentKBAfter", aResult->newInt64(VdcMetrics::residentMemoryKB()));
+    return Error::ok();
+  }
+  else if (aBenchmark=="depopulate") {
+    // remove the synthetic devices, including their settings
+    size_t removed = benchmarkDevices.size();
+    while (!benchmarkDevices.empty()) {
+      DevicePtr dev = benchmarkDevices.back();
+      benchmarkDevices.pop_back();
+      dev->reportVanished();
+      removeDevice(dev, true);
+    }
+    aResult->add("removed", aResult->newUint64(removed));
+    aResult->add("residentKB", aResult->newInt64(VdcMetrics::residentMemoryKB()));
+    return Error::ok();
+  }
+  return inherited::runBenchmark(aBenchmark, aParams, aResult, aCompletedCB);
+}
 
@@ -91,6 +91,8 @@ namespace p44 {
 
     StaticDevicePersistence db;
 
+    DeviceVector benchmarkDevices; ///< synthetic devices added by the "populate" benchmark, not stored in the DB
+
   public:
     StaticDeviceContainer(int aInstanceNumber, DeviceConfigMap aDeviceConfigs, DeviceContainer *aDeviceContainerP, int aTag);
 
@@ -108,6 +110,10 @@ namespace p44 {
     /// vdc level methods (p44 specific, JSON only, for configuring static devices)
     virtual ErrorPtr handleMethod(VdcApiRequestPtr aRequest, const string &aMethod, ApiValuePtr aParams);
 
+    /// run a benchmark: "populate" adds a set of synthetic console dimmer devices (for measuring
+    /// the vdc host with a large device set), "depopulate" removes them again
+    virtual ErrorPtr runBenchmark(const string &aBenchmark, ApiValuePtr aParams, ApiValuePtr aResult, StatusCB aCompletedCB);
+
     /// @return human readable, language independent suffix to explain vdc functionality.
     ///   Will be appended to product name to create modelName() for vdcs
     virtual string vdcModelSuffix() { return "GPIO,I2C,console"; }
@@ -0,0 +1,433 @@
+//
+//  Copyright (c) 2013-2016 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of vdcd.
+//
+//  vdcd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  vdcd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with vdcd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+// Simulator for a hue bridge, serving the subset of the hue REST API used by vdcd's hue device
+// container over HTTP. Models a configurable number of dimmable lights, and can delay /lights
+// responses (with the light states as they were when the request arrived), so that light state
+// reads overtaken by state changes can be reproduced.
+// Point vdcd's --hueapiurl option at http://127.0.0.1:<port>/api and start learning.
+
+#include "application.hpp"
+
+#include "jsonobject.hpp"
+
+#include "mongoose.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define DEFAULT_LIGHTS 4
+#define DEFAULT_PORT 18380
+#define DEFAULT_LIGHTS_DELAY 0 // mS
+#define DEFAULT_LOGLEVEL LOG_NOTICE
+
+#define SIM_USERNAME "vdcdsimuser"
+#define MAX_REQUEST_SIZE 16384
+
+
+using namespace p44;
+
+
+class SimLight
+{
+public:
+
+  bool on;
+  int bri;
+
+  SimLight() : on(false), bri(1) {};
+
+  /// @return light info as delivered by v1.4 and later bridges
+  JsonObjectPtr info(int aIndex)
+  {
+    JsonObjectPtr state = JsonObject::newObj();
+    state->add("on", JsonObject::newBool(on));
+    state->add("bri", JsonObject::newInt32(bri));
+    state->add("alert", JsonObject::newString("none"));
+    state->add("reachable", JsonObject::newBool(true));
+    JsonObjectPtr light = JsonObject::newObj();
+    light->add("state", state);
+    light->add("type", JsonObject::newString("Dimmable light"));
+    light->add("name", JsonObject::newString(string_format("simulated light %d", aIndex+1)));
+    light->add("modelid", JsonObject::newString("LWB004"));
+    light->add("uniqueid", JsonObject::newString(string_format("00:17:88:01:00:00:%02x:%02x-0b", (aIndex>>8)&0xFF, aIndex&0xFF)));
+    light->add("swversion", JsonObject::newString("66012040"));
+    return light;
+  }
+
+};
+typedef std::vector<SimLight> SimLightVector;
+
+
+class HueBridgeSim : public Application
+{
+  struct mg_context *mgContext;
+  pthread_mutex_t stateMutex; ///< protects lights, requests are served by mongoose worker threads
+
+  SimLightVector lights;
+  MLMicroSeconds lightsDelay; ///< how long /lights responses are delayed after taking the state snapshot
+
+  long lightsQueries; ///< number of /lights queries served
+
+public:
+
+  HueBridgeSim() :
+    mgContext(NULL),
+    lightsDelay(DEFAULT_LIGHTS_DELAY*MilliSecond),
+    lightsQueries(0)
+  {
+    pthread_mutex_init(&stateMutex, NULL);
+  }
+
+  virtual ~HueBridgeSim()
+  {
+    if (mgContext) mg_stop(mgContext);
+    pthread_mutex_destroy(&stateMutex);
+  }
+
+
+  void usage(char *name)
+  {
+    fprintf(stderr, "usage:\n");
+    fprintf(stderr, "  %s [options]\n", name);
+    fprintf(stderr, "    -n lights       : number of simulated dimmable lights (default=%d)\n", DEFAULT_LIGHTS);
+    fprintf(stderr, "    -p port         : HTTP port of the simulated bridge (default=%d)\n", DEFAULT_PORT);
+    fprintf(stderr, "    -d delay        : delay of /lights responses in mS, states are taken at arrival of request (default=%d)\n", DEFAULT_LIGHTS_DELAY);
+    fprintf(stderr, "    -l loglevel     : set loglevel (default = %d)\n", DEFAULT_LOGLEVEL);
+  };
+
+  virtual int main(int argc, char **argv)
+  {
+    int loglevel = DEFAULT_LOGLEVEL; // use defaults
+
+    int numLights = DEFAULT_LIGHTS;
+    int port = DEFAULT_PORT;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:p:d:l:h")) != -1)
+    {
+      switch (c) {
+        case 'n':
+          numLights = atoi(optarg);
+          break;
+        case 'p':
+          port = atoi(optarg);
+          break;
+        case 'd':
+          lightsDelay = atof(optarg)*MilliSecond;
+          break;
+        case 'l':
+          loglevel = atoi(optarg);
+          break;
+        default:
+          usage(argv[0]);
+          exit(-1);
+      }
+    }
+    if (numLights<1 || port<=0 || lightsDelay<0) {
+      usage(argv[0]);
+      exit(-1);
+    }
+
+    SETLOGLEVEL(loglevel);
+
+    lights.resize(numLights);
+    // start the HTTP server
+    string portStr = string_format("%d", port);
+    const char *options[] = {
+      "listening_ports", portStr.c_str(),
+      "num_threads", "8",
+      NULL
+    };
+    struct mg_callbacks callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.begin_request = &HueBridgeSim::beginRequest;
+    mgContext = mg_start(&callbacks, this, options);
+    if (!mgContext) {
+      LOG(LOG_ERR, "Cannot start HTTP server on port %d", port);
+      exit(1);
+    }
+    LOG(LOG_NOTICE,
+      "Simulated hue bridge with %d lights ready at http://127.0.0.1:%d/api, /lights responses delayed by %lld mS",
+      numLights, port, lightsDelay/MilliSecond
+    );
+    // app now ready to run
+    return run();
+  }
+
+
+  #pragma mark - HTTP requests
+
+  static int beginRequest(struct mg_connection *aConn)
+  {
+    struct mg_request_info *ri = mg_get_request_info(aConn);
+    HueBridgeSim *sim = static_cast<HueBridgeSim *>(ri->user_data);
+    return sim->handleRequest(aConn, ri);
+  }
+
+
+  int handleRequest(struct mg_connection *aConn, struct mg_request_info *aRequestInfo)
+  {
+    string method = nonNullCStr(aRequestInfo->request_method);
+    string uri = nonNullCStr(aRequestInfo->uri);
+    // get request body
+    JsonObjectPtr data;
+    const char *cl = mg_get_header(aConn, "Content-Length");
+    size_t len = cl ? atoi(cl) : 0;
+    if (len>0 && len<=MAX_REQUEST_SIZE) {
+      string body(len, 0);
+      size_t got = 0;
+      int n;
+      while (got<len && (n = mg_read(aConn, &body[got], len-got))>0) got += n;
+      body.resize(got);
+      data = JsonObject::objFromText(body.c_str());
+    }
+    LOG(LOG_INFO, "%s %s %s", method.c_str(), uri.c_str(), data ? data->json_c_str() : "");
+    // split path: /api/<username>/<resource>/<id>/<subresource>
+    std::vector<string> path;
+    size_t i = 0;
+    while (i<uri.size()) {
+      size_t e = uri.find('/', i);
+      if (e==string::npos) e = uri.size();
+      if (e>i) path.push_back(uri.substr(i, e-i));
+      i = e+1;
+    }
+    JsonObjectPtr answer;
+    if (path.size()==0 || path[0]!="api") {
+      return 0; // not ours, let mongoose answer with 404
+    }
+    if (path.size()==1) {
+      if (method=="POST") {
+        // create user, link button is always considered pressed
+        answer = successItem("username", JsonObject::newString(SIM_USERNAME));
+      }
+    }
+    else if (path[1]!=SIM_USERNAME) {
+      answer = errorItem(1, uri, "unauthorized user");
+    }
+    else if (path.size()==2) {
+      if (method=="GET") answer = fullState();
+    }
+    else if (path[2]=="lights") {
+      answer = lightsRequest(method, path, data);
+    }
+    else if (path[2]=="groups") {
+      answer = groupsRequest(method, path, data);
+    }
+    else if (path[2]=="config") {
+      if (method=="GET") answer = config();
+      else if (method=="DELETE" && path.size()==5 && path[3]=="whitelist") {
+        answer = JsonObject::newArray();
+        answer->arrayAppend(JsonObject::newString(uri + " deleted"));
+      }
+    }
+    if (!answer) {
+      answer = errorItem(3, uri, "resource not available");
+    }
+    const char *text = answer->json_c_str();
+    mg_printf(aConn,
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: application/json\r\n"
+      "Content-Length: %ld\r\n"
+      "Connection: close\r\n"
+      "\r\n",
+      (long)strlen(text)
+    );
+    mg_write(aConn, text, strlen(text));
+    return 1; // handled
+  }
+
+
+  JsonObjectPtr lightsRequest(const string &aMethod, const std::vector<string> &aPath, JsonObjectPtr aData)
+  {
+    if (aPath.size()==3) {
+      if (aMethod!="GET") return JsonObjectPtr();
+      // /lights: snapshot the states now, deliver later
+      pthread_mutex_lock(&stateMutex);
+      long q = ++lightsQueries;
+      JsonObjectPtr answer = JsonObject::newObj();
+      for (int i=0; i<(int)lights.size(); i++) {
+        answer->add(string_format("%d", i+1).c_str(), lights[i].info(i));
+      }
+      pthread_mutex_unlock(&stateMutex);
+      LOG(LOG_NOTICE, "/lights query #%ld: states taken, answering in %lld mS", q, lightsDelay/MilliSecond);
+      if (lightsDelay>0) {
+        usleep((useconds_t)lightsDelay);
+      }
+      return answer;
+    }
+    int idx = atoi(aPath[3].c_str())-1;
+    if (idx<0 || idx>=(int)lights.size()) return JsonObjectPtr();
+    if (aPath.size()==4 && aMethod=="GET") {
+      pthread_mutex_lock(&stateMutex);
+      JsonObjectPtr answer = lights[idx].info(idx);
+      pthread_mutex_unlock(&stateMutex);
+      return answer;
+    }
+    if (aPath.size()==4 && aMethod=="PUT") {
+      // rename etc., just confirm
+      return JsonObject::newArray();
+    }
+    if (aPath.size()==5 && aPath[4]=="state" && aMethod=="PUT" && aData) {
+      pthread_mutex_lock(&stateMutex);
+      applyState(idx, aData);
+      pthread_mutex_unlock(&stateMutex);
+      return successItems(string_format("/lights/%d/state", idx+1), aData);
+    }
+    return JsonObjectPtr();
+  }
+
+
+  JsonObjectPtr groupsRequest(const string &aMethod, const std::vector<string> &aPath, JsonObjectPtr aData)
+  {
+    if (aPath.size()==3) {
+      if (aMethod!="GET") return JsonObjectPtr();
+      // group 1 contains all lights but the last one (if there are at least 3 lights)
+      JsonObjectPtr answer = JsonObject::newObj();
+      if (lights.size()>=3) {
+        JsonObjectPtr members = JsonObject::newArray();
+        for (int i=0; i<(int)lights.size()-1; i++) {
+          members->arrayAppend(JsonObject::newString(string_format("%d", i+1)));
+        }
+        JsonObjectPtr grp = JsonObject::newObj();
+        grp->add("name", JsonObject::newString("simulated group"));
+        grp->add("lights", members);
+        answer->add("1", grp);
+      }
+      return answer;
+    }
+    if (aPath.size()==5 && aPath[4]=="action" && aMethod=="PUT" && aData) {
+      int grp = atoi(aPath[3].c_str());
+      int n;
+      if (grp==0) n = (int)lights.size();
+      else if (grp==1 && lights.size()>=3) n = (int)lights.size()-1;
+      else return JsonObjectPtr();
+      pthread_mutex_lock(&stateMutex);
+      for (int i=0; i<n; i++) applyState(i, aData);
+      pthread_mutex_unlock(&stateMutex);
+      return successItems(string_format("/groups/%d/action", grp), aData);
+    }
+    return JsonObjectPtr();
+  }
+
+
+  JsonObjectPtr config()
+  {
+    JsonObjectPtr cfg = JsonObject::newObj();
+    cfg->add("name", JsonObject::newString("simulated hue bridge"));
+    cfg->add("swversion", JsonObject::newString("01012917"));
+    cfg->add("apiversion", JsonObject::newString("1.3.0"));
+    cfg->add("mac", JsonObject::newString("00:17:88:00:00:00"));
+    return cfg;
+  }
+
+
+  JsonObjectPtr fullState()
+  {
+    JsonObjectPtr all = JsonObject::newObj();
+    all->add("lights", lightsRequest("GET", std::vector<string>(3), JsonObjectPtr()));
+    all->add("groups", groupsRequest("GET", std::vector<string>(3), JsonObjectPtr()));
+    all->add("config", config());
+    return all;
+  }
+
+
+  /// apply new state to a light
+  /// @note must be called with stateMutex locked
+  void applyState(int aIndex, JsonObjectPtr aState)
+  {
+    SimLight &l = lights[aIndex];
+    JsonObjectPtr o = aState->get("on");
+    if (o) l.on = o->boolValue();
+    o = aState->get("bri");
+    if (o) {
+      l.bri = o->int32Value();
+      if (l.bri<1) l.bri = 1;
+      if (l.bri>254) l.bri = 254;
+    }
+    LOG(LOG_NOTICE, "Light %d: on=%d bri=%d", aIndex+1, l.on, l.bri);
+  }
+
+
+  #pragma mark - answer items
+
+  JsonObjectPtr successItem(const string &aPath, JsonObjectPtr aValue)
+  {
+    JsonObjectPtr answer = JsonObject::newArray();
+    JsonObjectPtr s = JsonObject::newObj();
+    s->add(aPath.c_str(), aValue);
+    JsonObjectPtr item = JsonObject::newObj();
+    item->add("success", s);
+    answer->arrayAppend(item);
+    return answer;
+  }
+
+
+  /// one success item per changed state field, like the real bridge
+  JsonObjectPtr successItems(const string &aPathPrefix, JsonObjectPtr aState)
+  {
+    JsonObjectPtr answer = JsonObject::newArray();
+    aState->resetKeyIteration();
+    string key;
+    JsonObjectPtr val;
+    while (aState->nextKeyValue(key, val)) {
+      JsonObjectPtr s = JsonObject::newObj();
+      s->add((aPathPrefix + "/" + key).c_str(), val);
+      JsonObjectPtr item = JsonObject::newObj();
+      item->add("success", s);
+      answer->arrayAppend(item);
+    }
+    return answer;
+  }
+
+
+  JsonObjectPtr errorItem(int aType, const string &aAddress, const string &aDescription)
+  {
+    JsonObjectPtr e = JsonObject::newObj();
+    e->add("type", JsonObject::newInt32(aType));
+    e->add("address", JsonObject::newString(aAddress));
+    e->add("description", JsonObject::newString(aDescription));
+    JsonObjectPtr item = JsonObject::newObj();
+    item->add("error", e);
+    JsonObjectPtr answer = JsonObject::newArray();
+    answer->arrayAppend(item);
+    return answer;
+  }
+
+
+  virtual void initialize()
+  {
+  }
+
+};
+
+
+int main(int argc, char **argv)
+{
+  // create the mainloop
+  MainLoop::currentMainLoop();
+  // create app with current mainloop
+  static HueBridgeSim application;
+  // pass control
+  return application.main(argc, argv);
+}
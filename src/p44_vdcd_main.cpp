@@ -301,6 +301,7 @@ public:
       #if !DISABLE_ENOCEAN
       { 'b', "enocean",       true,  "bridge;EnOcean modem serial port device or proxy host[:port]" },
       { 0,   "enoceanreset",  true,  "pinspec;set I/O pin connected to EnOcean module reset" },
+      { 0,   "enoceanpipeline", true, "telegrams;max number of radio telegrams sent to the EnOcean modem before it has answered (default=2, 1=no pipelining)" },
       #endif
       #if !DISABLE_HUE
       { 0,   "huelights",     false, "enable support for hue LED lamps (via hue bridge)" },
@@ -308,6 +309,7 @@ public:
       #endif
       #if !DISABLE_OLA
       { 0,   "ola",           false, "enable support for OLA (Open Lighting Architecture) server" },
+      { 0,   "olauniverse",   true,  "universe;OLA universe for DMX channels 1..512, higher channels use the following universes (default=42)" },
       #endif
       #if !DISABLE_LEDCHAIN
       { 0,   "ledchain",      true,  "numleds;enable support for LED chains forming one or multiple RGB lights" },
@@ -353,12 +355,16 @@ public:
       { 0  , "webuiport",     true,  "portno;publish a Web-UI service at given port" },
       { 'C', "vdsmport",      true,  "port;port number/service name for vdSM to connect to (default pbuf:" DEFAULT_PBUF_VDSMSERVICE ", JSON:" DEFAULT_JSON_VDSMSERVICE ")" },
       { 'i', "vdsmnonlocal",  false, "allow vdSM connections from non-local clients" },
+      { 0  , "announcewindow",true,  "count;max number of unacknowledged announcements sent to vdSM at once (default=5)" },
       { 'w', "startupdelay",  true,  "seconds;delay startup" },
       { 'l', "loglevel",      true,  "level;set max level of log message detail to show on stdout" },
       { 0  , "errlevel",      true,  "level;set max level for log messages to go to stderr as well" },
       { 0  , "mainloopstats", true,  "interval;0=no stats, 1..N interval (5Sec steps)" },
       { 0  , "dontlogerrors", false, "don't duplicate error messages (see --errlevel) on stdout" },
       { 's', "sqlitedir",     true,  "dirpath;set SQLite DB directory (default = " DEFAULT_DBDIR ")" },
+      { 0  , "flushtime",     true,  "milliseconds;max time spent saving changed devices per periodic DB flush (0=no limit, default=100)" },
+      { 0  , "faststart",     false, "restore devices from snapshot of previous run at startup, collect in background" },
+      { 0  , "workers",       true,  "count;max number of worker threads for CPU-heavy/blocking jobs (0=none, default=2)" },
       { 0  , "icondir",       true,  "icon directory;specifiy path to directory containing device icons" },
       { 'W', "cfgapiport",    true,  "port;server port number for web configuration JSON API (default=none)" },
       { 0  , "cfgapinonlocal",false, "allow web configuration JSON API from non-local clients" },
@@ -438,6 +444,10 @@ public:
       const char *dbdir = DEFAULT_DBDIR;
       getStringOption("sqlitedir", dbdir);
       p44VdcHost->setPersistentDataDir(dbdir);
+      int flushTime;
+      if (getIntOption("flushtime", flushTime)) {
+        p44VdcHost->setFlushTimeBudget(flushTime*MilliSecond);
+      }
 
       // - set icon directory
       const char *icondir = NULL;
@@ -497,6 +507,15 @@ public:
       getStringOption("vdsmport", vdcapiservice);
       p44VdcHost->vdcApiServer->setConnectionParams(NULL, vdcapiservice, SOCK_STREAM, AF_INET);
       p44VdcHost->vdcApiServer->setAllowNonlocalConnections(getOption("vdsmnonlocal"));
+      int announceWindow;
+      if (getIntOption("announcewindow", announceWindow)) {
+        p44VdcHost->setAnnounceWindow(announceWindow);
+      }
+      p44VdcHost->setFastStart(getOption("faststart"));
+      int workers;
+      if (getIntOption("workers", workers)) {
+        p44VdcHost->getWorkerPool().setMaxThreads(workers);
+      }
 
 
       // Create Web configuration JSON API server
@@ -529,6 +548,10 @@ public:
       if (enoceanname) {
         EnoceanDeviceContainerPtr enoceanDeviceContainer = EnoceanDeviceContainerPtr(new EnoceanDeviceContainer(1, p44VdcHost.get(), 2)); // Tag 2 = EnOcean
         enoceanDeviceContainer->enoceanComm.setConnectionSpecification(enoceanname, DEFAULT_ENOCEANPORT, enoceanresetpin);
+        int pipeline;
+        if (getIntOption("enoceanpipeline", pipeline)) {
+          enoceanDeviceContainer->enoceanComm.setMaxPipelined(pipeline);
+        }
         // add
         enoceanDeviceContainer->addClassToDeviceContainer();
       }
@@ -548,6 +571,10 @@ public:
       // - Add OLA support
       if (getOption("ola")) {
         OlaDeviceContainerPtr olaDeviceContainer = OlaDeviceContainerPtr(new OlaDeviceContainer(1, p44VdcHost.get(), 5)); // Tag 5 = ola
+        int olaUniverse;
+        if (getIntOption("olauniverse", olaUniverse)) {
+          olaDeviceContainer->setBaseUniverse(olaUniverse);
+        }
         olaDeviceContainer->addClassToDeviceContainer();
       }
       #endif
@@ -86,6 +86,31 @@ void ApiValue::clear()
 
 
 
+#pragma mark - building objects
+
+
+ApiValuePtr ApiValue::beginMember(const string &aKey)
+{
+  return newValue(apivalue_object);
+}
+
+
+void ApiValue::endMember(const string &aKey, ApiValuePtr aMember, bool aKeep)
+{
+  if (aKeep) add(aKey, aMember);
+}
+
+
+bool ApiValue::isEmptyObject()
+{
+  string k;
+  ApiValuePtr v;
+  resetKeyIteration();
+  return !nextKeyValue(k, v);
+}
+
+
+
 #pragma mark -  getting and setting as string (for all basic types)
 
 string ApiValue::stringValue()
@@ -133,6 +133,22 @@ namespace p44 {
     /// @return false if no more key/values
     virtual bool nextKeyValue(string &aKey, ApiValuePtr &aValue) = 0;
 
+    /// start adding an object member which is filled after creation (rather than being added when complete)
+    /// @param aKey key of the new member
+    /// @return new object value to be filled and then passed to endMember()
+    /// @note base class just creates a new object value, which is added by endMember().
+    ///   Streaming implementations can override this to output the key before the member's contents.
+    virtual ApiValuePtr beginMember(const string &aKey);
+
+    /// complete adding an object member started with beginMember()
+    /// @param aKey key of the member
+    /// @param aMember the member as returned by beginMember(), now filled
+    /// @param aKeep if not set, the member is discarded (for streaming implementations, as far as still possible)
+    virtual void endMember(const string &aKey, ApiValuePtr aMember, bool aKeep);
+
+    /// @return true if this object has no members
+    virtual bool isEmptyObject();
+
     /// @name simple value accessors
     /// @{
 
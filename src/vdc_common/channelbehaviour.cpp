@@ -63,6 +63,13 @@ string ChannelBehaviour::description()
 }
 
 
+void ChannelBehaviour::subtreeChanged(uint64_t aGeneration)
+{
+  inherited::subtreeChanged(aGeneration);
+  output.subtreeChanged(aGeneration);
+}
+
+
 
 #pragma mark - channel value handling
 
@@ -163,6 +170,7 @@ void ChannelBehaviour::syncChannelValue(double aActualChannelValue, bool aAlways
     transitionProgress = 1; // not in transition
     channelUpdatePending = false; // we are in sync
     channelLastSync = MainLoop::now(); // value is current
+    propertiesChanged();
   }
 }
 
@@ -208,6 +216,7 @@ void ChannelBehaviour::setChannelValue(double aNewValue, MLMicroSeconds aTransit
     nextTransitionTime = aTransitionTime;
     channelUpdatePending = true; // pending to be sent to the device
     channelLastSync = Never; // cachedChannelValue is no longer applied (does not correspond with actual hardware)
+    propertiesChanged();
   }
 }
 
@@ -237,6 +246,7 @@ double ChannelBehaviour::dimChannelValue(double aIncrement, MLMicroSeconds aTran
     nextTransitionTime = aTransitionTime;
     channelUpdatePending = true; // pending to be sent to the device
     channelLastSync = Never; // cachedChannelValue is no longer applied (does not correspond with actual hardware)
+    propertiesChanged();
   }
   return newValue;
 }
@@ -248,6 +258,7 @@ void ChannelBehaviour::channelValueApplied(bool aAnyWay)
   if (channelUpdatePending || aAnyWay) {
     channelUpdatePending = false; // applied (might still be in transition, though)
     channelLastSync = MainLoop::now(); // now we know that we are in sync
+    propertiesChanged();
     if (!aAnyWay) {
       // only log when actually of importance (to prevent messages for devices that apply mostly immediately)
       if (LOGENABLED(LOG_INFO)) {
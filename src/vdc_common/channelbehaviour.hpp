@@ -206,6 +206,9 @@ namespace p44 {
     /// @return textual description of object, may contain LFs
     virtual string description();
 
+    /// mark this channel's subtree changed, passes change on to the output
+    virtual void subtreeChanged(uint64_t aGeneration);
+
 
   protected:
 
@@ -56,11 +56,47 @@ Device::Device(DeviceClassContainer *aClassContainerP) :
   applyInProgress(false),
   missedApplyAttempts(0),
   updateInProgress(false),
-  serializerWatchdogTicket(0)
+  serializerWatchdogTicket(0),
+  applyPendingSince(Never),
+  hwAccessStart(Never),
+  statesPushTicket(0)
 {
 }
 
 
+bool Device::queueBehaviourStatePush(const string &aStatesName, size_t aIndex)
+{
+  if (!isAnnounced()) return false; // pushProperty would suppress it anyway, don't let caller assume it is underway
+  VdcApiConnectionPtr api = getDeviceContainer().getSessionConnection();
+  if (!api) return false; // cannot push
+  if (!pendingStatesPush) {
+    // first state to push in this mainloop cycle, others will be merged in
+    pendingStatesPush = api->newApiValue();
+    pendingStatesPush->setType(apivalue_object);
+    statesPushTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&Device::sendQueuedStatesPush, this), 0);
+  }
+  ApiValuePtr subQuery = pendingStatesPush->get(aStatesName);
+  if (!subQuery) {
+    subQuery = pendingStatesPush->newValue(apivalue_object);
+    pendingStatesPush->add(aStatesName, subQuery);
+  }
+  subQuery->add(string_format("%zu",aIndex), subQuery->newValue(apivalue_null));
+  return true;
+}
+
+
+void Device::sendQueuedStatesPush()
+{
+  statesPushTicket = 0;
+  ApiValuePtr query = pendingStatesPush;
+  pendingStatesPush.reset();
+  if (query) {
+    pushProperty(query, VDC_API_DOMAIN);
+  }
+}
+
+
+
 string Device::modelUID()
 {
   // combine basic device type identifier, primary group, behaviours and model features and make UUID based dSUID of it
@@ -84,6 +120,7 @@ string Device::modelUID()
 
 Device::~Device()
 {
+  MainLoop::currentMainLoop().cancelExecutionTicket(statesPushTicket);
   buttons.clear();
   binaryInputs.clear();
   sensors.clear();
@@ -788,6 +825,7 @@ void Device::requestApplyingChannels(SimpleCB aAppliedOrSupersededCB, bool aForD
     }
     // - when previous request actually terminates, we need another update to make sure finally settled values are correct
     missedApplyAttempts++;
+    if (applyPendingSince==Never) applyPendingSince = MainLoop::now();
     FOCUSLOG("- missed requestApplyingChannels requests now %d", missedApplyAttempts);
   }
   else if (updateInProgress) {
@@ -796,6 +834,7 @@ void Device::requestApplyingChannels(SimpleCB aAppliedOrSupersededCB, bool aForD
     missedApplyAttempts++;
     appliedOrSupersededCB = aAppliedOrSupersededCB;
     applyInProgress = true;
+    if (applyPendingSince==Never) applyPendingSince = MainLoop::now();
   }
   else {
     // case c) applying is not currently in progress, can start updating hardware now
@@ -806,6 +845,10 @@ void Device::requestApplyingChannels(SimpleCB aAppliedOrSupersededCB, bool aForD
     serializerWatchdogTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&Device::serializerWatchdog, this), 10*Second); // new
     FOCUSLOG("+++++ Serializer watchdog started for apply with ticket #%ld", serializerWatchdogTicket);
     #endif
+    // - account for time the request had to wait in the serializer
+    hwAccessStart = MainLoop::now();
+    getDeviceContainer().getMetrics().recordLatency("apply.wait", applyPendingSince==Never ? 0 : hwAccessStart-applyPendingSince);
+    applyPendingSince = Never;
     // - start applying
     appliedOrSupersededCB = aAppliedOrSupersededCB;
     applyInProgress = true;
@@ -867,6 +910,15 @@ void Device::serializerWatchdog()
 }
 
 
+void Device::recordHardwareAccess(const char *aKind)
+{
+  if (hwAccessStart!=Never) {
+    getDeviceContainer().getMetrics().recordLatency(string(aKind)+classContainerP->deviceClassIdentifier(), MainLoop::now()-hwAccessStart);
+    hwAccessStart = Never;
+  }
+}
+
+
 bool Device::checkForReapply()
 {
   ALOG(LOG_DEBUG, "checkForReapply - missed %d apply attempts in between", missedApplyAttempts);
@@ -895,6 +947,7 @@ void Device::applyingChannelsComplete()
     MainLoop::currentMainLoop().cancelExecutionTicket(serializerWatchdogTicket); // cancel watchdog
   }
   #endif
+  recordHardwareAccess("apply.");
   applyInProgress = false;
   // if more apply request have happened in the meantime, we need to reapply now
   if (!checkForReapply()) {
@@ -969,6 +1022,7 @@ void Device::requestUpdatingChannels(SimpleCB aUpdatedOrCachedCB)
     FOCUSLOG("+++++ Serializer watchdog started for update with ticket #%ld", serializerWatchdogTicket);
     #endif
     // - trigger querying hardware
+    hwAccessStart = MainLoop::now();
     syncChannelValues(boost::bind(&Device::updatingChannelsComplete, this));
   }
 }
@@ -984,6 +1038,7 @@ void Device::updatingChannelsComplete()
   #endif
   if (updateInProgress) {
     AFOCUSLOG("endUpdatingChannels (while actually waiting for these updates!)");
+    recordHardwareAccess("sync.");
     updateInProgress = false;
     if (updatedOrCachedCB) {
       FOCUSLOG("- confirming channels updated from hardware (= calling callback now)");
@@ -1212,8 +1267,8 @@ void Device::saveScene(SceneNo aSceneNo)
   ALOG(LOG_NOTICE, "SaveScene(%d)", aSceneNo);
   SceneDeviceSettingsPtr scenes = boost::dynamic_pointer_cast<SceneDeviceSettings>(deviceSettings);
   if (scenes) {
-    // we have a device-wide scene table, get the scene object
-    DsScenePtr scene = scenes->getScene(aSceneNo);
+    // we have a device-wide scene table, get the scene object for modification
+    DsScenePtr scene = scenes->getWritableScene(aSceneNo);
     if (scene) {
       // scene found, now capture to all of our outputs
       if (output) {
@@ -1241,7 +1296,7 @@ void Device::outputSceneValueSaved(DsScenePtr aScene)
         aScene->setDontCare(mustBeDontCare);
         // also update the off scene's dontCare
         SceneDeviceSettingsPtr scenes = boost::dynamic_pointer_cast<SceneDeviceSettings>(deviceSettings);
-        DsScenePtr offScene = scenes->getScene(offSceneForArea(area));
+        DsScenePtr offScene = scenes->getWritableScene(offSceneForArea(area));
         if (offScene) {
           offScene->setDontCare(mustBeDontCare);
           // update scene in scene table and DB if dirty
@@ -1317,6 +1372,16 @@ ErrorPtr Device::save()
 }
 
 
+void Device::collectDirtyParams(FlushedParamsVector &aList)
+{
+  if (deviceSettings) deviceSettings->collectDirtyParams(aList);
+  for (BehaviourVector::iterator pos = buttons.begin(); pos!=buttons.end(); ++pos) noteDirtyParams(aList, **pos);
+  for (BehaviourVector::iterator pos = binaryInputs.begin(); pos!=binaryInputs.end(); ++pos) noteDirtyParams(aList, **pos);
+  for (BehaviourVector::iterator pos = sensors.begin(); pos!=sensors.end(); ++pos) noteDirtyParams(aList, **pos);
+  if (output) noteDirtyParams(aList, *output);
+}
+
+
 ErrorPtr Device::forget()
 {
   // delete the device settings
@@ -1566,6 +1631,19 @@ PropertyContainerPtr Device::getContainer(PropertyDescriptorPtr &aPropertyDescri
 }
 
 
+PropertyContainerPtr Device::getContainerForWrite(PropertyDescriptorPtr &aPropertyDescriptor, int &aDomain)
+{
+  if (aPropertyDescriptor->hasObjectKey(device_scenes_key)) {
+    // default scenes are shared, writing needs a scene object of this device
+    SceneDeviceSettingsPtr scenes = boost::dynamic_pointer_cast<SceneDeviceSettings>(deviceSettings);
+    if (scenes) {
+      return scenes->getWritableScene(aPropertyDescriptor->fieldKey());
+    }
+  }
+  return getContainer(aPropertyDescriptor, aDomain);
+}
+
+
 
 bool Device::accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, PropertyDescriptorPtr aPropertyDescriptor)
 {
@@ -1649,6 +1727,18 @@ ErrorPtr Device::writtenProperty(PropertyAccessMode aMode, PropertyDescriptorPtr
 }
 
 
+void Device::subtreeChanged(uint64_t aGeneration)
+{
+  inherited::subtreeChanged(aGeneration);
+  // scratch devices are not part of the vdc's device tree
+  if (!isScratch()) {
+    classContainerP->subtreeChanged(aGeneration);
+    // changes might include settings, make sure next flush will save them
+    getDeviceContainer().deviceChanged(*this);
+  }
+}
+
+
 #pragma mark - Device description/shortDesc
 
 
@@ -96,6 +96,12 @@ namespace p44 {
     SimpleCB updatedOrCachedCB; ///< will be called when current values are either read from hardware, or new values have been requested for applying
     bool updateInProgress; ///< set when updating channel values from hardware is in progress
     long serializerWatchdogTicket; ///< watchdog terminating non-responding hardware requests
+    MLMicroSeconds applyPendingSince; ///< time when an apply request had to start waiting for the hardware, Never if none waiting
+    MLMicroSeconds hwAccessStart; ///< time when the currently running apply or sync was started, Never if none running
+
+    // behaviour state push merging
+    ApiValuePtr pendingStatesPush; ///< query for all behaviour states to be pushed together at end of this mainloop cycle
+    long statesPushTicket; ///< ticket for sending pendingStatesPush
 
   public:
     Device(DeviceClassContainer *aClassContainerP);
@@ -199,6 +205,10 @@ namespace p44 {
     /// @note this is usually called from the device container in regular intervals
     virtual ErrorPtr save();
 
+    /// collect the persistent objects that will be written by the next save()
+    /// @param aList list to add objects with unsaved changes to
+    void collectDirtyParams(FlushedParamsVector &aList);
+
     /// forget any parameters stored in persistent DB
     virtual ErrorPtr forget();
 
@@ -376,6 +386,9 @@ namespace p44 {
     /// @return textual description of object, may contain LFs
     virtual string description();
 
+    /// mark this device's subtree changed, passes change on to the vdc (unless this is a scratch device)
+    virtual void subtreeChanged(uint64_t aGeneration);
+
   protected:
 
 
@@ -421,6 +434,7 @@ namespace p44 {
     virtual PropertyDescriptorPtr getDescriptorByIndex(int aPropIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
     virtual PropertyDescriptorPtr getDescriptorByName(string aPropMatch, int &aStartIndex, int aDomain, PropertyDescriptorPtr aParentDescriptor);
     virtual PropertyContainerPtr getContainer(PropertyDescriptorPtr &aPropertyDescriptor, int &aDomain);
+    virtual PropertyContainerPtr getContainerForWrite(PropertyDescriptorPtr &aPropertyDescriptor, int &aDomain);
     virtual bool accessField(PropertyAccessMode aMode, ApiValuePtr aPropValue, PropertyDescriptorPtr aPropertyDescriptor);
     virtual ErrorPtr writtenProperty(PropertyAccessMode aMode, PropertyDescriptorPtr aPropertyDescriptor, int aDomain, PropertyContainerPtr aContainer);
 
@@ -437,6 +451,9 @@ namespace p44 {
 
     DsGroupMask behaviourGroups();
 
+    bool queueBehaviourStatePush(const string &aStatesName, size_t aIndex);
+    void sendQueuedStatesPush();
+
     void dimAutostopHandler(DsChannelType aChannel);
     void dimHandler(ChannelBehaviourPtr aChannel, double aIncrement, MLMicroSeconds aNow);
     void dimDoneHandler(ChannelBehaviourPtr aChannel, double aIncrement, MLMicroSeconds aNextDimAt);
@@ -449,6 +466,7 @@ namespace p44 {
     void updatingChannelsComplete();
     void serializerWatchdog();
     bool checkForReapply();
+    void recordHardwareAccess(const char *aKind);
     void forkDoneCB(SimpleCB aOriginalCB, SimpleCB aNewCallback);
 
   };
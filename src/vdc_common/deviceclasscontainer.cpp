@@ -95,6 +95,12 @@ ErrorPtr DeviceClassContainer::handleMethod(VdcApiRequestPtr aRequest, const str
 }
 
 
+ErrorPtr DeviceClassContainer::runBenchmark(const string &aBenchmark, ApiValuePtr aParams, ApiValuePtr aResult, StatusCB aCompletedCB)
+{
+  return ErrorPtr(new WebError(400, "unknown benchmark"));
+}
+
+
 void DeviceClassContainer::collectDevicesMethodComplete(VdcApiRequestPtr aRequest, ErrorPtr aError)
 {
   // devices re-collected, return ok (empty response)
@@ -191,6 +197,7 @@ bool DeviceClassContainer::addDevice(DevicePtr aDevice)
     // not a duplicate
     // - save in my own list
     devices.push_back(aDevice);
+    propertiesChanged();
     // added
     return true;
   }
@@ -209,6 +216,7 @@ void DeviceClassContainer::removeDevice(DevicePtr aDevice, bool aForget)
 			break;
 		}
 	}
+  propertiesChanged();
   // remove from global device container
   deviceContainerP->removeDevice(aDevice, aForget);
 }
@@ -225,6 +233,7 @@ void DeviceClassContainer::removeDevices(bool aForget)
   }
   // clear my own list
   devices.clear();
+  propertiesChanged();
 }
 
 
@@ -408,6 +417,13 @@ bool DeviceClassContainer::accessField(PropertyAccessMode aMode, ApiValuePtr aPr
 }
 
 
+void DeviceClassContainer::subtreeChanged(uint64_t aGeneration)
+{
+  inherited::subtreeChanged(aGeneration);
+  deviceContainerP->subtreeChanged(aGeneration);
+}
+
+
 #pragma mark - persistence implementation
 
 // SQLIte3 table name to store these parameters to
@@ -151,6 +151,16 @@ namespace p44 {
     /// vdc level methods (p44 specific)
     virtual ErrorPtr handleMethod(VdcApiRequestPtr aRequest, const string &aMethod, ApiValuePtr aParams);
 
+    /// run a vdc specific performance benchmark on the main loop
+    /// @param aBenchmark name of the benchmark
+    /// @param aParams benchmark specific parameters, such as "repeat"
+    /// @param aResult object to add the measured values to
+    /// @param aCompletedCB called when a benchmark that yields to the main loop has completed (and has added its values to aResult)
+    /// @return error if benchmark is unknown or parameters are out of range, explicit OK if aResult is complete already,
+    ///   NULL if the benchmark continues and aCompletedCB will be called later
+    /// @note only exposed via the p44 config API, not to the vdSM
+    virtual ErrorPtr runBenchmark(const string &aBenchmark, ApiValuePtr aParams, ApiValuePtr aResult, StatusCB aCompletedCB);
+
     /// @}
 
 
@@ -201,6 +211,18 @@ namespace p44 {
     /// @note learn events (new devices found or devices removed) must be reported by calling reportLearnEvent() on DeviceContainer.
     virtual void setLearnMode(bool aEnableLearning, bool aDisableProximityCheck) { /* NOP in base class */ }
 
+    /// get information to re-create a device at next startup without accessing hardware (fast start)
+    /// @param aDevice a device of this class container
+    /// @return compact, class specific binary info, or empty string if this device cannot be restored from a snapshot
+    /// @note class containers supporting this must also implement deviceFromSnapshotInfo(), and must support
+    ///   incremental collection, which is used to reconcile restored devices with the actual hardware.
+    virtual string deviceSnapshotInfo(DevicePtr aDevice) { return ""; };
+
+    /// re-create a device from snapshot info (without accessing hardware)
+    /// @param aSnapshotInfo info as returned by deviceSnapshotInfo() in a previous run
+    /// @return new device object, not yet added, or NULL if it cannot be re-created
+    virtual DevicePtr deviceFromSnapshotInfo(const string &aSnapshotInfo) { return DevicePtr(); };
+
     /// @}
 
 
@@ -290,6 +312,9 @@ namespace p44 {
     /// @return textual description of object
     virtual string description();
 
+    /// mark this vdc's subtree changed, passes change on to the vdc host
+    virtual void subtreeChanged(uint64_t aGeneration);
+
   protected:
 
     // property access implementation
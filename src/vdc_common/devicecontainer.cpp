@@ -48,15 +48,35 @@ using namespace p44;
 // how long vDC waits after receiving ok from one announce until it fires the next
 #define ANNOUNCE_PAUSE (10*MilliSecond)
 
+// how many announcements may be in flight (sent, but not yet acknowledged) at the same time by default
+#define DEFAULT_ANNOUNCE_WINDOW 5
+
+// how many times a failed announcement is retried immediately (afterwards, ANNOUNCE_RETRY_TIMEOUT applies)
+#define ANNOUNCE_MAX_RETRIES 3
+
 // how long until a not acknowledged registrations is considered timed out (and next device can be attempted)
 #define ANNOUNCE_TIMEOUT (30*Second)
 
 // how long until a not acknowledged announcement for a device is retried again for the same device
 #define ANNOUNCE_RETRY_TIMEOUT (300*Second)
 
+// how much time one periodic flush may spend saving changed devices (0=no limit)
+#define DEFAULT_FLUSH_TIME_BUDGET (100*MilliSecond)
+
+// how many devices not noted as changed are saved in one periodic flush anyway, to catch changes made without notification
+#define FLUSH_SWEEP_DEVICES 10
+
+// flushes taking longer than this are logged as warning, as they noticeably stall the main loop
+#define FLUSH_WARNING_TIME (200*MilliSecond)
+
 // default product name
 #define DEFAULT_PRODUCT_NAME "plan44.ch vdcd"
 
+// device tree snapshot file
+#define SNAPSHOT_FILE_NAME "DeviceTree.snapshot"
+#define SNAPSHOT_MAGIC "P44T"
+#define SNAPSHOT_VERSION 1
+
 DeviceContainer::DeviceContainer() :
   inheritedParams(dsParamStore),
   mac(0),
@@ -71,8 +91,17 @@ DeviceContainer::DeviceContainer() :
   localDimDirection(0), // undefined
   mainloopStatsInterval(DEFAULT_MAINLOOP_STATS_INTERVAL),
   mainLoopStatsCounter(0),
+  flushTimeBudget(DEFAULT_FLUSH_TIME_BUDGET),
+  maxFlushTime(0),
+  maxPendingAnnounces(DEFAULT_ANNOUNCE_WINDOW),
+  fastStartPending(false),
+  restoringSnapshot(false),
+  snapshotWriting(false),
+  snapshotWritePending(false),
+  pendingSnapshotDevices(0),
   productName(DEFAULT_PRODUCT_NAME)
 {
+  workerPool.setMetrics(&metrics);
   // obtain MAC address
   mac = macAddress();
   deriveDsUid(); // make sure we have a vdc host dSUID FROM THE BEGINNING. Usually, setIdMode derives it again, but just in case...
@@ -324,6 +353,8 @@ class DeviceClassCollector
   ContainerMap::iterator nextContainer;
   DeviceContainer *deviceContainerP;
   DsDeviceMap::iterator nextDevice;
+  MLMicroSeconds containerStart; ///< for timing collection per vdc
+  MLMicroSeconds initStart; ///< for timing device initialisation
 public:
   static void collectDevices(DeviceContainer *aDeviceContainerP, StatusCB aCallback, bool aIncremental, bool aExhaustive, bool aClearSettings)
   {
@@ -347,13 +378,17 @@ private:
   {
     if (!aError && nextContainer!=deviceContainerP->deviceClassContainers.end()) {
       DeviceClassContainerPtr vdc = nextContainer->second;
+      // vdcs with devices restored from snapshot must keep these, so they are collected incrementally
+      bool restored = deviceContainerP->isRestoredVdc(vdc);
       LOG(LOG_NOTICE,
-        "=== collecting devices from vdc %s (%s #%d)",
+        "=== collecting devices from vdc %s (%s #%d)%s",
         vdc->shortDesc().c_str(),
         vdc->deviceClassIdentifier(),
-        vdc->getInstanceNumber()
+        vdc->getInstanceNumber(),
+        restored ? " in background, to reconcile devices restored from snapshot" : ""
       );
-      nextContainer->second->collectDevices(boost::bind(&DeviceClassCollector::containerQueried, this, _1), incremental, exhaustive, clear);
+      containerStart = MainLoop::now();
+      nextContainer->second->collectDevices(boost::bind(&DeviceClassCollector::containerQueried, this, _1), incremental || restored, exhaustive, clear);
     }
     else
       collectedAll(aError);
@@ -363,7 +398,9 @@ private:
   {
     // load persistent params
     nextContainer->second->load();
-    LOG(LOG_NOTICE, "=== done collecting from %s\n", nextContainer->second->shortDesc().c_str());
+    MLMicroSeconds t = MainLoop::now()-containerStart;
+    deviceContainerP->metrics.recordLatency(string("collect.")+nextContainer->second->deviceClassIdentifier(), t);
+    LOG(LOG_NOTICE, "=== done collecting from %s in %.3f S\n", nextContainer->second->shortDesc().c_str(), (double)t/Second);
     // check next
     ++nextContainer;
     queryNextContainer(aError);
@@ -373,6 +410,7 @@ private:
   void collectedAll(ErrorPtr aError)
   {
     // now have each of them initialized
+    initStart = MainLoop::now();
     nextDevice = deviceContainerP->dSDevices.begin();
     initializeNextDevice(ErrorPtr());
   }
@@ -380,6 +418,10 @@ private:
 
   void initializeNextDevice(ErrorPtr aError)
   {
+    // devices restored from snapshot are already initialized
+    while (nextDevice!=deviceContainerP->dSDevices.end() && deviceContainerP->snapshotDevices.count(nextDevice->first)>0) {
+      ++nextDevice;
+    }
     if (!aError && nextDevice!=deviceContainerP->dSDevices.end())
       // TODO: now never doing factory reset init, maybe parametrize later
       nextDevice->second->initializeDevice(boost::bind(&DeviceClassCollector::deviceInitialized, this, _1), false);
@@ -399,6 +441,12 @@ private:
 
   void completed(ErrorPtr aError)
   {
+    deviceContainerP->metrics.recordLatency("collect.initialize", MainLoop::now()-initStart);
+    // remove restored devices not found again, and update snapshot for next start
+    deviceContainerP->reconcileSnapshotDevices(aError);
+    if (Error::isOK(aError)) {
+      deviceContainerP->saveDeviceSnapshot();
+    }
     callback(aError);
     deviceContainerP->collecting = false;
     // done, delete myself
@@ -411,8 +459,7 @@ private:
 
 void DeviceContainer::collectDevices(StatusCB aCompletedCB, bool aIncremental, bool aExhaustive, bool aClearSettings)
 {
-  if (!collecting) {
-    collecting = true;
+  if (!collecting && !restoringSnapshot) {
     if (!aIncremental) {
       // only for non-incremental collect, close vdsm connection
       if (activeSessionConnection) {
@@ -422,11 +469,29 @@ void DeviceContainer::collectDevices(StatusCB aCompletedCB, bool aIncremental, b
         activeSessionConnection.reset(); // forget connection
       }
       dSDevices.clear(); // forget existing ones
+      if (fastStartPending && !aClearSettings) {
+        // restore devices from the previous run's snapshot first. These are initialized and
+        // announced right away (addDevice() does so because we are not collecting yet),
+        // the actual collection only starts once the restore has finished
+        fastStartPending = false;
+        restoringSnapshot = true;
+        loadDeviceSnapshot(boost::bind(&DeviceContainer::startCollecting, this, aCompletedCB, aIncremental, aExhaustive, aClearSettings));
+        return;
+      }
     }
-    DeviceClassCollector::collectDevices(this, aCompletedCB, aIncremental, aExhaustive, aClearSettings);
+    fastStartPending = false; // only at first collect
+    startCollecting(aCompletedCB, aIncremental, aExhaustive, aClearSettings);
   }
 }
 
+
+void DeviceContainer::startCollecting(StatusCB aCompletedCB, bool aIncremental, bool aExhaustive, bool aClearSettings)
+{
+  restoringSnapshot = false;
+  collecting = true;
+  DeviceClassCollector::collectDevices(this, aCompletedCB, aIncremental, aExhaustive, aClearSettings);
+}
+
 } // namespace
 
 
@@ -443,7 +508,12 @@ bool DeviceContainer::addDevice(DevicePtr aDevice)
   // check if device with same dSUID already exists
   DsDeviceMap::iterator pos = dSDevices.find(aDevice->getDsUid());
   if (pos!=dSDevices.end()) {
-    LOG(LOG_INFO, "- device %s already registered, not added again",aDevice->shortDesc().c_str());
+    if (unconfirmedDevices.erase(aDevice->getDsUid())>0) {
+      LOG(LOG_INFO, "- device %s restored from snapshot is confirmed present",aDevice->shortDesc().c_str());
+    }
+    else {
+      LOG(LOG_INFO, "- device %s already registered, not added again",aDevice->shortDesc().c_str());
+    }
     return false; // duplicate dSUID, not added
   }
   // set for given dSUID in the container-wide map of devices
@@ -451,6 +521,8 @@ bool DeviceContainer::addDevice(DevicePtr aDevice)
   LOG(LOG_NOTICE, "--- added device: %s (not yet initialized)",aDevice->shortDesc().c_str());
   // load the device's persistent params
   aDevice->load();
+  // new devices might have settings not yet stored
+  deviceChanged(*aDevice);
   // if not collecting, initialize device right away.
   // Otherwise, initialisation will be done when collecting is complete
   if (!collecting) {
@@ -482,11 +554,244 @@ void DeviceContainer::removeDevice(DevicePtr aDevice, bool aForget)
   }
   // remove from container-wide map of devices
   dSDevices.erase(aDevice->getDsUid());
+  snapshotDevices.erase(aDevice->getDsUid());
+  unconfirmedDevices.erase(aDevice->getDsUid());
   LOG(LOG_NOTICE, "--- removed device: %s", aDevice->shortDesc().c_str());
 }
 
 
 
+#pragma mark - device tree snapshot
+
+// Snapshot file format:
+// - header: SNAPSHOT_MAGIC, 1 byte SNAPSHOT_VERSION
+// - per device: 1 byte length + binary dSUID of the vdc, 2 bytes length (MSB first) + class specific device info
+
+
+// strerror_r() is the GNU variant returning the message on Linux, but the XSI variant returning a status on OS X
+static const char *strerrorResult(int aStatus, const char *aBuf) { return aStatus==0 ? aBuf : "unknown error"; }
+static const char *strerrorResult(const char *aMsg, const char *aBuf) { return aMsg; }
+
+static string errnoText(int aErrno)
+{
+  char buf[128];
+  buf[0] = 0;
+  return strerrorResult(strerror_r(aErrno, buf, sizeof(buf)), buf);
+}
+
+
+string DeviceContainer::snapshotFilePath()
+{
+  return string(getPersistentDataDir()) + SNAPSHOT_FILE_NAME;
+}
+
+
+void DeviceContainer::saveDeviceSnapshot()
+{
+  string data = SNAPSHOT_MAGIC;
+  data += (char)SNAPSHOT_VERSION;
+  int numDevices = 0;
+  for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
+    DevicePtr dev = pos->second;
+    string info = dev->classContainerP->deviceSnapshotInfo(dev);
+    if (info.empty() || info.size()>0xFFFF) continue; // not restorable
+    string vdcId = dev->classContainerP->getDsUid().getBinary();
+    data += (char)vdcId.size();
+    data += vdcId;
+    data += (char)((info.size()>>8) & 0xFF);
+    data += (char)(info.size() & 0xFF);
+    data += info;
+    numDevices++;
+  }
+  if (snapshotWriting) {
+    // only one write at a time, the newest data is written when the current write has completed
+    snapshotWritePending = true;
+    pendingSnapshotData = data;
+    pendingSnapshotDevices = numDevices;
+    return;
+  }
+  startSnapshotWrite(data, numDevices);
+}
+
+
+void DeviceContainer::startSnapshotWrite(const string &aData, int aNumDevices)
+{
+  // writing the file is done by a worker, so slow flash does not stall the main loop
+  snapshotWriting = true;
+  string *errP = new string;
+  workerPool.submit(
+    boost::bind(&DeviceContainer::writeSnapshotFile, snapshotFilePath(), aData, errP),
+    boost::bind(&DeviceContainer::snapshotSaved, this, aNumDevices, aData.size(), errP)
+  );
+}
+
+
+void DeviceContainer::writeSnapshotFile(const string aPath, const string aData, string *aErrP)
+{
+  // Note: runs in a worker thread
+  // write to temp file first and then rename, so a crash while writing cannot leave a corrupt snapshot
+  string tmpPath = aPath + ".tmp";
+  FILE *f = fopen(tmpPath.c_str(), "wb");
+  if (f) {
+    bool ok = fwrite(aData.data(), 1, aData.size(), f)==aData.size();
+    ok = fclose(f)==0 && ok;
+    if (ok && rename(tmpPath.c_str(), aPath.c_str())==0) {
+      return;
+    }
+  }
+  int err = errno;
+  *aErrP = string_format("Cannot save device tree snapshot to %s: %s", aPath.c_str(), errnoText(err).c_str());
+}
+
+
+void DeviceContainer::snapshotSaved(int aNumDevices, size_t aSize, string *aErrP)
+{
+  if (aErrP->empty()) {
+    LOG(LOG_INFO, "Saved device tree snapshot with %d devices (%zu bytes)", aNumDevices, aSize);
+  }
+  else {
+    LOG(LOG_ERR, "%s", aErrP->c_str());
+  }
+  delete aErrP;
+  snapshotWriting = false;
+  if (snapshotWritePending) {
+    // snapshot has changed while writing, write newest data now
+    snapshotWritePending = false;
+    string data;
+    data.swap(pendingSnapshotData);
+    startSnapshotWrite(data, pendingSnapshotDevices);
+  }
+}
+
+
+void DeviceContainer::loadDeviceSnapshot(SimpleCB aDoneCB)
+{
+  // reading the file is done by a worker, restoring the devices from it on the main loop
+  string *dataP = new string;
+  string *errP = new string;
+  workerPool.submit(
+    boost::bind(&DeviceContainer::readSnapshotFile, snapshotFilePath(), dataP, errP),
+    boost::bind(&DeviceContainer::snapshotLoaded, this, MainLoop::now(), dataP, errP, aDoneCB)
+  );
+}
+
+
+void DeviceContainer::readSnapshotFile(const string aPath, string *aDataP, string *aErrP)
+{
+  // Note: runs in a worker thread
+  FILE *f = fopen(aPath.c_str(), "rb");
+  if (!f) {
+    int err = errno;
+    *aErrP = errnoText(err);
+    return;
+  }
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f))>0) aDataP->append(buf, n);
+  fclose(f);
+}
+
+
+void DeviceContainer::snapshotLoaded(MLMicroSeconds aStarted, string *aDataP, string *aErrP, SimpleCB aDoneCB)
+{
+  if (!aErrP->empty()) {
+    LOG(LOG_NOTICE, "No device tree snapshot available (%s) -> normal collection", aErrP->c_str());
+  }
+  else {
+    restoreDeviceSnapshot(*aDataP);
+    metrics.recordLatency("collect.snapshot", MainLoop::now()-aStarted);
+  }
+  delete aDataP;
+  delete aErrP;
+  if (aDoneCB) aDoneCB();
+}
+
+
+bool DeviceContainer::restoreDeviceSnapshot(const string &aData)
+{
+  MLMicroSeconds started = MainLoop::now();
+  size_t i = strlen(SNAPSHOT_MAGIC);
+  if (aData.size()<i+1 || aData.compare(0, i, SNAPSHOT_MAGIC)!=0 || (uint8_t)aData[i]!=SNAPSHOT_VERSION) {
+    LOG(LOG_WARNING, "Device tree snapshot is invalid or has unknown version -> ignored, normal collection");
+    return false;
+  }
+  i++;
+  int skipped = 0;
+  while (i<aData.size()) {
+    // - vdc dSUID
+    size_t len = (uint8_t)aData[i++];
+    if (i+len+2>aData.size()) break;
+    DsUid vdcUid;
+    vdcUid.setAsBinary(aData.substr(i, len));
+    i += len;
+    // - device info
+    len = ((uint8_t)aData[i]<<8) + (uint8_t)aData[i+1];
+    i += 2;
+    if (i+len>aData.size()) break;
+    string info = aData.substr(i, len);
+    i += len;
+    // re-create the device
+    ContainerMap::iterator vpos = deviceClassContainers.find(vdcUid);
+    DevicePtr dev;
+    if (vpos!=deviceClassContainers.end()) {
+      dev = vpos->second->deviceFromSnapshotInfo(info);
+    }
+    if (dev && vpos->second->addDevice(dev)) {
+      // device is initialized and announced right away, but must be confirmed by background collection
+      snapshotDevices[dev->getDsUid()] = dev;
+      unconfirmedDevices[dev->getDsUid()] = dev;
+    }
+    else {
+      skipped++;
+    }
+  }
+  if (i<aData.size()) {
+    LOG(LOG_WARNING, "Device tree snapshot is truncated, restored devices up to truncation point");
+  }
+  MLMicroSeconds t = MainLoop::now()-started;
+  LOG(LOG_NOTICE,
+    "=== restored %zu devices from device tree snapshot in %.3f S (%d skipped), collecting in background",
+    snapshotDevices.size(), (double)t/Second, skipped
+  );
+  return !snapshotDevices.empty();
+}
+
+
+bool DeviceContainer::isRestoredVdc(DeviceClassContainerPtr aVdc)
+{
+  for (DsDeviceMap::iterator pos = snapshotDevices.begin(); pos!=snapshotDevices.end(); ++pos) {
+    if (pos->second->classContainerP==aVdc.get()) return true;
+  }
+  return false;
+}
+
+
+void DeviceContainer::reconcileSnapshotDevices(ErrorPtr aCollectError)
+{
+  if (snapshotDevices.empty()) return; // not a fast start
+  if (Error::isOK(aCollectError)) {
+    // restored devices that were not found again by the collection are gone
+    DsDeviceMap gone = unconfirmedDevices; // copy, as removeDevice() modifies unconfirmedDevices
+    for (DsDeviceMap::iterator pos = gone.begin(); pos!=gone.end(); ++pos) {
+      DevicePtr dev = pos->second;
+      LOG(LOG_NOTICE, "--- device %s restored from snapshot is no longer present -> removed", dev->shortDesc().c_str());
+      dev->reportVanished();
+      dev->classContainerP->removeDevice(dev, false);
+    }
+    LOG(LOG_NOTICE, "=== reconciled devices restored from snapshot: %zu confirmed, %zu removed", snapshotDevices.size(), gone.size());
+  }
+  else if (!unconfirmedDevices.empty()) {
+    LOG(LOG_WARNING,
+      "Background collection failed (%s) -> keeping %zu unconfirmed devices restored from snapshot",
+      aCollectError->description().c_str(), unconfirmedDevices.size()
+    );
+  }
+  snapshotDevices.clear();
+  unconfirmedDevices.clear();
+}
+
+
+
 void DeviceContainer::startLearning(LearnCB aLearnHandler, bool aDisableProximityCheck)
 {
   // enable learning in all class containers
@@ -601,23 +906,16 @@ void DeviceContainer::periodicTask(MLMicroSeconds aCycleStartTime)
       // check again for devices that need to be announced
       startAnnouncing();
       // do a save run as well
-      // - myself
-      save();
-      // - device containers
-      for (ContainerMap::iterator pos = deviceClassContainers.begin(); pos!=deviceClassContainers.end(); ++pos) {
-        pos->second->save();
-      }
-      // - devices
-      for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
-        pos->second->save();
-      }
+      flushPersistentParams();
     }
   }
   if (mainloopStatsInterval>0) {
     // show mainloop statistics
     if (mainLoopStatsCounter<=0) {
       LOG(LOG_INFO, "%s", MainLoop::currentMainLoop().description().c_str());
+      LOG(LOG_INFO, "Longest persistent params flush: %.3f mS", (double)maxFlushTime/MilliSecond);
       MainLoop::currentMainLoop().statistics_reset();
+      maxFlushTime = 0;
       mainLoopStatsCounter = mainloopStatsInterval;
     }
     else {
@@ -629,6 +927,114 @@ void DeviceContainer::periodicTask(MLMicroSeconds aCycleStartTime)
 }
 
 
+void DeviceContainer::deviceChanged(Device &aDevice)
+{
+  changedDevices.insert(aDevice.getDsUid());
+}
+
+
+void DeviceContainer::flushPersistentParams()
+{
+  MLMicroSeconds flushStart = MainLoop::now();
+  // group all writes of this flush into one transaction, so the DB only needs to sync once
+  bool inTransaction = dsParamStore.execute("BEGIN")==SQLITE_OK;
+  if (!inTransaction) {
+    LOG(LOG_WARNING, "Could not start flush transaction, saving without: %s", dsParamStore.error_msg());
+  }
+  // - remember what gets written, because a failed transaction must leave these objects unsaved
+  FlushedParamsVector flushed;
+  std::vector<DsUid> flushedDevices;
+  // - myself
+  if (inTransaction) noteDirtyParams(flushed, *this);
+  save();
+  // - device containers
+  for (ContainerMap::iterator pos = deviceClassContainers.begin(); pos!=deviceClassContainers.end(); ++pos) {
+    if (inTransaction) noteDirtyParams(flushed, *(pos->second));
+    pos->second->save();
+  }
+  // - devices noted as changed, as long as the time budget allows
+  while (!changedDevices.empty()) {
+    if (flushTimeBudget>0 && MainLoop::now()-flushStart>flushTimeBudget) {
+      LOG(LOG_INFO, "Flush time budget used up, %zu changed devices will be saved in next flush", changedDevices.size());
+      break;
+    }
+    DsUid uid = *changedDevices.begin();
+    changedDevices.erase(changedDevices.begin());
+    DsDeviceMap::iterator pos = dSDevices.find(uid);
+    if (pos==dSDevices.end()) continue; // device is gone (or noted before it got its final dSUID)
+    if (inTransaction) pos->second->collectDirtyParams(flushed);
+    pos->second->save();
+    flushedDevices.push_back(uid);
+  }
+  // - safety net: a few more devices per flush, continuing where the last flush has stopped
+  //   Note: PersistentParams only issue SQL for dirty records, so visiting clean objects is cheap
+  DsDeviceMap::iterator pos = dSDevices.lower_bound(nextDeviceToSweep);
+  for (int n=0; n<FLUSH_SWEEP_DEVICES && n<(int)dSDevices.size(); n++) {
+    if (pos==dSDevices.end()) pos = dSDevices.begin(); // wrap around
+    if (inTransaction) pos->second->collectDirtyParams(flushed);
+    pos->second->save();
+    ++pos;
+  }
+  if (pos==dSDevices.end())
+    nextDeviceToSweep = DsUid(); // start at beginning
+  else
+    nextDeviceToSweep = pos->first;
+  if (inTransaction) {
+    if (dsParamStore.execute("COMMIT")!=SQLITE_OK) {
+      LOG(LOG_ERR, "Error committing flush transaction: %s -> %zu records will be written again", dsParamStore.error_msg(), flushed.size());
+      dsParamStore.execute("ROLLBACK");
+      // saving has cleared the dirty flags, but nothing was actually written
+      restoreDirtyParams(flushed);
+      changedDevices.insert(flushedDevices.begin(), flushedDevices.end());
+    }
+  }
+  // statistics
+  MLMicroSeconds flushTime = MainLoop::now()-flushStart;
+  if (flushTime>maxFlushTime) maxFlushTime = flushTime;
+  metrics.recordLatency("persistence.flush", flushTime);
+  metrics.count("persistence.flushedDevices", flushedDevices.size());
+  LOG(flushTime>FLUSH_WARNING_TIME ? LOG_WARNING : LOG_DEBUG, "Persistent params flush took %.3f mS", (double)flushTime/MilliSecond);
+}
+
+
+void DeviceContainer::flushBenchmark(int aChanged, int aRepeat, ApiValuePtr aResult)
+{
+  if (aChanged>(int)dSDevices.size()) aChanged = (int)dSDevices.size();
+  MLMicroSeconds journalTime = 0;
+  MLMicroSeconds sweepTime = 0;
+  DsDeviceMap::iterator pos = dSDevices.begin();
+  for (int r=0; r<aRepeat; r++) {
+    // journal: make a few devices dirty, then flush as the periodic task does
+    for (int n=0; n<aChanged; n++, ++pos) {
+      if (pos==dSDevices.end()) pos = dSDevices.begin();
+      if (pos->second->deviceSettings) pos->second->deviceSettings->markDirty();
+      deviceChanged(*(pos->second));
+    }
+    MLMicroSeconds start = MainLoop::now();
+    flushPersistentParams();
+    journalTime += MainLoop::now()-start;
+    // sweep: make the same number of devices dirty, then visit all devices in one transaction
+    for (int n=0; n<aChanged; n++, ++pos) {
+      if (pos==dSDevices.end()) pos = dSDevices.begin();
+      if (pos->second->deviceSettings) pos->second->deviceSettings->markDirty();
+    }
+    start = MainLoop::now();
+    dsParamStore.execute("BEGIN");
+    for (DsDeviceMap::iterator dpos = dSDevices.begin(); dpos!=dSDevices.end(); ++dpos) {
+      dpos->second->save();
+    }
+    dsParamStore.execute("COMMIT");
+    sweepTime += MainLoop::now()-start;
+  }
+  aResult->add("devices", aResult->newUint64(dSDevices.size()));
+  aResult->add("changedPerFlush", aResult->newUint64(aChanged));
+  aResult->add("flushes", aResult->newUint64(aRepeat));
+  aResult->add("msPerJournalFlush", aResult->newDouble((double)journalTime/MilliSecond/aRepeat));
+  aResult->add("msPerFullSweep", aResult->newDouble((double)sweepTime/MilliSecond/aRepeat));
+}
+
+
+
 #pragma mark - local operation mode
 
 
@@ -764,10 +1170,33 @@ void DeviceContainer::vdcApiConnectionStatusHandler(VdcApiConnectionPtr aApiConn
 }
 
 
+// methods and notifications which get their own latency histogram
+static const char *apiMetricsMethods[] = {
+  "hello", "bye", "getProperty", "setProperty", "remove", "ping",
+  "callScene", "saveScene", "undoScene", "setLocalPriority", "callSceneMin", "identify",
+  "setControlValue", "dimChannel", "setOutputChannelValue",
+  "x-p44-getProperties", "x-p44-collectDevices", "x-p44-addDevice", "x-p44-removeDevice",
+  "x-p44-addProfile", "x-p44-groupDevices", "x-p44-ungroupDevice", "x-p44-teachInSignal",
+  "x-p44-daliScan", "x-p44-daliCmd", "x-p44-bridgeStats",
+  NULL
+};
+
+/// @return metrics name for an API method, "api.unknown" for methods not in apiMetricsMethods
+/// @note the method name comes from the peer, so it must not be used to create new histograms unchecked
+static string apiMetricsName(const string &aMethod)
+{
+  for (const char **m = apiMetricsMethods; *m; m++) {
+    if (aMethod==*m) return string("api.")+*m;
+  }
+  return "api.unknown";
+}
+
+
 void DeviceContainer::vdcApiRequestHandler(VdcApiConnectionPtr aApiConnection, VdcApiRequestPtr aRequest, const string &aMethod, ApiValuePtr aParams)
 {
   ErrorPtr respErr;
   signalActivity();
+  MLMicroSeconds handlingStart = MainLoop::now();
   // now process
   if (aRequest) {
     // Methods
@@ -836,6 +1265,8 @@ void DeviceContainer::vdcApiRequestHandler(VdcApiConnectionPtr aApiConnection, V
       LOG(LOG_WARNING, "Notification '%s' processing error: %s", aMethod.c_str(), respErr->description().c_str());
     }
   }
+  // account for the time spent in handling (does not include asynchronous completion of methods)
+  metrics.recordLatency(apiMetricsName(aMethod), MainLoop::now()-handlingStart);
 }
 
 
@@ -1033,6 +1464,8 @@ void DeviceContainer::resetAnnouncing()
 {
   // end pending announcement
   MainLoop::currentMainLoop().cancelExecutionTicket(announcementTicket);
+  announceQueue.clear();
+  pendingAnnounces.clear();
   // end all device sessions
   for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
     DevicePtr dev = pos->second;
@@ -1049,88 +1482,178 @@ void DeviceContainer::resetAnnouncing()
 
 
 
+/// check if announcements can be sent now
+bool DeviceContainer::announcingAllowed()
+{
+  // no announcements without session, and none during collect - except for devices restored from snapshot,
+  // which are already initialized while the actual collection runs in the background
+  return activeSessionConnection && (!collecting || !snapshotDevices.empty());
+}
+
+
 /// start announcing all not-yet announced entities to the vdSM
 void DeviceContainer::startAnnouncing()
 {
-  if (!collecting && announcementTicket==0 && activeSessionConnection) {
+  if (announcingAllowed()) {
+    if (announceQueue.empty() && pendingAnnounces.empty()) {
+      // previous round complete, check (once) for entities that need to be announced
+      queueAnnouncements();
+    }
     announceNext();
   }
 }
 
 
-void DeviceContainer::announceNext()
+/// put all not-yet announced entities into the announce queue, vdcs first
+void DeviceContainer::queueAnnouncements()
 {
-  if (collecting) return; // prevent announcements during collect.
-  // cancel re-announcing
-  MainLoop::currentMainLoop().cancelExecutionTicket(announcementTicket);
-  // announce vdcs first
+  MLMicroSeconds now = MainLoop::now();
+  AnnounceItem item;
+  item.retries = 0;
+  // vdcs first, because devices can only be announced after their vdc
   for (ContainerMap::iterator pos = deviceClassContainers.begin(); pos!=deviceClassContainers.end(); ++pos) {
     DeviceClassContainerPtr vdc = pos->second;
     if (
+      (!collecting || isRestoredVdc(vdc)) && // during background collection, only vdcs with restored devices
       vdc->announced==Never &&
-      (vdc->announcing==Never || MainLoop::now()>vdc->announcing+ANNOUNCE_RETRY_TIMEOUT) &&
+      (vdc->announcing==Never || now>vdc->announcing+ANNOUNCE_RETRY_TIMEOUT) &&
       (!vdc->invisibleWhenEmpty() || vdc->getNumberOfDevices()>0)
     ) {
-      // mark device as being in process of getting announced
-      vdc->announcing = MainLoop::now();
-      // call announcevdc method (need to construct here, because dSUID must be sent as vdcdSUID)
-      ApiValuePtr params = getSessionConnection()->newApiValue();
-      params->setType(apivalue_object);
-      params->add("dSUID", params->newBinary(vdc->getDsUid().getBinary()));
-      if (!sendApiRequest("announcevdc", params, boost::bind(&DeviceContainer::announceResultHandler, this, vdc, _2, _3, _4))) {
-        LOG(LOG_ERR, "Could not send vdc announcement message for %s %s", vdc->entityType(), vdc->shortDesc().c_str());
-        vdc->announcing = Never; // not registering
-      }
-      else {
-        LOG(LOG_NOTICE, "Sent vdc announcement for %s %s", vdc->entityType(), vdc->shortDesc().c_str());
-      }
-      // schedule a retry
-      announcementTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DeviceContainer::announceNext, this), ANNOUNCE_TIMEOUT);
-      // done for now, continues after ANNOUNCE_TIMEOUT or when registration acknowledged
-      return;
+      item.addressable = vdc;
+      announceQueue.push_back(item);
     }
   }
-  // check all devices for unnannounced ones and announce those
+  // then all unannounced devices
   for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
     DevicePtr dev = pos->second;
     if (
       dev->isPublicDS() && // only public ones
-      (dev->classContainerP->announced!=Never) && // class container must have already completed an announcement
+      (!collecting || snapshotDevices.count(dev->getDsUid())>0) && // during background collection, only restored devices
       dev->announced==Never &&
-      (dev->announcing==Never || MainLoop::now()>dev->announcing+ANNOUNCE_RETRY_TIMEOUT)
+      (dev->announcing==Never || now>dev->announcing+ANNOUNCE_RETRY_TIMEOUT)
     ) {
-      // mark device as being in process of getting announced
-      dev->announcing = MainLoop::now();
-      // call announce method
-      ApiValuePtr params = getSessionConnection()->newApiValue();
-      params->setType(apivalue_object);
-      // include link to vdc for device announcements
-      params->add("vdc_dSUID", params->newBinary(dev->classContainerP->getDsUid().getBinary()));
-      if (!dev->sendRequest("announcedevice", params, boost::bind(&DeviceContainer::announceResultHandler, this, dev, _2, _3, _4))) {
-        LOG(LOG_ERR, "Could not send device announcement message for %s %s", dev->entityType(), dev->shortDesc().c_str());
-        dev->announcing = Never; // not registering
+      item.addressable = dev;
+      announceQueue.push_back(item);
+    }
+  }
+  if (!announceQueue.empty()) {
+    LOG(LOG_INFO, "Queued %zu entities for announcement to vdSM", announceQueue.size());
+  }
+}
+
+
+void DeviceContainer::announceNext()
+{
+  if (!announcingAllowed()) return; // prevent announcements during collect or without session
+  // cancel re-announcing
+  MainLoop::currentMainLoop().cancelExecutionTicket(announcementTicket);
+  // free the window slots of announcements not acknowledged in time
+  MLMicroSeconds now = MainLoop::now();
+  for (DsAddressableList::iterator pos = pendingAnnounces.begin(); pos!=pendingAnnounces.end(); ) {
+    if (now>(*pos)->announcing+ANNOUNCE_TIMEOUT) {
+      LOG(LOG_WARNING, "Announcement for %s %s not acknowledged by vdSM in time", (*pos)->entityType(), (*pos)->shortDesc().c_str());
+      pos = pendingAnnounces.erase(pos);
+    }
+    else {
+      ++pos;
+    }
+  }
+  // send as many announcements as the window allows
+  while ((int)pendingAnnounces.size()<maxPendingAnnounces && !announceQueue.empty()) {
+    AnnounceItem item = announceQueue.front();
+    DevicePtr dev = boost::dynamic_pointer_cast<Device>(item.addressable);
+    if (dev) {
+      if (dSDevices.find(dev->getDsUid())==dSDevices.end()) {
+        // device has vanished meanwhile
+        announceQueue.pop_front();
+        continue;
       }
-      else {
-        LOG(LOG_NOTICE, "Sent device announcement for %s %s", dev->entityType(), dev->shortDesc().c_str());
+      if (dev->classContainerP->announced==Never) {
+        // class container must have already completed an announcement
+        if (dev->classContainerP->announcing!=Never && now<=dev->classContainerP->announcing+ANNOUNCE_TIMEOUT) {
+          // vdc announcement still in progress, continue when acknowledged
+          break;
+        }
+        // vdc announcement has failed, device will be queued again in a later round
+        announceQueue.pop_front();
+        continue;
       }
-      // schedule a retry
-      announcementTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DeviceContainer::announceNext, this), ANNOUNCE_TIMEOUT);
-      // done for now, continues after ANNOUNCE_TIMEOUT or when registration acknowledged
-      return;
     }
+    announceQueue.pop_front();
+    if (item.addressable->announced!=Never) continue; // already announced meanwhile
+    sendAnnouncement(item);
+  }
+  if (!pendingAnnounces.empty()) {
+    // supervise acknowledgement of pending announcements
+    announcementTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DeviceContainer::announceNext, this), ANNOUNCE_TIMEOUT);
   }
 }
 
 
-void DeviceContainer::announceResultHandler(DsAddressablePtr aAddressable, VdcApiRequestPtr aRequest, ErrorPtr &aError, ApiValuePtr aResultOrErrorData)
+bool DeviceContainer::sendAnnouncement(AnnounceItem &aItem)
 {
+  DsAddressablePtr a = aItem.addressable;
+  // mark entity as being in process of getting announced
+  a->announcing = MainLoop::now();
+  ApiValuePtr params = getSessionConnection()->newApiValue();
+  params->setType(apivalue_object);
+  bool sent;
+  DevicePtr dev = boost::dynamic_pointer_cast<Device>(a);
+  if (dev) {
+    // call announce method
+    // - include link to vdc for device announcements
+    params->add("vdc_dSUID", params->newBinary(dev->classContainerP->getDsUid().getBinary()));
+    sent = dev->sendRequest("announcedevice", params, boost::bind(&DeviceContainer::announceResultHandler, this, aItem, _2, _3, _4));
+  }
+  else {
+    // call announcevdc method (need to construct here, because dSUID must be sent as vdcdSUID)
+    params->add("dSUID", params->newBinary(a->getDsUid().getBinary()));
+    sent = sendApiRequest("announcevdc", params, boost::bind(&DeviceContainer::announceResultHandler, this, aItem, _2, _3, _4));
+  }
+  if (!sent) {
+    LOG(LOG_ERR, "Could not send announcement message for %s %s", a->entityType(), a->shortDesc().c_str());
+    a->announcing = Never; // not registering
+    return false;
+  }
+  LOG(LOG_NOTICE, "Sent announcement for %s %s", a->entityType(), a->shortDesc().c_str());
+  pendingAnnounces.push_back(a);
+  return true;
+}
+
+
+void DeviceContainer::announceFailed(AnnounceItem &aItem)
+{
+  if (aItem.retries<ANNOUNCE_MAX_RETRIES) {
+    // retry right away, before others (devices might depend on it in case it is a vdc)
+    aItem.retries++;
+    LOG(LOG_WARNING, "Retrying announcement for %s %s (retry #%d)", aItem.addressable->entityType(), aItem.addressable->shortDesc().c_str(), aItem.retries);
+    announceQueue.push_front(aItem);
+  }
+  // otherwise, announcing timestamp stays set, so entity will be queued again after ANNOUNCE_RETRY_TIMEOUT
+}
+
+
+void DeviceContainer::announceResultHandler(AnnounceItem aItem, VdcApiRequestPtr aRequest, ErrorPtr &aError, ApiValuePtr aResultOrErrorData)
+{
+  DsAddressablePtr a = aItem.addressable;
+  // no longer in flight
+  for (DsAddressableList::iterator pos = pendingAnnounces.begin(); pos!=pendingAnnounces.end(); ++pos) {
+    if (*pos==a) {
+      pendingAnnounces.erase(pos);
+      break;
+    }
+  }
   if (Error::isOK(aError)) {
     // set device announced successfully
-    LOG(LOG_NOTICE, "Announcement for %s %s acknowledged by vdSM", aAddressable->entityType(), aAddressable->shortDesc().c_str());
-    aAddressable->announced = MainLoop::now();
-    aAddressable->announcing = Never; // not announcing any more
+    LOG(LOG_NOTICE, "Announcement for %s %s acknowledged by vdSM", a->entityType(), a->shortDesc().c_str());
+    a->announced = MainLoop::now();
+    a->announcing = Never; // not announcing any more
+  }
+  else {
+    LOG(LOG_WARNING, "Announcement for %s %s failed: %s", a->entityType(), a->shortDesc().c_str(), aError->description().c_str());
+    announceFailed(aItem);
   }
-  // cancel retry timer
+  // cancel supervision timer
   MainLoop::currentMainLoop().cancelExecutionTicket(announcementTicket);
   // try next announcement, after a pause
   announcementTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&DeviceContainer::announceNext, this), ANNOUNCE_PAUSE);
@@ -1141,10 +1664,159 @@ void DeviceContainer::announceResultHandler(DsAddressablePtr aAddressable, VdcAp
 
 ErrorPtr DeviceContainer::handleMethod(VdcApiRequestPtr aRequest,  const string &aMethod, ApiValuePtr aParams)
 {
+  if (aMethod=="x-p44-getProperties") {
+    return getPropertiesHandler(aRequest, aParams);
+  }
   return inherited::handleMethod(aRequest, aMethod, aParams);
 }
 
 
+typedef vector<DsUid> DsUidVector;
+
+/// reads properties from a list of devices into a result, one device at a time
+/// @note when the result is streamed, reading pauses while the connection cannot keep up, so
+///   at most a few devices' worth of result text is held in memory at any time
+class DevicePropertiesReader
+{
+  DeviceContainer *deviceContainerP;
+  VdcApiRequestPtr request;
+  DsUidVector devices; ///< devices still to read (looked up when read, so devices vanishing meanwhile are skipped)
+  size_t nextDevice;
+  ApiValuePtr query;
+  uint64_t changedSince;
+  bool reportGeneration;
+  uint64_t generation;
+  ApiValuePtr result;
+  ApiValuePtr errors;
+public:
+  static void readProperties(DeviceContainer *aDeviceContainerP, VdcApiRequestPtr aRequest, const DsUidVector &aDevices, ApiValuePtr aQuery, uint64_t aChangedSince, bool aReportGeneration, uint64_t aGeneration, ApiValuePtr aResult, ApiValuePtr aErrors)
+  {
+    // create new instance, deletes itself when finished
+    new DevicePropertiesReader(aDeviceContainerP, aRequest, aDevices, aQuery, aChangedSince, aReportGeneration, aGeneration, aResult, aErrors);
+  };
+private:
+  DevicePropertiesReader(DeviceContainer *aDeviceContainerP, VdcApiRequestPtr aRequest, const DsUidVector &aDevices, ApiValuePtr aQuery, uint64_t aChangedSince, bool aReportGeneration, uint64_t aGeneration, ApiValuePtr aResult, ApiValuePtr aErrors) :
+    deviceContainerP(aDeviceContainerP),
+    request(aRequest),
+    devices(aDevices),
+    nextDevice(0),
+    query(aQuery),
+    changedSince(aChangedSince),
+    reportGeneration(aReportGeneration),
+    generation(aGeneration),
+    result(aResult),
+    errors(aErrors)
+  {
+    readNext();
+  }
+
+
+  void readNext()
+  {
+    while (nextDevice<devices.size()) {
+      if (request->resultCongested()) {
+        // let the connection catch up before adding more
+        request->whenResultDrained(boost::bind(&DevicePropertiesReader::readNext, this));
+        return;
+      }
+      DsDeviceMap::iterator pos = deviceContainerP->dSDevices.find(devices[nextDevice++]);
+      if (pos!=deviceContainerP->dSDevices.end()) {
+        deviceContainerP->readDeviceProperties(pos->second, query, changedSince, result, errors);
+      }
+    }
+    readAll();
+  }
+
+
+  void readAll()
+  {
+    if (!errors->isEmptyObject()) {
+      result->add("x-p44-errors", errors);
+    }
+    if (reportGeneration) {
+      // return the generation to use as changedSince for the next incremental read
+      result->add("x-p44-changeGeneration", result->newUint64(generation));
+    }
+    request->sendResult(result);
+    // done, delete myself
+    delete this;
+  }
+
+};
+
+
+/// read the same properties from many devices with a single request
+/// - devices: array of device dSUIDs, or "*" or missing for all devices
+/// - query: property query, applied to every device as in getProperty
+/// - changedSince: optional change generation, as in getProperty
+/// Result contains the per-device results keyed by dSUID, plus x-p44-errors for devices that could not be read
+/// @note devices are read one at a time, pausing whenever the (streamed) result cannot be transmitted fast enough
+ErrorPtr DeviceContainer::getPropertiesHandler(VdcApiRequestPtr aRequest, ApiValuePtr aParams)
+{
+  ErrorPtr respErr;
+  ApiValuePtr query;
+  if (Error::isOK(respErr = checkParam(aParams, "query", query))) {
+    // optional change generation
+    uint64_t changedSince = 0;
+    ApiValuePtr o = aParams->get("changedSince");
+    if (o) {
+      changedSince = o->uint64Value();
+    }
+    // - capture generation before reading, so changes happening from now on will be in the next delta
+    uint64_t generation = currentChangeGeneration();
+    if (!isValidChangeGeneration(changedSince)) {
+      // generation from a previous run (or bogus): changes since then are unknown, full read
+      changedSince = 0;
+    }
+    // result is framed only once, device results are added as members
+    ApiValuePtr result = aRequest->newApiValue();
+    result->setType(apivalue_object);
+    ApiValuePtr errors = result->newValue(apivalue_object);
+    DsUidVector toRead;
+    ApiValuePtr devices = aParams->get("devices");
+    if (!devices || (devices->isType(apivalue_string) && devices->stringValue()=="*")) {
+      // all devices
+      toRead.reserve(dSDevices.size());
+      for (DsDeviceMap::iterator pos = dSDevices.begin(); pos!=dSDevices.end(); ++pos) {
+        toRead.push_back(pos->first);
+      }
+    }
+    else if (devices->isType(apivalue_array)) {
+      // explicit list of devices
+      for (int i=0; i<devices->arrayLength(); i++) {
+        DsUid dsuid;
+        dsuid.setAsBinary(devices->arrayGet(i)->binaryValue());
+        if (dSDevices.find(dsuid)!=dSDevices.end()) {
+          toRead.push_back(dsuid);
+        }
+        else {
+          errors->add(dsuid.getString(), errors->newString("unknown dSUID"));
+        }
+      }
+    }
+    else {
+      return ErrorPtr(new VdcApiError(400, "Invalid Parameters - 'devices' must be an array of dSUIDs or \"*\""));
+    }
+    // read devices, result is sent when all are read
+    DevicePropertiesReader::readProperties(this, aRequest, toRead, query, changedSince, o.get()!=NULL, generation, result, errors);
+  }
+  return respErr;
+}
+
+
+void DeviceContainer::readDeviceProperties(DevicePtr aDevice, ApiValuePtr aQuery, uint64_t aChangedSince, ApiValuePtr aResult, ApiValuePtr aErrors)
+{
+  string key = aDevice->getDsUid().getString();
+  ApiValuePtr devResult = aResult->beginMember(key);
+  ErrorPtr err = aDevice->accessProperty(access_read, aQuery, devResult, VDC_API_DOMAIN, PropertyDescriptorPtr(), aChangedSince);
+  // - for change-only reads, omit devices without changed fields
+  aResult->endMember(key, devResult, Error::isOK(err) && !(aChangedSince>0 && devResult->isEmptyObject()));
+  if (!Error::isOK(err)) {
+    aErrors->add(key, aErrors->newString(err->description()));
+  }
+}
+
+
 void DeviceContainer::handleNotification(const string &aMethod, ApiValuePtr aParams)
 {
   inherited::handleNotification(aMethod, aParams);
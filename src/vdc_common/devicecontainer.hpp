@@ -31,7 +31,10 @@
 #include "digitalio.hpp"
 
 #include "vdcapi.hpp"
+#include "vdcmetrics.hpp"
+#include "workerpool.hpp"
 
+#include <set>
 
 using namespace std;
 
@@ -72,6 +75,15 @@ namespace p44 {
   typedef map<DsUid, DevicePtr> DsDeviceMap;
 
 
+  /// entry in the queue of entities to be announced to the vdSM
+  typedef struct {
+    DsAddressablePtr addressable; ///< the vdc or device to announce
+    int retries; ///< number of retries already made for this entity
+  } AnnounceItem;
+  typedef list<AnnounceItem> AnnounceQueue;
+  typedef list<DsAddressablePtr> DsAddressableList;
+
+
   /// container for all devices hosted by this application
   /// In dS terminology, this object represents the vDC host (a program/daemon hosting one or multiple virtual device connectors).
   /// - is the connection point to a vDSM
@@ -84,6 +96,7 @@ namespace p44 {
 
     friend class DeviceClassCollector;
     friend class DeviceClassInitializer;
+    friend class DevicePropertiesReader;
     friend class DeviceClassContainer;
     friend class DsAddressable;
 
@@ -122,11 +135,38 @@ namespace p44 {
     int mainloopStatsInterval; ///< 0=none, N=every PERIODIC_TASK_INTERVAL*N seconds
     int mainLoopStatsCounter;
 
+    // persistence write-back
+    std::set<DsUid> changedDevices; ///< journal of devices that may have unsaved changes since the last flush
+    MLMicroSeconds flushTimeBudget; ///< 0=no limit, otherwise max time spent saving devices within one flush
+    DsUid nextDeviceToSweep; ///< dSUID of device where the next safety sweep continues (empty=start at beginning)
+    MLMicroSeconds maxFlushTime; ///< longest flush (=main loop stall) since last statistics output
+
+    // performance metrics
+    VdcMetrics metrics;
+
+    // worker threads for CPU-heavy or blocking work
+    WorkerPool workerPool;
+
     // active vDC API session
     DsUid connectedVdsm;
     long sessionActivityTicket;
     VdcApiConnectionPtr activeSessionConnection;
 
+    // announcing
+    AnnounceQueue announceQueue; ///< entities still to be announced in this session
+    DsAddressableList pendingAnnounces; ///< entities with announcement sent, but not yet acknowledged
+    int maxPendingAnnounces; ///< max number of announcements in flight at the same time
+
+    // fast start from device tree snapshot
+    bool fastStartPending; ///< set when the next full collect may start by restoring the device tree snapshot
+    bool restoringSnapshot; ///< set while the device tree snapshot is being loaded, before the actual collection starts
+    DsDeviceMap snapshotDevices; ///< devices restored from the snapshot, while background collection is running
+    DsDeviceMap unconfirmedDevices; ///< restored devices not (yet) found again by the background collection
+    bool snapshotWriting; ///< set while a worker is writing the snapshot file
+    bool snapshotWritePending; ///< set when a newer snapshot must be written as soon as the current write has completed
+    string pendingSnapshotData; ///< the newer snapshot data
+    int pendingSnapshotDevices; ///< number of devices in the newer snapshot
+
   public:
 
     DeviceContainer();
@@ -140,6 +180,12 @@ namespace p44 {
     /// active session
     VdcApiConnectionPtr getSessionConnection() { return activeSessionConnection; };
 
+    /// performance metrics (latency histograms and event counters)
+    VdcMetrics &getMetrics() { return metrics; };
+
+    /// worker pool for self-contained CPU-heavy or blocking jobs that should not stall the main loop
+    WorkerPool &getWorkerPool() { return workerPool; };
+
     /// set user assignable name
     /// @param new name of this instance of the vdc host
     virtual void setName(const string &aName);
@@ -177,6 +223,20 @@ namespace p44 {
     /// @param aInterval 0=none, N=every PERIODIC_TASK_INTERVAL*N seconds
     void setMainloopStatsInterval(int aInterval) { mainloopStatsInterval = aInterval; };
 
+    /// Set how much time a periodic flush may spend saving devices
+    /// @param aBudget 0=save all changed devices in every flush, otherwise stop saving devices when the
+    ///   budget is used up and continue with the remaining changed devices in the next periodic flush
+    void setFlushTimeBudget(MLMicroSeconds aBudget) { flushTimeBudget = aBudget; };
+
+    /// Set how many announcements may be sent to the vdSM without waiting for acknowledgement
+    /// @param aWindow max number of unacknowledged announcements in flight (1=strictly one by one)
+    void setAnnounceWindow(int aWindow) { maxPendingAnnounces = aWindow>0 ? aWindow : 1; };
+
+    /// Enable starting from the device tree snapshot saved after the previous collection
+    /// @param aFastStart if set, the first full collectDevices() restores the devices from the snapshot, so these can be
+    ///   announced right away, and then collects in the background to reconcile with the actual devices present
+    void setFastStart(bool aFastStart) { fastStartPending = aFastStart; };
+
     /// @return MAC address as 12 char hex string (6 bytes)
     string macAddressString();
 
@@ -218,6 +278,10 @@ namespace p44 {
     ///   and thus cannot remove any settings, either)
     void collectDevices(StatusCB aCompletedCB, bool aIncremental, bool aExhaustive, bool aClearSettings);
 
+    /// save a snapshot of the current device tree, to restore devices from at the next (fast) start
+    /// @note only devices for which their class container provides snapshot info are included
+    void saveDeviceSnapshot();
+
     /// Put device class controllers into learn-in mode
     /// @param aCompletedCB handler to call when a learn-in action occurs
     /// @param aDisableProximityCheck true to disable proximity check (e.g. minimal RSSI requirement for some EnOcean devices)
@@ -346,7 +410,25 @@ namespace p44 {
 
     /// forget any parameters stored in persistent DB
     ErrorPtr forget();
-    
+
+    /// write back unsaved parameters of vdc host, vdcs and devices to the persistent DB
+    /// @note all writes are grouped into a single DB transaction. Only devices noted by deviceChanged()
+    ///   are visited, plus a few others per flush as a safety net for changes made without notification.
+    ///   When a flush time budget is set (see setFlushTimeBudget()), the remaining changed devices are
+    ///   saved in the next flush.
+    void flushPersistentParams();
+
+    /// note a device that may have unsaved changes, so the next flush will save it
+    /// @param aDevice the device
+    /// @note Device calls this for every change of its property tree
+    void deviceChanged(Device &aDevice);
+
+    /// measure flushing a number of changed devices via the journal vs. visiting all devices
+    /// @param aChanged number of devices to mark changed before each flush
+    /// @param aRepeat number of flushes for each method
+    /// @param aResult object to add the measured values to
+    void flushBenchmark(int aChanged, int aRepeat, ApiValuePtr aResult);
+
     /// @}
 
 
@@ -412,14 +494,33 @@ namespace p44 {
     ErrorPtr helloHandler(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
     ErrorPtr byeHandler(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
     ErrorPtr removeHandler(VdcApiRequestPtr aForRequest, DevicePtr aDevice);
+    ErrorPtr getPropertiesHandler(VdcApiRequestPtr aRequest, ApiValuePtr aParams);
+    void readDeviceProperties(DevicePtr aDevice, ApiValuePtr aQuery, uint64_t aChangedSince, ApiValuePtr aResult, ApiValuePtr aErrors);
     void removeResultHandler(DevicePtr aDevice, VdcApiRequestPtr aForRequest, bool aDisconnected);
     void deviceInitialized(DevicePtr aDevice);
 
     // announcing dSUID addressable entities within the device container (vdc host)
     void resetAnnouncing();
     void startAnnouncing();
+    void queueAnnouncements();
     void announceNext();
-    void announceResultHandler(DsAddressablePtr aAddressable, VdcApiRequestPtr aRequest, ErrorPtr &aError, ApiValuePtr aResultOrErrorData);
+    bool sendAnnouncement(AnnounceItem &aItem);
+    void announceFailed(AnnounceItem &aItem);
+    void announceResultHandler(AnnounceItem aItem, VdcApiRequestPtr aRequest, ErrorPtr &aError, ApiValuePtr aResultOrErrorData);
+    bool announcingAllowed();
+
+    // device tree snapshot
+    string snapshotFilePath();
+    void startSnapshotWrite(const string &aData, int aNumDevices);
+    static void writeSnapshotFile(const string aPath, const string aData, string *aErrP);
+    void snapshotSaved(int aNumDevices, size_t aSize, string *aErrP);
+    void loadDeviceSnapshot(SimpleCB aDoneCB);
+    static void readSnapshotFile(const string aPath, string *aDataP, string *aErrP);
+    void snapshotLoaded(MLMicroSeconds aStarted, string *aDataP, string *aErrP, SimpleCB aDoneCB);
+    bool restoreDeviceSnapshot(const string &aData);
+    void startCollecting(StatusCB aCompletedCB, bool aIncremental, bool aExhaustive, bool aClearSettings);
+    void reconcileSnapshotDevices(ErrorPtr aCollectError);
+    bool isRestoredVdc(DeviceClassContainerPtr aVdc);
 
     // activity monitor
     void signalActivity();
@@ -89,3 +89,29 @@ void DeviceSettings::bindToStatement(sqlite3pp::statement &aStatement, int &aInd
   aStatement.bind(aIndex++, device.getAssignedName().c_str()); // stable string!
   aStatement.bind(aIndex++, zoneID);
 }
+
+
+
+#pragma mark - flush transaction support
+
+
+void p44::noteDirtyParams(FlushedParamsVector &aList, PersistentParams &aParams)
+{
+  if (aParams.isDirty()) {
+    FlushedParams f;
+    f.paramsP = &aParams;
+    f.wasNew = aParams.rowid==0;
+    aList.push_back(f);
+  }
+}
+
+
+void p44::restoreDirtyParams(FlushedParamsVector &aList)
+{
+  for (FlushedParamsVector::iterator pos = aList.begin(); pos!=aList.end(); ++pos) {
+    // records inserted in the rolled back transaction do not exist, must be inserted again
+    if (pos->wasNew) pos->paramsP->rowid = 0;
+    pos->paramsP->markDirty();
+  }
+}
+
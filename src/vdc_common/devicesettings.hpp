@@ -35,6 +35,24 @@ namespace p44 {
   class DsScene;
 
 
+  /// persistent object written as part of a settings flush transaction
+  typedef struct {
+    PersistentParams *paramsP; ///< the object
+    bool wasNew; ///< set if the object had no DB record before, so its ROWID becomes invalid if the transaction is rolled back
+  } FlushedParams;
+  typedef std::vector<FlushedParams> FlushedParamsVector;
+
+  /// add a persistent object to a list of objects to be written, if it has unsaved changes
+  /// @param aList the list to add to
+  /// @param aParams the persistent object
+  void noteDirtyParams(FlushedParamsVector &aList, PersistentParams &aParams);
+
+  /// restore unsaved state of objects after the transaction that wrote them was rolled back
+  /// @param aList the objects that were written in the transaction
+  void restoreDirtyParams(FlushedParamsVector &aList);
+
+
+
   /// Base class for persistent settings common to all devices.
   /// @note This class can be used as-is for devices without a scene table (such as pure inputs and sensors),
   ///   but it also is the base class for SceneDeviceSettings which implements a scene table on top of it.
@@ -65,6 +83,10 @@ namespace p44 {
     virtual void loadFromRow(sqlite3pp::query::iterator &aRow, int &aIndex, uint64_t *aCommonFlagsP);
     virtual void bindToStatement(sqlite3pp::statement &aStatement, int &aIndex, const char *aParentIdentifier, uint64_t aCommonFlags);
 
+    /// collect the settings objects that will be written by the next save
+    /// @param aList list to add objects with unsaved changes to
+    virtual void collectDirtyParams(FlushedParamsVector &aList) { noteDirtyParams(aList, *this); };
+
     /// @}
 
   };
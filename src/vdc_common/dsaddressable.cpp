@@ -39,7 +39,8 @@ using namespace p44;
 DsAddressable::DsAddressable(DeviceContainer *aDeviceContainerP) :
   deviceContainerP(aDeviceContainerP),
   announced(Never),
-  announcing(Never)
+  announcing(Never),
+  scratch(false)
 {
 }
 
@@ -61,6 +62,7 @@ void DsAddressable::setName(const string &aName)
   //   we prevent replacing a long name with a truncated version
   if (name!=aName && (name.length()<20 || name.substr(0,20)!=aName)) {
     name = aName;
+    propertiesChanged(); // also when not set via property write
   }
 }
 
@@ -144,10 +146,29 @@ ErrorPtr DsAddressable::handleMethod(VdcApiRequestPtr aRequest, const string &aM
     // query must be present
     ApiValuePtr query;
     if (Error::isOK(respErr = checkParam(aParams, "query", query))) {
+      // optional change generation: only return properties changed since then
+      uint64_t changedSince = 0;
+      ApiValuePtr o = aParams->get("changedSince");
+      if (o) {
+        changedSince = o->uint64Value();
+      }
+      // - capture generation before reading, so changes happening from now on will be in the next delta
+      uint64_t generation = currentChangeGeneration();
+      if (!isValidChangeGeneration(changedSince)) {
+        // generation from a previous run (or bogus): changes since then are unknown, full read
+        changedSince = 0;
+      }
       // now read
+      // Note: the entire subtree is read in one go. Streamed results are transmitted while being read, but
+      //   what the connection does not take right away is buffered. Reading many devices should use
+      //   x-p44-getProperties, which pauses between devices until the connection catches up.
       ApiValuePtr result = aRequest->newApiValue();
-      respErr = accessProperty(access_read, query, result, VDC_API_DOMAIN, PropertyDescriptorPtr());
+      respErr = accessProperty(access_read, query, result, VDC_API_DOMAIN, PropertyDescriptorPtr(), changedSince);
       if (Error::isOK(respErr)) {
+        if (o) {
+          // return the generation to use as changedSince for the next incremental read
+          result->add("x-p44-changeGeneration", result->newUint64(generation));
+        }
         // send back property result
         aRequest->sendResult(result);
       }
@@ -188,13 +209,17 @@ bool DsAddressable::pushProperty(ApiValuePtr aQuery, int aDomain)
       // - send pushProperty
       ApiValuePtr pushParams = aQuery->newValue(apivalue_object);
       pushParams->add("properties", value);
-      return sendRequest("pushProperty", pushParams);
+      if (sendRequest("pushProperty", pushParams)) {
+        getDeviceContainer().getMetrics().count("push.sent");
+        return true;
+      }
     }
   }
   else {
     // not announced, suppress pushProperty
     ALOG(LOG_WARNING, "pushProperty suppressed - is not yet announced");
   }
+  getDeviceContainer().getMetrics().count("push.failed");
   return false;
 }
 
@@ -467,6 +492,7 @@ string DsAddressable::vendorId()
 
 void DsAddressable::logAddressable(int aErrLevel, const char *aFmt, ... )
 {
+  if (scratch) return; // scratch objects are not worth logging about
   va_list args;
   va_start(args, aFmt);
   // format the message
@@ -60,6 +60,8 @@ namespace p44 {
     MLMicroSeconds announced; ///< set when last announced to the vdSM
     MLMicroSeconds announcing; ///< set when announcement has been started (but not yet confirmed)
 
+    bool scratch; ///< set for scratch objects that are never added to the vdc host
+
   protected:
     DeviceContainer *deviceContainerP;
 
@@ -100,6 +102,16 @@ namespace p44 {
     /// @note only addressables that have been announced on the vDC API will send a vanish message
     void reportVanished();
 
+    /// @return true if this addressable has been announced to the vdSM (and thus may push properties)
+    bool isAnnounced() { return announced!=Never; };
+
+    /// mark this addressable as a scratch object (e.g. for benchmarks), which is never added to the vdc host.
+    /// Scratch objects do not log and do not propagate property changes to their parent containers.
+    void setScratch() { scratch = true; };
+
+    /// @return true if this addressable is a scratch object
+    bool isScratch() { return scratch; };
+
     /// @name vDC API
     /// @{
 
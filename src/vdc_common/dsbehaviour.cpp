@@ -53,12 +53,20 @@ void DsBehaviour::setHardwareError(DsHardwareError aHardwareError)
     // error status has changed
     hardwareError = aHardwareError;
     hardwareErrorUpdated = MainLoop::now();
+    propertiesChanged();
     // push the error status change
     pushBehaviourState();
   }
 }
 
 
+void DsBehaviour::subtreeChanged(uint64_t aGeneration)
+{
+  inheritedProps::subtreeChanged(aGeneration);
+  device.subtreeChanged(aGeneration);
+}
+
+
 bool DsBehaviour::pushBehaviourState()
 {
   VdcApiConnectionPtr api = device.getDeviceContainer().getSessionConnection();
@@ -75,6 +83,12 @@ bool DsBehaviour::pushBehaviourState()
 }
 
 
+bool DsBehaviour::queueBehaviourStatePush()
+{
+  return device.queueBehaviourStatePush(string(getTypeName()).append("States"), index);
+}
+
+
 string DsBehaviour::getDbKey()
 {
   return string_format("%s_%zu",device.dSUID.getString().c_str(),index);
@@ -137,6 +137,13 @@ namespace p44 {
     /// @return true if API was connected and push could be sent
     bool pushBehaviourState();
 
+    /// push state together with other behaviour states of the same device queued in the same mainloop cycle
+    /// @return true if API was connected and push could be queued
+    bool queueBehaviourStatePush();
+
+    /// mark this behaviour's subtree changed, passes change on to the device
+    virtual void subtreeChanged(uint64_t aGeneration);
+
 
     /// @name persistent settings management
     /// @{
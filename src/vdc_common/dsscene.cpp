@@ -50,6 +50,12 @@ class SceneChannels : public PropertyContainer
 public:
   SceneChannels(DsScene &aScene) : scene(aScene) {};
 
+  virtual void subtreeChanged(uint64_t aGeneration)
+  {
+    inherited::subtreeChanged(aGeneration);
+    scene.subtreeChanged(aGeneration);
+  }
+
 protected:
 
   int numProps(int aDomain, PropertyDescriptorPtr aParentDescriptor)
@@ -168,6 +174,9 @@ typedef boost::intrusive_ptr<SceneChannels> SceneChannelsPtr;
 #pragma mark - scene base class
 
 
+static uint64_t scenesCreated = 0;
+static uint64_t scenesAlive = 0;
+
 DsScene::DsScene(SceneDeviceSettings &aSceneDeviceSettings, SceneNo aSceneNo) :
   inheritedParams(aSceneDeviceSettings.paramStore),
   sceneDeviceSettings(aSceneDeviceSettings),
@@ -177,6 +186,21 @@ DsScene::DsScene(SceneDeviceSettings &aSceneDeviceSettings, SceneNo aSceneNo) :
   globalSceneFlags(0)
 {
   sceneChannels = SceneChannelsPtr(new SceneChannels(*this));
+  scenesCreated++;
+  scenesAlive++;
+}
+
+
+DsScene::~DsScene()
+{
+  scenesAlive--;
+}
+
+
+void DsScene::getAllocationStats(uint64_t &aCreated, uint64_t &aAlive)
+{
+  aCreated = scenesCreated;
+  aAlive = scenesAlive;
 }
 
 
@@ -192,6 +216,13 @@ OutputBehaviourPtr DsScene::getOutputBehaviour()
 }
 
 
+void DsScene::subtreeChanged(uint64_t aGeneration)
+{
+  inheritedProps::subtreeChanged(aGeneration);
+  getDevice().subtreeChanged(aGeneration);
+}
+
+
 void DsScene::setDefaultSceneValues(SceneNo aSceneNo)
 {
   sceneNo = aSceneNo; // usually already set, but still make sure
@@ -470,7 +501,6 @@ DsScenePtr SceneDeviceSettings::newDefaultScene(SceneNo aSceneNo)
 }
 
 
-
 DsScenePtr SceneDeviceSettings::getScene(SceneNo aSceneNo)
 {
   // see if we have a stored version different from the default
@@ -479,10 +509,30 @@ DsScenePtr SceneDeviceSettings::getScene(SceneNo aSceneNo)
     // found scene params in map
     return pos->second;
   }
-  else {
-    // just return default values for this scene
-    return newDefaultScene(aSceneNo);
+  // not stored, use the cached default scene
+  pos = defaultScenes.find(aSceneNo);
+  if (pos!=defaultScenes.end()) {
+    return pos->second;
+  }
+  // create default scene
+  DsScenePtr scene = newDefaultScene(aSceneNo);
+  if (device.numChannels()>0) {
+    // default values are final only when the output behaviour and its channels are installed -> cache the scene
+    defaultScenes[aSceneNo] = scene;
   }
+  return scene;
+}
+
+
+DsScenePtr SceneDeviceSettings::getWritableScene(SceneNo aSceneNo)
+{
+  DsSceneMap::iterator pos = scenes.find(aSceneNo);
+  if (pos!=scenes.end()) {
+    // user defined scene belongs to this device only
+    return pos->second;
+  }
+  // private copy of the default scene, the cached one must remain unmodified
+  return newDefaultScene(aSceneNo);
 }
 
 
@@ -495,6 +545,9 @@ void SceneDeviceSettings::updateScene(DsScenePtr aScene)
   }
   // anyway, mark scene dirty
   aScene->markDirty();
+  // scene values are usually changed by saveScene, not via property writes -> make delta reads report them
+  aScene->sceneChannels->propertiesChanged();
+  aScene->propertiesChanged();
   // as we need the ROWID of the settings as parentID, make sure we get saved if we don't have one
   if (rowid==0) markDirty();
 }
@@ -555,6 +608,15 @@ ErrorPtr SceneDeviceSettings::saveChildren()
 }
 
 
+void SceneDeviceSettings::collectDirtyParams(FlushedParamsVector &aList)
+{
+  inherited::collectDirtyParams(aList);
+  for (DsSceneMap::iterator pos = scenes.begin(); pos!=scenes.end(); ++pos) {
+    noteDirtyParams(aList, *(pos->second));
+  }
+}
+
+
 // save child parameters (scenes)
 ErrorPtr SceneDeviceSettings::deleteChildren()
 {
@@ -114,7 +114,12 @@ namespace p44 {
 
   public:
     DsScene(SceneDeviceSettings &aSceneDeviceSettings, SceneNo aSceneNo); ///< constructor, creates empty scene
-    virtual ~DsScene() {}; // important for multiple inheritance!
+    virtual ~DsScene(); // important for multiple inheritance!
+
+    /// get scene object statistics
+    /// @param aCreated set to number of scene objects created so far
+    /// @param aAlive set to number of scene objects currently in memory
+    static void getAllocationStats(uint64_t &aCreated, uint64_t &aAlive);
 
     /// @name common scene values (available in all scene objects)
     /// @{
@@ -193,6 +198,9 @@ namespace p44 {
     /// @return the output behaviour controlled by this scene
     OutputBehaviourPtr getOutputBehaviour();
 
+    /// mark this scene's subtree changed, passes change on to the device
+    virtual void subtreeChanged(uint64_t aGeneration);
+
     /// Set default scene values for a specified scene number
     /// @param aSceneNo the scene number to set default values
     virtual void setDefaultSceneValues(SceneNo aSceneNo);
@@ -241,6 +249,7 @@ namespace p44 {
     friend class SceneChannels;
 
     DsSceneMap scenes; ///< the user defined scenes (default scenes will be created on the fly)
+    DsSceneMap defaultScenes; ///< cache of unmodified default scenes, created on first use
 
   public:
     SceneDeviceSettings(Device &aDevice);
@@ -252,14 +261,23 @@ namespace p44 {
     /// get the parameters for the scene
     /// @param aSceneNo the scene to get current settings for.
     /// @note the object returned may not be attached to a container (if it is a default scene
-    ///   created on the fly). Scene modifications must be posted using updateScene()
+    ///   created on the fly).
+    /// @note default scenes are cached and shared between calls, and must not be modified.
+    ///   Use getWritableScene() to obtain a scene for modification.
     DsScenePtr getScene(SceneNo aSceneNo);
 
+    /// get the parameters for the scene for modification
+    /// @param aSceneNo the scene to get current settings for.
+    /// @return the user defined scene, or a private copy of the default scene. Scene modifications
+    ///   must be posted using updateScene()
+    DsScenePtr getWritableScene(SceneNo aSceneNo);
+
     /// update scene (mark dirty, add to list of non-default scene objects)
     /// @param aSceneNo the scene to save modified settings for.
     /// @note call updateScene only if scene values are changed from defaults, because
     ///   updating a scene creates DB records and needs more run-time memory.
     /// @note always updates the scene and causes write to DB even if scene was not marked dirty already
+    /// @note also marks the scene changed, so incremental (changedSince) property reads report it
     void updateScene(DsScenePtr aScene);
 
     /// reset scene to default values
@@ -275,6 +293,10 @@ namespace p44 {
 
     /// @}
 
+    /// collect the settings and scene objects that will be written by the next save
+    /// @param aList list to add objects with unsaved changes to
+    virtual void collectDirtyParams(FlushedParamsVector &aList);
+
   protected:
 
     // persistence implementation
@@ -283,6 +305,7 @@ namespace p44 {
     virtual ErrorPtr deleteChildren();
     
     /// @}
+
   };
   typedef boost::intrusive_ptr<SceneDeviceSettings> SceneDeviceSettingsPtr;
 
@@ -131,6 +131,237 @@ ApiValuePtr JsonApiValue::newValueFromJson(JsonObjectPtr aJsonObject)
 
 
 
+#pragma mark - JsonStreamWriter
+
+
+JsonStreamWriter::JsonStreamWriter(JsonCommPtr aJsonComm, size_t aChunkSize) :
+  jsonComm(aJsonComm),
+  chunkSize(aChunkSize),
+  bytesSent(0),
+  maxBuffered(0),
+  waitingForConnection(false)
+{
+  buffer.reserve(chunkSize+256);
+}
+
+
+void JsonStreamWriter::write(const string &aJsonText)
+{
+  if (!Error::isOK(sendError)) return; // connection failed, result is lost anyway
+  buffer.append(aJsonText);
+  if (buffer.size()>maxBuffered) maxBuffered = buffer.size();
+  // when the connection is busy, the transmit handler will continue
+  if (buffer.size()>=chunkSize && !waitingForConnection) transmit();
+}
+
+
+void JsonStreamWriter::writeString(const string &aString)
+{
+  string s = "\"";
+  for (size_t i=0; i<aString.size(); i++) {
+    char c = aString[i];
+    switch (c) {
+      case '"': s += "\\\""; break;
+      case '\\': s += "\\\\"; break;
+      case '\n': s += "\\n"; break;
+      case '\r': s += "\\r"; break;
+      case '\t': s += "\\t"; break;
+      default:
+        if ((uint8_t)c<0x20)
+          string_format_append(s, "\\u%04x", (int)c);
+        else
+          s += c;
+        break;
+    }
+  }
+  s += '"';
+  write(s);
+}
+
+
+void JsonStreamWriter::writeValue(ApiValuePtr aValue)
+{
+  JsonApiValuePtr v = boost::dynamic_pointer_cast<JsonApiValue>(aValue);
+  if (v) {
+    JsonObjectPtr o = v->jsonObject();
+    write(o ? o->json_c_str() : "null");
+  }
+  else if (!aValue || aValue->isNull()) {
+    write("null");
+  }
+  else {
+    writeString(aValue->stringValue());
+  }
+}
+
+
+ErrorPtr JsonStreamWriter::flush()
+{
+  if (!buffer.empty() && !waitingForConnection && Error::isOK(sendError)) transmit();
+  return sendError;
+}
+
+
+void JsonStreamWriter::discard()
+{
+  buffer.clear();
+  drainedHandler = NULL;
+  if (waitingForConnection) {
+    jsonComm->setTransmitHandler(NULL);
+    waitingForConnection = false;
+  }
+}
+
+
+void JsonStreamWriter::whenDrained(SimpleCB aDrainedCB)
+{
+  if (!congested() || !Error::isOK(sendError)) {
+    aDrainedCB();
+  }
+  else {
+    drainedHandler = aDrainedCB;
+  }
+}
+
+
+void JsonStreamWriter::transmit()
+{
+  ErrorPtr err;
+  size_t sentBytes = jsonComm->transmitBytes(buffer.size(), (const uint8_t *)buffer.data(), err);
+  if (!Error::isOK(err)) {
+    sendError = err;
+    discard();
+    return;
+  }
+  bytesSent += sentBytes;
+  // Note: buffer size is bounded by congestion control, so removing the sent part is cheap
+  buffer.erase(0, sentBytes);
+  if (buffer.empty()) {
+    if (waitingForConnection) {
+      jsonComm->setTransmitHandler(NULL);
+      waitingForConnection = false;
+    }
+  }
+  else if (!waitingForConnection) {
+    // connection did not take everything, continue when it is ready for more
+    // Note: handler keeps the writer alive until everything is transmitted
+    jsonComm->setTransmitHandler(boost::bind(&JsonStreamWriter::canSendData, JsonStreamWriterPtr(this), _1));
+    waitingForConnection = true;
+  }
+}
+
+
+void JsonStreamWriter::canSendData(ErrorPtr aError)
+{
+  if (!Error::isOK(aError)) {
+    sendError = aError;
+    discard();
+  }
+  else if (!buffer.empty()) {
+    transmit();
+  }
+  if (drainedHandler && (buffer.size()<chunkSize || !Error::isOK(sendError))) {
+    // let producer continue
+    SimpleCB cb = drainedHandler;
+    drainedHandler = NULL;
+    cb();
+  }
+}
+
+
+
+#pragma mark - JsonStreamApiValue
+
+
+JsonStreamApiValue::JsonStreamApiValue(JsonStreamWriterPtr aWriter) :
+  writer(aWriter),
+  opened(false),
+  hasMembers(false)
+{
+  objectType = apivalue_object;
+}
+
+
+JsonStreamApiValue::JsonStreamApiValue(JsonStreamWriterPtr aWriter, JsonStreamApiValuePtr aParent, const string &aKey) :
+  writer(aWriter),
+  parent(aParent),
+  key(aKey),
+  opened(false),
+  hasMembers(false)
+{
+  objectType = apivalue_object;
+}
+
+
+ApiValuePtr JsonStreamApiValue::newValue(ApiValueType aObjectType)
+{
+  ApiValuePtr newVal = ApiValuePtr(new JsonApiValue);
+  newVal->setType(aObjectType);
+  return newVal;
+}
+
+
+void JsonStreamApiValue::open()
+{
+  // opening is deferred until the first member is written, so empty members can still be omitted
+  if (!opened) {
+    if (parent) parent->writeMemberKey(key);
+    writer->write("{");
+    opened = true;
+  }
+}
+
+
+void JsonStreamApiValue::writeMemberKey(const string &aKey)
+{
+  open();
+  if (hasMembers) writer->write(",");
+  writer->writeString(aKey);
+  writer->write(":");
+  hasMembers = true;
+}
+
+
+void JsonStreamApiValue::add(const string &aKey, ApiValuePtr aObj)
+{
+  writeMemberKey(aKey);
+  writer->writeValue(aObj);
+}
+
+
+ApiValuePtr JsonStreamApiValue::beginMember(const string &aKey)
+{
+  return ApiValuePtr(new JsonStreamApiValue(writer, JsonStreamApiValuePtr(this), aKey));
+}
+
+
+void JsonStreamApiValue::endMember(const string &aKey, ApiValuePtr aMember, bool aKeep)
+{
+  JsonStreamApiValuePtr m = boost::dynamic_pointer_cast<JsonStreamApiValue>(aMember);
+  if (!m) {
+    // not streamed, add when complete
+    inherited::endMember(aKey, aMember, aKeep);
+  }
+  else if (m->opened) {
+    // already written (even if not to be kept), must be completed to keep output well-formed
+    writer->write("}");
+  }
+  else if (aKeep) {
+    // empty object
+    writeMemberKey(aKey);
+    writer->write("{}");
+  }
+}
+
+
+void JsonStreamApiValue::finish()
+{
+  open();
+  writer->write("}");
+}
+
+
+
 #pragma mark - VdcJsonApiServer
 
 
@@ -101,6 +101,138 @@ namespace p44 {
   };
 
 
+
+  // default size of text chunks transmitted to the connection while streaming JSON
+  #define JSON_STREAM_CHUNK_SIZE 4096
+  // amount of text waiting for transmission at which a streamed result counts as congested
+  #define JSON_STREAM_MAX_BUFFERED (4*JSON_STREAM_CHUNK_SIZE)
+
+  class JsonStreamWriter;
+  typedef boost::intrusive_ptr<JsonStreamWriter> JsonStreamWriterPtr;
+
+  /// writes JSON text to a JSON connection in chunks while it is being generated
+  /// @note the writer transmits the text itself, and only as fast as the connection accepts it. Producers
+  ///   must check congested() between units of output (such as one device) and continue via whenDrained(),
+  ///   so the text waiting for transmission stays bounded to about JSON_STREAM_MAX_BUFFERED plus one unit.
+  class JsonStreamWriter : public P44Obj
+  {
+    JsonCommPtr jsonComm;
+    string buffer; ///< text not yet transmitted to the connection
+    size_t chunkSize; ///< buffered text size at which transmitting starts
+    size_t bytesSent; ///< text transmitted to the connection so far
+    size_t maxBuffered; ///< largest amount of text that was waiting for transmission
+    bool waitingForConnection; ///< set while the connection's transmit handler is installed
+    ErrorPtr sendError; ///< set when transmitting to the connection has failed, further text is discarded
+    SimpleCB drainedHandler; ///< called when congestion has cleared
+
+  public:
+
+    JsonStreamWriter(JsonCommPtr aJsonComm, size_t aChunkSize = JSON_STREAM_CHUNK_SIZE);
+
+    /// append raw JSON text
+    void write(const string &aJsonText);
+
+    /// append string as quoted and escaped JSON string
+    void writeString(const string &aString);
+
+    /// append value as JSON text
+    void writeValue(ApiValuePtr aValue);
+
+    /// start transmitting all buffered text. What the connection does not accept right now is
+    /// transmitted as soon as it can take more.
+    /// @return error if the connection has failed (now or before)
+    ErrorPtr flush();
+
+    /// discard buffered text and stop transmitting
+    void discard();
+
+    /// @return true if so much text is waiting for transmission that producing more should be postponed
+    bool congested() { return buffer.size()>=JSON_STREAM_MAX_BUFFERED; };
+
+    /// have a handler called when the writer is no longer congested (or the connection has failed)
+    /// @param aDrainedCB handler to call, immediately if not congested now
+    void whenDrained(SimpleCB aDrainedCB);
+
+    /// @return error if transmitting to the connection has failed, NULL otherwise
+    ErrorPtr error() { return sendError; };
+
+    /// @return true if text has already been transmitted (and thus cannot be revoked any more)
+    bool started() { return bytesSent>0; };
+
+    /// @return total size of the text written so far
+    size_t totalBytes() { return bytesSent+buffer.size(); };
+
+    /// @return largest amount of text that was waiting for transmission at the same time
+    size_t peakBuffered() { return maxBuffered; };
+
+  private:
+
+    void transmit();
+    void canSendData(ErrorPtr aError);
+
+  };
+
+
+  class JsonStreamApiValue;
+  typedef boost::intrusive_ptr<JsonStreamApiValue> JsonStreamApiValuePtr;
+
+  /// JSON object that is written to a JsonStreamWriter while it is being built, rather than being built as a JSON object tree.
+  /// @note only supports building objects via add() and beginMember()/endMember() in a depth-first manner,
+  ///   such as PropertyContainer::accessProperty() does for reading. Members cannot be read back.
+  class JsonStreamApiValue : public ApiValue
+  {
+    typedef ApiValue inherited;
+
+    JsonStreamWriterPtr writer;
+    JsonStreamApiValuePtr parent; ///< the object this object is a member of, NULL for root
+    string key; ///< the key of this object in its parent
+    bool opened; ///< set when the opening brace has been written
+    bool hasMembers; ///< set when at least one member has been written
+
+    JsonStreamApiValue(JsonStreamWriterPtr aWriter, JsonStreamApiValuePtr aParent, const string &aKey);
+    void open();
+    void writeMemberKey(const string &aKey);
+
+  public:
+
+    /// create a root object
+    JsonStreamApiValue(JsonStreamWriterPtr aWriter);
+
+    /// complete the root object
+    void finish();
+
+    /// @note new values are regular JsonApiValues, to be added when complete
+    virtual ApiValuePtr newValue(ApiValueType aObjectType);
+
+    virtual void add(const string &aKey, ApiValuePtr aObj);
+    virtual ApiValuePtr beginMember(const string &aKey);
+    virtual void endMember(const string &aKey, ApiValuePtr aMember, bool aKeep);
+    virtual bool isEmptyObject() { return !hasMembers; };
+
+    // streamed objects cannot be read back or modified
+    virtual void clear() { /* NOP */ };
+    virtual void operator=(ApiValue &aApiValue) { /* NOP */ };
+    virtual ApiValuePtr get(const string &aKey) { return ApiValuePtr(); };
+    virtual void del(const string &aKey) { /* NOP */ };
+    virtual void arrayAppend(ApiValuePtr aObj) { /* NOP */ };
+    virtual ApiValuePtr arrayGet(int aAtIndex) { return ApiValuePtr(); };
+    virtual void arrayPut(int aAtIndex, ApiValuePtr aObj) { /* NOP */ };
+    virtual bool resetKeyIteration() { return false; };
+    virtual bool nextKeyValue(string &aKey, ApiValuePtr &aValue) { return false; };
+    virtual uint64_t uint64Value() { return 0; };
+    virtual int64_t int64Value() { return 0; };
+    virtual double doubleValue() { return 0; };
+    virtual bool boolValue() { return false; };
+    virtual string binaryValue() { return ""; };
+    virtual void setUint64Value(uint64_t aUint64) { /* NOP */ };
+    virtual void setInt64Value(int64_t aInt64) { /* NOP */ };
+    virtual void setDoubleValue(double aDouble) { /* NOP */ };
+    virtual void setBoolValue(bool aBool) { /* NOP */ };
+    virtual void setBinaryValue(const string &aBinary) { /* NOP */ };
+
+  };
+
+
   /// a JSON API server
   class VdcJsonApiServer : public VdcApiServer
   {
@@ -26,13 +26,18 @@
 
 #include "jsonvdcapi.hpp"
 
+// max number of complete tree reads in one propertyBenchmark call (runs on the main loop)
+#define PROPERTY_BENCHMARK_MAX_REPEAT 100
+#define FLUSH_BENCHMARK_MAX_REPEAT 100
+
 using namespace p44;
 
 
 #pragma mark - config API - P44JsonApiRequest
 
 
-P44JsonApiRequest::P44JsonApiRequest(JsonCommPtr aJsonComm)
+P44JsonApiRequest::P44JsonApiRequest(JsonCommPtr aJsonComm, bool aStreamResult) :
+  streamResult(aStreamResult)
 {
   jsonComm = aJsonComm;
 }
@@ -41,6 +46,24 @@ P44JsonApiRequest::P44JsonApiRequest(JsonCommPtr aJsonComm)
 
 ErrorPtr P44JsonApiRequest::sendResult(ApiValuePtr aResult)
 {
+  JsonStreamApiValuePtr streamedResult = boost::dynamic_pointer_cast<JsonStreamApiValue>(aResult);
+  if (streamedResult) {
+    // result has been streamed already, just complete it
+    streamedResult->finish();
+    resultStream->write("}\n");
+    ErrorPtr err = resultStream->flush();
+    if (!Error::isOK(err)) {
+      // connection failed while streaming, remainder of result is lost
+      LOG(LOG_ERR, "cfg: streaming result failed after %zu bytes: %s -> closing connection", resultStream->totalBytes(), err->description().c_str());
+      resultStream.reset();
+      jsonComm->closeConnection();
+      return err;
+    }
+    // Note: text not yet accepted by the connection is transmitted later, writer is kept alive by the connection until then
+    LOG(LOG_INFO, "cfg <- vdcd (JSON) result streamed: %zu bytes, at most %zu bytes buffered", resultStream->totalBytes(), resultStream->peakBuffered());
+    resultStream.reset();
+    return ErrorPtr();
+  }
   LOG(LOG_INFO, "cfg <- vdcd (JSON) result sent: result=%s", aResult ? aResult->description().c_str() : "<none>");
   JsonApiValuePtr result = boost::dynamic_pointer_cast<JsonApiValue>(aResult);
   if (result) {
@@ -58,6 +81,18 @@ ErrorPtr P44JsonApiRequest::sendResult(ApiValuePtr aResult)
 ErrorPtr P44JsonApiRequest::sendError(uint32_t aErrorCode, string aErrorMessage, ApiValuePtr aErrorData)
 {
   LOG(LOG_INFO, "cfg <- vdcd (JSON) error sent: error=%d (%s)", aErrorCode, aErrorMessage.c_str());
+  if (resultStream && resultStream->started()) {
+    // part of the result has already been sent, cannot send an error response any more
+    LOG(LOG_ERR, "cfg: error after streaming %zu bytes of result -> closing connection", resultStream->totalBytes());
+    resultStream->discard();
+    resultStream.reset();
+    jsonComm->closeConnection();
+    return ErrorPtr();
+  }
+  if (resultStream) {
+    resultStream->discard(); // nothing sent yet
+    resultStream.reset();
+  }
   ErrorPtr err = ErrorPtr(new Error(aErrorCode, aErrorMessage));
   P44VdcHost::sendCfgApiResponse(jsonComm, JsonObjectPtr(), err);
   return ErrorPtr();
@@ -66,10 +101,32 @@ ErrorPtr P44JsonApiRequest::sendError(uint32_t aErrorCode, string aErrorMessage,
 
 ApiValuePtr P44JsonApiRequest::newApiValue()
 {
+  if (streamResult && !resultStream) {
+    // stream the result object, wrapped in the same response object sendCfgApiResponse() would create
+    resultStream = JsonStreamWriterPtr(new JsonStreamWriter(jsonComm));
+    resultStream->write("{\"result\":");
+    return ApiValuePtr(new JsonStreamApiValue(resultStream));
+  }
   return ApiValuePtr(new JsonApiValue);
 }
 
 
+bool P44JsonApiRequest::resultCongested()
+{
+  return resultStream && resultStream->congested();
+}
+
+
+void P44JsonApiRequest::whenResultDrained(SimpleCB aDrainedCB)
+{
+  if (resultStream) {
+    resultStream->whenDrained(aDrainedCB);
+    return;
+  }
+  aDrainedCB();
+}
+
+
 #pragma mark - perform self test
 
 
@@ -335,7 +392,14 @@ ErrorPtr P44VdcHost::processVdcRequest(JsonCommPtr aJsonComm, JsonObjectPtr aReq
       if (isMethod) {
         dsuid.setAsBinary(o->binaryValue());
         // create request
-        P44JsonApiRequestPtr request = P44JsonApiRequestPtr(new P44JsonApiRequest(aJsonComm));
+        // - property reads can produce large results, which are streamed rather than built as JSON object tree
+        //   (unless disabled with "stream":false, for comparison)
+        bool stream = cmd=="getProperty" || cmd=="x-p44-getProperties";
+        ApiValuePtr streamParam = params->get("stream");
+        if (stream && streamParam) {
+          stream = streamParam->boolValue();
+        }
+        P44JsonApiRequestPtr request = P44JsonApiRequestPtr(new P44JsonApiRequest(aJsonComm, stream));
         // check for old-style name/index and generate basic query (1 or 2 levels)
         ApiValuePtr query = params->newObject();
         ApiValuePtr name = params->get("name");
@@ -462,6 +526,121 @@ ErrorPtr P44VdcHost::processP44Request(JsonCommPtr aJsonComm, JsonObjectPtr aReq
       // anyway: return current value
       sendCfgApiResponse(aJsonComm, JsonObject::newInt32(LOGLEVEL), ErrorPtr());
     }
+    else if (method=="metrics") {
+      // return latency histograms and counters collected so far
+      sendCfgApiResponse(aJsonComm, metrics.json(), ErrorPtr());
+      // optionally start new collection period
+      JsonObjectPtr o = aRequest->get("reset");
+      if (o && o->boolValue()) {
+        metrics.reset();
+      }
+    }
+    else if (method=="jitterBenchmark") {
+      // measure main loop timer accuracy while deriving dSUIDs on the main loop or in the worker pool
+      string load = "worker";
+      int duration = 10; // seconds
+      int interval = 10; // milliseconds
+      int derivations = 1000;
+      JsonObjectPtr o = aRequest->get("load");
+      if (o) load = o->stringValue();
+      o = aRequest->get("duration");
+      if (o) duration = o->int32Value();
+      o = aRequest->get("interval");
+      if (o) interval = o->int32Value();
+      o = aRequest->get("derivations");
+      if (o) derivations = o->int32Value();
+      if (load!="none" && load!="mainloop" && load!="worker") {
+        err = ErrorPtr(new P44VdcError(400, "load must be none, mainloop or worker"));
+      }
+      else {
+        LOG(LOG_NOTICE, "starting %d seconds main loop jitter benchmark with load '%s'", duration, load.c_str());
+        JitterBenchmarkPtr bm = JitterBenchmarkPtr(new JitterBenchmark(workerPool, load, duration*Second, interval*MilliSecond, derivations));
+        bm->start(boost::bind(&P44VdcHost::sendCfgApiResponse, aJsonComm, _1, ErrorPtr()));
+      }
+    }
+    else if (method=="propertyBenchmark") {
+      // measure wall time, descriptor and scene allocations and resident memory of complete property tree reads
+      int repeat = 10;
+      JsonObjectPtr o = aRequest->get("repeat");
+      if (o) repeat = o->int32Value();
+      if (repeat<1 || repeat>PROPERTY_BENCHMARK_MAX_REPEAT) {
+        err = ErrorPtr(new P44VdcError(400, string_format("repeat must be 1..%d", PROPERTY_BENCHMARK_MAX_REPEAT)));
+      }
+      else {
+        uint64_t createdBefore, heapBefore, createdAfter, heapAfter;
+        uint64_t scenesBefore, scenesAfter, scenesAlive;
+        long residentBefore = VdcMetrics::residentMemoryKB();
+        PropertyDescriptor::getAllocationStats(createdBefore, heapBefore);
+        DsScene::getAllocationStats(scenesBefore, scenesAlive);
+        MLMicroSeconds start = MainLoop::now();
+        for (int i=0; i<repeat && Error::isOK(err); i++) {
+          // NULL query reads the entire tree
+          ApiValuePtr query = ApiValuePtr(new JsonApiValue);
+          ApiValuePtr result = ApiValuePtr(new JsonApiValue);
+          err = accessProperty(access_read, query, result, VDC_API_DOMAIN, PropertyDescriptorPtr());
+        }
+        MLMicroSeconds duration = MainLoop::now()-start;
+        PropertyDescriptor::getAllocationStats(createdAfter, heapAfter);
+        DsScene::getAllocationStats(scenesAfter, scenesAlive);
+        if (Error::isOK(err)) {
+          JsonObjectPtr r = JsonObject::newObj();
+          r->add("reads", JsonObject::newInt32(repeat));
+          r->add("msPerRead", JsonObject::newDouble((double)duration/MilliSecond/repeat));
+          r->add("descriptorsPerRead", JsonObject::newDouble((double)(createdAfter-createdBefore)/repeat));
+          r->add("descriptorHeapAllocationsPerRead", JsonObject::newDouble((double)(heapAfter-heapBefore)/repeat));
+          r->add("scenesCreatedPerRead", JsonObject::newDouble((double)(scenesAfter-scenesBefore)/repeat));
+          r->add("scenesAlive", JsonObject::newInt64(scenesAlive));
+          r->add("residentKBBefore", JsonObject::newInt64(residentBefore));
+          r->add("residentKBAfter", JsonObject::newInt64(VdcMetrics::residentMemoryKB()));
+          sendCfgApiResponse(aJsonComm, r, ErrorPtr());
+        }
+      }
+    }
+    else if (method=="flushBenchmark") {
+      // measure persistence flushes of a few changed devices, via the change journal vs. visiting all devices
+      int changed = 10;
+      int repeat = 10;
+      JsonObjectPtr o = aRequest->get("changed");
+      if (o) changed = o->int32Value();
+      o = aRequest->get("repeat");
+      if (o) repeat = o->int32Value();
+      if (repeat<1 || repeat>FLUSH_BENCHMARK_MAX_REPEAT || changed<1) {
+        err = ErrorPtr(new P44VdcError(400, string_format("repeat must be 1..%d, changed at least 1", FLUSH_BENCHMARK_MAX_REPEAT)));
+      }
+      else {
+        ApiValuePtr r = ApiValuePtr(new JsonApiValue);
+        r->setType(apivalue_object);
+        flushBenchmark(changed, repeat, r);
+        sendCfgApiResponse(aJsonComm, boost::dynamic_pointer_cast<JsonApiValue>(r)->jsonObject(), ErrorPtr());
+      }
+    }
+    else if (method=="vdcBenchmark") {
+      // run a benchmark specific to one vdc (repeat count is checked by the vdc)
+      ApiValuePtr params = JsonApiValue::newValueFromJson(aRequest);
+      ApiValuePtr o;
+      err = checkParam(params, "dSUID", o);
+      if (Error::isOK(err)) {
+        DsUid dsuid;
+        dsuid.setAsBinary(o->binaryValue());
+        string benchmark;
+        err = checkStringParam(params, "benchmark", benchmark);
+        if (Error::isOK(err)) {
+          ContainerMap::iterator pos = deviceClassContainers.find(dsuid);
+          if (pos==deviceClassContainers.end()) {
+            err = ErrorPtr(new P44VdcError(404, "no vdc with this dSUID"));
+          }
+          else {
+            ApiValuePtr r = params->newObject();
+            err = pos->second->runBenchmark(benchmark, params, r, boost::bind(&P44VdcHost::benchmarkDone, this, aJsonComm, r, _1));
+            if (err && Error::isOK(err)) {
+              // explicit OK: results are complete already
+              benchmarkDone(aJsonComm, r, ErrorPtr());
+              err.reset();
+            }
+          }
+        }
+      }
+    }
     else {
       err = ErrorPtr(new P44VdcError(400, "unknown method"));
     }
@@ -470,6 +649,17 @@ ErrorPtr P44VdcHost::processP44Request(JsonCommPtr aJsonComm, JsonObjectPtr aReq
 }
 
 
+void P44VdcHost::benchmarkDone(JsonCommPtr aJsonComm, ApiValuePtr aResult, ErrorPtr aError)
+{
+  if (Error::isOK(aError)) {
+    sendCfgApiResponse(aJsonComm, boost::dynamic_pointer_cast<JsonApiValue>(aResult)->jsonObject(), ErrorPtr());
+  }
+  else {
+    sendCfgApiResponse(aJsonComm, JsonObjectPtr(), aError);
+  }
+}
+
+
 void P44VdcHost::learnHandler(JsonCommPtr aJsonComm, bool aLearnIn, ErrorPtr aError)
 {
   MainLoop::currentMainLoop().cancelExecutionTicket(learnIdentifyTicket);
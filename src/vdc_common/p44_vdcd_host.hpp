@@ -25,6 +25,7 @@
 #include "devicecontainer.hpp"
 
 #include "jsoncomm.hpp"
+#include "jsonvdcapi.hpp"
 
 using namespace std;
 
@@ -46,11 +47,16 @@ namespace p44 {
   {
     typedef VdcApiRequest inherited;
     JsonCommPtr jsonComm;
+    bool streamResult; ///< if set, the result is streamed to the connection while being built
+    JsonStreamWriterPtr resultStream; ///< the stream the result is written to
 
   public:
 
     /// constructor
-    P44JsonApiRequest(JsonCommPtr aJsonComm);
+    /// @param aJsonComm the connection to send the response to
+    /// @param aStreamResult if set, the first API value obtained via newApiValue() is a streaming object
+    ///   that writes the result to the connection while it is being built (for potentially large property reads)
+    P44JsonApiRequest(JsonCommPtr aJsonComm, bool aStreamResult = false);
 
     /// return the request ID as a string
     /// @return request ID as string
@@ -75,7 +81,14 @@ namespace p44 {
     /// @param aErrorData the optional "data" member for the vDC API error object
     /// @result empty or Error object in case of error sending error response
     virtual ErrorPtr sendError(uint32_t aErrorCode, string aErrorMessage = "", ApiValuePtr aErrorData = ApiValuePtr());
-    
+
+    /// @return true if the streamed result has too much text waiting for transmission
+    virtual bool resultCongested();
+
+    /// have a handler called when the streamed result is no longer congested
+    /// @param aDrainedCB handler to call when more can be added to the result
+    virtual void whenResultDrained(SimpleCB aDrainedCB);
+
   };
   typedef boost::intrusive_ptr<P44JsonApiRequest> P44JsonApiRequestPtr;
 
@@ -116,6 +129,7 @@ namespace p44 {
     SocketCommPtr configApiConnectionHandler(SocketCommPtr aServerSocketComm);
     void configApiRequestHandler(JsonCommPtr aJsonComm, ErrorPtr aError, JsonObjectPtr aJsonObject);
     void learnHandler(JsonCommPtr aJsonComm, bool aLearnIn, ErrorPtr aError);
+    void benchmarkDone(JsonCommPtr aJsonComm, ApiValuePtr aResult, ErrorPtr aError);
     void identifyHandler(JsonCommPtr aJsonComm, DevicePtr aDevice);
     void endIdentify();
 
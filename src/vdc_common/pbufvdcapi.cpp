@@ -1055,6 +1055,9 @@ ErrorPtr VdcPbufApiRequest::sendError(uint32_t aErrorCode, string aErrorMessage,
 VdcPbufApiConnection::VdcPbufApiConnection() :
   closeWhenSent(false),
   expectedMsgBytes(0),
+  receiveOffset(0),
+  peerExtendedFrames(false),
+  transmitOffset(0),
   requestIdCounter(0)
 {
   socketComm = SocketCommPtr(new SocketComm(MainLoop::currentMainLoop()));
@@ -1063,8 +1066,24 @@ VdcPbufApiConnection::VdcPbufApiConnection() :
 }
 
 
-// max message size accepted - everything bigger must be an error
-#define MAX_DATA_SIZE 16384
+// Framing
+// - normal frames have a 2-byte big endian length header, followed by the message
+// - extended frames have the 2-byte value EXTENDED_FRAME_MARKER, followed by a 4-byte big endian length and the message.
+//   Extended frames are always accepted. They are sent for messages too large for a normal frame only when the
+//   peer has sent an extended frame itself (usually, by sending its hello that way), which negotiates support for them.
+//   vdsmloadtool -x sends all its messages in extended frames, to exercise both directions.
+#define EXTENDED_FRAME_MARKER 0xFFFF
+
+// max message size in a normal frame
+#define MAX_DATA_SIZE (EXTENDED_FRAME_MARKER-1)
+
+// max message size accepted in an extended frame - everything bigger must be an error
+#define MAX_EXTENDED_DATA_SIZE (4*1024*1024)
+
+// buffers are compacted (processed or sent bytes removed from the front) when they have at least this many such bytes,
+// and these make up more than half of the buffer. This way, each byte is moved at most once on average, even when
+// the peer consumes a large buffer in many small portions.
+#define BUFFER_COMPACT_SIZE 4096
 
 
 void VdcPbufApiConnection::gotData(ErrorPtr aError)
@@ -1076,40 +1095,57 @@ void VdcPbufApiConnection::gotData(ErrorPtr aError)
     DBGFOCUSLOG("gotData: numBytesReady()=%d", dataSz);
     // read data we've got so far
     if (dataSz>0) {
-      // temporary buffer
-      uint8_t *buf = new uint8_t[dataSz];
-      size_t receivedBytes = socketComm->receiveBytes(dataSz, buf, aError);
+      // receive directly into the end of the receive buffer
+      size_t oldSize = receiveBuffer.size();
+      receiveBuffer.resize(oldSize+dataSz);
+      size_t receivedBytes = socketComm->receiveBytes(dataSz, (uint8_t *)&receiveBuffer[oldSize], aError);
       DBGFOCUSLOG("gotData: receiveBytes(%d)=%d", dataSz, receivedBytes);
-      DBGFOCUSLOG("gotData: before appending: receivedMessage.size()=%d", receivedMessage.size());
+      receiveBuffer.resize(oldSize+(Error::isOK(aError) ? receivedBytes : 0));
       if (Error::isOK(aError)) {
-        // append to receive buffer
-        receivedMessage.append((const char *)buf, receivedBytes);
-        DBGFOCUSLOG("gotData: after appending: receivedMessage.size()=%d", receivedMessage.size());
+        DBGFOCUSLOG("gotData: after appending: unprocessed bytes=%d", receiveBuffer.size()-receiveOffset);
         // single message extraction
         while(true) {
           DBGFOCUSLOG("gotData: processing loop beginning, expectedMsgBytes=%d", expectedMsgBytes);
-          if(expectedMsgBytes==0 && receivedMessage.size()>=2) {
+          size_t available = receiveBuffer.size()-receiveOffset;
+          if(expectedMsgBytes==0 && available>=2) {
             // got 2-byte length header, decode it
-            const uint8_t *sz = (const uint8_t *)receivedMessage.c_str();
-            expectedMsgBytes =
+            const uint8_t *sz = (const uint8_t *)receiveBuffer.data()+receiveOffset;
+            uint32_t len =
               (sz[0]<<8) +
               sz[1];
-            receivedMessage.erase(0,2);
-            FOCUSLOG("gotData: parsed new header, now expectedMsgBytes=%d", expectedMsgBytes);
-            DBGFOCUSLOG("gotData: after removing header: receivedMessage.size()=%d", receivedMessage.size());
-            if (expectedMsgBytes>MAX_DATA_SIZE) {
-              aError = ErrorPtr(new VdcApiError(413, "message exceeds maximum length of 16kB"));
-              break;
+            if (len==EXTENDED_FRAME_MARKER) {
+              // extended frame, 4-byte length follows
+              if (available<6) break; // wait for rest of header
+              len =
+                (sz[2]<<24) +
+                (sz[3]<<16) +
+                (sz[4]<<8) +
+                sz[5];
+              receiveOffset += 6;
+              available -= 6;
+              if (len>MAX_EXTENDED_DATA_SIZE) {
+                aError = ErrorPtr(new VdcApiError(413, string_format("message size %u exceeds maximum length of %d bytes", len, MAX_EXTENDED_DATA_SIZE)));
+                break;
+              }
+              if (!peerExtendedFrames) {
+                LOG(LOG_INFO, "vdSM uses extended length frames -> large messages will be sent in extended frames");
+                peerExtendedFrames = true;
+              }
             }
+            else {
+              receiveOffset += 2;
+              available -= 2;
+            }
+            expectedMsgBytes = len;
+            FOCUSLOG("gotData: parsed new header, now expectedMsgBytes=%d", expectedMsgBytes);
           }
           // check for complete message
-          if (expectedMsgBytes && (receivedMessage.size()>=expectedMsgBytes)) {
-            FOCUSLOG("gotData: receivedMessage.size()=%d >= expectedMsgBytes=%d -> process", receivedMessage.size(), expectedMsgBytes);
-            // process message
-            aError = processMessage((uint8_t *)receivedMessage.c_str(),expectedMsgBytes);
-            // erase processed message
-            receivedMessage.erase(0,expectedMsgBytes);
-            DBGFOCUSLOG("gotData: after removing message: receivedMessage.size()=%d", receivedMessage.size());
+          if (expectedMsgBytes && (available>=expectedMsgBytes)) {
+            FOCUSLOG("gotData: unprocessed bytes=%d >= expectedMsgBytes=%d -> process", available, expectedMsgBytes);
+            // process message in place
+            aError = processMessage((const uint8_t *)receiveBuffer.data()+receiveOffset, expectedMsgBytes);
+            // skip processed message
+            receiveOffset += expectedMsgBytes;
             expectedMsgBytes = 0; // reset to unknown
             // repeat evaluation with remaining bytes (could be another message)
           }
@@ -1118,10 +1154,19 @@ void VdcPbufApiConnection::gotData(ErrorPtr aError)
             break;
           }
         }
-        DBGFOCUSLOG("gotData: end of processing loop: receivedMessage.size()=%d", receivedMessage.size());
+        // get rid of processed data
+        if (receiveOffset>=receiveBuffer.size()) {
+          // everything processed, just reset (keeps allocated buffer)
+          receiveBuffer.clear();
+          receiveOffset = 0;
+        }
+        else if (receiveOffset>=BUFFER_COMPACT_SIZE && receiveOffset>receiveBuffer.size()/2) {
+          // move remaining partial message to the beginning of the buffer
+          receiveBuffer.erase(0, receiveOffset);
+          receiveOffset = 0;
+        }
+        DBGFOCUSLOG("gotData: end of processing loop: unprocessed bytes=%d", receiveBuffer.size()-receiveOffset);
       }
-      // forget buffer
-      delete[] buf; buf = NULL;
     } // some data seems to be ready
   } // no connection error
   if (!Error::isOK(aError)) {
@@ -1143,62 +1188,82 @@ ErrorPtr VdcPbufApiConnection::sendMessage(const Vdcapi__Message *aVdcApiMessage
   #endif
   // generate the binary message
   size_t packedSize = vdcapi__message__get_packed_size(aVdcApiMessage);
-  uint8_t *packedMsg = new uint8_t[packedSize+2]; // leave room for header
+  bool extended = packedSize>MAX_DATA_SIZE;
+  if (extended && (!peerExtendedFrames || packedSize>MAX_EXTENDED_DATA_SIZE)) {
+    // cannot be expressed in a frame the peer understands
+    return ErrorPtr(new VdcApiError(413, string_format("message size %zu exceeds maximum length of %s", packedSize, peerExtendedFrames ? "4MB" : "64kB")));
+  }
+  size_t headerSize = extended ? 6 : 2;
+  bool idle = transmitOffset>=transmitBuffer.size();
+  if (idle) {
+    // nothing pending, re-use buffer from start
+    transmitBuffer.clear();
+    transmitOffset = 0;
+  }
+  // append the framed message to the transmit buffer, packing it in place
+  size_t frameStart = transmitBuffer.size();
+  transmitBuffer.resize(frameStart+packedSize+headerSize); // leave room for header
+  uint8_t *frameP = (uint8_t *)&transmitBuffer[frameStart];
   // - add the header
-  packedMsg[0] = (packedSize>>8) & 0xFF;
-  packedMsg[1] = packedSize & 0xFF;
+  if (extended) {
+    frameP[0] = (EXTENDED_FRAME_MARKER>>8) & 0xFF;
+    frameP[1] = EXTENDED_FRAME_MARKER & 0xFF;
+    frameP[2] = (packedSize>>24) & 0xFF;
+    frameP[3] = (packedSize>>16) & 0xFF;
+    frameP[4] = (packedSize>>8) & 0xFF;
+    frameP[5] = packedSize & 0xFF;
+  }
+  else {
+    frameP[0] = (packedSize>>8) & 0xFF;
+    frameP[1] = packedSize & 0xFF;
+  }
   // - add the message data
-  vdcapi__message__pack(aVdcApiMessage, packedMsg+2);
-  // - adjust the total message length
-  packedSize += 2;
+  vdcapi__message__pack(aVdcApiMessage, frameP+headerSize);
   // send the message
-  if (transmitBuffer.size()>0) {
-    // other messages are already waiting, append entire message
-    transmitBuffer.append((const char *)packedMsg, packedSize);
+  if (idle) {
+    // nothing sent yet, start new send
+    // (otherwise, other messages are already waiting, and canSendData handler will send this one as well)
+    transmitBuffered(err);
   }
-  else {
-    // nothing in buffer yet, start new send
-    size_t sentBytes = socketComm->transmitBytes(packedSize, packedMsg, err);
-    if (Error::isOK(err)) {
-      // check if all could be sent
-      if (sentBytes<packedSize) {
-        // Not everything (or maybe nothing, transmitBytes() can return 0) was sent
-        // - enable callback for ready-for-send
-        socketComm->setTransmitHandler(boost::bind(&VdcPbufApiConnection::canSendData, this, _1));
-        // buffer the rest, canSendData handler will take care of writing it out
-        transmitBuffer.assign((char *)packedMsg+sentBytes, packedSize-sentBytes);
+  // done
+  return err;
+}
+
+
+void VdcPbufApiConnection::transmitBuffered(ErrorPtr &aError)
+{
+  size_t bytesToSend = transmitBuffer.size()-transmitOffset;
+  size_t sentBytes = socketComm->transmitBytes(bytesToSend, (const uint8_t *)transmitBuffer.data()+transmitOffset, aError);
+  if (Error::isOK(aError)) {
+    if (sentBytes==bytesToSend) {
+      // all sent
+      transmitBuffer.clear();
+      transmitOffset = 0;
+      // - disable transmit handler
+      socketComm->setTransmitHandler(NULL);
+    }
+    else {
+      // Not everything (or maybe nothing, transmitBytes() can return 0) was sent
+      // - skip sent bytes, rest will be sent later
+      transmitOffset += sentBytes;
+      if (transmitOffset>=BUFFER_COMPACT_SIZE && transmitOffset>transmitBuffer.size()/2) {
+        // remove sent data, so buffer does not keep growing while peer is slow
+        transmitBuffer.erase(0, transmitOffset);
+        transmitOffset = 0;
       }
-			else {
-				// all sent
-				// - disable transmit handler
-        socketComm->setTransmitHandler(NULL);
-			}
+      // - enable callback for ready-for-send
+      socketComm->setTransmitHandler(boost::bind(&VdcPbufApiConnection::canSendData, this, _1));
     }
   }
-  // return the buffer
-  delete[] packedMsg;
-  // done
-  return err;
 }
 
 
 void VdcPbufApiConnection::canSendData(ErrorPtr aError)
 {
-  size_t bytesToSend = transmitBuffer.size();
-  if (bytesToSend>0 && Error::isOK(aError)) {
+  if (transmitOffset<transmitBuffer.size() && Error::isOK(aError)) {
     // send data from transmit buffer
-    size_t sentBytes = socketComm->transmitBytes(bytesToSend, (const uint8_t *)transmitBuffer.c_str(), aError);
+    transmitBuffered(aError);
     if (Error::isOK(aError)) {
-      if (sentBytes==bytesToSend) {
-        // all sent
-        transmitBuffer.erase();
-				// - disable transmit handler
-        socketComm->setTransmitHandler(NULL);
-      }
-      else {
-        // partially sent, remove sent bytes
-        transmitBuffer.erase(0, sentBytes);
-      }
       // check for closing connection when no data pending to be sent any more
       if (closeWhenSent && transmitBuffer.size()==0) {
         closeWhenSent = false; // done
@@ -224,10 +224,13 @@ namespace p44 {
 
     // receiving
     uint32_t expectedMsgBytes; ///< number of bytes expected of next message
-    string receivedMessage; ///< accumulated message bytes, including 4-byte length header
+    string receiveBuffer; ///< accumulated received bytes (headers and messages)
+    size_t receiveOffset; ///< start of not yet processed data in receiveBuffer
+    bool peerExtendedFrames; ///< set when peer has sent an extended length frame, so it can receive them as well
 
     // sending
-    string transmitBuffer; ///< binary buffer for data to be sent
+    string transmitBuffer; ///< binary buffer for framed messages to be sent
+    size_t transmitOffset; ///< start of not yet sent data in transmitBuffer
     bool closeWhenSent;
 
     // pending requests
@@ -263,6 +266,7 @@ namespace p44 {
 
     void gotData(ErrorPtr aError);
     void canSendData(ErrorPtr aError);
+    void transmitBuffered(ErrorPtr &aError);
 
     ErrorPtr processMessage(const uint8_t *aPackedMessageP, size_t aPackedMessageSize);
     ErrorPtr sendMessage(const Vdcapi__Message *aVdcApiMessage);
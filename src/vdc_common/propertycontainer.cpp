@@ -28,13 +28,169 @@
 
 #include "propertycontainer.hpp"
 
+#include "fnv.hpp"
+
+#include <typeinfo>
+#include <unistd.h>
+
 using namespace p44;
 
 
+#pragma mark - property name index
+
+// Index of plain property names to their descriptor index, shared by all instances of a PropertyContainer subclass
+// - key is a hash over the container's class, the domain, the parent descriptor's object key and the property name
+// - entries are only hints: a looked-up descriptor is always verified by name, so instances with differing
+//   property sets, hash collisions or outdated entries just fall back to the linear search
+typedef std::map<uint64_t, int> PropertyNameIndex;
+static PropertyNameIndex propertyNameIndex;
+
+static uint64_t propertyNameKey(PropertyContainer &aContainer, const string &aPropName, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+{
+  Fnv64 hash;
+  const std::type_info *classInfoP = &typeid(aContainer);
+  // Note: a container can implement several levels with the same object key, which differ by field key
+  intptr_t parentKey = aParentDescriptor ? aParentDescriptor->objectKey() : 0;
+  size_t parentField = aParentDescriptor ? aParentDescriptor->fieldKey() : 0;
+  hash.addBytes(sizeof(classInfoP), (uint8_t *)&classInfoP);
+  hash.addBytes(sizeof(aDomain), (uint8_t *)&aDomain);
+  hash.addBytes(sizeof(parentKey), (uint8_t *)&parentKey);
+  hash.addBytes(sizeof(parentField), (uint8_t *)&parentField);
+  hash.addString(aPropName);
+  return hash.getHash();
+}
+
+
+#pragma mark - descriptor recycling
+
+// number of different descriptor object sizes recycled (currently, static and dynamic descriptors)
+#define DESCRIPTOR_POOL_SIZES 4
+// max number of recycled objects kept per size
+#define DESCRIPTOR_POOL_MAX_FREE 256
+
+typedef struct {
+  size_t objSize;
+  std::vector<void *> freeObjs;
+} DescriptorPool;
+
+static DescriptorPool descriptorPools[DESCRIPTOR_POOL_SIZES];
+static uint64_t descriptorsCreated = 0;
+static uint64_t descriptorHeapAllocations = 0;
+
+
+static DescriptorPool *descriptorPoolFor(size_t aSize)
+{
+  for (int i=0; i<DESCRIPTOR_POOL_SIZES; i++) {
+    if (descriptorPools[i].objSize==aSize) return &descriptorPools[i];
+    if (descriptorPools[i].objSize==0) {
+      // unused slot, assign to this size
+      descriptorPools[i].objSize = aSize;
+      return &descriptorPools[i];
+    }
+  }
+  return NULL; // no pool for this size
+}
+
+
+void *PropertyDescriptor::operator new(size_t aSize)
+{
+  descriptorsCreated++;
+  DescriptorPool *poolP = descriptorPoolFor(aSize);
+  if (poolP && !poolP->freeObjs.empty()) {
+    void *obj = poolP->freeObjs.back();
+    poolP->freeObjs.pop_back();
+    return obj;
+  }
+  descriptorHeapAllocations++;
+  return ::operator new(aSize);
+}
+
+
+void PropertyDescriptor::operator delete(void *aObj, size_t aSize)
+{
+  if (!aObj) return;
+  DescriptorPool *poolP = descriptorPoolFor(aSize);
+  if (poolP && poolP->freeObjs.size()<DESCRIPTOR_POOL_MAX_FREE) {
+    poolP->freeObjs.push_back(aObj);
+    return;
+  }
+  ::operator delete(aObj);
+}
+
+
+void PropertyDescriptor::getAllocationStats(uint64_t &aCreated, uint64_t &aHeapAllocated)
+{
+  aCreated = descriptorsCreated;
+  aHeapAllocated = descriptorHeapAllocations;
+}
+
+
+
+#pragma mark - change generation tracking
+
+// global change generation counter, incremented for every change of any container
+// - bits 32..51: boot epoch, random per vdcd run, so generations from a previous run are not taken for current ones
+// - bits 0..31: count of changes in this run
+// Note: stays below 2^53 so generations survive JSON clients that use doubles for numbers
+static uint64_t changeGenerationCounter = 0;
+
+
+static uint64_t changeGenerationBase()
+{
+  if (changeGenerationCounter==0) {
+    uint32_t epoch = 0;
+    FILE *f = fopen("/dev/urandom", "r");
+    if (f) {
+      if (fread(&epoch, sizeof(epoch), 1, f)!=1) epoch = 0;
+      fclose(f);
+    }
+    if (epoch==0) {
+      epoch = (uint32_t)time(NULL) ^ ((uint32_t)getpid()<<16);
+    }
+    changeGenerationCounter = ((uint64_t)((epoch & 0xFFFFF)|1))<<32;
+  }
+  return changeGenerationCounter;
+}
+
+
+static uint64_t nextChangeGeneration()
+{
+  changeGenerationBase();
+  return ++changeGenerationCounter;
+}
+
+
+PropertyContainer::PropertyContainer() :
+  localChangeGeneration(nextChangeGeneration()),
+  treeChangeGeneration(localChangeGeneration)
+{
+}
+
+
+uint64_t PropertyContainer::currentChangeGeneration()
+{
+  return changeGenerationBase();
+}
+
+
+bool PropertyContainer::isValidChangeGeneration(uint64_t aGeneration)
+{
+  uint64_t current = currentChangeGeneration();
+  return (aGeneration>>32)==(current>>32) && aGeneration<=current;
+}
+
+
+void PropertyContainer::propertiesChanged()
+{
+  localChangeGeneration = nextChangeGeneration();
+  subtreeChanged(localChangeGeneration);
+}
+
+
 #pragma mark - property access API
 
 
-ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr aQueryObject, ApiValuePtr aResultObject, int aDomain, PropertyDescriptorPtr aParentDescriptor)
+ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr aQueryObject, ApiValuePtr aResultObject, int aDomain, PropertyDescriptorPtr aParentDescriptor, uint64_t aChangedSince)
 {
   ErrorPtr err;
   #if DEBUGFOCUSLOGGING
@@ -55,6 +211,9 @@ ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr
     if (!aResultObject)
       return ErrorPtr(new VdcApiError(415, "accessing property for read must provide result object"));
     aResultObject->setType(apivalue_object); // must be object
+    if (aChangedSince>0 && treeChangeGeneration<=aChangedSince) {
+      return ErrorPtr(); // nothing changed in this container or below, empty result
+    }
   }
   // Iterate trough elements of query object
   aQueryObject->resetKeyIteration();
@@ -100,20 +259,22 @@ ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr
               // - get the PropertyContainer
               int containerDomain = aDomain; // default to same, but getContainer may modify it
               PropertyDescriptorPtr containerPropDesc = propDesc;
-              PropertyContainerPtr container = getContainer(containerPropDesc, containerDomain);
+              PropertyContainerPtr container = aMode==access_read ? getContainer(containerPropDesc, containerDomain) : getContainerForWrite(containerPropDesc, containerDomain);
               if (container) {
                 FOCUSLOG("  - container for '%s' is 0x%p", propDesc->name(), container.get());
                 FOCUSLOG("    >>>> RECURSING into accessProperty()");
                 if (aMode==access_read) {
-                  // read needs a result object
-                  ApiValuePtr resultValue = queryValue->newValue(apivalue_object);
-                  err = container->accessProperty(aMode, subQuery, resultValue, containerDomain, containerPropDesc);
-                  if (Error::isOK(err)) {
-                    // add to result with actual name (from descriptor)
-                    FOCUSLOG("\n  <<<< RETURNED from accessProperty() recursion");
-                    FOCUSLOG("  - accessProperty of container for '%s' returns %s", propDesc->name(), resultValue->description().c_str());
-                    aResultObject->add(propDesc->name(), resultValue);
-                  }
+                  // read needs a result object, started before recursing so streaming results can be output top-down
+                  ApiValuePtr resultValue = aResultObject->beginMember(propDesc->name());
+                  err = container->accessProperty(aMode, subQuery, resultValue, containerDomain, containerPropDesc, aChangedSince);
+                  FOCUSLOG("\n  <<<< RETURNED from accessProperty() recursion");
+                  FOCUSLOG("  - accessProperty of container for '%s' returns %s", propDesc->name(), resultValue->description().c_str());
+                  // add to result with actual name (from descriptor)
+                  // - for change-only reads, omit subcontainers without changed fields
+                  aResultObject->endMember(
+                    propDesc->name(), resultValue,
+                    Error::isOK(err) && !(aChangedSince>0 && resultValue->isEmptyObject())
+                  );
                 }
                 else {
                   // for write, just pass the query value
@@ -136,6 +297,8 @@ ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr
           else {
             // addressed (and known by descriptor!) property is a simple value field -> access it
             if (aMode==access_read) {
+              // for change-only reads, fields of unchanged containers are omitted
+              if (aChangedSince>0 && localChangeGeneration<=aChangedSince) continue;
               // read access: create a new apiValue and have it filled
               ApiValuePtr fieldValue = queryValue->newValue(propDesc->type()); // create a value of correct type to get filled
               bool accessOk = accessField(aMode, fieldValue, propDesc); // read
@@ -152,6 +315,9 @@ ErrorPtr PropertyContainer::accessProperty(PropertyAccessMode aMode, ApiValuePtr
               if (!accessField(aMode, queryValue, propDesc)) { // write
                 err = ErrorPtr(new VdcApiError(403,string_format("Write access to '%s' denied", propDesc->name())));
               }
+              else {
+                propertiesChanged();
+              }
             }
           }
         }
@@ -259,6 +425,20 @@ PropertyDescriptorPtr PropertyContainer::getDescriptorByName(string aPropMatch,
           aStartIndex = n; // already passed -> make out of range
       }
     }
+    uint64_t nameKey = 0;
+    if (!wildcard) {
+      // plain name: try index position known from earlier lookups first
+      nameKey = propertyNameKey(*this, aPropMatch, aDomain, aParentDescriptor);
+      PropertyNameIndex::iterator pos = propertyNameIndex.find(nameKey);
+      if (pos!=propertyNameIndex.end() && pos->second>=aStartIndex && pos->second<n) {
+        propDesc = getDescriptorByIndex(pos->second, aDomain, aParentDescriptor);
+        if (propDesc && aPropMatch==propDesc->name()) {
+          // names are unique within a level, no need to search further
+          aStartIndex = PROPINDEX_NONE;
+          return propDesc;
+        }
+      }
+    }
     while (aStartIndex<n) {
       propDesc = getDescriptorByIndex(aStartIndex, aDomain, aParentDescriptor);
       // check for match
@@ -276,6 +456,12 @@ PropertyDescriptorPtr PropertyContainer::getDescriptorByName(string aPropMatch,
     }
     if (aStartIndex<n) {
       // found a descriptor
+      if (!wildcard) {
+        // - remember position of plain name for next lookup, no need to search further (names are unique within a level)
+        propertyNameIndex[nameKey] = aStartIndex;
+        aStartIndex = PROPINDEX_NONE;
+        return propDesc;
+      }
       // - determine next index
       aStartIndex++;
       if (aStartIndex>=n)
@@ -84,6 +84,22 @@ namespace p44 {
     bool hasObjectKey(char &aMemAddrObjectKey) { return (objectKey()==(intptr_t)&aMemAddrObjectKey); };
     bool hasObjectKey(intptr_t aIntObjectKey) { return (objectKey()==aIntObjectKey); };
     bool isStructured() { return type()==apivalue_object || isArrayContainer(); };
+
+    /// @name descriptor recycling
+    /// Descriptors are created and released in large numbers while traversing the property tree.
+    /// Their memory is kept in a small free list per object size for re-use instead of going back to the heap.
+    /// @note not thread safe - property access happens on the main thread only
+    /// @{
+
+    static void *operator new(size_t aSize);
+    static void operator delete(void *aObj, size_t aSize);
+
+    /// get descriptor allocation statistics
+    /// @param aCreated set to number of descriptors created so far
+    /// @param aHeapAllocated set to number of these that needed a new heap allocation
+    static void getAllocationStats(uint64_t &aCreated, uint64_t &aHeapAllocated);
+
+    /// @}
   };
 
 
@@ -144,9 +160,14 @@ namespace p44 {
   /// provided by base classes, without modifications of the base class.
   class PropertyContainer : public P44Obj
   {
+    uint64_t localChangeGeneration; ///< change generation of the last change of this container's own fields
+    uint64_t treeChangeGeneration; ///< change generation of the last change of this container or any of its subcontainers
 
   public:
 
+    /// constructor, new containers count as changed
+    PropertyContainer();
+
     /// @name property access API
     /// @{
 
@@ -155,8 +176,35 @@ namespace p44 {
     /// @param aQueryObject the object defining the read or write query
     /// @param aResultObject for read, must be an object
     /// @param aParentDescriptor the descriptor of the parent property, can be NULL at root level
+    /// @param aChangedSince for read, if>0, only fields of containers changed after this change generation are returned,
+    ///   and unchanged subcontainers are omitted entirely
     /// @return Error 501 if property is unknown, 403 if property exists but cannot be accessed, 415 if value type is incompatible with the property
-    ErrorPtr accessProperty(PropertyAccessMode aMode, ApiValuePtr aQueryObject, ApiValuePtr aResultObject, int aDomain, PropertyDescriptorPtr aParentDescriptor);
+    ErrorPtr accessProperty(PropertyAccessMode aMode, ApiValuePtr aQueryObject, ApiValuePtr aResultObject, int aDomain, PropertyDescriptorPtr aParentDescriptor, uint64_t aChangedSince = 0);
+
+    /// @}
+
+    /// @name change generation tracking
+    /// @{
+
+    /// @return the current (latest) change generation, for use as aChangedSince in subsequent reads
+    static uint64_t currentChangeGeneration();
+
+    /// check if a change generation obtained from currentChangeGeneration() is usable as aChangedSince
+    /// @param aGeneration the generation to check
+    /// @return false if aGeneration stems from a previous vdcd run (generations are tagged with a per-run epoch)
+    ///   or is newer than the current generation. In that case, changes since then are unknown and a full read is needed.
+    static bool isValidChangeGeneration(uint64_t aGeneration);
+
+    /// mark fields of this container as changed
+    /// @note must be called by implementations when field values change other than by writing via accessProperty(),
+    ///   such as state changes reported by hardware
+    void propertiesChanged();
+
+    /// mark this container's subtree as changed
+    /// @param aGeneration the change generation of the change
+    /// @note subclasses that are subcontainers of another container must override this to pass the change
+    ///   on to their parent container (after calling inherited)
+    virtual void subtreeChanged(uint64_t aGeneration) { treeChangeGeneration = aGeneration; };
 
     /// @}
 
@@ -203,6 +251,14 @@ namespace p44 {
     /// @note base class always returns NULL, which means no structured or proxy properties
     virtual PropertyContainerPtr getContainer(PropertyDescriptorPtr &aPropertyDescriptor, int &aDomain) { return NULL; };
 
+    /// get subcontainer to be modified by a write access
+    /// @param aPropertyDescriptor descriptor for a structured (object) property, see getContainer()
+    /// @param aDomain the domain for which to access properties, see getContainer()
+    /// @return PropertyContainer representing the property or property array element
+    /// @note base class returns the same container as getContainer(). Containers that hand out shared, immutable
+    ///   subcontainers for reading must return a private copy here.
+    virtual PropertyContainerPtr getContainerForWrite(PropertyDescriptorPtr &aPropertyDescriptor, int &aDomain) { return getContainer(aPropertyDescriptor, aDomain); };
+
     /// access single field in this container
     /// @param aMode access mode (see PropertyAccessMode: read, write or write preload)
     /// @param aPropValue JsonObject with a single value
@@ -193,6 +193,16 @@ namespace p44 {
     /// @result empty or Error object in case of error sending error response
     virtual ErrorPtr sendError(uint32_t aErrorCode, string aErrorMessage = "", ApiValuePtr aErrorData = ApiValuePtr()) = 0;
 
+    /// check if the result, while being streamed, has too much text waiting for transmission
+    /// @return true if adding more to the result should be postponed until whenResultDrained() calls back
+    /// @note base class never congests, as results are sent as a whole by sendResult()
+    virtual bool resultCongested() { return false; };
+
+    /// have a handler called when the result stream is no longer congested
+    /// @param aDrainedCB handler to call when more can be added to the result
+    /// @note base class calls the handler right away
+    virtual void whenResultDrained(SimpleCB aDrainedCB) { aDrainedCB(); };
+
     /// send p44utils::Error object as vDC API error
     /// @param aForRequest this must be the VdcApiRequestPtr received in the VdcApiRequestCB handler.
     /// @param aErrorToSend From this error object, getErrorCode() and description() will be used as "code" and "message" members
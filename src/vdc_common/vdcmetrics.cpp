@@ -0,0 +1,165 @@
+//
+//  Copyright (c) 2013-2016 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of vdcd.
+//
+//  vdcd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  vdcd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with vdcd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "vdcmetrics.hpp"
+
+#include <unistd.h>
+
+using namespace p44;
+
+
+#pragma mark - LatencyHistogram
+
+LatencyHistogram::LatencyHistogram()
+{
+  reset();
+}
+
+
+void LatencyHistogram::reset()
+{
+  memset(buckets, 0, sizeof(buckets));
+  numSamples = 0;
+  totalLatency = 0;
+  maxLatency = 0;
+}
+
+
+void LatencyHistogram::record(MLMicroSeconds aLatency)
+{
+  if (aLatency<0) aLatency = 0;
+  // find bucket: index is number of significant bits
+  int b = 0;
+  MLMicroSeconds l = aLatency;
+  while (l>0 && b<LATENCY_HISTOGRAM_BUCKETS-1) { l >>= 1; b++; }
+  buckets[b]++;
+  numSamples++;
+  totalLatency += aLatency;
+  if (aLatency>maxLatency) maxLatency = aLatency;
+}
+
+
+MLMicroSeconds LatencyHistogram::percentile(int aPercent) const
+{
+  if (numSamples==0) return 0;
+  uint64_t threshold = (numSamples*aPercent+99)/100;
+  uint64_t seen = 0;
+  for (int b=0; b<LATENCY_HISTOGRAM_BUCKETS; b++) {
+    seen += buckets[b];
+    if (seen>=threshold) {
+      MLMicroSeconds upper = ((MLMicroSeconds)1<<b)-1;
+      return upper<maxLatency ? upper : maxLatency;
+    }
+  }
+  return maxLatency;
+}
+
+
+static JsonObjectPtr msValue(MLMicroSeconds aLatency)
+{
+  return JsonObject::newDouble((double)aLatency/MilliSecond);
+}
+
+
+JsonObjectPtr LatencyHistogram::json() const
+{
+  JsonObjectPtr h = JsonObject::newObj();
+  h->add("count", JsonObject::newInt64(numSamples));
+  h->add("avg_mS", msValue(numSamples>0 ? totalLatency/(MLMicroSeconds)numSamples : 0));
+  h->add("max_mS", msValue(maxLatency));
+  h->add("p50_mS", msValue(percentile(50)));
+  h->add("p90_mS", msValue(percentile(90)));
+  h->add("p99_mS", msValue(percentile(99)));
+  // non-empty buckets, keyed by their upper bound in microseconds
+  JsonObjectPtr b = JsonObject::newObj();
+  for (int i=0; i<LATENCY_HISTOGRAM_BUCKETS; i++) {
+    if (buckets[i]>0) {
+      b->add(string_format("lt_%lld_uS", (long long)1<<i).c_str(), JsonObject::newInt64(buckets[i]));
+    }
+  }
+  h->add("buckets", b);
+  return h;
+}
+
+
+#pragma mark - VdcMetrics
+
+VdcMetrics::VdcMetrics() :
+  since(MainLoop::now())
+{
+}
+
+
+void VdcMetrics::recordLatency(const string &aName, MLMicroSeconds aLatency)
+{
+  histograms[aName].record(aLatency);
+}
+
+
+void VdcMetrics::count(const string &aName, uint64_t aIncrement)
+{
+  counters[aName] += aIncrement;
+}
+
+
+void VdcMetrics::reset()
+{
+  histograms.clear();
+  counters.clear();
+  since = MainLoop::now();
+}
+
+
+JsonObjectPtr VdcMetrics::json() const
+{
+  JsonObjectPtr m = JsonObject::newObj();
+  MLMicroSeconds period = MainLoop::now()-since;
+  m->add("period_S", JsonObject::newDouble((double)period/Second));
+  JsonObjectPtr h = JsonObject::newObj();
+  for (HistogramMap::const_iterator pos = histograms.begin(); pos!=histograms.end(); ++pos) {
+    h->add(pos->first.c_str(), pos->second.json());
+  }
+  m->add("latencies", h);
+  JsonObjectPtr c = JsonObject::newObj();
+  for (CounterMap::const_iterator pos = counters.begin(); pos!=counters.end(); ++pos) {
+    JsonObjectPtr e = JsonObject::newObj();
+    e->add("count", JsonObject::newInt64(pos->second));
+    e->add("perSecond", JsonObject::newDouble(period>0 ? (double)pos->second*Second/period : 0));
+    c->add(pos->first.c_str(), e);
+  }
+  m->add("counters", c);
+  long rss = residentMemoryKB();
+  if (rss>=0) m->add("residentKB", JsonObject::newInt64(rss));
+  return m;
+}
+
+
+long VdcMetrics::residentMemoryKB()
+{
+  // second field of /proc/self/statm is the resident set size in pages
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (!f) return -1;
+  long size, resident;
+  int n = fscanf(f, "%ld %ld", &size, &resident);
+  fclose(f);
+  if (n!=2) return -1;
+  return resident*(sysconf(_SC_PAGESIZE)/1024);
+}
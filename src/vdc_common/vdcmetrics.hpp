@@ -0,0 +1,108 @@
+//
+//  Copyright (c) 2013-2016 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of vdcd.
+//
+//  vdcd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  vdcd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with vdcd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __vdcd__vdcmetrics__
+#define __vdcd__vdcmetrics__
+
+#include "vdcd_common.hpp"
+
+#include "jsonobject.hpp"
+
+using namespace std;
+
+namespace p44 {
+
+  /// number of buckets in a latency histogram. Bucket N counts latencies below 2^N microseconds,
+  /// so the last bucket covers everything above ~134 seconds
+  #define LATENCY_HISTOGRAM_BUCKETS 28
+
+  /// low overhead latency histogram with power-of-two microsecond buckets
+  class LatencyHistogram
+  {
+    uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+    uint64_t numSamples; ///< number of recorded samples
+    MLMicroSeconds totalLatency; ///< sum of all recorded latencies
+    MLMicroSeconds maxLatency; ///< largest recorded latency
+
+  public:
+
+    LatencyHistogram();
+
+    /// record a sample
+    /// @param aLatency the latency to record
+    void record(MLMicroSeconds aLatency);
+
+    /// clear all samples
+    void reset();
+
+    /// @return number of samples recorded
+    uint64_t count() const { return numSamples; };
+
+    /// estimate a percentile from the buckets
+    /// @param aPercent percentile to estimate (0..100)
+    /// @return upper bound of the bucket containing the percentile, capped at the max latency seen
+    MLMicroSeconds percentile(int aPercent) const;
+
+    /// @return JSON representation (count, average, max, percentiles and non-empty buckets) in milliseconds
+    JsonObjectPtr json() const;
+
+  };
+
+
+  /// collection of named latency histograms and event counters
+  /// @note names are dot-separated categories, such as "api.callScene", "apply.EnOcean" or "persistence.flush"
+  class VdcMetrics
+  {
+    typedef map<string, LatencyHistogram> HistogramMap;
+    typedef map<string, uint64_t> CounterMap;
+
+    HistogramMap histograms;
+    CounterMap counters;
+    MLMicroSeconds since; ///< time when collection started or was last reset
+
+  public:
+
+    VdcMetrics();
+
+    /// record a latency sample
+    /// @param aName name of the histogram
+    /// @param aLatency the latency to record
+    void recordLatency(const string &aName, MLMicroSeconds aLatency);
+
+    /// count an event
+    /// @param aName name of the counter
+    /// @param aIncrement amount to add
+    void count(const string &aName, uint64_t aIncrement = 1);
+
+    /// clear all histograms and counters and restart collection period
+    void reset();
+
+    /// @return JSON representation of all histograms and counters (with rates per second since last reset)
+    JsonObjectPtr json() const;
+
+    /// @return current resident memory (RSS) of the process in kB, -1 if not available on this platform
+    static long residentMemoryKB();
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__vdcd__vdcmetrics__) */
@@ -0,0 +1,278 @@
+//
+//  Copyright (c) 2013-2016 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of vdcd.
+//
+//  vdcd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  vdcd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with vdcd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "workerpool.hpp"
+
+using namespace p44;
+
+
+#pragma mark - WorkerPool
+
+WorkerPool::WorkerPool(int aMaxThreads, size_t aMaxQueued) :
+  maxThreads(aMaxThreads>0 ? aMaxThreads : 0),
+  maxQueued(aMaxQueued),
+  idleWorkers(0),
+  stopping(false),
+  metricsP(NULL)
+{
+  pthread_mutex_init(&jobAccess, NULL);
+  pthread_cond_init(&jobAvailable, NULL);
+}
+
+
+WorkerPool::~WorkerPool()
+{
+  stop();
+  pthread_cond_destroy(&jobAvailable);
+  pthread_mutex_destroy(&jobAccess);
+}
+
+
+void WorkerPool::submit(WorkerJobCB aJob, SimpleCB aDoneCB)
+{
+  Job *job = new Job;
+  job->job = aJob;
+  job->doneCB = aDoneCB;
+  job->submitted = MainLoop::now();
+  job->started = Never;
+  job->finished = Never;
+  if (maxThreads>0) {
+    pthread_mutex_lock(&jobAccess);
+    if (!stopping && pendingJobs.size()<maxQueued) {
+      pendingJobs.push_back(job);
+      bool needWorker = (size_t)idleWorkers<pendingJobs.size() && (int)workers.size()<maxThreads;
+      pthread_cond_signal(&jobAvailable);
+      pthread_mutex_unlock(&jobAccess);
+      if (needWorker) {
+        FOCUSLOG("WorkerPool: starting worker thread #%zu", workers.size()+1);
+        workers.push_back(MainLoop::currentMainLoop().executeInThread(
+          boost::bind(&WorkerPool::workerRoutine, this, _1),
+          boost::bind(&WorkerPool::workerSignal, this, _1, _2)
+        ));
+      }
+      return;
+    }
+    pthread_mutex_unlock(&jobAccess);
+  }
+  // no worker available: run it here, but still deliver the result from a later main loop cycle
+  job->started = MainLoop::now();
+  job->job();
+  job->finished = MainLoop::now();
+  if (metricsP) metricsP->count("worker.inline");
+  MainLoop::currentMainLoop().executeOnce(boost::bind(&WorkerPool::deliverDone, this, job));
+}
+
+
+void WorkerPool::workerRoutine(ChildThreadWrapper &aThread)
+{
+  // Note: this runs in the worker thread, do not touch anything not protected by jobAccess
+  pthread_mutex_lock(&jobAccess);
+  while (true) {
+    while (pendingJobs.empty() && !stopping) {
+      idleWorkers++;
+      pthread_cond_wait(&jobAvailable, &jobAccess);
+      idleWorkers--;
+    }
+    if (stopping) break;
+    Job *job = pendingJobs.front();
+    pendingJobs.pop_front();
+    pthread_mutex_unlock(&jobAccess);
+    job->started = MainLoop::now();
+    job->job();
+    job->finished = MainLoop::now();
+    pthread_mutex_lock(&jobAccess);
+    doneJobs.push_back(job);
+    // let main loop pick up the result
+    aThread.signalParentThread(threadSignalUserSignal);
+  }
+  pthread_mutex_unlock(&jobAccess);
+}
+
+
+void WorkerPool::workerSignal(ChildThreadWrapper &aChildThread, ThreadSignals aSignalCode)
+{
+  // Note: this runs on the main loop thread
+  if (aSignalCode==threadSignalUserSignal) {
+    JobList done;
+    pthread_mutex_lock(&jobAccess);
+    done.swap(doneJobs);
+    pthread_mutex_unlock(&jobAccess);
+    for (JobList::iterator pos = done.begin(); pos!=done.end(); ++pos) {
+      deliverDone(*pos);
+    }
+  }
+}
+
+
+void WorkerPool::deliverDone(Job *aJob)
+{
+  if (metricsP) {
+    metricsP->recordLatency("worker.queue", aJob->started-aJob->submitted);
+    metricsP->recordLatency("worker.run", aJob->finished-aJob->started);
+  }
+  if (aJob->doneCB) aJob->doneCB();
+  delete aJob;
+}
+
+
+void WorkerPool::stop()
+{
+  JobList discarded;
+  pthread_mutex_lock(&jobAccess);
+  stopping = true;
+  pthread_cond_broadcast(&jobAvailable);
+  pthread_mutex_unlock(&jobAccess);
+  // wait for workers to finish their current job
+  for (WorkerVector::iterator pos = workers.begin(); pos!=workers.end(); ++pos) {
+    (*pos)->terminate();
+  }
+  workers.clear();
+  pthread_mutex_lock(&jobAccess);
+  discarded.swap(pendingJobs);
+  discarded.splice(discarded.end(), doneJobs);
+  pthread_mutex_unlock(&jobAccess);
+  for (JobList::iterator pos = discarded.begin(); pos!=discarded.end(); ++pos) {
+    delete *pos;
+  }
+}
+
+
+JsonObjectPtr WorkerPool::status()
+{
+  JsonObjectPtr s = JsonObject::newObj();
+  pthread_mutex_lock(&jobAccess);
+  s->add("maxThreads", JsonObject::newInt32(maxThreads));
+  s->add("threads", JsonObject::newInt32((int)workers.size()));
+  s->add("idle", JsonObject::newInt32(idleWorkers));
+  s->add("queued", JsonObject::newInt32((int)pendingJobs.size()));
+  pthread_mutex_unlock(&jobAccess);
+  return s;
+}
+
+
+#pragma mark - JitterBenchmark
+
+JitterBenchmark::JitterBenchmark(WorkerPool &aWorkerPool, const string &aLoad, MLMicroSeconds aDuration, MLMicroSeconds aInterval, int aDerivationsPerTick) :
+  workerPool(aWorkerPool),
+  load(aLoad),
+  interval(aInterval>0 ? aInterval : 10*MilliSecond),
+  duration(aDuration),
+  endTime(Never),
+  nextTick(Never),
+  derivationsPerTick(aDerivationsPerTick),
+  ticket(0),
+  loadTicket(0),
+  finished(false),
+  jobsPending(0),
+  jobsDone(0),
+  derivations(0)
+{
+}
+
+
+void JitterBenchmark::start(JitterBenchmarkCB aResultCB)
+{
+  resultCB = aResultCB;
+  MLMicroSeconds now = MainLoop::now();
+  endTime = now+duration;
+  nextTick = now+interval;
+  ticket = MainLoop::currentMainLoop().executeOnce(boost::bind(&JitterBenchmark::tick, JitterBenchmarkPtr(this)), interval);
+  // load is generated at the same rate, but half an interval offset, so measuring ticks are not just delayed by their own work
+  if (load!="none") {
+    loadTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&JitterBenchmark::loadTick, JitterBenchmarkPtr(this)), interval/2);
+  }
+}
+
+
+void JitterBenchmark::tick()
+{
+  ticket = 0;
+  MLMicroSeconds now = MainLoop::now();
+  lateness.record(now-nextTick);
+  if (now>=endTime) {
+    // measurement done
+    finished = true;
+    MainLoop::currentMainLoop().cancelExecutionTicket(loadTicket);
+    checkCompleted();
+    return;
+  }
+  // next tick on the original schedule, skipping ticks that are already over
+  while (nextTick<=now) nextTick += interval;
+  ticket = MainLoop::currentMainLoop().executeOnce(boost::bind(&JitterBenchmark::tick, JitterBenchmarkPtr(this)), nextTick-now);
+}
+
+
+void JitterBenchmark::loadTick()
+{
+  loadTicket = 0;
+  string prefix = string_format("jitterbenchmark:%ld:", jobsDone+jobsPending);
+  if (load=="worker") {
+    DsUid *lastP = new DsUid;
+    jobsPending++;
+    workerPool.submit(
+      boost::bind(&JitterBenchmark::deriveDsUids, prefix, derivationsPerTick, lastP),
+      boost::bind(&JitterBenchmark::jobDone, JitterBenchmarkPtr(this), lastP)
+    );
+  }
+  else {
+    DsUid last;
+    deriveDsUids(prefix, derivationsPerTick, &last);
+    jobsDone++;
+    derivations += derivationsPerTick;
+  }
+  loadTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&JitterBenchmark::loadTick, JitterBenchmarkPtr(this)), interval);
+}
+
+
+void JitterBenchmark::deriveDsUids(const string aPrefix, int aCount, DsUid *aLastP)
+{
+  DsUid vdcNamespace(DSUID_P44VDC_MODELUID_UUID);
+  for (int i=0; i<aCount; i++) {
+    aLastP->setNameInSpace(string_format("%s%d", aPrefix.c_str(), i), vdcNamespace);
+  }
+}
+
+
+void JitterBenchmark::jobDone(DsUid *aLastP)
+{
+  delete aLastP;
+  jobsPending--;
+  jobsDone++;
+  derivations += derivationsPerTick;
+  checkCompleted();
+}
+
+
+void JitterBenchmark::checkCompleted()
+{
+  if (!finished || jobsPending>0 || !resultCB) return;
+  JsonObjectPtr r = JsonObject::newObj();
+  r->add("load", JsonObject::newString(load));
+  r->add("interval_mS", JsonObject::newDouble((double)interval/MilliSecond));
+  r->add("derivationsPerTick", JsonObject::newInt32(derivationsPerTick));
+  r->add("loadJobs", JsonObject::newInt64(jobsDone));
+  r->add("derivations", JsonObject::newInt64(derivations));
+  r->add("timerLateness", lateness.json());
+  r->add("workers", workerPool.status());
+  JitterBenchmarkCB cb = resultCB;
+  resultCB = NULL;
+  cb(r);
+}
@@ -0,0 +1,171 @@
+//
+//  Copyright (c) 2013-2016 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of vdcd.
+//
+//  vdcd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  vdcd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with vdcd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#ifndef __vdcd__workerpool__
+#define __vdcd__workerpool__
+
+#include "vdcd_common.hpp"
+
+#include "vdcmetrics.hpp"
+#include "dsuid.hpp"
+
+#include <pthread.h>
+
+using namespace std;
+
+namespace p44 {
+
+  /// default max number of worker threads
+  #define DEFAULT_WORKER_THREADS 2
+  /// default max number of jobs waiting for a worker. When the queue is full, jobs run directly on the main loop
+  #define DEFAULT_WORKER_QUEUE 64
+
+  /// job routine, executed in a worker thread
+  /// @note must be self-contained: it must not access any object owned by the main loop thread, and in particular
+  ///   must not copy or release P44Obj based smart pointers, because their reference counting is not thread safe.
+  ///   Input should be bound by value, output should go to a plain object that only the done callback will access.
+  typedef boost::function<void ()> WorkerJobCB;
+
+
+  /// small bounded pool of worker threads for CPU-heavy or blocking work that should not stall the main loop.
+  /// Jobs are handed in from the main loop thread, their done callbacks are called back on the main loop thread.
+  class WorkerPool
+  {
+    typedef struct {
+      WorkerJobCB job;
+      SimpleCB doneCB;
+      MLMicroSeconds submitted; ///< when job was submitted
+      MLMicroSeconds started; ///< when a worker started running the job
+      MLMicroSeconds finished; ///< when the job finished
+    } Job;
+    typedef std::list<Job *> JobList;
+    typedef std::vector<ChildThreadWrapperPtr> WorkerVector;
+
+    int maxThreads; ///< max number of worker threads
+    size_t maxQueued; ///< max number of jobs waiting for a worker
+    WorkerVector workers; ///< running worker threads
+
+    pthread_mutex_t jobAccess; ///< protects everything below
+    pthread_cond_t jobAvailable; ///< signalled when a job is queued or the pool stops
+    JobList pendingJobs; ///< jobs waiting for a worker
+    JobList doneJobs; ///< jobs completed, waiting to be delivered on the main loop
+    int idleWorkers; ///< number of workers waiting for a job
+    bool stopping; ///< set when workers must terminate
+
+    VdcMetrics *metricsP; ///< if set, job queue and run times are recorded here
+
+  public:
+
+    /// create pool
+    /// @param aMaxThreads max number of worker threads, 0 = run all jobs directly on the main loop
+    /// @param aMaxQueued max number of jobs waiting for a free worker
+    WorkerPool(int aMaxThreads = DEFAULT_WORKER_THREADS, size_t aMaxQueued = DEFAULT_WORKER_QUEUE);
+    ~WorkerPool();
+
+    /// set max number of worker threads
+    /// @param aMaxThreads max number of worker threads, 0 = run all jobs directly on the main loop
+    /// @note does not stop already running workers
+    void setMaxThreads(int aMaxThreads) { maxThreads = aMaxThreads>0 ? aMaxThreads : 0; };
+
+    /// set where to record job latencies ("worker.queue", "worker.run") and counters ("worker.inline")
+    /// @param aMetricsP metrics collection, NULL for none
+    void setMetrics(VdcMetrics *aMetricsP) { metricsP = aMetricsP; };
+
+    /// hand a job to the pool
+    /// @param aJob the job to run in a worker thread (see WorkerJobCB for restrictions)
+    /// @param aDoneCB called on the main loop thread when the job has completed
+    /// @note when no worker is available and the queue is full, the job is run directly on the main loop,
+    ///   but aDoneCB is still called from a later main loop cycle, never from within submit()
+    void submit(WorkerJobCB aJob, SimpleCB aDoneCB);
+
+    /// stop all workers, jobs not yet started are discarded without calling their done callbacks
+    void stop();
+
+    /// @return JSON object with current pool status
+    JsonObjectPtr status();
+
+  private:
+
+    void workerRoutine(ChildThreadWrapper &aThread);
+    void workerSignal(ChildThreadWrapper &aChildThread, ThreadSignals aSignalCode);
+    void deliverDone(Job *aJob);
+
+  };
+
+
+  class JitterBenchmark;
+  typedef boost::intrusive_ptr<JitterBenchmark> JitterBenchmarkPtr;
+
+  /// callback delivering the benchmark result
+  typedef boost::function<void (JsonObjectPtr aResult)> JitterBenchmarkCB;
+
+  /// measures how accurately main loop timers fire while CPU-heavy work (name based dSUID derivation)
+  /// is either done directly on the main loop or handed to a worker pool
+  class JitterBenchmark : public P44Obj
+  {
+    WorkerPool &workerPool;
+    JitterBenchmarkCB resultCB;
+    string load; ///< "none", "mainloop" or "worker"
+    MLMicroSeconds interval; ///< timer interval
+    MLMicroSeconds duration; ///< how long to measure
+    MLMicroSeconds endTime; ///< when to stop ticking
+    MLMicroSeconds nextTick; ///< when next tick is due
+    int derivationsPerTick; ///< number of dSUIDs to derive per tick
+    LatencyHistogram lateness; ///< how late timer ticks fired
+    long ticket; ///< measuring timer
+    long loadTicket; ///< load generating timer
+    bool finished; ///< set when measurement has ended
+    int jobsPending;
+    long jobsDone;
+    long derivations;
+
+  public:
+
+    /// create benchmark
+    /// @param aWorkerPool the pool to use for load "worker"
+    /// @param aLoad where to put the load: "none", "mainloop" or "worker"
+    /// @param aDuration how long to run
+    /// @param aInterval timer interval
+    /// @param aDerivationsPerTick number of name based dSUIDs to derive per timer tick
+    JitterBenchmark(WorkerPool &aWorkerPool, const string &aLoad, MLMicroSeconds aDuration, MLMicroSeconds aInterval, int aDerivationsPerTick);
+
+    /// start the benchmark
+    /// @param aResultCB called with the result when the benchmark has completed
+    void start(JitterBenchmarkCB aResultCB);
+
+    /// derive a batch of name based dSUIDs, suitable to be run as a worker job
+    /// @param aPrefix name prefix, names are aPrefix followed by a sequence number
+    /// @param aCount number of dSUIDs to derive
+    /// @param aLastP will receive the last derived dSUID
+    static void deriveDsUids(const string aPrefix, int aCount, DsUid *aLastP);
+
+  private:
+
+    void tick();
+    void loadTick();
+    void jobDone(DsUid *aLastP);
+    void checkCompleted();
+
+  };
+
+} // namespace p44
+
+#endif /* defined(__vdcd__workerpool__) */
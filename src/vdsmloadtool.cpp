@@ -0,0 +1,925 @@
+//
+//  Copyright (c) 2013-2016 plan44.ch / Lukas Zeller, Zurich, Switzerland
+//
+//  Author: Lukas Zeller <luz@plan44.ch>
+//
+//  This file is part of vdcd.
+//
+//  vdcd is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  vdcd is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with vdcd. If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "application.hpp"
+
+#include "jsonrpccomm.hpp"
+#include "socketcomm.hpp"
+
+#include "messages.pb-c.h"
+
+#include <algorithm>
+#include <deque>
+
+#define DEFAULT_PBUF_VDCSERVICE "8340"
+#define DEFAULT_JSON_VDCSERVICE "8440"
+#define DEFAULT_RATE 20 // operations per second
+#define DEFAULT_DURATION 30 // seconds
+#define DEFAULT_MIX "callScene:40,dimChannel:10,getProperty:40,setProperty:10"
+#define MAINLOOP_CYCLE_TIME_uS 5000 // 5mS
+#define DEFAULT_LOGLEVEL LOG_NOTICE
+
+#define VDC_API_VERSION 2
+#define LOADTOOL_VDSM_DSUID "4C4F414447454E000000000000000000F0" // fake vdSM dSUID used in hello
+
+#define ANNOUNCE_SETTLE_TIME (3*Second) // load starts when no more announcements arrive for this time
+#define LOAD_TICK_INTERVAL (10*MilliSecond)
+#define FINISH_WAIT_TIME (3*Second) // time to wait for outstanding answers after sending last operation
+#define PONG_TIMEOUT (5*Second) // notifications whose follow-up ping is not answered within this time are counted as lost
+#define RESPONSE_TIMEOUT (5*Second) // requests not answered within this time are counted as lost
+
+// max message size of the protobuf API (2-byte length header)
+#define EXTENDED_FRAME_MARKER 0xFFFF // 2-byte header value announcing a 4-byte length (extended frame)
+#define MAX_PBUF_DATA_SIZE (EXTENDED_FRAME_MARKER-1)
+#define MAX_PBUF_EXTENDED_DATA_SIZE (4*1024*1024)
+#define THROUGHPUT_WINDOW 32 // requests kept outstanding in throughput mode
+
+
+using namespace p44;
+
+
+typedef enum {
+  op_callScene,
+  op_dimChannel,
+  op_getProperty,
+  op_setProperty,
+  numOpTypes
+} OpType;
+
+static const char *opNames[numOpTypes] = {
+  "callScene",
+  "dimChannel",
+  "getProperty",
+  "setProperty"
+};
+
+
+/// an operation awaiting its answer (result, error or pong)
+typedef struct {
+  OpType op;
+  MLMicroSeconds started;
+} PendingOp;
+
+typedef std::deque<PendingOp> PendingOpQueue;
+typedef std::map<string, PendingOpQueue> PongWaitMap;
+typedef std::map<uint32_t, PendingOp> ResponseWaitMap;
+
+
+class VdsmLoadTool : public Application
+{
+  // common
+  bool useJson;
+  vector<string> devices; ///< dSUIDs (as hex strings) of the announced devices
+  MLMicroSeconds lastAnnounce;
+  long settleTicket;
+  long loadTicket;
+
+  // JSON API
+  JsonRpcCommPtr jsonRpcComm;
+
+  // protobuf API
+  SocketCommPtr pbufComm;
+  string receiveBuffer;
+  string transmitBuffer;
+  uint32_t messageIdCounter;
+  ResponseWaitMap responseWaits;
+  bool extendedFrames; ///< send all messages in extended length frames (which makes vdcd use them for large messages, too)
+  uint64_t bytesSent;
+  uint64_t bytesReceived;
+
+  // throughput mode
+  long throughputCount; ///< if >0, number of full property reads to pipeline as fast as possible instead of a timed load
+  long throughputIssued;
+  long throughputDone;
+
+  // load parameters
+  double rate;
+  MLMicroSeconds duration;
+  int mixWeights[numOpTypes];
+  int totalWeight;
+
+  // load state
+  MLMicroSeconds loadStarted;
+  long opsIssued;
+  int dimToggle;
+  PongWaitMap pongWaits;
+
+  // statistics
+  vector<double> latencies[numOpTypes]; ///< latencies of completed operations in mS
+  long sent[numOpTypes];
+  long errors[numOpTypes];
+  long lost[numOpTypes]; ///< notifications whose ping and requests whose response did not arrive in time
+
+public:
+
+  VdsmLoadTool() :
+    useJson(false),
+    lastAnnounce(Never),
+    settleTicket(0),
+    loadTicket(0),
+    messageIdCounter(0),
+    extendedFrames(false),
+    bytesSent(0),
+    bytesReceived(0),
+    throughputCount(0),
+    throughputIssued(0),
+    throughputDone(0),
+    rate(DEFAULT_RATE),
+    duration(DEFAULT_DURATION*Second),
+    totalWeight(0),
+    loadStarted(Never),
+    opsIssued(0),
+    dimToggle(0)
+  {
+    for (int i=0; i<numOpTypes; i++) {
+      mixWeights[i] = 0;
+      sent[i] = 0;
+      errors[i] = 0;
+      lost[i] = 0;
+    }
+  }
+
+
+  void usage(char *name)
+  {
+    fprintf(stderr, "usage:\n");
+    fprintf(stderr, "  %s [options]\n", name);
+    fprintf(stderr, "    -c vdchost      : host of the vdcd to load (default=localhost)\n");
+    fprintf(stderr, "    -C vdcport      : port number/service name of vdcd's vDC API (default=%s for protobuf, %s for JSON)\n", DEFAULT_PBUF_VDCSERVICE, DEFAULT_JSON_VDCSERVICE);
+    fprintf(stderr, "    -j              : use JSON API instead of protobuf API\n");
+    fprintf(stderr, "    -r rate         : target rate in operations per second (default=%d)\n", DEFAULT_RATE);
+    fprintf(stderr, "    -d seconds      : duration of the load phase (default=%d)\n", DEFAULT_DURATION);
+    fprintf(stderr, "    -m mix          : operation mix as op:weight,... (default=%s)\n", DEFAULT_MIX);
+    fprintf(stderr, "    -x              : send protobuf messages in extended length frames\n");
+    fprintf(stderr, "    -t count        : protobuf throughput: pipeline count full device property reads, report msgs/s and MB/s\n");
+    fprintf(stderr, "    -l loglevel     : set loglevel (default = %d)\n", DEFAULT_LOGLEVEL);
+  };
+
+  virtual int main(int argc, char **argv)
+  {
+    int loglevel = DEFAULT_LOGLEVEL; // use defaults
+
+    const char *vdchost = "localhost";
+    const char *vdcport = NULL;
+    const char *mix = DEFAULT_MIX;
+
+    int c;
+    while ((c = getopt(argc, argv, "c:C:jr:d:m:xt:l:h")) != -1)
+    {
+      switch (c) {
+        case 'c':
+          vdchost = optarg;
+          break;
+        case 'C':
+          vdcport = optarg;
+          break;
+        case 'j':
+          useJson = true;
+          break;
+        case 'r':
+          rate = atof(optarg);
+          break;
+        case 'd':
+          duration = atoi(optarg)*Second;
+          break;
+        case 'm':
+          mix = optarg;
+          break;
+        case 'x':
+          extendedFrames = true;
+          break;
+        case 't':
+          throughputCount = atol(optarg);
+          break;
+        case 'l':
+          loglevel = atoi(optarg);
+          break;
+        default:
+          usage(argv[0]);
+          exit(-1);
+      }
+    }
+    if (!parseMix(mix) || rate<=0 || throughputCount<0 || (useJson && (throughputCount>0 || extendedFrames))) {
+      usage(argv[0]);
+      exit(-1);
+    }
+    if (!vdcport) vdcport = useJson ? DEFAULT_JSON_VDCSERVICE : DEFAULT_PBUF_VDCSERVICE;
+
+    SETLOGLEVEL(loglevel);
+
+    // connect as vdSM to the vdcd
+    if (useJson) {
+      jsonRpcComm = JsonRpcCommPtr(new JsonRpcComm(MainLoop::currentMainLoop()));
+      jsonRpcComm->setConnectionParams(vdchost, vdcport, SOCK_STREAM, AF_INET);
+      jsonRpcComm->setConnectionStatusHandler(boost::bind(&VdsmLoadTool::connectionHandler, this, _2));
+      jsonRpcComm->setRequestHandler(boost::bind(&VdsmLoadTool::jsonRequestHandler, this, _1, _2, _3));
+      jsonRpcComm->initiateConnection();
+    }
+    else {
+      pbufComm = SocketCommPtr(new SocketComm(MainLoop::currentMainLoop()));
+      pbufComm->setConnectionParams(vdchost, vdcport, SOCK_STREAM, AF_INET);
+      pbufComm->setConnectionStatusHandler(boost::bind(&VdsmLoadTool::connectionHandler, this, _2));
+      pbufComm->setReceiveHandler(boost::bind(&VdsmLoadTool::pbufGotData, this, _1));
+      pbufComm->initiateConnection();
+    }
+    // app now ready to run
+    return run();
+  }
+
+
+  bool parseMix(const char *aMix)
+  {
+    string m = aMix;
+    size_t i = 0;
+    totalWeight = 0;
+    while (i<m.size()) {
+      size_t e = m.find(',', i);
+      if (e==string::npos) e = m.size();
+      string part = m.substr(i, e-i);
+      size_t s = part.find(':');
+      int w = s==string::npos ? 1 : atoi(part.c_str()+s+1);
+      string name = part.substr(0, s);
+      int op;
+      for (op=0; op<numOpTypes; op++) {
+        if (name==opNames[op]) break;
+      }
+      if (op>=numOpTypes || w<0) {
+        fprintf(stderr, "Invalid operation mix entry '%s'\n", part.c_str());
+        return false;
+      }
+      mixWeights[op] = w;
+      totalWeight += w;
+      i = e+1;
+    }
+    return totalWeight>0;
+  }
+
+
+  #pragma mark - session
+
+
+  void connectionHandler(ErrorPtr aError)
+  {
+    if (Error::isOK(aError)) {
+      LOG(LOG_NOTICE, "Connection to vdcd established, sending hello (%s API)", useJson ? "JSON" : "protobuf");
+      sendHello();
+    }
+    else {
+      LOG(LOG_ERR, "Connection to vdcd terminated: %s", aError->description().c_str());
+      if (loadStarted!=Never) report();
+      exit(1);
+    }
+  }
+
+
+  void helloDone(ErrorPtr aError)
+  {
+    if (!Error::isOK(aError)) {
+      LOG(LOG_ERR, "hello failed: %s", aError->description().c_str());
+      exit(1);
+    }
+    LOG(LOG_NOTICE, "vDC session started, waiting for announcements");
+    lastAnnounce = MainLoop::now();
+    settleTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdsmLoadTool::checkSettled, this), ANNOUNCE_SETTLE_TIME);
+  }
+
+
+  void announced(const string &aDsUid, bool aIsDevice)
+  {
+    lastAnnounce = MainLoop::now();
+    if (aIsDevice) {
+      devices.push_back(aDsUid);
+      LOG(LOG_INFO, "device announced: %s", aDsUid.c_str());
+    }
+  }
+
+
+  void vanished(const string &aDsUid)
+  {
+    vector<string>::iterator pos = std::find(devices.begin(), devices.end(), aDsUid);
+    if (pos!=devices.end()) devices.erase(pos);
+  }
+
+
+  void checkSettled()
+  {
+    settleTicket = 0;
+    MLMicroSeconds now = MainLoop::now();
+    if (now<lastAnnounce+ANNOUNCE_SETTLE_TIME) {
+      // still getting announcements
+      settleTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdsmLoadTool::checkSettled, this), lastAnnounce+ANNOUNCE_SETTLE_TIME-now);
+      return;
+    }
+    if (devices.empty()) {
+      LOG(LOG_ERR, "No devices announced, nothing to load");
+      exit(1);
+    }
+    loadStarted = now;
+    if (throughputCount>0) {
+      LOG(LOG_NOTICE, "%zu devices announced, starting throughput run: %ld full property reads, %d outstanding", devices.size(), throughputCount, THROUGHPUT_WINDOW);
+      bytesSent = 0;
+      bytesReceived = 0;
+      throughputNext();
+      loadTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdsmLoadTool::throughputTick, this), LOAD_TICK_INTERVAL);
+      return;
+    }
+    LOG(LOG_NOTICE, "%zu devices announced, starting load: %.1f ops/s for %lld seconds", devices.size(), rate, duration/Second);
+    loadTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdsmLoadTool::loadTick, this), 0);
+  }
+
+
+  #pragma mark - load generation
+
+
+  void loadTick()
+  {
+    loadTicket = 0;
+    MLMicroSeconds now = MainLoop::now();
+    if (now>=loadStarted+duration) {
+      // load phase done, wait for stragglers
+      LOG(LOG_NOTICE, "Load phase done, waiting for outstanding answers");
+      MainLoop::currentMainLoop().executeOnce(boost::bind(&VdsmLoadTool::finish, this), FINISH_WAIT_TIME);
+      return;
+    }
+    // forget notifications whose pong and requests whose response did not arrive in time
+    expirePongWaits(now-PONG_TIMEOUT);
+    expireResponseWaits(now-RESPONSE_TIMEOUT);
+    // issue all operations due by now
+    long due = (long)(rate*(now-loadStarted)/Second);
+    while (opsIssued<due) {
+      issueOp(pickOp(), devices[rand() % devices.size()]);
+      opsIssued++;
+    }
+    loadTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdsmLoadTool::loadTick, this), LOAD_TICK_INTERVAL);
+  }
+
+
+  void throughputTick()
+  {
+    loadTicket = 0;
+    // a lost response must not stall the run: count it as done (and lost), refill the window
+    expireResponseWaits(MainLoop::now()-RESPONSE_TIMEOUT);
+    throughputNext();
+    loadTicket = MainLoop::currentMainLoop().executeOnce(boost::bind(&VdsmLoadTool::throughputTick, this), LOAD_TICK_INTERVAL);
+  }
+
+
+  void throughputNext()
+  {
+    // keep the window of outstanding requests filled
+    while (throughputIssued<throughputCount && throughputIssued-throughputDone<THROUGHPUT_WINDOW) {
+      issueOp(op_getProperty, devices[throughputIssued % devices.size()]);
+      throughputIssued++;
+    }
+    if (throughputDone>=throughputCount) {
+      finish();
+    }
+  }
+
+
+  OpType pickOp()
+  {
+    int r = rand() % totalWeight;
+    for (int op=0; op<numOpTypes; op++) {
+      if (r<mixWeights[op]) return (OpType)op;
+      r -= mixWeights[op];
+    }
+    return op_getProperty; // NOP, weights add up to totalWeight
+  }
+
+
+  void issueOp(OpType aOp, const string &aDsUid)
+  {
+    PendingOp p;
+    p.op = aOp;
+    p.started = MainLoop::now();
+    sent[aOp]++;
+    switch (aOp) {
+      case op_callScene:
+      case op_dimChannel:
+        // notifications have no answer: follow up with a ping to the same device,
+        // the pong arrives after the notification has been processed
+        if (useJson) jsonSendNotification(aOp, aDsUid); else pbufSendNotification(aOp, aDsUid);
+        pongWaits[aDsUid].push_back(p);
+        break;
+      case op_getProperty:
+      case op_setProperty:
+        if (useJson) jsonSendRequest(p, aDsUid); else pbufSendRequest(p, aDsUid);
+        break;
+      default:
+        break;
+    }
+  }
+
+
+  int nextDimMode()
+  {
+    // alternate between start dimming up and stop
+    dimToggle = !dimToggle;
+    return dimToggle ? 1 : 0;
+  }
+
+
+  int randomSceneNo()
+  {
+    // off, preset 1..4
+    static const int sceneNos[] = { 0, 5, 17, 18, 19 };
+    return sceneNos[rand() % (sizeof(sceneNos)/sizeof(int))];
+  }
+
+
+  void opDone(const PendingOp &aPendingOp, bool aOk)
+  {
+    if (aOk) {
+      latencies[aPendingOp.op].push_back((double)(MainLoop::now()-aPendingOp.started)/MilliSecond);
+    }
+    else {
+      errors[aPendingOp.op]++;
+    }
+  }
+
+
+  void expirePongWaits(MLMicroSeconds aStartedBefore)
+  {
+    for (PongWaitMap::iterator pos = pongWaits.begin(); pos!=pongWaits.end(); ++pos) {
+      PendingOpQueue &q = pos->second;
+      while (!q.empty() && q.front().started<aStartedBefore) {
+        lost[q.front().op]++;
+        q.pop_front();
+      }
+    }
+  }
+
+
+  void expireResponseWaits(MLMicroSeconds aStartedBefore)
+  {
+    ResponseWaitMap::iterator pos = responseWaits.begin();
+    while (pos!=responseWaits.end()) {
+      if (pos->second.started<aStartedBefore) {
+        lost[pos->second.op]++;
+        if (throughputCount>0) throughputDone++;
+        responseWaits.erase(pos++);
+      }
+      else {
+        ++pos;
+      }
+    }
+  }
+
+
+  void pongReceived(const string &aDsUid)
+  {
+    // pongs arrive in order per device, make sure this one is not matched to a ping already given up
+    expirePongWaits(MainLoop::now()-PONG_TIMEOUT);
+    PongWaitMap::iterator pos = pongWaits.find(aDsUid);
+    if (pos!=pongWaits.end() && !pos->second.empty()) {
+      opDone(pos->second.front(), true);
+      pos->second.pop_front();
+    }
+  }
+
+
+  #pragma mark - report
+
+
+  static double percentile(vector<double> &aSorted, double aPercent)
+  {
+    if (aSorted.empty()) return 0;
+    size_t i = (size_t)(aPercent/100*(aSorted.size()-1)+0.5);
+    return aSorted[i];
+  }
+
+
+  void report()
+  {
+    double secs = (double)(MainLoop::now()-loadStarted)/Second;
+    long totalCompleted = 0;
+    if (throughputCount>0)
+      printf("\nvDC API throughput results (protobuf API, %zu devices, %d requests outstanding)\n\n", devices.size(), THROUGHPUT_WINDOW);
+    else
+      printf("\nvDC API load results (%s API, %zu devices, target %.1f ops/s)\n\n", useJson ? "JSON" : "protobuf", devices.size(), rate);
+    printf("%-12s %8s %8s %8s %8s %10s %10s %10s %10s\n", "operation", "sent", "done", "errors", "lost", "p50[mS]", "p90[mS]", "p99[mS]", "max[mS]");
+    for (int op=0; op<numOpTypes; op++) {
+      if (sent[op]==0) continue;
+      vector<double> &l = latencies[op];
+      std::sort(l.begin(), l.end());
+      totalCompleted += l.size();
+      printf(
+        "%-12s %8ld %8zu %8ld %8ld %10.2f %10.2f %10.2f %10.2f\n",
+        opNames[op], sent[op], l.size(), errors[op], lost[op],
+        percentile(l, 50), percentile(l, 90), percentile(l, 99), l.empty() ? 0 : l.back()
+      );
+    }
+    printf("\nthroughput: %.1f completed ops/s over %.1f seconds\n\n", secs>0 ? totalCompleted/secs : 0, secs);
+    if (!useJson) {
+      // each completed operation is one request and one response message
+      printf(
+        "protobuf (%s frames): %.1f msgs/s, %.2f MB/s (%llu bytes sent, %llu bytes received)\n\n",
+        extendedFrames ? "extended" : "normal",
+        secs>0 ? 2*totalCompleted/secs : 0,
+        secs>0 ? (bytesSent+bytesReceived)/secs/1e6 : 0,
+        (unsigned long long)bytesSent, (unsigned long long)bytesReceived
+      );
+    }
+  }
+
+
+  void finish()
+  {
+    // whatever is still waiting for a pong or response now is lost
+    expirePongWaits(Infinite);
+    expireResponseWaits(Infinite);
+    report();
+    exit(0);
+  }
+
+
+  #pragma mark - JSON API
+
+
+  void sendHello()
+  {
+    if (useJson) {
+      JsonObjectPtr params = JsonObject::newObj();
+      params->add("api_version", JsonObject::newInt32(VDC_API_VERSION));
+      params->add("dSUID", JsonObject::newString(LOADTOOL_VDSM_DSUID));
+      jsonRpcComm->sendRequest("hello", params, boost::bind(&VdsmLoadTool::jsonHelloResponse, this, _2));
+    }
+    else {
+      pbufSendHello();
+    }
+  }
+
+
+  void jsonHelloResponse(ErrorPtr &aError)
+  {
+    helloDone(aError);
+  }
+
+
+  void jsonRequestHandler(const char *aMethod, const char *aJsonRpcId, JsonObjectPtr aParams)
+  {
+    JsonObjectPtr o;
+    string dsuid;
+    if (aParams && aParams->get("dSUID", o)) dsuid = o->stringValue();
+    if (strcmp(aMethod, "announcedevice")==0 || strcmp(aMethod, "announcevdc")==0) {
+      announced(dsuid, strcmp(aMethod, "announcedevice")==0);
+      if (aJsonRpcId) jsonRpcComm->sendResult(aJsonRpcId, JsonObjectPtr());
+    }
+    else if (strcmp(aMethod, "pong")==0) {
+      pongReceived(dsuid);
+    }
+    else if (strcmp(aMethod, "vanish")==0) {
+      vanished(dsuid);
+    }
+    else if (aJsonRpcId) {
+      // unknown method call, must answer anyway
+      jsonRpcComm->sendError(aJsonRpcId, 405);
+    }
+  }
+
+
+  void jsonSendNotification(OpType aOp, const string &aDsUid)
+  {
+    JsonObjectPtr params = JsonObject::newObj();
+    params->add("dSUID", JsonObject::newString(aDsUid));
+    if (aOp==op_callScene) {
+      params->add("scene", JsonObject::newInt32(randomSceneNo()));
+      params->add("force", JsonObject::newBool(false));
+      jsonRpcComm->sendRequest("callScene", params);
+    }
+    else {
+      params->add("channel", JsonObject::newInt32(0)); // default channel
+      params->add("mode", JsonObject::newInt32(nextDimMode()));
+      jsonRpcComm->sendRequest("dimChannel", params);
+    }
+    params = JsonObject::newObj();
+    params->add("dSUID", JsonObject::newString(aDsUid));
+    jsonRpcComm->sendRequest("ping", params);
+  }
+
+
+  void jsonSendRequest(PendingOp &aPendingOp, const string &aDsUid)
+  {
+    JsonObjectPtr params = JsonObject::newObj();
+    params->add("dSUID", JsonObject::newString(aDsUid));
+    if (aPendingOp.op==op_getProperty) {
+      JsonObjectPtr query = JsonObject::newObj();
+      query->add("name", JsonObjectPtr());
+      query->add("primaryGroup", JsonObjectPtr());
+      query->add("zoneID", JsonObjectPtr());
+      params->add("query", query);
+      jsonRpcComm->sendRequest("getProperty", params, boost::bind(&VdsmLoadTool::jsonResponse, this, aPendingOp, _2));
+    }
+    else {
+      JsonObjectPtr props = JsonObject::newObj();
+      props->add("progMode", JsonObject::newBool(false)); // harmless, not persisted
+      params->add("properties", props);
+      jsonRpcComm->sendRequest("setProperty", params, boost::bind(&VdsmLoadTool::jsonResponse, this, aPendingOp, _2));
+    }
+  }
+
+
+  void jsonResponse(PendingOp aPendingOp, ErrorPtr &aError)
+  {
+    opDone(aPendingOp, Error::isOK(aError));
+  }
+
+
+  #pragma mark - protobuf API
+
+
+  void pbufSendMessage(Vdcapi__Message &aMsg)
+  {
+    size_t packedSize = vdcapi__message__get_packed_size(&aMsg);
+    if (packedSize>(extendedFrames ? MAX_PBUF_EXTENDED_DATA_SIZE : MAX_PBUF_DATA_SIZE)) {
+      LOG(LOG_ERR, "message too large: %zu bytes", packedSize);
+      return;
+    }
+    // append framed message to transmit buffer
+    size_t headerSize = extendedFrames ? 6 : 2;
+    size_t frameStart = transmitBuffer.size();
+    transmitBuffer.resize(frameStart+packedSize+headerSize);
+    uint8_t *frameP = (uint8_t *)&transmitBuffer[frameStart];
+    if (extendedFrames) {
+      frameP[0] = (EXTENDED_FRAME_MARKER>>8) & 0xFF;
+      frameP[1] = EXTENDED_FRAME_MARKER & 0xFF;
+      frameP[2] = (packedSize>>24) & 0xFF;
+      frameP[3] = (packedSize>>16) & 0xFF;
+      frameP[4] = (packedSize>>8) & 0xFF;
+      frameP[5] = packedSize & 0xFF;
+    }
+    else {
+      frameP[0] = (packedSize>>8) & 0xFF;
+      frameP[1] = packedSize & 0xFF;
+    }
+    vdcapi__message__pack(&aMsg, frameP+headerSize);
+    bytesSent += packedSize+headerSize;
+    if (frameStart==0) {
+      // was idle, start sending
+      pbufCanSendData(ErrorPtr());
+    }
+  }
+
+
+  void pbufCanSendData(ErrorPtr aError)
+  {
+    if (!Error::isOK(aError) || transmitBuffer.empty()) return;
+    size_t sentBytes = pbufComm->transmitBytes(transmitBuffer.size(), (const uint8_t *)transmitBuffer.data(), aError);
+    if (Error::isOK(aError)) {
+      transmitBuffer.erase(0, sentBytes);
+    }
+    if (transmitBuffer.empty()) {
+      pbufComm->setTransmitHandler(NULL);
+    }
+    else {
+      // rest will be sent when socket is ready again
+      pbufComm->setTransmitHandler(boost::bind(&VdsmLoadTool::pbufCanSendData, this, _1));
+    }
+  }
+
+
+  void pbufSendHello()
+  {
+    Vdcapi__Message msg = VDCAPI__MESSAGE__INIT;
+    Vdcapi__VdsmRequestHello hello = VDCAPI__VDSM__REQUEST_HELLO__INIT;
+    hello.dsuid = (char *)LOADTOOL_VDSM_DSUID;
+    hello.has_api_version = true;
+    hello.api_version = VDC_API_VERSION;
+    msg.type = VDCAPI__TYPE__VDSM_REQUEST_HELLO;
+    msg.has_message_id = true;
+    msg.message_id = ++messageIdCounter;
+    msg.vdsm_request_hello = &hello;
+    pbufSendMessage(msg);
+  }
+
+
+  void pbufSendResponse(uint32_t aMessageId)
+  {
+    Vdcapi__Message msg = VDCAPI__MESSAGE__INIT;
+    Vdcapi__GenericResponse resp = VDCAPI__GENERIC_RESPONSE__INIT;
+    resp.code = VDCAPI__RESULT_CODE__ERR_OK;
+    msg.type = VDCAPI__TYPE__GENERIC_RESPONSE;
+    msg.has_message_id = true;
+    msg.message_id = aMessageId;
+    msg.generic_response = &resp;
+    pbufSendMessage(msg);
+  }
+
+
+  void pbufSendNotification(OpType aOp, const string &aDsUid)
+  {
+    char *dsuids[1] = { (char *)aDsUid.c_str() };
+    Vdcapi__Message msg = VDCAPI__MESSAGE__INIT;
+    if (aOp==op_callScene) {
+      Vdcapi__VdsmNotificationCallScene cs = VDCAPI__VDSM__NOTIFICATION_CALL_SCENE__INIT;
+      cs.n_dsuid = 1;
+      cs.dsuid = dsuids;
+      cs.has_scene = true;
+      cs.scene = randomSceneNo();
+      cs.has_force = true;
+      cs.force = false;
+      msg.type = VDCAPI__TYPE__VDSM_NOTIFICATION_CALL_SCENE;
+      msg.vdsm_send_call_scene = &cs;
+      pbufSendMessage(msg);
+    }
+    else {
+      Vdcapi__VdsmNotificationDimChannel dc = VDCAPI__VDSM__NOTIFICATION_DIM_CHANNEL__INIT;
+      dc.n_dsuid = 1;
+      dc.dsuid = dsuids;
+      dc.has_channel = true;
+      dc.channel = 0; // default channel
+      dc.has_mode = true;
+      dc.mode = nextDimMode();
+      msg.type = VDCAPI__TYPE__VDSM_NOTIFICATION_DIM_CHANNEL;
+      msg.vdsm_send_dim_channel = &dc;
+      pbufSendMessage(msg);
+    }
+    Vdcapi__Message pingMsg = VDCAPI__MESSAGE__INIT;
+    Vdcapi__VdsmSendPing ping = VDCAPI__VDSM__SEND_PING__INIT;
+    ping.dsuid = dsuids[0];
+    pingMsg.type = VDCAPI__TYPE__VDSM_SEND_PING;
+    pingMsg.vdsm_send_ping = &ping;
+    pbufSendMessage(pingMsg);
+  }
+
+
+  void pbufSendRequest(PendingOp &aPendingOp, const string &aDsUid)
+  {
+    Vdcapi__Message msg = VDCAPI__MESSAGE__INIT;
+    msg.has_message_id = true;
+    msg.message_id = ++messageIdCounter;
+    if (aPendingOp.op==op_getProperty && throughputCount>0) {
+      // full (deep) read of the device, for large responses
+      Vdcapi__PropertyElement q = VDCAPI__PROPERTY_ELEMENT__INIT;
+      Vdcapi__PropertyElement *qP = &q;
+      q.name = (char *)"";
+      Vdcapi__VdsmRequestGetProperty gp = VDCAPI__VDSM__REQUEST_GET_PROPERTY__INIT;
+      gp.dsuid = (char *)aDsUid.c_str();
+      gp.n_query = 1;
+      gp.query = &qP;
+      msg.type = VDCAPI__TYPE__VDSM_REQUEST_GET_PROPERTY;
+      msg.vdsm_request_get_property = &gp;
+      pbufSendMessage(msg);
+    }
+    else if (aPendingOp.op==op_getProperty) {
+      Vdcapi__PropertyElement q[3] = { VDCAPI__PROPERTY_ELEMENT__INIT, VDCAPI__PROPERTY_ELEMENT__INIT, VDCAPI__PROPERTY_ELEMENT__INIT };
+      Vdcapi__PropertyElement *qP[3] = { &q[0], &q[1], &q[2] };
+      q[0].name = (char *)"name";
+      q[1].name = (char *)"primaryGroup";
+      q[2].name = (char *)"zoneID";
+      Vdcapi__VdsmRequestGetProperty gp = VDCAPI__VDSM__REQUEST_GET_PROPERTY__INIT;
+      gp.dsuid = (char *)aDsUid.c_str();
+      gp.n_query = 3;
+      gp.query = qP;
+      msg.type = VDCAPI__TYPE__VDSM_REQUEST_GET_PROPERTY;
+      msg.vdsm_request_get_property = &gp;
+      pbufSendMessage(msg);
+    }
+    else {
+      Vdcapi__PropertyValue v = VDCAPI__PROPERTY_VALUE__INIT;
+      v.has_v_bool = true;
+      v.v_bool = false;
+      Vdcapi__PropertyElement p = VDCAPI__PROPERTY_ELEMENT__INIT;
+      Vdcapi__PropertyElement *pP = &p;
+      p.name = (char *)"progMode"; // harmless, not persisted
+      p.value = &v;
+      Vdcapi__VdsmRequestSetProperty sp = VDCAPI__VDSM__REQUEST_SET_PROPERTY__INIT;
+      sp.dsuid = (char *)aDsUid.c_str();
+      sp.n_properties = 1;
+      sp.properties = &pP;
+      msg.type = VDCAPI__TYPE__VDSM_REQUEST_SET_PROPERTY;
+      msg.vdsm_request_set_property = &sp;
+      pbufSendMessage(msg);
+    }
+    responseWaits[msg.message_id] = aPendingOp;
+  }
+
+
+  void pbufGotData(ErrorPtr aError)
+  {
+    if (Error::isOK(aError)) {
+      size_t dataSz = pbufComm->numBytesReady();
+      if (dataSz>0) {
+        size_t oldSize = receiveBuffer.size();
+        receiveBuffer.resize(oldSize+dataSz);
+        size_t receivedBytes = pbufComm->receiveBytes(dataSz, (uint8_t *)&receiveBuffer[oldSize], aError);
+        receiveBuffer.resize(oldSize+(Error::isOK(aError) ? receivedBytes : 0));
+        bytesReceived += receiveBuffer.size()-oldSize;
+        // process all complete messages
+        size_t offset = 0;
+        while (receiveBuffer.size()-offset>=2) {
+          const uint8_t *p = (const uint8_t *)receiveBuffer.data()+offset;
+          size_t headerSize = 2;
+          size_t msgSize = (p[0]<<8) + p[1];
+          if (msgSize==EXTENDED_FRAME_MARKER) {
+            // extended frame, 4-byte length follows
+            if (receiveBuffer.size()-offset<6) break; // incomplete header
+            headerSize = 6;
+            msgSize = ((size_t)p[2]<<24) + (p[3]<<16) + (p[4]<<8) + p[5];
+            if (msgSize>MAX_PBUF_EXTENDED_DATA_SIZE) {
+              LOG(LOG_ERR, "Received frame size %zu exceeds maximum, cannot resync", msgSize);
+              exit(1);
+            }
+          }
+          if (receiveBuffer.size()-offset<msgSize+headerSize) break; // incomplete
+          pbufProcessMessage(p+headerSize, msgSize);
+          offset += msgSize+headerSize;
+        }
+        receiveBuffer.erase(0, offset);
+      }
+    }
+    if (!Error::isOK(aError)) {
+      LOG(LOG_ERR, "Error on protobuf connection: %s", aError->description().c_str());
+    }
+  }
+
+
+  void pbufProcessMessage(const uint8_t *aData, size_t aSize)
+  {
+    Vdcapi__Message *msg = vdcapi__message__unpack(NULL, aSize, aData);
+    if (!msg) {
+      LOG(LOG_ERR, "Cannot decode protobuf message of %zu bytes", aSize);
+      return;
+    }
+    switch (msg->type) {
+      case VDCAPI__TYPE__VDC_RESPONSE_HELLO:
+        helloDone(ErrorPtr());
+        break;
+      case VDCAPI__TYPE__VDC_SEND_ANNOUNCE_VDC:
+        if (msg->vdc_send_announce_vdc) announced(nonNullCStr(msg->vdc_send_announce_vdc->dsuid), false);
+        pbufSendResponse(msg->message_id);
+        break;
+      case VDCAPI__TYPE__VDC_SEND_ANNOUNCE_DEVICE:
+        if (msg->vdc_send_announce_device) announced(nonNullCStr(msg->vdc_send_announce_device->dsuid), true);
+        pbufSendResponse(msg->message_id);
+        break;
+      case VDCAPI__TYPE__VDC_SEND_VANISH:
+        if (msg->vdc_send_vanish) vanished(nonNullCStr(msg->vdc_send_vanish->dsuid));
+        break;
+      case VDCAPI__TYPE__VDC_SEND_PONG:
+        if (msg->vdc_send_pong) pongReceived(nonNullCStr(msg->vdc_send_pong->dsuid));
+        break;
+      case VDCAPI__TYPE__VDC_RESPONSE_GET_PROPERTY:
+      case VDCAPI__TYPE__GENERIC_RESPONSE: {
+        bool ok = msg->type!=VDCAPI__TYPE__GENERIC_RESPONSE || (msg->generic_response && msg->generic_response->code==VDCAPI__RESULT_CODE__ERR_OK);
+        ResponseWaitMap::iterator pos = responseWaits.find(msg->message_id);
+        if (pos!=responseWaits.end()) {
+          opDone(pos->second, ok);
+          responseWaits.erase(pos);
+          if (throughputCount>0) {
+            throughputDone++;
+            throughputNext();
+          }
+        }
+        else if (!ok && loadStarted==Never) {
+          // error before load started, must be hello
+          if (msg->generic_response)
+            helloDone(ErrorPtr(new Error(msg->generic_response->code, nonNullCStr(msg->generic_response->description))));
+          else
+            helloDone(ErrorPtr(new Error(VDCAPI__RESULT_CODE__ERR_MESSAGE_UNKNOWN, "generic response without result")));
+        }
+        break;
+      }
+      default:
+        // pushProperty, identify etc. are not relevant here
+        break;
+    }
+    vdcapi__message__free_unpacked(msg, NULL);
+  }
+
+
+  virtual void initialize()
+  {
+  }
+
+};
+
+
+int main(int argc, char **argv)
+{
+  // create the mainloop
+  MainLoop::currentMainLoop().setLoopCycleTime(MAINLOOP_CYCLE_TIME_uS);
+  // create app with current mainloop
+  static VdsmLoadTool application;
+  // pass control
+  return application.main(argc, argv);
+}
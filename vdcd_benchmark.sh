@@ -0,0 +1,142 @@
+#!/bin/bash
+
+#  vdcd_benchmark.sh
+#  vdcd
+#
+#  Copyright (c) 2016 plan44.ch. All rights reserved.
+
+# Run vdcd with a large set of synthetic devices (console dimmers added by the
+# static device container's "populate" benchmark) and measure it via the config API.
+# Usage: vdcd_benchmark.sh [-v vdcd] [-t vdsmloadtool] [-n devices] [-r repeat] [measurement...]
+# Measurements:
+#   scenes : property tree reads, scene objects created per read, resident memory
+#   delta  : check that an incremental (changedSince) read reports a saved scene
+#   flush  : persistence flush of 10 changed devices, via change journal vs. visiting all devices
+#   dump   : peak memory of vdcd while reading all properties of all devices, with and without streaming
+#   pbuf   : protobuf vDC API throughput over loopback (msgs/s, MB/s), with normal and extended frames
+
+VDCD=./vdcd
+LOADTOOL=./vdsmloadtool
+DEVICES=1000
+REPEAT=10
+CFGAPIPORT=18390 # avoid clashing with a vdcd running on the default ports
+VDSMPORT=18340
+
+while getopts "v:t:n:r:" opt; do
+  case $opt in
+    v) VDCD=$OPTARG ;;
+    t) LOADTOOL=$OPTARG ;;
+    n) DEVICES=$OPTARG ;;
+    r) REPEAT=$OPTARG ;;
+    *) echo "usage: $0 [-v vdcd] [-t vdsmloadtool] [-n devices] [-r repeat] [scenes|delta|flush|dump|pbuf...]"; exit 1 ;;
+  esac
+done
+shift $((OPTIND-1))
+MEASUREMENTS=${*:-scenes flush delta dump pbuf}
+
+WORKDIR=$(mktemp -d)
+VDCDLOG=$WORKDIR/vdcd.log
+
+cleanup()
+{
+  [ -n "$VDCDPID" ] && kill $VDCDPID 2>/dev/null
+  wait 2>/dev/null
+  rm -rf "$WORKDIR"
+}
+trap cleanup EXIT
+
+# send one request to the config API, print the response line
+# @param $1 API selector (vdc or p44)
+# @param $2 JSON request
+cfgapi()
+{
+  exec 3<>/dev/tcp/127.0.0.1/$CFGAPIPORT || return 1
+  echo "{\"method\":\"POST\",\"uri\":\"$1\",\"data\":$2}" >&3
+  read -r -t 600 RESPONSE <&3
+  exec 3<&-
+  echo "$RESPONSE"
+}
+
+# run vdcd with static devices only, on a fresh database
+$VDCD --staticdevices --sqlitedir "$WORKDIR" --vdsmport $VDSMPORT --cfgapiport $CFGAPIPORT -l 4 >"$VDCDLOG" 2>&1 &
+VDCDPID=$!
+for i in $(seq 100); do
+  cfgapi p44 '{"method":"logLevel"}' >/dev/null 2>&1 && break
+  if ! kill -0 $VDCDPID 2>/dev/null; then
+    echo "vdcd terminated:"
+    tail -20 "$VDCDLOG"
+    exit 1
+  fi
+  sleep 0.1
+done
+
+# find the static device container
+STATICVDC=$(cfgapi vdc '{"method":"getProperty","dSUID":"","query":{"x-p44-vdcs":{"*":{"x-p44-deviceClass":null}}}}' | \
+  grep -o '"[0-9A-F]*":{"x-p44-deviceClass":"Static_Device_Container"' | cut -d '"' -f 2)
+if [ -z "$STATICVDC" ]; then
+  echo "static device container not found"
+  exit 1
+fi
+
+echo "vdcd benchmark: $DEVICES synthetic devices"
+echo
+echo "Populate:"
+echo "  $(cfgapi p44 "{\"method\":\"vdcBenchmark\",\"dSUID\":\"$STATICVDC\",\"benchmark\":\"populate\",\"count\":$DEVICES}")"
+
+for m in $MEASUREMENTS; do
+  echo
+  case $m in
+    scenes)
+      # first read creates the per device default scene caches, second shows steady state
+      echo "Property tree reads (first, then repeated):"
+      echo "  $(cfgapi p44 '{"method":"propertyBenchmark","repeat":1}')"
+      echo "  $(cfgapi p44 "{\"method\":\"propertyBenchmark\",\"repeat\":$REPEAT}")"
+      ;;
+    flush)
+      echo "Persistence flush (10 changed devices):"
+      echo "  $(cfgapi p44 "{\"method\":\"flushBenchmark\",\"changed\":10,\"repeat\":$REPEAT}")"
+      ;;
+    delta)
+      # save scene 5 of one device with a new value, then read the scenes changed since before the save
+      DEV=$(cfgapi vdc "{\"method\":\"getProperty\",\"dSUID\":\"$STATICVDC\",\"query\":{\"x-p44-devices\":{\"*\":{\"name\":null}}}}" | \
+        grep -o '"x-p44-devices":{"[0-9A-F]*"' | cut -d '"' -f 4)
+      GEN=$(cfgapi vdc "{\"method\":\"getProperty\",\"dSUID\":\"$DEV\",\"query\":{\"scenes\":{\"5\":null}}}" | \
+        grep -o '"x-p44-changeGeneration":[0-9]*' | cut -d ':' -f 2)
+      cfgapi vdc "{\"notification\":\"setOutputChannelValue\",\"dSUID\":\"$DEV\",\"channel\":0,\"value\":42}" >/dev/null
+      cfgapi vdc "{\"notification\":\"saveScene\",\"dSUID\":\"$DEV\",\"scene\":5}" >/dev/null
+      sleep 1
+      DELTA=$(cfgapi vdc "{\"method\":\"getProperty\",\"dSUID\":\"$DEV\",\"query\":{\"scenes\":{\"5\":null}},\"changedSince\":$GEN}")
+      echo "Delta read after saveScene (device $DEV, changedSince $GEN):"
+      echo "  $DELTA"
+      if echo "$DELTA" | grep -q '"scenes":{"5":{.*"value":42'; then
+        echo "  OK: saved scene reported"
+      else
+        echo "  FAILED: saved scene not reported"
+        FAILED=1
+      fi
+      ;;
+    dump)
+      # read everything from all devices, once built as a whole and once streamed device by device,
+      # resetting the peak resident memory (VmHWM) before each read
+      echo "Full property read of all devices, peak memory:"
+      for STREAM in false true; do
+        echo 5 >/proc/$VDCDPID/clear_refs 2>/dev/null || echo "  (cannot reset peak memory, values include earlier peaks)"
+        BEFORE=$(grep VmRSS /proc/$VDCDPID/status | awk '{print $2}')
+        SIZE=$(cfgapi vdc "{\"method\":\"x-p44-getProperties\",\"dSUID\":\"\",\"devices\":\"*\",\"query\":{\"\":null},\"stream\":$STREAM}" | wc -c)
+        PEAK=$(grep VmHWM /proc/$VDCDPID/status | awk '{print $2}')
+        echo "  stream=$STREAM: response $SIZE bytes, resident before ${BEFORE}kB, peak ${PEAK}kB"
+      done
+      ;;
+    pbuf)
+      # vdsmloadtool connects as vdSM and pipelines full device property reads
+      echo "Protobuf API throughput ($((DEVICES*REPEAT)) full device reads):"
+      for FRAMES in "" "-x"; do
+        $LOADTOOL -C $VDSMPORT $FRAMES -t $((DEVICES*REPEAT)) -l 3 | grep "msgs/s" | sed 's/^/  /'
+      done
+      ;;
+    *)
+      echo "unknown measurement '$m'"
+      ;;
+  esac
+done
+exit ${FAILED:-0}